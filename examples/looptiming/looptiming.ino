@@ -0,0 +1,195 @@
+/*
+   looptiming.ino : Measures how fast Hackflight's main loop runs on the Ladybug Flight Controller
+
+   Runs Hackflight::update() on the real board with a stub receiver that sends a centered, throttle-down frame
+   at 50 Hz (so the vehicle never arms and the motors stay off), timing every pass with the Cortex-M DWT cycle
+   counter.  Every few seconds it prints the loop rate, percentiles, worst case and jitter of the pass time, then
+   the per-stage cycle statistics from Hackflight's profiler, over USB serial.  Use it to compare boards and
+   clock speeds by how much headroom the loop leaves.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <Arduino.h>
+
+#include "hackflight.hpp"
+
+#include "boards/real/ladybug.hpp"
+
+// Seconds between reports
+static const uint32_t REPORT_SECONDS = 5;
+
+// Pass times are histogrammed in quarter-microsecond bins; the last bin holds anything longer
+static const uint16_t BINS_PER_USEC = 4;
+static const uint16_t BINS          = 2048;
+
+// Receiver that never arms: centered sticks, throttle down, aux off, one frame every 20 msec
+class StubReceiver final : public hf::Receiver {
+
+    public:
+
+        StubReceiver(hf::Board * board) : _board(board) { }
+
+    protected:
+
+        void begin(void)
+        {
+            _nextFrameMicros = 0;
+        }
+
+        bool gotNewFrame(void)
+        {
+            uint32_t usec = _board->getMicroseconds();
+
+            if ((int32_t)(usec - _nextFrameMicros) < 0) {
+                return false;
+            }
+
+            _nextFrameMicros = usec + 20000;
+
+            return true;
+        }
+
+        void readRawvals(void)
+        {
+            rawvals[0] = -1;
+            rawvals[1] = 0;
+            rawvals[2] = 0;
+            rawvals[3] = 0;
+            rawvals[4] = -1;
+        }
+
+    private:
+
+        hf::Board * _board;
+        uint32_t    _nextFrameMicros;
+};
+
+static hf::HackflightT<hf::Ladybug, StubReceiver> h;
+
+static hf::Ladybug board;
+
+static StubReceiver rc = StubReceiver(&board);
+
+static hf::Stabilizer stabilizer = hf::Stabilizer(
+                0.20f,      // Level P
+                0.225f,     // Gyro cyclic P
+                0.001875f,  // Gyro cyclic I
+                0.375f,     // Gyro cyclic D
+                1.0625f,    // Gyro yaw P
+                0.005625f); // Gyro yaw I
+
+static uint32_t histogram[BINS];
+
+static uint32_t passes;
+static uint32_t worstCycles;
+static uint64_t sumCycles;
+static uint64_t sumSquaredCycles;
+static uint32_t reportStartMicros;
+
+static const char * STAGE_NAMES[hf::Profiler::STAGE_COUNT] = {
+    "gyro", "euler", "receiver", "accel", "baro", "serial", "blackbox"
+};
+
+static float cyclesToMicros(float cycles)
+{
+    return cycles / (float)board.getCyclesPerMicrosecond();
+}
+
+// Pass time in microseconds below which the given fraction of passes fell
+static float percentile(float fraction)
+{
+    uint32_t target = (uint32_t)(fraction * passes);
+    uint32_t count = 0;
+
+    for (uint16_t k=0; k<BINS; ++k) {
+        count += histogram[k];
+        if (count > target) {
+            return (k + 1) / (float)BINS_PER_USEC;
+        }
+    }
+
+    return BINS / (float)BINS_PER_USEC;
+}
+
+static void resetStatistics(void)
+{
+    memset(histogram, 0, sizeof(histogram));
+    passes = 0;
+    worstCycles = 0;
+    sumCycles = 0;
+    sumSquaredCycles = 0;
+    reportStartMicros = micros();
+}
+
+static void report(void)
+{
+    float seconds = (micros() - reportStartMicros) / 1.e6f;
+
+    float mean = sumCycles / (float)passes;
+    float variance = sumSquaredCycles / (float)passes - mean * mean;
+
+    hf::Debug::printf("\n%lu passes in %.1f sec: %.0f Hz at %lu MHz\n", (unsigned long)passes, seconds, passes / seconds,
+            (unsigned long)board.getCyclesPerMicrosecond());
+    hf::Debug::printf("pass usec:  mean %.2f  p50 %.2f  p90 %.2f  p99 %.2f  p99.9 %.2f  max %.2f\n",
+            cyclesToMicros(mean), percentile(.50f), percentile(.90f), percentile(.99f), percentile(.999f),
+            cyclesToMicros(worstCycles));
+    hf::Debug::printf("jitter usec: stddev %.2f  p99-p50 %.2f\n",
+            cyclesToMicros(variance > 0 ? sqrtf(variance) : 0), percentile(.99f) - percentile(.50f));
+
+    hf::Profiler & profiler = h.getProfiler();
+
+    hf::Debug::printf("%-10s %10s %10s %10s %10s\n", "stage", "runs", "min usec", "mean usec", "max usec");
+    for (uint8_t k=0; k<hf::Profiler::STAGE_COUNT; ++k) {
+        if (profiler.getCount(k)) {
+            hf::Debug::printf("%-10s %10lu %10.2f %10.2f %10.2f\n", STAGE_NAMES[k], (unsigned long)profiler.getCount(k),
+                    cyclesToMicros(profiler.getMin(k)), cyclesToMicros(profiler.getMean(k)),
+                    cyclesToMicros(profiler.getMax(k)));
+        }
+        profiler.reset(k);
+    }
+}
+
+void setup(void)
+{
+    h.init(&board, &rc, &stabilizer);
+
+    resetStatistics();
+}
+
+void loop(void)
+{
+    uint32_t start = board.getCycleCount();
+
+    h.update();
+
+    uint32_t cycles = board.getCycleCount() - start;
+
+    uint32_t bin = cycles * BINS_PER_USEC / board.getCyclesPerMicrosecond();
+    histogram[bin < BINS ? bin : BINS-1]++;
+
+    passes++;
+    sumCycles += cycles;
+    sumSquaredCycles += (uint64_t)cycles * cycles;
+    if (cycles > worstCycles) {
+        worstCycles = cycles;
+    }
+
+    // Printing happens outside the timed pass
+    if (micros() - reportStartMicros >= REPORT_SECONDS * 1000000) {
+        report();
+        resetStatistics();
+    }
+}
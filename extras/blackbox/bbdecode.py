@@ -0,0 +1,130 @@
+#!/usr/bin/env python3
+
+'''
+bbdecode.py Decodes a Hackflight blackbox log into CSV
+
+Usage: python3 bbdecode.py LOGFILE [CSVFILE]
+
+See src/blackbox.hpp for the stream format.
+
+This file is part of Hackflight.
+
+Hackflight is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Hackflight is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+'''
+
+from sys import argv, stdout, stderr, exit
+
+VERSION = 1
+
+GYRO_SCALE    = 1000.
+DEMANDS_SCALE = 10000.
+MOTOR_SCALE   = 1000.
+
+def varint(data, pos):
+
+    value = 0
+    shift = 0
+    while True:
+        b = data[pos]
+        pos += 1
+        value |= (b & 0x7F) << shift
+        shift += 7
+        if b < 0x80:
+            return value, pos
+
+def zigzag(data, pos):
+
+    value, pos = varint(data, pos)
+    return (value >> 1) ^ -(value & 1), pos
+
+def decode(data):
+
+    if len(data) < 6 or data[:4] != b'HFBB':
+        raise ValueError('not a Hackflight blackbox log')
+
+    if data[4] != VERSION:
+        raise ValueError('unsupported log version %d' % data[4])
+
+    nmotors = data[5]
+    nfields = 3 + 4 + 4 + nmotors
+
+    pos = 6
+    time = None
+    fields = None
+
+    while pos < len(data):
+
+        frametype = data[pos]
+        pos += 1
+
+        try:
+
+            if frametype == ord('I'):
+                time, pos = varint(data, pos)
+                fields = []
+                for _ in range(nfields):
+                    value, pos = zigzag(data, pos)
+                    fields.append(value)
+
+            elif frametype == ord('P') and fields is not None:
+                dt, pos = varint(data, pos)
+                time += dt
+                for k in range(nfields):
+                    delta, pos = zigzag(data, pos)
+                    fields[k] += delta
+
+            else:
+                # Lost sync: skip ahead to the next key frame
+                fields = None
+                continue
+
+        except IndexError:
+            # Log cut off mid-frame
+            break
+
+        yield nmotors, time, fields
+
+def main():
+
+    if len(argv) < 2:
+        print('Usage: python3 %s LOGFILE [CSVFILE]' % argv[0])
+        exit(1)
+
+    data = open(argv[1], 'rb').read()
+
+    out = open(argv[2], 'w') if len(argv) > 2 else stdout
+
+    header = False
+
+    try:
+
+        for nmotors, time, fields in decode(data):
+
+            if not header:
+                out.write('time,gyroRoll,gyroPitch,gyroYaw,' +
+                          'throttleIn,rollIn,pitchIn,yawIn,throttleOut,rollOut,pitchOut,yawOut,' +
+                          ','.join(['m%d' % (k+1) for k in range(nmotors)]) + '\n')
+                header = True
+
+            values = [time / 1.e6]
+            values += [f / GYRO_SCALE for f in fields[0:3]]
+            values += [f / DEMANDS_SCALE for f in fields[3:11]]
+            values += [f / MOTOR_SCALE for f in fields[11:]]
+
+            out.write(','.join(['%g' % v for v in values]) + '\n')
+
+    except ValueError as err:
+        stderr.write('%s: %s\n' % (argv[1], err))
+        exit(1)
+
+main()
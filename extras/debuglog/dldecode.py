@@ -0,0 +1,174 @@
+#!/usr/bin/env python3
+
+'''
+dldecode.py Formats a Hackflight binary debug log
+
+Usage: python3 dldecode.py LOGFILE [SOURCEDIR ...]
+
+Finds the format strings by scanning the C++ sources under each SOURCEDIR (by default, the src directory of this
+repository) for DebugLog::log() calls, so give it the sources the firmware was built from.  See src/debuglog.hpp
+for the stream format.
+
+This file is part of Hackflight.
+
+Hackflight is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Hackflight is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+'''
+
+from sys import argv, stdout, stderr, exit
+import os
+import re
+import struct
+
+VERSION = 1
+
+SOURCE_EXTENSIONS = ('.hpp', '.cpp', '.h', '.c', '.ino')
+
+# A call's format string: one or more adjacent literals after DebugLog::log(
+CALL = re.compile(r'DebugLog::log\s*\(\s*((?:"(?:[^"\\]|\\.)*"\s*)+)')
+LITERAL = re.compile(r'"((?:[^"\\]|\\.)*)"')
+
+# A conversion, as the board reads it: flags, width, and precision; length modifiers, which it ignores; type
+CONVERSION = re.compile(r'%([-+ #0-9.]*)[hlLqjzt]*([a-zA-Z%])')
+
+def fnv1a(text):
+
+    h = 2166136261
+    for b in text.encode('latin-1'):
+        h = ((h ^ b) * 16777619) & 0xFFFFFFFF
+    return h
+
+def unescape(literal):
+
+    return literal.encode('latin-1').decode('unicode_escape')
+
+def formats(sourcedirs):
+
+    table = {}
+
+    for sourcedir in sourcedirs:
+        for root, _, files in os.walk(sourcedir):
+            for name in files:
+                if not name.endswith(SOURCE_EXTENSIONS):
+                    continue
+                path = os.path.join(root, name)
+                text = open(path, encoding='latin-1').read()
+                for call in CALL.finditer(text):
+                    fmt = ''.join(unescape(s) for s in LITERAL.findall(call.group(1)))
+                    ident = fnv1a(fmt)
+                    if ident in table and table[ident] != fmt:
+                        stderr.write('Warning: %r and %r have the same ID\n' % (table[ident], fmt))
+                    table[ident] = fmt
+
+    return table
+
+def format(fmt, words):
+
+    out = ''
+    pos = 0
+    k = 0
+
+    for m in CONVERSION.finditer(fmt):
+
+        out += fmt[pos:m.start()]
+        pos = m.end()
+
+        flags, conversion = m.group(1), m.group(2)
+
+        if conversion == '%':
+            out += '%'
+            continue
+
+        # A conversion without an argument prints nothing, as on the board
+        if k >= len(words):
+            continue
+
+        word = words[k]
+        k += 1
+
+        if conversion in 'fFeEgGaA':
+            value = struct.unpack('<f', struct.pack('<I', word))[0]
+            out += ('%' + flags + (conversion if conversion not in 'aA' else 'e')) % value
+        elif conversion in 'di':
+            out += ('%' + flags + 'd') % struct.unpack('<i', struct.pack('<I', word))[0]
+        elif conversion in 'ouxX':
+            out += ('%' + flags + (conversion if conversion != 'u' else 'd')) % word
+        elif conversion == 'c':
+            out += ('%' + flags + 'c') % (word & 0xFF)
+        else:
+            out += '?'
+
+    return out + fmt[pos:]
+
+def decode(data, table):
+
+    if len(data) < 5 or data[:4] != b'HFDL':
+        raise ValueError('not a Hackflight debug log')
+
+    if data[4] != VERSION:
+        raise ValueError('unsupported log version %d' % data[4])
+
+    pos = 5
+    dropped = 0
+
+    while pos < len(data):
+
+        frametype = data[pos]
+        pos += 1
+
+        if frametype == ord('L'):
+            if pos + 5 > len(data):
+                break
+            ident, nargs = struct.unpack('<IB', data[pos:pos+5])
+            pos += 5
+            if pos + 4*nargs > len(data):
+                break
+            words = struct.unpack('<%dI' % nargs, data[pos:pos+4*nargs])
+            pos += 4*nargs
+            if ident in table:
+                yield format(table[ident], words)
+            else:
+                yield '(unknown message %08X: %s)\n' % (ident, ' '.join('%08X' % w for w in words))
+
+        elif frametype == ord('D'):
+            if pos + 4 > len(data):
+                break
+            count = struct.unpack('<I', data[pos:pos+4])[0]
+            pos += 4
+            yield '(%d debug messages dropped)\n' % (count - dropped)
+            dropped = count
+
+        else:
+            raise ValueError('bad frame type 0x%02X at byte %d' % (frametype, pos-1))
+
+def main():
+
+    if len(argv) < 2:
+        print('Usage: python3 %s LOGFILE [SOURCEDIR ...]' % argv[0])
+        exit(1)
+
+    here = os.path.dirname(os.path.abspath(__file__))
+    sourcedirs = argv[2:] if len(argv) > 2 else [os.path.join(here, '..', '..', 'src')]
+
+    table = formats(sourcedirs)
+
+    data = open(argv[1], 'rb').read()
+
+    try:
+        for message in decode(data, table):
+            stdout.write(message)
+    except ValueError as err:
+        stderr.write('%s\n' % err)
+        exit(1)
+
+if __name__ == '__main__':
+    main()
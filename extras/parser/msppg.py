@@ -21,7 +21,7 @@ You should have received a copy of the GNU Lesser General Public License
 along with this code.  If not, see <http:#www.gnu.org/licenses/>.
 '''
 
-PYTHON_EXAMPLES = ['getimu', 'getrc', 'imudisplay', 'blueimudisplay', 'setrc']
+PYTHON_EXAMPLES = ['getimu', 'streamimu', 'getrc', 'imudisplay', 'blueimudisplay', 'setrc', 'tune']
 
 from sys import exit, argv
 import os
@@ -122,6 +122,9 @@ class Python_Emitter(CodeEmitter):
 
         mkdir_if_missing('output/python/msppg')
 
+        self._copyfile('mspv2.py', 'python/msppg/mspv2.py')
+        self._copyfile('attitude.py', 'python/msppg/attitude.py')
+
         self._copyfile('setup.py', 'python/setup.py')
 
         self.output = _openw('output/python/msppg/__init__.py')
@@ -216,6 +219,10 @@ class CPP_Emitter(CodeEmitter):
         # Create C++ example
         self._copyfile('example.cpp', 'cpp/example.cpp')
 
+        # Create asynchronous multi-link client and its example
+        self._copyfile('MSPClient.h', 'cpp/msppg/MSPClient.h')
+        self._copyfile('clientexample.cpp', 'cpp/clientexample.cpp')
+
         # Create Arduino stuff
         mkdir_if_missing('output/arduino')
         mkdir_if_missing('output/arduino/MSPPG')
@@ -253,25 +260,25 @@ class CPP_Emitter(CodeEmitter):
             # Write handler code for incoming messages
             if msgid < 200:
 
-                self._cwrite(5*self.indent + ('case %s: {\n\n' % msgdict[msgtype][0]))
+                self._cwrite(2*self.indent + ('case %s: if (this->handlerFor%s) {\n\n' % (msgdict[msgtype][0], msgtype)))
                 nargs = len(argnames)
                 offset = 0
                 for k in range(nargs):
                     argname = argnames[k]
                     argtype = argtypes[k]
                     decl = self.type2decl[argtype]
-                    self._cwrite(6*self.indent + decl  + ' ' + argname + ';\n')
-                    self._cwrite(6*self.indent + 
-                            'memcpy(&%s,  &this->message_buffer[%d], sizeof(%s));\n\n' % 
+                    self._cwrite(3*self.indent + decl  + ' ' + argname + ';\n')
+                    self._cwrite(3*self.indent + 
+                            'memcpy(&%s,  &payload[%d], sizeof(%s));\n\n' % 
                             (argname, offset, decl))
                     offset += self.type2size[argtype]
-                self._cwrite(6*self.indent + 'this->handlerFor%s->handle_%s(' % (msgtype, msgtype))
+                self._cwrite(3*self.indent + 'this->handlerFor%s->handle_%s(' % (msgtype, msgtype))
                 for k in range(nargs):
                     self._cwrite(argnames[k])
                     if k < nargs-1:
                         self._cwrite(', ')
                 self._cwrite(');\n')
-                self._cwrite(6*self.indent + '} break;\n\n')
+                self._cwrite(2*self.indent + '} break;\n\n')
                 
                 self._hwrite(self.indent*2 + 'static MSP_Message serialize_%s_Request();\n\n' % msgtype)
                 self._hwrite(self.indent*2 + 
@@ -291,6 +298,14 @@ class CPP_Emitter(CodeEmitter):
         self._hwrite('};\n');
 
         self._cwrite(self._getsrc('bottom-cpp'))
+
+        # Constructor starts with no handlers set
+        self._cwrite('MSP_Parser::MSP_Parser() {\n\n')
+        self._cwrite(self.indent + 'this->state = 0;\n')
+        for msgtype in msgdict.keys():
+            if msgdict[msgtype][0] < 200:
+                self._cwrite(self.indent + 'this->handlerFor%s = NULL;\n' % msgtype)
+        self._cwrite('}\n\n')
  
         for msgtype in msgdict.keys():
 
@@ -448,7 +463,7 @@ class C_Emitter(CodeEmitter):
                 self._write_params(self.houtput, argtypes, argnames)
                 self._hwrite(');\n\n')
 
-        self._cwrite(self._getsrc('bottom-cpp'))
+        self._cwrite(self._getsrc('bottom-c'))
  
         for msgtype in msgdict.keys():
 
@@ -656,6 +671,89 @@ class Java_Emitter(CodeEmitter):
 
         self.output.write(s)
 
+# Firmware emitter ===================================================================================
+
+class Firmware_Emitter(CodeEmitter):
+
+    def __init__(self, msgdict):
+
+        CodeEmitter.__init__(self, 'firmware', 'hpp')
+
+        self.type2decl = {'byte': 'uint8_t', 'short' : 'int16_t', 'float' : 'float', 'int' : 'int32_t'}
+
+        self.type2field = {'byte': 'FIELD_BYTE', 'short' : 'FIELD_SHORT', 'float' : 'FIELD_FLOAT', 'int' : 'FIELD_INT'}
+
+        self.output = _openw('output/firmware/mspmessages.hpp')
+
+        self._write(self.warning('//'))
+
+        self._write(self._getsrc('top-firmware'))
+
+        ind2 = 2*self.indent
+        ind3 = 3*self.indent
+        ind4 = 4*self.indent
+
+        for msgtype in msgdict.keys():
+
+            msgstuff = msgdict[msgtype]
+            msgid = msgstuff[0]
+
+            argnames = self._getargnames(msgstuff)
+            argtypes = self._getargtypes(msgstuff)
+
+            offsets = []
+            offset = 0
+            for argtype in argtypes:
+                offsets.append(offset)
+                offset += self.type2size[argtype]
+
+            # Templated, with a typedef for the message's name (see top-firmware)
+            self._write('\n' + ind2 + 'template <typename T=void>\n')
+            self._write(ind2 + 'struct %s_T {\n\n' % msgtype)
+            self._write(ind3 + 'static const uint8_t ID = %d;\n' % msgid)
+            self._write(ind3 + 'static const uint8_t SIZE = %d;\n' % self._paysize(argtypes))
+            self._write(ind3 + 'static const uint8_t FIELD_COUNT = %d;\n\n' % len(argnames))
+            self._write(ind3 + 'static constexpr field_t FIELDS[FIELD_COUNT] = {\n')
+            self._write(',\n'.join([ind4 + '{%2d, %s}' % (o, self.type2field[t]) for o,t in zip(offsets, argtypes)]))
+            self._write('\n' + ind3 + '};\n\n')
+
+            for argtype,argname in zip(argtypes, argnames):
+                self._write(ind3 + '%s %s;\n' % (self.type2decl[argtype], argname))
+
+            self._write('\n' + ind3 + 'void encode(uint8_t * payload) const\n')
+            self._write(ind3 + '{\n')
+            for o,argname in zip(offsets, argnames):
+                self._write(ind4 + 'put(payload + %d, %s);\n' % (o, argname))
+            self._write(ind3 + '}\n\n')
+
+            self._write(ind3 + 'void decode(const uint8_t * payload)\n')
+            self._write(ind3 + '{\n')
+            for o,argname in zip(offsets, argnames):
+                self._write(ind4 + 'get(payload + %d, %s);\n' % (o, argname))
+            self._write(ind3 + '}\n\n')
+
+            self._write(ind2 + '}; // struct %s_T\n\n' % msgtype)
+
+            self._write(ind2 + 'template <typename T> constexpr field_t %s_T<T>::FIELDS[];\n\n' % msgtype)
+
+            self._write(ind2 + 'typedef %s_T<> %s;\n' % (msgtype, msgtype))
+
+        # Table of all messages, for lookup by ID
+        self._write('\n' + ind2 + 'constexpr descriptor_t DESCRIPTORS[] = {\n')
+        self._write(',\n'.join([ind3 + '{%s::ID, %s::SIZE, %s::FIELD_COUNT, %s::FIELDS}' % (m, m, m, m) 
+            for m in msgdict.keys()]))
+        self._write('\n' + ind2 + '};\n\n')
+
+        self._write(ind2 + 'static const uint8_t MESSAGE_COUNT = sizeof(DESCRIPTORS) / sizeof(descriptor_t);\n\n')
+
+        self._write(self._getsrc('bottom-firmware'))
+
+        self.output.close()
+
+    def _write(self, s):
+
+        self.output.write(s)
+
 # main ===============================================================================================
 
 if __name__ == '__main__':
@@ -709,3 +807,6 @@ if __name__ == '__main__':
 
     # Emite Java
     Java_Emitter(msgdict)
+
+    # Emit firmware message header
+    Firmware_Emitter(msgdict)
@@ -0,0 +1,552 @@
+// MSPClient.h : Asynchronous MSP client for talking to many vehicles from one thread
+//
+// Each MSP_Link is one vehicle, over a serial port or UDP, with its own MSP_Parser whose handlers fire as
+// replies arrive.  An MSP_Client polls any number of links with epoll (Linux) or poll() (other POSIX systems):
+// every readable link is drained in one read() per wakeup and the whole buffer is framed at once, and requests
+// are queued and written as fast as the link accepts them, without waiting for replies (pipelining).
+//
+// Handlers run on the thread calling MSP_Client::poll().  To hand messages to another thread instead, give the
+// link an MSP_Queue for the message ID; frames for that ID are pushed there, lock-free, instead of (or as well as)
+// going to the handler.
+//
+// Copyright (C) Simon D. Levy 2015
+//
+// This code is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This code is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this code.  If not, see <http:#www.gnu.org/licenses/>.
+
+#pragma once
+
+#if defined(_WIN32)
+#error "MSPClient.h needs POSIX I/O; there is no IOCP transport yet"
+#endif
+
+#include <atomic>
+#include <vector>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#else
+#include <poll.h>
+#endif
+
+#include "MSPPG.h"
+
+// Single-producer, single-consumer queue of raw message payloads for one message ID -----------------------------
+
+class MSP_Queue {
+
+    public:
+
+        static const int CAPACITY = 64;  // power of two
+
+        typedef struct {
+            byte id;
+            byte len;
+            byte payload[MAXBUF];
+        } entry_t;
+
+        MSP_Queue() : _head(0), _tail(0) { }
+
+        // Called by the client thread; drops the message if the consumer has fallen a whole queue behind
+        bool push(byte id, const byte * payload, byte len) {
+
+            unsigned head = _head.load(std::memory_order_relaxed);
+            if (head - _tail.load(std::memory_order_acquire) == CAPACITY) {
+                return false;
+            }
+
+            entry_t & e = _entries[head & (CAPACITY-1)];
+            e.id = id;
+            e.len = len;
+            memcpy(e.payload, payload, len);
+
+            _head.store(head + 1, std::memory_order_release);
+            return true;
+        }
+
+        // Called by the consumer thread
+        bool pop(entry_t & e) {
+
+            unsigned tail = _tail.load(std::memory_order_relaxed);
+            if (tail == _head.load(std::memory_order_acquire)) {
+                return false;
+            }
+
+            e = _entries[tail & (CAPACITY-1)];
+
+            _tail.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+    private:
+
+        entry_t _entries[CAPACITY];
+
+        std::atomic<unsigned> _head;
+        std::atomic<unsigned> _tail;
+};
+
+// One vehicle --------------------------------------------------------------------------------------------------
+
+class MSP_Link {
+
+    friend class MSP_Client;
+
+    public:
+
+        // Set handlers on this parser to receive replies
+        MSP_Parser parser;
+
+        // Opens a serial port in raw, non-blocking mode; returns NULL on failure
+        static MSP_Link * openSerial(const char * device, int baud) {
+
+            int fd = open(device, O_RDWR | O_NOCTTY | O_NONBLOCK);
+            if (fd < 0) {
+                return NULL;
+            }
+
+            struct termios tio;
+            if (tcgetattr(fd, &tio) < 0) {
+                close(fd);
+                return NULL;
+            }
+            cfmakeraw(&tio);
+            tio.c_cflag |= CLOCAL | CREAD;
+            speed_t speed = baudToSpeed(baud);
+            cfsetispeed(&tio, speed);
+            cfsetospeed(&tio, speed);
+            if (tcsetattr(fd, TCSANOW, &tio) < 0) {
+                close(fd);
+                return NULL;
+            }
+
+            return new MSP_Link(fd);
+        }
+
+        // Opens a UDP socket connected to host:port; returns NULL on failure
+        static MSP_Link * openUdp(const char * host, const char * port) {
+
+            struct addrinfo hints, * res;
+            memset(&hints, 0, sizeof(hints));
+            hints.ai_family = AF_UNSPEC;
+            hints.ai_socktype = SOCK_DGRAM;
+            if (getaddrinfo(host, port, &hints, &res) != 0) {
+                return NULL;
+            }
+
+            int fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+            if (fd >= 0 && connect(fd, res->ai_addr, res->ai_addrlen) < 0) {
+                close(fd);
+                fd = -1;
+            }
+            freeaddrinfo(res);
+
+            if (fd < 0) {
+                return NULL;
+            }
+
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+            return new MSP_Link(fd);
+        }
+
+        // Wraps an already-open non-blocking descriptor (e.g. one end of a socketpair)
+        explicit MSP_Link(int fd) : _fd(fd), _txHead(0), _outstanding(0), _client(NULL), _received(0), _errors(0) {
+
+            memset(_queues, 0, sizeof(_queues));
+            memset(_alsoHandle, 0, sizeof(_alsoHandle));
+        }
+
+        ~MSP_Link() {
+
+            close(_fd);
+        }
+
+        // Queues a request; it goes out as soon as the link can take it, behind any already queued
+        void send(const MSP_Message & msg) {
+
+            size_t start = _tx.size();
+
+            MSP_Message m = msg;
+            for (byte b=m.start(); m.hasNext(); b=m.getNext()) {
+                _tx.push_back(b);
+            }
+
+            // Requests ($M<) are answered; count them so callers can limit how many are in flight
+            if (_tx.size() - start > 2 && _tx[start+2] == '<') {
+                _outstanding++;
+            }
+
+            flush();
+        }
+
+        // Sends frames for a message ID to a queue rather than to the parser's handler
+        void setQueue(byte id, MSP_Queue * queue, bool alsoHandle=false) {
+
+            _queues[id] = queue;
+            _alsoHandle[id] = alsoHandle;
+        }
+
+        // Requests sent but not yet answered
+        int outstanding() const {
+            return _outstanding;
+        }
+
+        // Bytes queued but not yet written
+        size_t pending() const {
+            return _tx.size() - _txHead;
+        }
+
+        unsigned long received() const {
+            return _received;
+        }
+
+        unsigned long errors() const {
+            return _errors;
+        }
+
+        int fd() const {
+            return _fd;
+        }
+
+    private:
+
+        static const int READ_SIZE = 4096;
+
+        int _fd;
+
+        std::vector<byte> _rx;   // received bytes not yet framed
+        std::vector<byte> _tx;   // queued output
+        size_t            _txHead;
+
+        int _outstanding;
+
+        MSP_Queue * _queues[256];
+        bool        _alsoHandle[256];
+
+        class MSP_Client * _client;
+
+        unsigned long _received;
+        unsigned long _errors;
+
+        static speed_t baudToSpeed(int baud) {
+
+            switch (baud) {
+                case 9600:   return B9600;
+                case 19200:  return B19200;
+                case 38400:  return B38400;
+                case 57600:  return B57600;
+                case 230400: return B230400;
+#ifdef B460800
+                case 460800: return B460800;
+#endif
+#ifdef B921600
+                case 921600: return B921600;
+#endif
+            }
+            return B115200;
+        }
+
+        inline void flush();
+
+        // Reads everything available and frames it; returns false if the link has closed
+        bool onReadable() {
+
+            while (true) {
+
+                byte buf[READ_SIZE];
+                ssize_t n = read(_fd, buf, sizeof(buf));
+
+                if (n > 0) {
+                    _rx.insert(_rx.end(), buf, buf + n);
+                    continue;
+                }
+
+                if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                    break;
+                }
+
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+
+                return false;
+            }
+
+            frame();
+
+            return true;
+        }
+
+        // Pulls every complete $M frame out of the receive buffer in one pass
+        void frame() {
+
+            size_t k = 0, size = _rx.size();
+
+            while (k < size) {
+
+                // Find the next frame start
+                if (_rx[k] != '$') {
+                    k++;
+                    continue;
+                }
+
+                // Wait for the header
+                if (size - k < 5) {
+                    break;
+                }
+
+                if (_rx[k+1] != 'M' || (_rx[k+2] != '>' && _rx[k+2] != '!' && _rx[k+2] != '<')) {
+                    k++;
+                    continue;
+                }
+
+                byte len = _rx[k+3];
+                byte id  = _rx[k+4];
+
+                // Wait for the rest of the frame
+                if (size - k < (size_t)len + 6) {
+                    break;
+                }
+
+                const byte * payload = &_rx[k+5];
+
+                byte checksum = len ^ id;
+                for (int j=0; j<len; ++j) {
+                    checksum ^= payload[j];
+                }
+
+                if (checksum != _rx[k+5+len]) {
+                    _errors++;
+                    k++;
+                    continue;
+                }
+
+                if (_rx[k+2] != '<' && _outstanding > 0) {
+                    _outstanding--;
+                }
+
+                if (_rx[k+2] == '>') {
+
+                    _received++;
+
+                    MSP_Queue * queue = _queues[id];
+                    if (queue) {
+                        queue->push(id, payload, len);
+                    }
+                    if (!queue || _alsoHandle[id]) {
+                        parser.dispatch(id, payload);
+                    }
+                }
+
+                k += len + 6;
+            }
+
+            _rx.erase(_rx.begin(), _rx.begin() + k);
+        }
+
+        // Writes as much queued output as the link accepts; returns false on error
+        bool onWritable() {
+
+            while (_txHead < _tx.size()) {
+
+                ssize_t n = write(_fd, &_tx[_txHead], _tx.size() - _txHead);
+
+                if (n > 0) {
+                    _txHead += n;
+                    continue;
+                }
+
+                if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                    return true;
+                }
+
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+
+                return false;
+            }
+
+            _tx.clear();
+            _txHead = 0;
+
+            return true;
+        }
+};
+
+// Event loop over many links -----------------------------------------------------------------------------------
+
+class MSP_Client {
+
+    friend class MSP_Link;
+
+    public:
+
+        static const int MAX_EVENTS = 64;
+
+        MSP_Client() {
+#if defined(__linux__)
+            _epfd = epoll_create1(0);
+#endif
+        }
+
+        ~MSP_Client() {
+#if defined(__linux__)
+            close(_epfd);
+#endif
+        }
+
+        // Adds a link; the client doesn't take ownership
+        bool add(MSP_Link * link) {
+
+            link->_client = this;
+            _links.push_back(link);
+
+#if defined(__linux__)
+            struct epoll_event ev;
+            memset(&ev, 0, sizeof(ev));
+            ev.events = EPOLLIN;
+            ev.data.ptr = link;
+            return epoll_ctl(_epfd, EPOLL_CTL_ADD, link->_fd, &ev) == 0;
+#else
+            return true;
+#endif
+        }
+
+        void remove(MSP_Link * link) {
+
+#if defined(__linux__)
+            epoll_ctl(_epfd, EPOLL_CTL_DEL, link->_fd, NULL);
+#endif
+            for (size_t k=0; k<_links.size(); ++k) {
+                if (_links[k] == link) {
+                    _links.erase(_links.begin() + k);
+                    break;
+                }
+            }
+            link->_client = NULL;
+        }
+
+        // Waits up to timeoutMsec for activity and services every link that has any.  Links that close or fail
+        // are removed.  Returns the number of links serviced, or -1 on error.
+        int poll(int timeoutMsec) {
+
+#if defined(__linux__)
+            struct epoll_event events[MAX_EVENTS];
+
+            int n = epoll_wait(_epfd, events, MAX_EVENTS, timeoutMsec);
+
+            if (n < 0) {
+                return errno == EINTR ? 0 : -1;
+            }
+
+            for (int k=0; k<n; ++k) {
+                service((MSP_Link *)events[k].data.ptr,
+                        events[k].events & (EPOLLIN | EPOLLHUP | EPOLLERR), events[k].events & EPOLLOUT);
+            }
+
+            return n;
+#else
+            std::vector<struct pollfd> fds(_links.size());
+            for (size_t k=0; k<_links.size(); ++k) {
+                fds[k].fd = _links[k]->_fd;
+                fds[k].events = POLLIN | (_links[k]->pending() ? POLLOUT : 0);
+                fds[k].revents = 0;
+            }
+
+            int n = ::poll(fds.data(), fds.size(), timeoutMsec);
+
+            if (n < 0) {
+                return errno == EINTR ? 0 : -1;
+            }
+
+            // Links may be removed while servicing, so work from a copy
+            std::vector<MSP_Link *> links = _links;
+            for (size_t k=0; k<fds.size(); ++k) {
+                if (fds[k].revents) {
+                    service(links[k], fds[k].revents & (POLLIN | POLLHUP | POLLERR), fds[k].revents & POLLOUT);
+                }
+            }
+
+            return n;
+#endif
+        }
+
+        size_t linkCount() const {
+            return _links.size();
+        }
+
+    private:
+
+        std::vector<MSP_Link *> _links;
+
+#if defined(__linux__)
+        int _epfd;
+#endif
+
+        void service(MSP_Link * link, bool readable, bool writable) {
+
+            bool ok = true;
+
+            if (readable) {
+                ok = link->onReadable();
+            }
+
+            if (ok && writable) {
+                ok = link->onWritable();
+                if (ok) {
+                    watchOutput(link);
+                }
+            }
+
+            if (!ok) {
+                remove(link);
+            }
+        }
+
+        // Asks for writability only while a link has output waiting
+        void watchOutput(MSP_Link * link) {
+
+#if defined(__linux__)
+            struct epoll_event ev;
+            memset(&ev, 0, sizeof(ev));
+            ev.events = EPOLLIN | (link->pending() ? EPOLLOUT : 0);
+            ev.data.ptr = link;
+            epoll_ctl(_epfd, EPOLL_CTL_MOD, link->_fd, &ev);
+#else
+            (void)link;
+#endif
+        }
+};
+
+// Writes what it can right away, leaving the rest for the client to finish when the link is writable
+void MSP_Link::flush() {
+
+    if (!onWritable()) {
+        _errors++;
+        return;
+    }
+
+    if (_client) {
+        _client->watchOutput(this);
+    }
+}
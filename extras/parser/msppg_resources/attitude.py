@@ -0,0 +1,55 @@
+'''
+attitude.py Decoders for the compact Hackflight attitude messages, ATTITUDE_COMPACT and ATTITUDE_DELTA
+
+Copyright (C) Rob Jones, Alec Singer, Chris Lavin, Blake Liebling, Simon D. Levy 2015
+
+This code is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+This code is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this code.  If not, see <http:#www.gnu.org/licenses/>.
+'''
+
+from math import pi
+
+# Angles go over the link as signed binary angles, 65536 to the turn, so they wrap like 16-bit integers
+UNITS_PER_RADIAN = 32768 / pi
+
+# Samples in an ATTITUDE_DELTA message
+DELTA_SAMPLES = 8
+
+def _wrap(units):
+
+    return (units + 32768) % 65536 - 32768
+
+def _signed(byte):
+
+    return byte - 256 if byte > 127 else byte
+
+def decode_compact(roll, pitch, yaw):
+    '''
+    Converts the fields of an ATTITUDE_COMPACT message to (roll, pitch, yaw) in radians.
+    '''
+    return roll / UNITS_PER_RADIAN, pitch / UNITS_PER_RADIAN, yaw / UNITS_PER_RADIAN
+
+def decode_delta(shift, roll, pitch, yaw, *deltas):
+    '''
+    Converts the fields of an ATTITUDE_DELTA message, in the order the handler receives them, to a list of its
+    (roll, pitch, yaw) samples in radians, oldest first.  Each message starts from an absolute sample, so it
+    decodes on its own.
+    '''
+    angles = [roll, pitch, yaw]
+    samples = [decode_compact(*angles)]
+
+    for k in range(DELTA_SAMPLES-1):
+        for j in range(3):
+            angles[j] = _wrap(angles[j] + (_signed(deltas[3*k+j]) << shift))
+        samples.append(decode_compact(*angles))
+
+    return samples
@@ -0,0 +1,123 @@
+// clientexample.cpp : Polls ATTITUDE_RADIANS from one or more vehicles at once with MSPClient
+//
+// Usage: clientexample DEVICE|udp:HOST:PORT ...
+//
+// Copyright (C) Simon D. Levy 2015
+//
+// This code is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as
+// published by the Free Software Foundation, either version 3 of the
+// License, or (at your option) any later version.
+//
+// This code is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this code.  If not, see <http:#www.gnu.org/licenses/>.
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "msppg/MSPClient.h"
+
+static const int BAUD = 115200;
+
+// Requests kept in flight per link
+static const int PIPELINE_DEPTH = 4;
+
+class Attitude_Handler : public ATTITUDE_RADIANS_Handler {
+
+    public:
+
+        float roll, pitch, yaw;
+
+        Attitude_Handler() : roll(0), pitch(0), yaw(0) { }
+
+        void handle_ATTITUDE_RADIANS(float r, float p, float y) {
+
+            roll = r;
+            pitch = p;
+            yaw = y;
+        }
+};
+
+static double now(void) {
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char ** argv) {
+
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s DEVICE|udp:HOST:PORT ...\n", argv[0]);
+        return 1;
+    }
+
+    MSP_Client client;
+
+    vector<MSP_Link *> links;
+    vector<Attitude_Handler *> handlers;
+
+    for (int k=1; k<argc; ++k) {
+
+        MSP_Link * link = NULL;
+
+        if (strncmp(argv[k], "udp:", 4) == 0) {
+            string spec(argv[k] + 4);
+            size_t colon = spec.rfind(':');
+            if (colon != string::npos) {
+                link = MSP_Link::openUdp(spec.substr(0, colon).c_str(), spec.substr(colon+1).c_str());
+            }
+        }
+        else {
+            link = MSP_Link::openSerial(argv[k], BAUD);
+        }
+
+        if (!link) {
+            fprintf(stderr, "Unable to open %s\n", argv[k]);
+            return 1;
+        }
+
+        Attitude_Handler * handler = new Attitude_Handler();
+        link->parser.set_ATTITUDE_RADIANS_Handler(handler);
+
+        client.add(link);
+        links.push_back(link);
+        handlers.push_back(handler);
+    }
+
+    MSP_Message request = MSP_Parser::serialize_ATTITUDE_RADIANS_Request();
+
+    double reportTime = now() + 1;
+
+    while (client.linkCount() > 0) {
+
+        // Keep each link's pipeline full
+        for (size_t k=0; k<links.size(); ++k) {
+            while (links[k]->outstanding() < PIPELINE_DEPTH) {
+                links[k]->send(request);
+            }
+        }
+
+        client.poll(10);
+
+        if (now() >= reportTime) {
+            for (size_t k=0; k<links.size(); ++k) {
+                printf("%s: %lu msg/sec  roll %+2.2f pitch %+2.2f yaw %+2.2f\n", argv[k+1], links[k]->received(),
+                        handlers[k]->roll, handlers[k]->pitch, handlers[k]->yaw);
+            }
+            reportTime += 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,117 @@
+'''
+mspv2.py MSPv2 framing for MSPPG: CRC8-DVB-S2 frames with 16-bit command and size, and Hackflight BATCH frames
+
+Copyright (C) Rob Jones, Alec Singer, Chris Lavin, Blake Liebling, Simon D. Levy 2015
+
+This code is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as 
+published by the Free Software Foundation, either version 3 of the 
+License, or (at your option) any later version.
+This code is distributed in the hope that it will be useful,     
+but WITHOUT ANY WARRANTY without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License 
+along with this code.  If not, see <http:#www.gnu.org/licenses/>.
+'''
+
+import struct
+
+# Firmware command carrying several replies as (command, size, payload) records
+BATCH = 0x4801
+
+def crc8_dvb_s2(crc, byte):
+
+    crc ^= byte
+    for _ in range(8):
+        crc = ((crc << 1) ^ 0xD5) & 0xFF if crc & 0x80 else (crc << 1) & 0xFF
+    return crc
+
+def serialize_v2(command, payload=b'', direction='<'):
+    '''
+    Builds an MSPv2 frame for a command and its payload.
+    '''
+    body = struct.pack('<BHH', 0, command, len(payload)) + bytes(payload)
+    crc = 0
+    for b in body:
+        crc = crc8_dvb_s2(crc, b)
+    return b'$X' + direction.encode() + body + bytes([crc])
+
+def to_v2(frame):
+    '''
+    Converts a request built by one of the msppg serialize_ functions to MSPv2 framing, so its reply (and any
+    subscription it starts) comes back in MSPv2 frames.
+    '''
+    frame = bytes(frame)
+    size, command = frame[3], frame[4]
+    return serialize_v2(command, frame[5:5+size])
+
+class V2_Parser(object):
+    '''
+    Parses MSPv2 frames, handing each message (including each one in a BATCH) to an MSP_Parser as a $M frame,
+    so the handlers set on that parser fire as usual.
+    '''
+
+    def __init__(self, parser):
+
+        self.parser = parser
+        self.state = 0
+
+    def parse(self, char):
+
+        byte = ord(char)
+
+        if self.state == 0:
+            self.state = 1 if byte == 36 else 0                 # $
+
+        elif self.state == 1:
+            self.state = 2 if byte == 88 else 0                 # X
+
+        elif self.state == 2:                                   # direction
+            self.error = (byte == 33)                           # !
+            self.header = b''
+            self.crc = 0
+            self.state = 3
+
+        elif self.state == 3:                                   # flag, command, size
+            self.header += bytes([byte])
+            self.crc = crc8_dvb_s2(self.crc, byte)
+            if len(self.header) == 5:
+                _, self.command, self.size = struct.unpack('<BHH', self.header)
+                self.payload = b''
+                self.state = 4 if self.size > 0 else 5
+
+        elif self.state == 4:                                   # payload
+            self.payload += bytes([byte])
+            self.crc = crc8_dvb_s2(self.crc, byte)
+            if len(self.payload) == self.size:
+                self.state = 5
+
+        elif self.state == 5:                                   # CRC
+            if byte == self.crc and not self.error:
+                self._deliver()
+            self.state = 0
+
+    def _deliver(self):
+
+        if self.command == BATCH:
+            k = 0
+            while k + 4 <= len(self.payload):
+                command, size = struct.unpack('<HH', self.payload[k:k+4])
+                self._forward(command, self.payload[k+4:k+4+size])
+                k += 4 + size
+        else:
+            self._forward(self.command, self.payload)
+
+    def _forward(self, command, payload):
+
+        if command > 255 or len(payload) > 255:
+            return
+
+        checksum = len(payload) ^ command
+        for b in payload:
+            checksum ^= b
+
+        for b in b'$M>' + bytes([len(payload), command]) + payload + bytes([checksum]):
+            self.parser.parse(bytes([b]))
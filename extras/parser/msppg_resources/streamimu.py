@@ -0,0 +1,94 @@
+#!/usr/bin/env python3
+
+'''
+streamimu.py Uses MSPPG to subscribe to ATTITUDE_RADIANS messages streamed from flight controller IMU
+
+Copyright (C) Rob Jones, Alec Singer, Chris Lavin, Blake Liebling, Simon D. Levy 2015
+
+This code is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as 
+published by the Free Software Foundation, either version 3 of the 
+License, or (at your option) any later version.
+This code is distributed in the hope that it will be useful,     
+but WITHOUT ANY WARRANTY without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License 
+along with this code.  If not, see <http:#www.gnu.org/licenses/>.
+'''
+
+BAUD = 115200
+
+ATTITUDE_RADIANS = 122
+ATTITUDE_DELTA   = 131
+ENVELOPE         = 133
+
+# Stream once every this many attitude updates
+DIVIDER = 1
+
+from msppg import MSP_Parser as Parser, serialize_SET_SUBSCRIPTION
+from msppg.mspv2 import V2_Parser, to_v2
+from msppg.attitude import decode_delta, DELTA_SAMPLES
+import serial
+
+from sys import argv
+
+if len(argv) < 2:
+
+    print('Usage: python3 %s PORT [--v2] [--delta | --envelope]' % argv[0])
+    print('Example: python3 %s /dev/ttyUSB0' % argv[0])
+    exit(1)
+
+# With --v2 the subscription is made, and streamed back, in MSPv2 (batched) frames
+v2 = '--v2' in argv
+
+# With --delta the attitude comes eight samples to a message, at about a quarter of the bytes per sample
+delta = '--delta' in argv
+
+# With --envelope each message gives the mean, min, and max of each angle over the attitudes since the last one
+envelope = '--envelope' in argv
+
+message = ENVELOPE if envelope else (ATTITUDE_DELTA if delta else ATTITUDE_RADIANS)
+divider = DIVIDER * DELTA_SAMPLES if delta else DIVIDER
+
+parser = Parser()
+port = serial.Serial(argv[1], BAUD)
+
+framer = to_v2 if v2 else (lambda frame: frame)
+reader = V2_Parser(parser) if v2 else parser
+
+def handler(pitch, roll, yaw):
+
+    print(pitch, roll, yaw)
+
+def delta_handler(*fields):
+
+    for sample in decode_delta(*fields):
+        handler(*sample)
+
+def envelope_handler(gyroCount, angleCount, *fields):
+
+    # Skip the gyro's nine fields; print each angle as mean [min,max]
+    angles = fields[9:]
+    print(angleCount, ' '.join('%+.4f [%+.4f,%+.4f]' % tuple(angles[3*k:3*k+3]) for k in range(3)))
+
+parser.set_ATTITUDE_RADIANS_Handler(handler)
+parser.set_ENVELOPE_Handler(envelope_handler)
+parser.set_ATTITUDE_DELTA_Handler(delta_handler)
+
+# One request; the firmware keeps sending until we unsubscribe
+port.write(framer(serialize_SET_SUBSCRIPTION(message, divider)))
+
+while True:
+
+    try:
+
+        reader.parse(port.read(1))
+
+    except KeyboardInterrupt:
+
+        break
+
+port.write(framer(serialize_SET_SUBSCRIPTION(message, 0)))
+
@@ -0,0 +1,78 @@
+#!/usr/bin/env python3
+
+'''
+tune.py Uses MSPPG to read and retune the flight controller's PID gains without reflashing
+
+Copyright (C) Simon D. Levy 2015
+
+This code is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as 
+published by the Free Software Foundation, either version 3 of the 
+License, or (at your option) any later version.
+This code is distributed in the hope that it will be useful,     
+but WITHOUT ANY WARRANTY without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License 
+along with this code.  If not, see <http:#www.gnu.org/licenses/>.
+'''
+
+BAUD = 115200
+
+NAMES = ('levelP', 'cyclicP', 'cyclicI', 'cyclicD', 'yawP', 'yawI', 'altP', 'velP', 'velI', 'velD')
+
+from msppg import MSP_Parser as Parser, serialize_PID_GAINS_Request, serialize_SET_PID_GAINS
+import serial
+
+from sys import argv
+
+if len(argv) < 2:
+
+    print('Usage: python3 %s PORT [NAME=VALUE ...]' % argv[0])
+    print('Example: python3 %s /dev/ttyUSB0 cyclicP=0.25 cyclicD=0.002' % argv[0])
+    print('Names: ' + ' '.join(NAMES))
+    exit(1)
+
+parser = Parser()
+port = serial.Serial(argv[1], BAUD, timeout=1)
+
+gains = None
+
+def handler(*values):
+
+    global gains
+    gains = dict(zip(NAMES, values))
+
+parser.set_PID_GAINS_Handler(handler)
+
+def fetch():
+
+    global gains
+    gains = None
+    port.write(serialize_PID_GAINS_Request())
+    while gains is None:
+        c = port.read(1)
+        if not c:
+            print('No reply from flight controller')
+            exit(1)
+        parser.parse(c)
+    return gains
+
+current = fetch()
+
+# Change only the gains named, sending the whole set so they all take effect on the same gyro cycle
+changes = dict(arg.split('=') for arg in argv[2:])
+
+for name in changes:
+    if name not in NAMES:
+        print('Unknown gain %s' % name)
+        exit(1)
+    current[name] = float(changes[name])
+
+if changes:
+    port.write(serialize_SET_PID_GAINS(*[current[name] for name in NAMES]))
+    current = fetch()
+
+for name in NAMES:
+    print('%-8s %g' % (name, current[name]))
@@ -0,0 +1,944 @@
+/*
+   batchtest.cpp : Parallel batch simulation of Hackflight over sets of PID gains and scripted scenarios
+
+   Usage: batchtest [-e MEMBERS[:SEED] | -c SECONDS] [GAINSFILE] [THREADS] [PREFIX]
+
+   Each non-comment line of GAINSFILE holds six gains:
+
+       levelP gyroCyclicP gyroCyclicI gyroCyclicD gyroYawP gyroYawI
+
+   With no GAINSFILE, or -, it flies the 3DFly's gains.
+
+   Every gain set is flown through every standard scenario (receivers/sim/scenarios.hpp), each run on its own
+   Hackflight / SimBoard / ScriptedReceiver on a simulated clock.  Runs are spread across all cores.  First, as a
+   check that instances share no state, the altitude-step run is flown interleaved step by step with each
+   scenario, on one thread, and both are compared with the same runs flown alone; and each scenario is flown on
+   from a checkpoint, by two forks side by side, which must both end up as the run does straight through.  Every
+   run stops its board's cycle counter, so the scheduler never defers a task on account of the host, and results
+   are repeatable.
+
+   With -c, the gain sets don't each fly the takeoff: each scenario is flown once, with the first gain set, up to
+   SECONDS, and there checkpointed, and every gain set flies on from the checkpoint with its own gains.  A
+   checkpoint is a whole vehicle (Hackflight with its mixer and altitude estimator, board, receiver, stabilizer,
+   and the run's metrics so far) held once, read-only, and copied by each fork only as it starts; its size is
+   printed.  Metrics take in the flight before the checkpoint, and steps are recorded only after it.
+
+   With PREFIX, the metrics also go to PREFIX-runs.hfc, one row per run, and PREFIX-steps.hfc, one row per
+   simulation step of every run, in the columnar format of columns.hpp (read them with columns.py).  Steps of
+   different runs are interleaved a chunk at a time in the order they finish; the run column tells them apart.
+
+   With -e, each gain set flies each scenario MEMBERS times as a Monte-Carlo ensemble.  Every member draws its own
+   gyro and attitude noise, motor mismatch, and gusts from a random stream seeded by SEED (default 1) and its
+   member number, so member k meets the same conditions under every gain set.  Results are reduced as members
+   finish, in the constant-memory statistics of ensemble.hpp: mean, standard deviation, and quantiles of each
+   run metric, and of each step metric in BIN_SECONDS time bins.  The run metrics are printed; with PREFIX, the
+   binned ones go to PREFIX-ensemble.hfc, one row per gain set, scenario, and bin, in place of the steps and runs
+   files.  Means and deviations may differ in their last bits with the order members finish in; quantiles don't.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <hackflight.hpp>
+#include <receivers/sim/scripted.hpp>
+#include <receivers/sim/scenarios.hpp>
+#include <boards/sim/linux-console.hpp>
+
+#include "workpool.hpp"
+#include "columns.hpp"
+#include "ensemble.hpp"
+
+static const uint32_t GYRO_RATE = 1000;
+static const float    BARO_RATE = 50;
+
+// Attitude bound for settling, in radians
+static const float SETTLE_BOUND = 0.05f;
+
+// Ensemble perturbations: sensor noise (standard deviations, in rad/s, rad, and mbar), motor thrust mismatch
+// (standard deviation about nominal), and gusts (roll and pitch rate in rad/s, vertical acceleration in m/s^2)
+static const float GYRO_NOISE     = 0.01f;
+static const float EULER_RATE     = 200;
+static const float EULER_NOISE    = 0.002f;
+static const float BARO_NOISE     = 0.02f;
+static const float MOTOR_MISMATCH = 0.02f;
+static const float GUST_RATE      = 0.01f;
+static const float GUST_ACCEL     = 0.5f;
+static const float GUST_SECONDS   = 0.5f;
+
+// Width of the ensemble's time bins, in seconds
+static const float BIN_SECONDS = 0.25f;
+
+// Steps buffered by each run before they go to the steps file
+static const uint32_t STEP_CHUNK_ROWS = 8192;
+
+typedef struct {
+
+    float levelP;
+    float gyroCyclicP;
+    float gyroCyclicI;
+    float gyroCyclicD;
+    float gyroYawP;
+    float gyroYawI;
+
+} gains_t;
+
+typedef struct {
+
+    float attitudeError;   // RMS roll/pitch angle in radians while flying
+    float settlingTime;    // seconds after last disturbance until attitude stays within bound
+    float saturation;      // fraction of flying steps with at least one motor pinned at 0 or 1
+    float altitudeError;   // RMS meters from where altitude hold engaged, while holding
+
+} metrics_t;
+
+// One ensemble member's draw of what a real vehicle doesn't get to choose
+typedef struct {
+
+    float    motorScales[4];
+    uint32_t sensorSeed;
+    uint32_t gustSeed;
+
+} perturbation_t;
+
+// Step metrics summed over one time bin of one run
+typedef struct {
+
+    double   attitudeError2;
+    double   altitudeError2;
+    uint32_t flyingSteps;
+    uint32_t saturatedSteps;
+    uint32_t holdingSteps;
+
+} bin_t;
+
+// The standard scenarios, in order
+static const size_t SCENARIO_COUNT = hf::Scenarios::COUNT;
+
+static const hf::scenario_t & ALTITUDE_HOLD = hf::Scenarios::get(hf::Scenarios::ALTITUDE_STEP);
+
+// Steps the other run is ahead of the altitude-hold run in the side-by-side check
+static const uint32_t SIDE_BY_SIDE_OFFSET = 7;
+
+// Where the checkpoint check forks each scenario: in the air, before any maneuver
+static const float CHECKPOINT_CHECK_SECONDS = 2.5f;
+
+// Output columns --------------------------------------------------------------------------------
+
+static ColumnSchema stepSchema, runSchema;
+
+static size_t STEP_RUN, STEP_STEP, STEP_TIME, STEP_ATTITUDE_ERROR, STEP_SATURATED, STEP_ALTITUDE_ERROR, STEP_LOOP_NANOS;
+
+static size_t RUN_RUN, RUN_GAINS, RUN_SCENARIO, RUN_ATTITUDE_ERROR, RUN_SETTLING_TIME, RUN_SATURATION,
+              RUN_ALTITUDE_ERROR, RUN_LOOP_MEAN_NANOS, RUN_LOOP_MAX_NANOS;
+
+static void makeSchemas(void)
+{
+    STEP_RUN            = stepSchema.add<uint32_t>("run");
+    STEP_STEP           = stepSchema.add<uint32_t>("step");
+    STEP_TIME           = stepSchema.add<float>("time");           // seconds
+    STEP_ATTITUDE_ERROR = stepSchema.add<float>("attitudeError");  // radians off level, roll and pitch together
+    STEP_SATURATED      = stepSchema.add<uint8_t>("saturated");    // a motor pinned at 0 or 1 while flying
+    STEP_ALTITUDE_ERROR = stepSchema.add<float>("altitudeError");  // meters from the hold altitude; 0 not holding
+    STEP_LOOP_NANOS     = stepSchema.add<uint32_t>("loopNanos");   // host time for the flight-loop pass
+
+    RUN_RUN             = runSchema.add<uint32_t>("run");
+    RUN_GAINS           = runSchema.add<uint32_t>("gains");        // line of the gains file, from 0
+    RUN_SCENARIO        = runSchema.add<uint32_t>("scenario");     // index in hf::Scenarios
+    RUN_ATTITUDE_ERROR  = runSchema.add<float>("attitudeError");
+    RUN_SETTLING_TIME   = runSchema.add<float>("settlingTime");
+    RUN_SATURATION      = runSchema.add<float>("saturation");
+    RUN_ALTITUDE_ERROR  = runSchema.add<float>("altitudeError");
+    RUN_LOOP_MEAN_NANOS = runSchema.add<float>("loopMeanNanos");
+    RUN_LOOP_MAX_NANOS  = runSchema.add<uint32_t>("loopMaxNanos");
+}
+
+// Runs ------------------------------------------------------------------------------------------
+
+// One run, stepped by the caller, so that runs can also be flown side by side on one thread
+class Flight {
+
+    private:
+
+        // Concrete board and receiver types let the compiler inline their calls into the core
+        hf::HackflightT<hf::SimBoard, hf::ScriptedReceiver> _hackflight;
+        hf::SimBoard _board;
+        hf::ScriptedReceiver _receiver;
+        hf::Stabilizer _stabilizer;
+
+        const hf::scenario_t & _scenario;
+
+        double   _errorSum;
+        uint32_t _flyingSteps;
+        uint32_t _saturatedSteps;
+        float    _lastUnsettled;
+
+        // Altitude hold
+        bool     _holding;
+        float    _holdAltitude;
+        double   _altitudeErrorSum;
+        uint32_t _holdingSteps;
+
+        // Per-step output, when recording
+        uint32_t      _run;
+        uint32_t      _step;
+        ColumnChunk * _chunk;
+        ColumnWriter * _writer;
+        uint32_t      _timedSteps;
+        double        _loopNanosSum;
+        uint32_t      _loopNanosMax;
+
+        // Time bins, for an ensemble member
+        std::vector<bin_t> * _bins;
+
+    public:
+
+        // A barometer model gives the altitude estimator samples at a steady rate; a perturbation makes the run
+        // an ensemble member
+        Flight(const gains_t & gains, const hf::scenario_t & scenario, bool barometer=false,
+                const perturbation_t * perturbation=NULL)
+            : _board(GYRO_RATE),
+              _receiver(&_board, scenario.script),
+              _stabilizer(
+                    gains.levelP,
+                    gains.gyroCyclicP,
+                    gains.gyroCyclicI,
+                    gains.gyroCyclicD,
+                    gains.gyroYawP,
+                    gains.gyroYawI),
+              _scenario(scenario),
+              _errorSum(0),
+              _flyingSteps(0),
+              _saturatedSteps(0),
+              _lastUnsettled(scenario.settleStart),
+              _holding(false),
+              _holdAltitude(0),
+              _altitudeErrorSum(0),
+              _holdingSteps(0),
+              _run(0),
+              _step(0),
+              _chunk(NULL),
+              _writer(NULL),
+              _timedSteps(0),
+              _loopNanosSum(0),
+              _loopNanosMax(0),
+              _bins(NULL)
+        {
+            // Runs are then repeatable, however busy the host
+            _board.simSetStoppedCycles();
+
+            if (perturbation) {
+                _board.simSetSensorModel(hf::SimBoard::SENSOR_GYRO, 0, 0, GYRO_NOISE, perturbation->sensorSeed);
+                _board.simSetSensorModel(hf::SimBoard::SENSOR_EULER, EULER_RATE, 0, EULER_NOISE,
+                        perturbation->sensorSeed);
+                _board.simSetMotorScales(perturbation->motorScales);
+                _board.simSetGusts(GUST_RATE, GUST_ACCEL, GUST_SECONDS, perturbation->gustSeed);
+            }
+
+            if (barometer) {
+                _board.simSetSensorModel(hf::SimBoard::SENSOR_BARO, BARO_RATE, 0, perturbation ? BARO_NOISE : 0,
+                        perturbation ? perturbation->sensorSeed : 1);
+            }
+
+            _hackflight.init(&_board, &_receiver, &_stabilizer);
+        }
+
+        // A fork of a checkpoint: the checkpoint's vehicle and metrics, carrying on with the given gains
+        Flight(const Flight & checkpoint, const gains_t & gains)
+            : _hackflight(checkpoint._hackflight),
+              _board(checkpoint._board),
+              _receiver(checkpoint._receiver),
+              _stabilizer(checkpoint._stabilizer),
+              _scenario(checkpoint._scenario),
+              _errorSum(checkpoint._errorSum),
+              _flyingSteps(checkpoint._flyingSteps),
+              _saturatedSteps(checkpoint._saturatedSteps),
+              _lastUnsettled(checkpoint._lastUnsettled),
+              _holding(checkpoint._holding),
+              _holdAltitude(checkpoint._holdAltitude),
+              _altitudeErrorSum(checkpoint._altitudeErrorSum),
+              _holdingSteps(checkpoint._holdingSteps),
+              _run(0),
+              _step(checkpoint._step),
+              _chunk(NULL),
+              _writer(NULL),
+              _timedSteps(0),
+              _loopNanosSum(0),
+              _loopNanosMax(0),
+              _bins(NULL)
+        {
+            _receiver.rebind(&_board);
+            _hackflight.rebind(&_board, &_receiver, &_stabilizer);
+
+            hf::gains_t g = {};
+            _stabilizer.getGains(g);
+            g.levelP      = gains.levelP;
+            g.gyroCyclicP = gains.gyroCyclicP;
+            g.gyroCyclicI = gains.gyroCyclicI;
+            g.gyroCyclicD = gains.gyroCyclicD;
+            g.gyroYawP    = gains.gyroYawP;
+            g.gyroYawI    = gains.gyroYawI;
+            _stabilizer.setGains(g);
+        }
+
+        uint32_t steps(void)
+        {
+            return (uint32_t)(_scenario.duration * GYRO_RATE);
+        }
+
+        // Steps flown so far, including a checkpoint's
+        uint32_t stepsFlown(void)
+        {
+            return _step;
+        }
+
+        // Puts a row for each step in chunk, handing it to writer when full, under the given run number
+        void record(uint32_t run, ColumnChunk * chunk, ColumnWriter * writer)
+        {
+            _run = run;
+            _chunk = chunk;
+            _writer = writer;
+        }
+
+        // Sums the step metrics of each BIN_SECONDS of the run into bins, which must hold binCount()
+        void bin(std::vector<bin_t> * bins)
+        {
+            _bins = bins;
+        }
+
+        size_t binCount(void)
+        {
+            return (size_t)ceilf(_scenario.duration / BIN_SECONDS) + 1;
+        }
+
+        void step(void)
+        {
+            std::chrono::steady_clock::time_point start;
+            if (_chunk) {
+                start = std::chrono::steady_clock::now();
+            }
+
+            _hackflight.update();
+
+            uint32_t loopNanos = 0;
+            if (_chunk) {
+                loopNanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - start).count();
+                _timedSteps++;
+                _loopNanosSum += loopNanos;
+                _loopNanosMax = std::max(_loopNanosMax, loopNanos);
+            }
+
+            float gyroRates[3], translationRates[3], position[3], eulerAngles[3], motors[4];
+            _board.simGetVehicleState(gyroRates, translationRates, position, eulerAngles, motors);
+
+            float motorMin = motors[0], motorMax = motors[0];
+            for (uint8_t i=1; i<4; ++i) {
+                motorMin = std::min(motorMin, motors[i]);
+                motorMax = std::max(motorMax, motors[i]);
+            }
+
+            float roll = eulerAngles[0], pitch = eulerAngles[1];
+            float t = _board.getMicroseconds() / 1.e6f;
+
+            // Steps before the motors spin up count for nothing
+            bool flying = motorMax > 0;
+            bool saturated = flying && (motorMin <= 0 || motorMax >= 1);
+
+            // From where the vehicle was when the hold engaged
+            bool holding = _hackflight.getAltitudeEstimator().isHolding();
+            if (holding && !_holding) {
+                _holdAltitude = position[2];
+            }
+            _holding = holding;
+            float altitudeError = holding ? position[2] - _holdAltitude : 0;
+
+            if (_chunk) {
+                _chunk->set(STEP_RUN, _run);
+                _chunk->set(STEP_STEP, _step);
+                _chunk->set(STEP_TIME, t);
+                _chunk->set(STEP_ATTITUDE_ERROR, sqrtf(roll*roll + pitch*pitch));
+                _chunk->set(STEP_SATURATED, (uint8_t)saturated);
+                _chunk->set(STEP_ALTITUDE_ERROR, altitudeError);
+                _chunk->set(STEP_LOOP_NANOS, loopNanos);
+                if (_chunk->next()) {
+                    _writer->write(*_chunk);
+                }
+            }
+
+            _step++;
+
+            if (!flying) return;
+
+            _flyingSteps++;
+
+            _errorSum += roll*roll + pitch*pitch;
+
+            if (saturated) {
+                _saturatedSteps++;
+            }
+
+            if (holding) {
+                _holdingSteps++;
+                _altitudeErrorSum += altitudeError * altitudeError;
+            }
+
+            if (_bins) {
+                bin_t & b = (*_bins)[(size_t)(t / BIN_SECONDS)];
+                b.flyingSteps++;
+                b.attitudeError2 += roll*roll + pitch*pitch;
+                b.saturatedSteps += saturated;
+                if (holding) {
+                    b.holdingSteps++;
+                    b.altitudeError2 += altitudeError * altitudeError;
+                }
+            }
+
+            if (t > _scenario.settleStart && (fabs(roll) > SETTLE_BOUND || fabs(pitch) > SETTLE_BOUND)) {
+                _lastUnsettled = t;
+            }
+        }
+
+        void getPosition(float position[3])
+        {
+            float gyroRates[3], translationRates[3], eulerAngles[3], motors[4];
+            _board.simGetVehicleState(gyroRates, translationRates, position, eulerAngles, motors);
+        }
+
+        metrics_t metrics(void)
+        {
+            metrics_t metrics;
+            metrics.attitudeError = _flyingSteps ? sqrt(_errorSum / _flyingSteps) : 0;
+            metrics.settlingTime  = _lastUnsettled - _scenario.settleStart;
+            metrics.saturation    = _flyingSteps ? (float)_saturatedSteps / _flyingSteps : 0;
+            metrics.altitudeError = _holdingSteps ? sqrt(_altitudeErrorSum / _holdingSteps) : 0;
+            return metrics;
+        }
+
+        // Host time per flight-loop pass, when recording
+        float loopMeanNanos(void)
+        {
+            return _timedSteps ? _loopNanosSum / _timedSteps : 0;
+        }
+
+        uint32_t loopMaxNanos(void)
+        {
+            return _loopNanosMax;
+        }
+
+}; // class Flight
+
+typedef struct {
+
+    float    meanNanos;
+    uint32_t maxNanos;
+
+} timing_t;
+
+// Flies a scenario with the given gains up to the given time, for runs to fork from
+static Flight * checkpoint(const gains_t & gains, const hf::scenario_t & scenario, float seconds)
+{
+    Flight * flight = new Flight(gains, scenario, scenario.altitudeHold);
+
+    for (uint32_t k=0, steps=std::min(flight->steps(), (uint32_t)(seconds * GYRO_RATE)); k<steps; ++k) {
+        flight->step();
+    }
+
+    return flight;
+}
+
+// With a steps file (and somewhere for the loop timing), records every step of the run there; with a checkpoint
+// of the scenario, flies on from it
+static metrics_t fly(const gains_t & gains, const hf::scenario_t & scenario, uint32_t run=0,
+        ColumnWriter * stepsFile=NULL, timing_t * timing=NULL, const Flight * from=NULL)
+{
+    std::unique_ptr<Flight> flight(from ? new Flight(*from, gains) :
+            new Flight(gains, scenario, scenario.altitudeHold));
+
+    std::unique_ptr<ColumnChunk> chunk;
+    if (stepsFile) {
+        chunk.reset(new ColumnChunk(stepSchema, STEP_CHUNK_ROWS));
+        flight->record(run, chunk.get(), stepsFile);
+    }
+
+    for (uint32_t k=flight->stepsFlown(), steps=flight->steps(); k<steps; ++k) {
+        flight->step();
+    }
+
+    if (stepsFile) {
+        stepsFile->write(*chunk);
+        timing->meanNanos = flight->loopMeanNanos();
+        timing->maxNanos = flight->loopMaxNanos();
+    }
+
+    return flight->metrics();
+}
+
+static void writeRuns(ColumnWriter & runsFile, const std::vector<metrics_t> & results,
+        const std::vector<timing_t> & timings)
+{
+    ColumnChunk chunk(runSchema, STEP_CHUNK_ROWS);
+
+    for (size_t run=0; run<results.size(); ++run) {
+        const metrics_t & m = results[run];
+        chunk.set(RUN_RUN, (uint32_t)run);
+        chunk.set(RUN_GAINS, (uint32_t)(run / SCENARIO_COUNT));
+        chunk.set(RUN_SCENARIO, (uint32_t)(run % SCENARIO_COUNT));
+        chunk.set(RUN_ATTITUDE_ERROR, m.attitudeError);
+        chunk.set(RUN_SETTLING_TIME, m.settlingTime);
+        chunk.set(RUN_SATURATION, m.saturation);
+        chunk.set(RUN_ALTITUDE_ERROR, m.altitudeError);
+        chunk.set(RUN_LOOP_MEAN_NANOS, timings[run].meanNanos);
+        chunk.set(RUN_LOOP_MAX_NANOS, timings[run].maxNanos);
+        if (chunk.next()) {
+            runsFile.write(chunk);
+        }
+    }
+
+    runsFile.write(chunk);
+}
+
+// Ensembles -------------------------------------------------------------------------------------
+
+// Spreads a seed and member number over all 32 bits (the MurmurHash3 finalizer), so neighbouring members get
+// unrelated random streams
+static uint32_t memberSeed(uint32_t seed, uint32_t member)
+{
+    uint32_t h = seed ^ (member * 0x9E3779B9u);
+    h ^= h >> 16;
+    h *= 0x85EBCA6Bu;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35u;
+    h ^= h >> 16;
+    return h;
+}
+
+static perturbation_t perturbation(uint32_t seed, uint32_t member)
+{
+    hf::SimRandom random(memberSeed(seed, member));
+
+    perturbation_t p;
+    for (uint8_t k=0; k<4; ++k) {
+        p.motorScales[k] = 1 + MOTOR_MISMATCH * random.gaussian();
+    }
+    p.sensorSeed = random.next();
+    p.gustSeed = random.next();
+
+    return p;
+}
+
+// The statistics of one gain set flying one scenario, over all its members
+class Ensemble {
+
+    public:
+
+        enum {
+            RUN_ATTITUDE_ERROR,
+            RUN_SETTLING_TIME,
+            RUN_SATURATION,
+            RUN_ALTITUDE_ERROR,
+            RUN_METRICS
+        };
+
+        enum {
+            BIN_ATTITUDE_ERROR, // RMS over the bin
+            BIN_SATURATION,     // fraction of the bin's flying steps
+            BIN_ALTITUDE_ERROR, // RMS over the bin's holding steps
+            BIN_METRICS
+        };
+
+        static const char * RUN_NAMES[RUN_METRICS];
+        static const char * BIN_NAMES[BIN_METRICS];
+
+        typedef struct {
+            MetricStats metrics[BIN_METRICS];
+        } binstats_t;
+
+    private:
+
+        std::mutex _lock;
+
+        MetricStats _run[RUN_METRICS];
+
+        std::vector<binstats_t> _bins;
+
+    public:
+
+        // Folds in one member's results; bins without a flying step, or without a holding step for altitude,
+        // add nothing
+        void add(const metrics_t & m, const std::vector<bin_t> & bins)
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+
+            _run[RUN_ATTITUDE_ERROR].add(m.attitudeError);
+            _run[RUN_SETTLING_TIME].add(m.settlingTime);
+            _run[RUN_SATURATION].add(m.saturation);
+            _run[RUN_ALTITUDE_ERROR].add(m.altitudeError);
+
+            _bins.resize(std::max(_bins.size(), bins.size()));
+
+            for (size_t k=0; k<bins.size(); ++k) {
+                const bin_t & b = bins[k];
+                if (b.flyingSteps) {
+                    _bins[k].metrics[BIN_ATTITUDE_ERROR].add(sqrt(b.attitudeError2 / b.flyingSteps));
+                    _bins[k].metrics[BIN_SATURATION].add((double)b.saturatedSteps / b.flyingSteps);
+                }
+                if (b.holdingSteps) {
+                    _bins[k].metrics[BIN_ALTITUDE_ERROR].add(sqrt(b.altitudeError2 / b.holdingSteps));
+                }
+            }
+        }
+
+        const MetricStats & run(uint8_t metric) const
+        {
+            return _run[metric];
+        }
+
+        size_t binCount(void) const
+        {
+            return _bins.size();
+        }
+
+        const binstats_t & bin(size_t k) const
+        {
+            return _bins[k];
+        }
+
+}; // class Ensemble
+
+const char * Ensemble::RUN_NAMES[] = {"attitudeError", "settlingTime", "saturation", "altitudeError"};
+const char * Ensemble::BIN_NAMES[] = {"attitudeError", "saturation", "altitudeError"};
+
+// Flies one member into its ensemble
+static void flyMember(const gains_t & gains, const hf::scenario_t & scenario, const perturbation_t & perturbation,
+        Ensemble & ensemble)
+{
+    Flight flight(gains, scenario, scenario.altitudeHold, &perturbation);
+
+    std::vector<bin_t> bins(flight.binCount());
+    memset(&bins[0], 0, bins.size() * sizeof(bin_t));
+    flight.bin(&bins);
+
+    for (uint32_t k=0, steps=flight.steps(); k<steps; ++k) {
+        flight.step();
+    }
+
+    ensemble.add(flight.metrics(), bins);
+}
+
+// One row per gain set, scenario, and time bin: the count of members, then each binned metric's mean, standard
+// deviation, and 5th, 50th, and 95th percentiles
+static void writeEnsembles(const char * filename, const std::vector<std::unique_ptr<Ensemble>> & ensembles)
+{
+    static const double QUANTILES[] = {.05, .50, .95};
+    static const char * SUFFIXES[] = {"Mean", "Stdev", "P05", "P50", "P95"};
+
+    ColumnSchema schema;
+    size_t gainsColumn    = schema.add<uint32_t>("gains");
+    size_t scenarioColumn = schema.add<uint32_t>("scenario");
+    size_t timeColumn     = schema.add<float>("time");      // start of the bin, in seconds
+    size_t membersColumn  = schema.add<uint32_t>("members"); // with a flying step in the bin
+    size_t firstColumn    = 0;
+    for (uint8_t m=0; m<Ensemble::BIN_METRICS; ++m) {
+        for (uint8_t k=0; k<5; ++k) {
+            size_t column = schema.add<float>((std::string(Ensemble::BIN_NAMES[m]) + SUFFIXES[k]).c_str());
+            firstColumn = (m || k) ? firstColumn : column;
+        }
+    }
+
+    ColumnWriter writer(filename, schema);
+    if (!writer.ok()) {
+        fprintf(stderr, "Unable to create %s\n", filename);
+        exit(1);
+    }
+
+    ColumnChunk chunk(schema, STEP_CHUNK_ROWS);
+
+    for (size_t e=0; e<ensembles.size(); ++e) {
+        const Ensemble & ensemble = *ensembles[e];
+        for (size_t b=0; b<ensemble.binCount(); ++b) {
+            const Ensemble::binstats_t & stats = ensemble.bin(b);
+            chunk.set(gainsColumn, (uint32_t)(e / SCENARIO_COUNT));
+            chunk.set(scenarioColumn, (uint32_t)(e % SCENARIO_COUNT));
+            chunk.set(timeColumn, b * BIN_SECONDS);
+            chunk.set(membersColumn, (uint32_t)stats.metrics[Ensemble::BIN_ATTITUDE_ERROR].stats.count());
+            for (uint8_t m=0; m<Ensemble::BIN_METRICS; ++m) {
+                const MetricStats & metric = stats.metrics[m];
+                size_t column = firstColumn + 5*m;
+                chunk.set(column++, (float)metric.stats.mean());
+                chunk.set(column++, (float)metric.stats.stdev());
+                for (uint8_t q=0; q<3; ++q) {
+                    chunk.set(column++, (float)metric.sketch.quantile(QUANTILES[q]));
+                }
+            }
+            if (chunk.next()) {
+                writer.write(chunk);
+            }
+        }
+    }
+
+    writer.write(chunk);
+}
+
+// Flies every gain set through every scenario members times, and prints the run metrics' statistics
+static void flyEnsembles(const std::vector<gains_t> & gainsets, WorkPool & pool, uint32_t members, uint32_t seed,
+        const char * prefix)
+{
+    size_t ensembleCount = gainsets.size() * SCENARIO_COUNT;
+
+    std::vector<std::unique_ptr<Ensemble>> ensembles;
+    for (size_t k=0; k<ensembleCount; ++k) {
+        ensembles.push_back(std::unique_ptr<Ensemble>(new Ensemble()));
+    }
+
+    pool.run(ensembleCount * members, [&](size_t job) {
+            size_t e = job / members;
+            flyMember(gainsets[e/SCENARIO_COUNT], hf::Scenarios::get(e%SCENARIO_COUNT),
+                    perturbation(seed, job % members), *ensembles[e]);
+            });
+
+    if (prefix) {
+        writeEnsembles((std::string(prefix) + "-ensemble.hfc").c_str(), ensembles);
+    }
+
+    printf("# ensemble: %u members, seed %u\n", members, seed);
+    printf("# gains scenario metric mean stdev p05 p50 p95 max\n");
+
+    for (size_t e=0; e<ensembleCount; ++e) {
+        for (uint8_t m=0; m<Ensemble::RUN_METRICS; ++m) {
+            const MetricStats & metric = ensembles[e]->run(m);
+            printf("%4zu %-14s %-14s %8.5f %8.5f %8.5f %8.5f %8.5f %8.5f\n", e/SCENARIO_COUNT,
+                    hf::Scenarios::get(e%SCENARIO_COUNT).name, Ensemble::RUN_NAMES[m], metric.stats.mean(),
+                    metric.stats.stdev(), metric.sketch.quantile(.05), metric.sketch.quantile(.50),
+                    metric.sketch.quantile(.95), metric.stats.max());
+        }
+    }
+}
+
+// Flies the altitude-hold run alongside another, a step of each in turn on the same thread, and checks that both
+// end up where they do alone: any state shared between instances would show up here
+static bool flySideBySide(const gains_t & gains, const hf::scenario_t & other)
+{
+    std::unique_ptr<Flight> flights[2] = {
+        std::unique_ptr<Flight>(new Flight(gains, ALTITUDE_HOLD, true)),
+        std::unique_ptr<Flight>(new Flight(gains, other, true))
+    };
+
+    // A head start for the other run, so the two clocks differ and state shared between them would get mixed up
+    for (uint32_t k=0; k<SIDE_BY_SIDE_OFFSET; ++k) {
+        flights[1]->step();
+    }
+
+    for (uint32_t k=0, steps=std::max(flights[0]->steps(), flights[1]->steps()); k<steps; ++k) {
+        for (uint8_t j=0; j<2; ++j) {
+            if (k + (j ? SIDE_BY_SIDE_OFFSET : 0) < flights[j]->steps()) {
+                flights[j]->step();
+            }
+        }
+    }
+
+    bool same = true;
+
+    for (uint8_t j=0; j<2; ++j) {
+
+        std::unique_ptr<Flight> alone(new Flight(gains, j ? other : ALTITUDE_HOLD, true));
+        for (uint32_t k=0, steps=alone->steps(); k<steps; ++k) {
+            alone->step();
+        }
+
+        float a[3], b[3];
+        alone->getPosition(a);
+        flights[j]->getPosition(b);
+        metrics_t ma = alone->metrics(), mb = flights[j]->metrics();
+
+        same = same && !memcmp(a, b, sizeof(a)) && !memcmp(&ma, &mb, sizeof(metrics_t));
+    }
+
+    return same;
+}
+
+// Flies two forks of a checkpoint of the scenario, a step of each in turn, and checks that both end up where the
+// scenario does when flown straight through: a fork that missed any of the state, or shared it with the
+// checkpoint or the other fork, would show up here
+static bool flyFromCheckpoint(const gains_t & gains, const hf::scenario_t & scenario)
+{
+    std::unique_ptr<Flight> start(checkpoint(gains, scenario, CHECKPOINT_CHECK_SECONDS));
+
+    std::unique_ptr<Flight> forks[2] = {
+        std::unique_ptr<Flight>(new Flight(*start, gains)),
+        std::unique_ptr<Flight>(new Flight(*start, gains))
+    };
+
+    for (uint32_t k=start->stepsFlown(), steps=start->steps(); k<steps; ++k) {
+        forks[0]->step();
+        forks[1]->step();
+    }
+
+    std::unique_ptr<Flight> straight(new Flight(gains, scenario, scenario.altitudeHold));
+    for (uint32_t k=0, steps=straight->steps(); k<steps; ++k) {
+        straight->step();
+    }
+
+    float a[3];
+    straight->getPosition(a);
+    metrics_t ma = straight->metrics();
+
+    bool same = true;
+
+    for (uint8_t j=0; j<2; ++j) {
+        float b[3];
+        forks[j]->getPosition(b);
+        metrics_t mb = forks[j]->metrics();
+        same = same && !memcmp(a, b, sizeof(a)) && !memcmp(&ma, &mb, sizeof(metrics_t));
+    }
+
+    return same;
+}
+
+static void readGains(const char * filename, std::vector<gains_t> & gainsets)
+{
+    FILE * fp = fopen(filename, "r");
+
+    if (!fp) {
+        fprintf(stderr, "Unable to open %s\n", filename);
+        exit(1);
+    }
+
+    char line[256];
+
+    while (fgets(line, sizeof(line), fp)) {
+        gains_t g;
+        if (line[0] != '#' &&
+                sscanf(line, "%f %f %f %f %f %f",
+                    &g.levelP, &g.gyroCyclicP, &g.gyroCyclicI, &g.gyroCyclicD, &g.gyroYawP, &g.gyroYawI) == 6) {
+            gainsets.push_back(g);
+        }
+    }
+
+    fclose(fp);
+}
+
+int main(int argc, char ** argv)
+{
+    // Ensemble or checkpoint mode, if asked for, and then the positional arguments
+    uint32_t members = 0, seed = 1;
+    float checkpointSeconds = 0;
+    if (argc > 2 && !strcmp(argv[1], "-e")) {
+        if (sscanf(argv[2], "%u:%u", &members, &seed) < 1 || members == 0) {
+            fprintf(stderr, "Ensemble size must be a positive number, optionally followed by :SEED\n");
+            exit(1);
+        }
+        argc -= 2;
+        argv += 2;
+    }
+    else if (argc > 2 && !strcmp(argv[1], "-c")) {
+        if (sscanf(argv[2], "%f", &checkpointSeconds) < 1 || !(checkpointSeconds > 0)) {
+            fprintf(stderr, "Checkpoint time must be a positive number of seconds\n");
+            exit(1);
+        }
+        argc -= 2;
+        argv += 2;
+    }
+
+    std::vector<gains_t> gainsets;
+
+    if (argc > 1 && strcmp(argv[1], "-")) {
+        readGains(argv[1], gainsets);
+    }
+
+    // Default to the gains we fly on the 3DFly
+    else {
+        gains_t g = {0.20f, 0.225f, 0.001875f, 0.375f, 1.0625f, 0.005625f};
+        gainsets.push_back(g);
+    }
+
+    WorkPool pool(argc > 2 ? atoi(argv[2]) : 0);
+
+    // Altitude hold alongside each scenario, with the first gain set
+    size_t matches = 0;
+    for (size_t k=0; k<SCENARIO_COUNT; ++k) {
+        matches += flySideBySide(gainsets[0], hf::Scenarios::get(k));
+    }
+    printf("# side by side: %zu of %zu pairs fly as they do alone\n", matches, SCENARIO_COUNT);
+
+    // Each scenario forked from a checkpoint, with the first gain set
+    matches = 0;
+    for (size_t k=0; k<SCENARIO_COUNT; ++k) {
+        matches += flyFromCheckpoint(gainsets[0], hf::Scenarios::get(k));
+    }
+    printf("# checkpoint: %zu of %zu scenarios fly on from a checkpoint as they do straight through\n", matches,
+            SCENARIO_COUNT);
+
+    if (members) {
+        flyEnsembles(gainsets, pool, members, seed, argc > 3 ? argv[3] : NULL);
+        return 0;
+    }
+
+    // Binary metrics files, if asked for
+    std::unique_ptr<ColumnWriter> stepsFile, runsFile;
+    if (argc > 3) {
+        makeSchemas();
+        std::string prefix = argv[3];
+        stepsFile.reset(new ColumnWriter((prefix + "-steps.hfc").c_str(), stepSchema));
+        runsFile.reset(new ColumnWriter((prefix + "-runs.hfc").c_str(), runSchema));
+        if (!stepsFile->ok() || !runsFile->ok()) {
+            fprintf(stderr, "Unable to create %s-steps.hfc and %s-runs.hfc\n", argv[3], argv[3]);
+            exit(1);
+        }
+    }
+
+    size_t runCount = gainsets.size() * SCENARIO_COUNT;
+
+    std::vector<metrics_t> results(runCount);
+    std::vector<timing_t> timings(runCount);
+
+    // With -c, one checkpoint of each scenario, which every gain set forks
+    std::vector<std::unique_ptr<const Flight>> checkpoints(checkpointSeconds > 0 ? SCENARIO_COUNT : 0);
+
+    pool.run(checkpoints.size(), [&](size_t k) {
+            checkpoints[k].reset(checkpoint(gainsets[0], hf::Scenarios::get(k), checkpointSeconds));
+            });
+
+    if (checkpointSeconds > 0) {
+        printf("# checkpoints at %.3f s with the first gain set, %zu bytes each\n", checkpointSeconds, sizeof(Flight));
+    }
+
+    pool.run(runCount, [&](size_t run) {
+            results[run] = fly(gainsets[run/SCENARIO_COUNT], hf::Scenarios::get(run%SCENARIO_COUNT), run,
+                    stepsFile.get(), &timings[run], checkpoints.empty() ? NULL : checkpoints[run%SCENARIO_COUNT].get());
+            });
+
+    if (runsFile) {
+        writeRuns(*runsFile, results, timings);
+    }
+
+    printf("# gains scenario attitudeError settlingTime saturation altitudeError\n");
+
+    for (size_t run=0; run<runCount; ++run) {
+        const metrics_t & m = results[run];
+        printf("%4zu %-14s %8.5f %8.4f %8.4f %8.4f\n", run/SCENARIO_COUNT, hf::Scenarios::get(run%SCENARIO_COUNT).name,
+                m.attitudeError, m.settlingTime, m.saturation, m.altitudeError);
+    }
+
+    return 0;
+}
@@ -0,0 +1,395 @@
+/*
+   benchmark.cpp : Host microbenchmarks for the control-core kernels
+
+   Usage: benchmark [REPETITIONS]
+
+   Times each hot-path kernel on a synthetic but realistic input stream (gyro noise and vibration, slowly
+   varying attitude, baro pressure noise, stick sweeps, a mix of MSP requests), repeating each measurement and
+   reporting min, median, mean, and standard deviation in nanoseconds per call.  Compare the median across
+   commits; the spread shows how much to trust a difference.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include <hackflight.hpp>
+#include <imu.hpp>
+#include <boards/real/msp.hpp>
+
+// Calls per timed repetition, and length of the precomputed input streams (a power of two)
+static const uint32_t CALLS  = 200000;
+static const uint32_t STREAM = 4096;
+
+static const uint32_t GYRO_PERIOD_MICROS = 1000;
+
+// The stabilizer gains below, as compile-time constants
+struct BenchmarkGains {
+    static constexpr float levelP = 0.20f, gyroCyclicP = 0.225f, gyroCyclicI = 0.001875f, gyroCyclicD = 0.375f,
+                           gyroYawP = 1.0625f, gyroYawI = 0.005625f;
+};
+
+// Keeps the compiler from discarding a result it can see is unused
+template <typename T>
+static inline void keep(T & value)
+{
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+// Nothing here prints through the board
+uint16_t hf::Board::outbufWrite(const uint8_t * buf, uint16_t len)
+{
+    (void)buf;
+    return len;
+}
+
+// Board that does nothing with the motor values, so Mixer::runArmed() is timed on its own
+class NullBoard final : public hf::Board {
+
+    public:
+
+        float motors[hf::Mixer::MAXMOTORS];
+
+        void     init(void) { }
+        bool     getEulerAngles(float eulerAngles[3]) { (void)eulerAngles; return false; }
+        bool     getGyroRates(float gyroRates[3]) { (void)gyroRates; return false; }
+        uint32_t getMicroseconds() { return 0; }
+        void     writeMotor(uint8_t index, float value) { motors[index] = value; }
+
+        void writeMotors(const float * values, uint8_t count)
+        {
+            memcpy(motors, values, count*sizeof(float));
+            keep(motors);
+        }
+};
+
+// Receiver whose frames come from a precomputed stick stream, one per call
+class StreamReceiver final : public hf::Receiver {
+
+    public:
+
+        const float (*stream)[5];
+        uint32_t index;
+
+    protected:
+
+        void begin(void) { index = 0; }
+        bool gotNewFrame(void) { return true; }
+
+        void readRawvals(void)
+        {
+            memcpy(rawvals, stream[index++ & (STREAM-1)], 5*sizeof(float));
+        }
+};
+
+// Input streams ----------------------------------------------------------------------------------------------
+
+static float gyroStream[STREAM][3];
+static float eulerStream[STREAM][3];
+static hf::BinaryAngle headingStream[STREAM];
+static float accelStream[STREAM][3];
+static float baroStream[STREAM];
+static float stickStream[STREAM][5];
+static demands_t demandStream[STREAM];
+static std::vector<uint8_t> mspStream;
+
+static float noise(void)
+{
+    return 2 * (rand() / (float)RAND_MAX) - 1;
+}
+
+static void mspRequest(uint8_t id, const uint8_t * payload=NULL, uint8_t size=0)
+{
+    uint8_t checksum = size ^ id;
+    mspStream.push_back('$');
+    mspStream.push_back('M');
+    mspStream.push_back('<');
+    mspStream.push_back(size);
+    mspStream.push_back(id);
+    for (uint8_t k=0; k<size; ++k) {
+        mspStream.push_back(payload[k]);
+        checksum ^= payload[k];
+    }
+    mspStream.push_back(checksum);
+}
+
+static void makeStreams(void)
+{
+    srand(0);
+
+    for (uint32_t k=0; k<STREAM; ++k) {
+
+        float t = k * GYRO_PERIOD_MICROS / 1.e6f;
+
+        // Rates of a few rad/sec, plus motor vibration at 180 Hz and sensor noise
+        for (uint8_t axis=0; axis<3; ++axis) {
+            gyroStream[k][axis] = 2 * sinf(2*M_PI*(0.5f+axis)*t) + 0.3f*sinf(2*M_PI*180*t) + 0.05f*noise();
+            eulerStream[k][axis] = 0.3f * sinf(2*M_PI*0.2f*(axis+1)*t);
+            accelStream[k][axis] = (axis == 2 ? 1 : 0) + 0.05f*noise();
+        }
+
+        headingStream[k] = hf::BinaryAngle::fromRadians(eulerStream[k][2]);
+
+        baroStream[k] = 1013.25f - 0.1f * t + 0.02f*noise();
+
+        // Sticks sweeping through their range, arming switch off
+        stickStream[k][0] = sinf(2*M_PI*0.3f*t);
+        stickStream[k][1] = 0.5f * sinf(2*M_PI*1.1f*t);
+        stickStream[k][2] = 0.5f * sinf(2*M_PI*0.7f*t);
+        stickStream[k][3] = 0.2f * sinf(2*M_PI*0.4f*t);
+        stickStream[k][4] = -1;
+
+        demandStream[k].throttle = 0.5f + 0.2f * sinf(2*M_PI*0.3f*t);
+        demandStream[k].roll     = 0.3f * sinf(2*M_PI*1.1f*t);
+        demandStream[k].pitch    = 0.3f * sinf(2*M_PI*0.7f*t);
+        demandStream[k].yaw      = 0.1f * sinf(2*M_PI*0.4f*t);
+        demandStream[k].aux      = 0;
+    }
+
+    // What a ground station polls for, plus motor commands
+    float motors[4] = {0, 0, 0, 0};
+    for (uint8_t k=0; k<8; ++k) {
+        mspRequest(122);
+        mspRequest(121);
+        mspRequest(123);
+        mspRequest(215, (const uint8_t *)motors, sizeof(motors));
+    }
+}
+
+// Timing -----------------------------------------------------------------------------------------------------
+
+typedef struct {
+    double min, median, mean, stddev;
+} stats_t;
+
+template <typename F>
+static stats_t measure(uint32_t repetitions, F kernel)
+{
+    std::vector<double> ns(repetitions);
+
+    // One untimed repetition warms caches and branch predictors
+    for (uint32_t k=0; k<CALLS; ++k) {
+        kernel(k);
+    }
+
+    for (uint32_t r=0; r<repetitions; ++r) {
+
+        auto start = std::chrono::steady_clock::now();
+
+        for (uint32_t k=0; k<CALLS; ++k) {
+            kernel(k);
+        }
+
+        auto stop = std::chrono::steady_clock::now();
+
+        ns[r] = std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count() / (double)CALLS;
+    }
+
+    std::sort(ns.begin(), ns.end());
+
+    stats_t s;
+    s.min = ns[0];
+    s.median = ns[repetitions/2];
+    s.mean = 0;
+    for (double x : ns) {
+        s.mean += x;
+    }
+    s.mean /= repetitions;
+    s.stddev = 0;
+    for (double x : ns) {
+        s.stddev += (x - s.mean) * (x - s.mean);
+    }
+    s.stddev = repetitions > 1 ? sqrt(s.stddev / (repetitions - 1)) : 0;
+
+    return s;
+}
+
+static void report(const char * name, const stats_t & s)
+{
+    printf("%-42s %8.2f %8.2f %8.2f %8.2f\n", name, s.min, s.median, s.mean, s.stddev);
+}
+
+int main(int argc, char ** argv)
+{
+    uint32_t repetitions = argc > 1 ? atoi(argv[1]) : 15;
+    if (repetitions < 1) {
+        repetitions = 1;
+    }
+
+    makeStreams();
+
+    printf("# %u repetitions of %u calls; nsec/call\n", repetitions, CALLS);
+    printf("# %-40s %8s %8s %8s %8s\n", "kernel", "min", "median", "mean", "stddev");
+
+    // Same gains as batchtest; filters as a typical 1 kHz gyro loop would set them
+    hf::Stabilizer stabilizer = hf::Stabilizer(0.20f, 0.225f, 0.001875f, 0.375f, 1.0625f, 0.005625f);
+    stabilizer.init();
+    stabilizer.initFilters(1000, 100, 70);
+
+    report("Stabilizer::modifyDemands", measure(repetitions, [&](uint32_t k) {
+                demands_t demands = demandStream[k & (STREAM-1)];
+                stabilizer.modifyDemands(gyroStream[k & (STREAM-1)], demands);
+                keep(demands);
+                }));
+
+    hf::StabilizerT<float, BenchmarkGains> constant;
+    constant.init();
+    constant.initFilters(1000, 100, 70);
+
+    report("Stabilizer::modifyDemands (constant gains)", measure(repetitions, [&](uint32_t k) {
+                demands_t demands = demandStream[k & (STREAM-1)];
+                constant.modifyDemands(gyroStream[k & (STREAM-1)], demands);
+                keep(demands);
+                }));
+
+    // Both have now seen the same inputs, so should agree to the bit
+    demands_t tunableDemands = demandStream[0], constantDemands = demandStream[0];
+    stabilizer.modifyDemands(gyroStream[0], tunableDemands);
+    constant.modifyDemands(gyroStream[0], constantDemands);
+    printf("# constant gains %s the tunable stabilizer\n",
+            memcmp(&tunableDemands, &constantDemands, sizeof(demands_t)) ? "DIFFER FROM" : "match");
+
+    report("Stabilizer::updateEulerAngles", measure(repetitions, [&](uint32_t k) {
+                stabilizer.updateEulerAngles(eulerStream[k & (STREAM-1)]);
+                keep(stabilizer);
+                }));
+
+    NullBoard board;
+    hf::MixerQuadX mixer;
+    mixer.init(&board);
+
+    report("Mixer::runArmed (null board)", measure(repetitions, [&](uint32_t k) {
+                mixer.runArmed(demandStream[k & (STREAM-1)], &board);
+                }));
+
+    hf::IMU imu;
+    imu.init();
+
+    report("IMU::updateGyro", measure(repetitions, [&](uint32_t k) {
+                imu.updateGyro(gyroStream[k & (STREAM-1)], k * GYRO_PERIOD_MICROS);
+                }));
+
+    report("IMU::updateAccel", measure(repetitions, [&](uint32_t k) {
+                imu.updateAccel(accelStream[k & (STREAM-1)], k * GYRO_PERIOD_MICROS);
+                }));
+
+    imu.init(hf::IMU::PROPAGATE_QUATERNION);
+
+    report("IMU::updateAccel (quaternion)", measure(repetitions, [&](uint32_t k) {
+                imu.updateAccel(accelStream[k & (STREAM-1)], k * GYRO_PERIOD_MICROS);
+                }));
+
+    hf::AltitudeEstimator altitude = hf::AltitudeEstimator(15, 15, 15, 1);
+    altitude.init();
+
+    // Calibrate at rest, then time the armed (estimating) path
+    for (uint32_t k=0; k<1000; ++k) {
+        altitude.updateBaro(false, baroStream[0], k * GYRO_PERIOD_MICROS);
+    }
+
+    report("AltitudeEstimator::updateBaro", measure(repetitions, [&](uint32_t k) {
+                altitude.updateBaro(true, baroStream[k & (STREAM-1)], (1000 + k) * GYRO_PERIOD_MICROS);
+                }));
+
+    hf::AltitudeEstimatorT<hf::BarometerT<hf::PressureDecimator<>>> decimated(15, 15, 15, 1);
+    decimated.init();
+
+    for (uint32_t k=0; k<1000; ++k) {
+        decimated.updateBaro(false, baroStream[0], k * GYRO_PERIOD_MICROS);
+    }
+
+    report("AltitudeEstimator::updateBaro (decimator)", measure(repetitions, [&](uint32_t k) {
+                decimated.updateBaro(true, baroStream[k & (STREAM-1)], (1000 + k) * GYRO_PERIOD_MICROS);
+                }));
+
+    hf::AltitudeEstimator kalman = hf::AltitudeEstimator(15, 15, 15, 1);
+    kalman.useKalmanFilter(100);
+    kalman.init();
+
+    for (uint32_t k=0; k<1000; ++k) {
+        kalman.updateBaro(false, baroStream[0], k * GYRO_PERIOD_MICROS);
+    }
+
+    report("AltitudeEstimator::updateBaro (Kalman)", measure(repetitions, [&](uint32_t k) {
+                kalman.updateBaro(true, baroStream[k & (STREAM-1)], (1000 + k) * GYRO_PERIOD_MICROS);
+                }));
+
+    StreamReceiver receiver;
+    receiver.stream = stickStream;
+    receiver.init();
+
+    report("Receiver::getDemands", measure(repetitions, [&](uint32_t k) {
+                receiver.getDemands(headingStream[k & (STREAM-1)], k * GYRO_PERIOD_MICROS);
+                }));
+
+    receiver.headless = true;
+
+    report("Receiver::getDemands (headless)", measure(repetitions, [&](uint32_t k) {
+                receiver.getDemands(headingStream[k & (STREAM-1)], k * GYRO_PERIOD_MICROS);
+                }));
+
+    receiver.headless = false;
+
+    hf::MSP msp;
+    msp.init();
+
+    hf::Profiler profiler;
+    profiler.init();
+
+    hf::GyroSpectrum spectrum;
+
+    hf::GainBuffer gains;
+    hf::gains_t initialGains = {};
+    gains.init(initialGains);
+
+    float eulerAngles[3] = {0.1f, -0.2f, 1.5f};
+
+    // One snapshot throughout, so attitude and stick replies after the first of each come from the cache
+    hf::VehicleState state;
+    state.publish(eulerAngles, &receiver);
+    hf::ReplyCache replies;
+    replies.refresh(&state);
+
+    hf::MSPContext context = {&state, &mixer, &profiler, &spectrum, &gains, 0, 0};
+    msp.bind(&replies, &context);
+
+    report("MSP::update (per byte, replies drained)", measure(repetitions, [&](uint32_t k) {
+                msp.update(mspStream[k % mspStream.size()]);
+                while (msp.availableBytes() > 0) {
+                    uint8_t c = msp.readByte();
+                    keep(c);
+                }
+                }));
+
+    // The same requests, handed over in chunks the size of a serial pass's budget
+    const uint16_t MSP_CHUNK = 64;
+    mspStream.insert(mspStream.end(), mspStream.begin(), mspStream.begin() + MSP_CHUNK);
+
+    report("MSP::parse (per 64-byte chunk, drained)", measure(repetitions, [&](uint32_t k) {
+                msp.parse(&mspStream[(k * MSP_CHUNK) % (mspStream.size() - MSP_CHUNK)], MSP_CHUNK);
+                while (msp.availableBytes() > 0) {
+                    uint8_t c = msp.readByte();
+                    keep(c);
+                }
+                }));
+
+    return 0;
+}
@@ -0,0 +1,242 @@
+/*
+   columns.hpp : Append-only columnar binary output for simulation sweeps
+
+   A file starts with a schema header, then holds any number of chunks, each a run of rows stored column by
+   column, so that every column of every chunk is one contiguous little-endian array at an 8-byte-aligned offset:
+
+       header   "HFCOLUMN", uint32 version, uint32 column count, uint32 header size, uint32 zero,
+                then per column a NUL-padded name[32] and a NumPy type string[8] (e.g. "<f4")
+       chunk    "CHNK", uint32 row count, then each column's values, padded to a multiple of 8 bytes
+
+   Producers fill a ColumnChunk of their own, one row at a time, and hand it to the ColumnWriter when it is full,
+   which takes a lock only to append the whole chunk; so threads never contend per row, and the file is written
+   a chunk at a time.  A file cut short (e.g. by a crash) still reads up to its last whole chunk.  columns.py
+   reads the files through a memory map, as NumPy arrays.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <mutex>
+#include <vector>
+
+// NumPy type strings for the column types supported
+template <typename T> struct ColumnType;
+template <> struct ColumnType<float>    { static const char * dtype(void) { return "<f4"; } };
+template <> struct ColumnType<double>   { static const char * dtype(void) { return "<f8"; } };
+template <> struct ColumnType<int32_t>  { static const char * dtype(void) { return "<i4"; } };
+template <> struct ColumnType<uint32_t> { static const char * dtype(void) { return "<u4"; } };
+template <> struct ColumnType<uint8_t>  { static const char * dtype(void) { return "|u1"; } };
+
+class ColumnSchema {
+
+    public:
+
+        static const uint8_t NAME_SIZE  = 32;
+        static const uint8_t DTYPE_SIZE = 8;
+
+        typedef struct {
+            char   name[NAME_SIZE];
+            char   dtype[DTYPE_SIZE];
+            size_t size;
+        } column_t;
+
+        // Adds a column of values of type T, returning its index
+        template <typename T>
+        size_t add(const char * name)
+        {
+            column_t c;
+            memset(&c, 0, sizeof(c));
+            strncpy(c.name, name, NAME_SIZE-1);
+            strncpy(c.dtype, ColumnType<T>::dtype(), DTYPE_SIZE-1);
+            c.size = sizeof(T);
+            _columns.push_back(c);
+            return _columns.size() - 1;
+        }
+
+        size_t count(void) const
+        {
+            return _columns.size();
+        }
+
+        const column_t & operator[](size_t k) const
+        {
+            return _columns[k];
+        }
+
+    private:
+
+        std::vector<column_t> _columns;
+
+}; // class ColumnSchema
+
+// Rows to be appended together, kept column by column
+class ColumnChunk {
+
+    public:
+
+        ColumnChunk(const ColumnSchema & schema, uint32_t capacity) :
+            _schema(schema), _capacity(capacity), _rows(0), _data(schema.count())
+        {
+            for (size_t k=0; k<schema.count(); ++k) {
+                _data[k].resize(capacity * schema[k].size);
+            }
+        }
+
+        // Sets a column of the row being filled; the type must be the column's
+        template <typename T>
+        void set(size_t column, T value)
+        {
+            memcpy(&_data[column][_rows * sizeof(T)], &value, sizeof(T));
+        }
+
+        // Completes the row being filled, returning true when the chunk is full
+        bool next(void)
+        {
+            return ++_rows == _capacity;
+        }
+
+        uint32_t rows(void) const
+        {
+            return _rows;
+        }
+
+        void clear(void)
+        {
+            _rows = 0;
+        }
+
+        const uint8_t * column(size_t k) const
+        {
+            return &_data[k][0];
+        }
+
+        const ColumnSchema & schema(void) const
+        {
+            return _schema;
+        }
+
+    private:
+
+        const ColumnSchema & _schema;
+        uint32_t _capacity;
+        uint32_t _rows;
+        std::vector<std::vector<uint8_t>> _data;
+
+}; // class ColumnChunk
+
+class ColumnWriter {
+
+    public:
+
+        static const uint32_t VERSION = 1;
+
+        // Bytes of output buffered before each write to the file
+        static const size_t BUFFER_SIZE = 1 << 20;
+
+        // Creates the file and writes the schema; check ok() after
+        ColumnWriter(const char * filename, const ColumnSchema & schema) :
+            _schema(schema), _buffer(BUFFER_SIZE)
+        {
+            _fp = fopen(filename, "wb");
+
+            if (!_fp) {
+                return;
+            }
+
+            setvbuf(_fp, &_buffer[0], _IOFBF, BUFFER_SIZE);
+
+            uint32_t version = VERSION;
+            uint32_t count = schema.count();
+            uint32_t headerSize = pad(24 + count * (ColumnSchema::NAME_SIZE + ColumnSchema::DTYPE_SIZE));
+            uint32_t zero = 0;
+
+            fwrite("HFCOLUMN", 1, 8, _fp);
+            fwrite(&version, 4, 1, _fp);
+            fwrite(&count, 4, 1, _fp);
+            fwrite(&headerSize, 4, 1, _fp);
+            fwrite(&zero, 4, 1, _fp);
+
+            for (uint32_t k=0; k<count; ++k) {
+                fwrite(schema[k].name, 1, ColumnSchema::NAME_SIZE, _fp);
+                fwrite(schema[k].dtype, 1, ColumnSchema::DTYPE_SIZE, _fp);
+            }
+
+            writePadding(24 + count * (ColumnSchema::NAME_SIZE + ColumnSchema::DTYPE_SIZE));
+        }
+
+        ~ColumnWriter(void)
+        {
+            if (_fp) {
+                fclose(_fp);
+            }
+        }
+
+        ColumnWriter(const ColumnWriter &) = delete;
+        ColumnWriter & operator=(const ColumnWriter &) = delete;
+
+        bool ok(void) const
+        {
+            return _fp != NULL;
+        }
+
+        // Appends the chunk's rows and clears it; safe to call from any thread
+        void write(ColumnChunk & chunk)
+        {
+            uint32_t rows = chunk.rows();
+
+            if (rows == 0 || !_fp) {
+                return;
+            }
+
+            std::lock_guard<std::mutex> guard(_lock);
+
+            fwrite("CHNK", 1, 4, _fp);
+            fwrite(&rows, 4, 1, _fp);
+
+            for (size_t k=0; k<_schema.count(); ++k) {
+                size_t bytes = rows * _schema[k].size;
+                fwrite(chunk.column(k), 1, bytes, _fp);
+                writePadding(bytes);
+            }
+
+            chunk.clear();
+        }
+
+    private:
+
+        const ColumnSchema & _schema;
+
+        FILE * _fp;
+        std::vector<char> _buffer;
+        std::mutex _lock;
+
+        static size_t pad(size_t bytes)
+        {
+            return (bytes + 7) & ~(size_t)7;
+        }
+
+        void writePadding(size_t bytes)
+        {
+            static const uint8_t ZEROS[8] = {0};
+            fwrite(ZEROS, 1, pad(bytes) - bytes, _fp);
+        }
+
+}; // class ColumnWriter
@@ -0,0 +1,135 @@
+#!/usr/bin/env python3
+'''
+columns.py : Reads the columnar metrics files that batchtest writes, as NumPy arrays over a memory map
+
+Usage: columns.py FILE [COLUMN ...]
+
+Prints each column's row count, mean, minimum, and maximum (all columns' by default).  As a module:
+
+    import columns
+    runs = columns.read('sweep-runs.hfc')         # dict of column name -> array, every chunk's rows
+    for chunk in columns.chunks('sweep-steps.hfc'):
+        ...                                       # dict of column name -> array, one chunk's rows
+
+chunks() makes no copies: each array is a view on the mapped file.  read() concatenates them, once per column.
+For Arrow, pyarrow.table(columns.read(path)) takes the arrays as they are.
+
+The layout is in columns.hpp.
+
+This file is part of Hackflight.
+
+Hackflight is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Hackflight is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+'''
+
+import struct
+import sys
+
+import numpy as np
+
+MAGIC       = b'HFCOLUMN'
+CHUNK_MAGIC = b'CHNK'
+VERSION     = 1
+
+NAME_SIZE  = 32
+DTYPE_SIZE = 8
+
+
+def pad(size):
+    return (size + 7) & ~7
+
+
+def schema(mem):
+    '''Returns the (name, dtype) of each column, and the offset of the first chunk'''
+
+    if bytes(mem[:8]) != MAGIC:
+        raise ValueError('not a column file')
+
+    version, count, header_size, _ = struct.unpack_from('<4I', mem, 8)
+    if version != VERSION:
+        raise ValueError('column file version %d, not %d' % (version, VERSION))
+
+    columns = []
+    for k in range(count):
+        offset = 24 + k * (NAME_SIZE + DTYPE_SIZE)
+        name = bytes(mem[offset:offset+NAME_SIZE]).split(b'\0')[0].decode()
+        dtype = bytes(mem[offset+NAME_SIZE:offset+NAME_SIZE+DTYPE_SIZE]).split(b'\0')[0].decode()
+        columns.append((name, np.dtype(dtype)))
+
+    return columns, header_size
+
+
+def chunks(path):
+    '''Yields each whole chunk of the file as a dict of column name -> array view'''
+
+    mem = np.memmap(path, dtype=np.uint8, mode='r')
+
+    columns, offset = schema(mem)
+
+    while offset + 8 <= len(mem):
+
+        if bytes(mem[offset:offset+4]) != CHUNK_MAGIC:
+            raise ValueError('bad chunk at offset %d' % offset)
+
+        rows = struct.unpack_from('<I', mem, offset+4)[0]
+        end = offset + 8 + sum(pad(rows * dtype.itemsize) for _, dtype in columns)
+
+        # A chunk cut short ends the file
+        if end > len(mem):
+            break
+
+        offset += 8
+        chunk = {}
+        for name, dtype in columns:
+            chunk[name] = mem[offset:offset + rows * dtype.itemsize].view(dtype)
+            offset += pad(rows * dtype.itemsize)
+
+        yield chunk
+
+
+def read(path):
+    '''Returns every row of the file as a dict of column name -> array'''
+
+    mem = np.memmap(path, dtype=np.uint8, mode='r')
+    columns, _ = schema(mem)
+
+    parts = {name: [] for name, _ in columns}
+    for chunk in chunks(path):
+        for name in parts:
+            parts[name].append(chunk[name])
+
+    return {name: np.concatenate(parts[name]) if parts[name] else np.zeros(0, dtype)
+            for name, dtype in columns}
+
+
+def main():
+
+    if len(sys.argv) < 2:
+        print(__doc__.split('\n\n')[1])
+        sys.exit(1)
+
+    table = read(sys.argv[1])
+    names = sys.argv[2:] if len(sys.argv) > 2 else table.keys()
+
+    print('# column rows mean min max')
+
+    for name in names:
+        values = table[name]
+        if len(values):
+            print('%-16s %10d %12.6g %12.6g %12.6g' %
+                    (name, len(values), values.mean(), values.min(), values.max()))
+        else:
+            print('%-16s %10d' % (name, 0))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,286 @@
+/*
+   cosimtest.cpp : Flies Hackflight in lockstep with a physics engine over UDP
+
+   Usage: cosimtest [SECONDS [BATCH]]              flies against a built-in engine and checks it against SimBoard
+          cosimtest engine PORT [BATCH]            runs the built-in engine on its own
+          cosimtest fly HOST PORT [SECONDS [BATCH]] flies against an engine somewhere else
+
+   The built-in engine is SimBoard's own physics behind the CoSimBoard protocol (see boards/sim/cosim.hpp), so
+   with a batch of one the flight should come out identical to flying SimBoard directly.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <hackflight.hpp>
+#include <receivers/sim/scripted.hpp>
+#include <boards/sim/linux-console.hpp>
+#include <boards/sim/cosim.hpp>
+
+static const uint32_t GYRO_RATE = 1000;
+
+// Same gains as batchtest
+static hf::Stabilizer stabilizer = hf::Stabilizer(0.20f, 0.225f, 0.001875f, 0.375f, 1.0625f, 0.005625f);
+
+// Arm, climb, then roll and pitch doublets
+static void script(float t, float rawvals[])
+{
+    bool arming = t < 1;
+    rawvals[0] = arming ? -1 : 0;
+    rawvals[1] = (t > 3 && t < 3.5) ? +0.3f : (t > 3.5 && t < 4) ? -0.3f : 0;
+    rawvals[2] = (t > 5 && t < 5.5) ? +0.3f : (t > 5.5 && t < 6) ? -0.3f : 0;
+    rawvals[3] = arming ? +1 : 0;
+    rawvals[4] = -1;
+}
+
+// Engine ------------------------------------------------------------------------------------------------------
+
+class Engine {
+
+    public:
+
+        hf::SimBoard physics = hf::SimBoard(GYRO_RATE);
+
+        uint32_t steps = 0;
+
+        std::atomic<bool> running;
+
+        // Binds to port on all interfaces (zero picks a free one), returning the port or zero on failure
+        uint16_t open(uint16_t port, uint8_t batch)
+        {
+            _batch = batch;
+
+            _sock = socket(AF_INET, SOCK_DGRAM, 0);
+
+            struct sockaddr_in addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_ANY);
+            addr.sin_port = htons(port);
+
+            socklen_t len = sizeof(addr);
+            if (bind(_sock, (struct sockaddr *)&addr, len) || getsockname(_sock, (struct sockaddr *)&addr, &len)) {
+                return 0;
+            }
+
+            physics.init();
+            running = true;
+
+            return ntohs(addr.sin_port);
+        }
+
+        void run(void)
+        {
+            hf::CoSimBoard::motor_packet_t request;
+            hf::CoSimBoard::sensor_packet_t reply;
+            uint16_t replySize = 0;
+            bool answered = false;
+
+            while (running) {
+
+                struct pollfd pfd = {_sock, POLLIN, 0};
+                if (poll(&pfd, 1, 100) <= 0) {
+                    continue;
+                }
+
+                struct sockaddr_storage from;
+                socklen_t fromLength = sizeof(from);
+                uint8_t packet[sizeof(request)];
+                int n = recvfrom(_sock, packet, sizeof(packet), 0, (struct sockaddr *)&from, &fromLength);
+
+                if (n < hf::CoSimBoard::MOTOR_HEADER_SIZE) {
+                    continue;
+                }
+
+                memcpy(&request, packet, hf::CoSimBoard::MOTOR_HEADER_SIZE);
+
+                if (request.magic != hf::CoSimBoard::MOTOR_MAGIC ||
+                        n < hf::CoSimBoard::MOTOR_HEADER_SIZE + request.ticks*request.nmotors*(int)sizeof(float)) {
+                    continue;
+                }
+
+                // A resend of what we've already answered gets the same answer, without stepping again
+                if (!answered || request.sequence != reply.sequence) {
+
+                    // Step once per tick flown with that tick's motors, then for the rest of the batch hold the
+                    // last motors (the flight code hasn't had a chance to change them yet)
+                    uint8_t frames = request.batch < _batch ? request.batch : _batch;
+                    const float * motors = (const float *)&packet[hf::CoSimBoard::MOTOR_HEADER_SIZE];
+
+                    for (uint8_t k=0; k<frames; ++k) {
+                        if (k < request.ticks) {
+                            physics.writeMotors(&motors[k*request.nmotors], request.nmotors);
+                        }
+                        step(reply.frame[k]);
+                    }
+
+                    reply.magic = hf::CoSimBoard::SENSOR_MAGIC;
+                    reply.sequence = request.sequence;
+                    reply.frames = frames;
+                    replySize = hf::CoSimBoard::SENSOR_HEADER_SIZE + frames*sizeof(hf::CoSimBoard::frame_t);
+                    answered = true;
+                }
+
+                sendto(_sock, &reply, replySize, 0, (struct sockaddr *)&from, fromLength);
+            }
+
+            close(_sock);
+        }
+
+    private:
+
+        int     _sock;
+        uint8_t _batch;
+
+        void step(hf::CoSimBoard::frame_t & frame)
+        {
+            frame.flags = 0;
+
+            if (physics.getGyroRates(frame.gyroRates)) {
+                frame.flags |= hf::CoSimBoard::HAVE_GYRO;
+            }
+            if (physics.getEulerAngles(frame.eulerAngles)) {
+                frame.flags |= hf::CoSimBoard::HAVE_EULER;
+            }
+            if (physics.getAccelerometer(frame.accelGs)) {
+                frame.flags |= hf::CoSimBoard::HAVE_ACCEL;
+            }
+            if (physics.getBarometer(frame.pressure)) {
+                frame.flags |= hf::CoSimBoard::HAVE_BARO;
+            }
+
+            frame.timeMicros = physics.getMicroseconds();
+
+            steps++;
+        }
+};
+
+// Flight ------------------------------------------------------------------------------------------------------
+
+static bool fly(hf::CoSimBoard & board, float duration)
+{
+    hf::HackflightT<hf::CoSimBoard, hf::ScriptedReceiver> hackflight;
+    hf::ScriptedReceiver receiver = hf::ScriptedReceiver(&board, script);
+
+    hackflight.init(&board, &receiver, &stabilizer);
+
+    uint32_t steps = (uint32_t)(duration * GYRO_RATE);
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (uint32_t k=0; k<steps && board.cosimConnected(); ++k) {
+        hackflight.update();
+    }
+
+    double sec = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count() / 1e6;
+
+    printf("Flew %.1f simulated seconds in %.3f sec: %u exchanges (%.1f usec each), %u resent\n",
+            board.getMicroseconds()/1e6, sec, board.cosimExchanges(),
+            board.cosimExchanges() ? 1e6*sec/board.cosimExchanges() : 0, board.cosimRetries());
+
+    return board.cosimConnected();
+}
+
+static int selfTest(float duration, uint8_t batch)
+{
+    // Reference: the same flight on SimBoard directly
+    hf::HackflightT<hf::SimBoard, hf::ScriptedReceiver> reference;
+    hf::SimBoard simboard = hf::SimBoard(GYRO_RATE);
+    hf::ScriptedReceiver receiver = hf::ScriptedReceiver(&simboard, script);
+    reference.init(&simboard, &receiver, &stabilizer);
+    for (uint32_t k=0; k<(uint32_t)(duration * GYRO_RATE); ++k) {
+        reference.update();
+    }
+
+    Engine engine;
+    uint16_t port = engine.open(0, batch);
+    if (!port) {
+        fprintf(stderr, "Unable to bind engine socket\n");
+        return 1;
+    }
+    std::thread thread(&Engine::run, &engine);
+
+    hf::CoSimBoard board = hf::CoSimBoard("127.0.0.1", port, 4, batch);
+    bool ok = fly(board, duration);
+
+    engine.running = false;
+    thread.join();
+
+    if (!ok) {
+        return 1;
+    }
+
+    float g[3], v[3], p[3], e[3], m[4];
+    float rg[3], rv[3], rp[3], re[3], rm[4];
+    engine.physics.simGetVehicleState(g, v, p, e, m);
+    simboard.simGetVehicleState(rg, rv, rp, re, rm);
+
+    float error = 0;
+    for (uint8_t k=0; k<3; ++k) {
+        error = fmaxf(error, fabsf(p[k] - rp[k]));
+        error = fmaxf(error, fabsf(e[k] - re[k]));
+    }
+
+    printf("Final position %+.3f %+.3f %+.3f (SimBoard %+.3f %+.3f %+.3f), largest difference %g\n",
+            p[0], p[1], p[2], rp[0], rp[1], rp[2], error);
+
+    // Batches longer than one add actuator delay, so only lockstep has to match exactly
+    if (batch == 1 && error > 0) {
+        printf("MISMATCH: lockstep flight differs from SimBoard\n");
+        return 2;
+    }
+
+    return 0;
+}
+
+int main(int argc, char ** argv)
+{
+    if (argc > 2 && !strcmp(argv[1], "engine")) {
+        Engine engine;
+        if (!engine.open(atoi(argv[2]), argc > 3 ? atoi(argv[3]) : hf::CoSimBoard::MAXBATCH)) {
+            fprintf(stderr, "Unable to bind port %s\n", argv[2]);
+            return 1;
+        }
+        engine.run();
+        return 0;
+    }
+
+    if (argc > 3 && !strcmp(argv[1], "fly")) {
+        hf::CoSimBoard board = hf::CoSimBoard(argv[2], atoi(argv[3]), 4, argc > 5 ? atoi(argv[5]) : 1);
+        return fly(board, argc > 4 ? atof(argv[4]) : 8) ? 0 : 1;
+    }
+
+    if (argc < 2 || isdigit(argv[1][0])) {
+        return selfTest(argc > 1 ? atof(argv[1]) : 8, argc > 2 ? atoi(argv[2]) : 1);
+    }
+
+    fprintf(stderr, "Usage: %s [SECONDS [BATCH]]\n       %s engine PORT [BATCH]\n       %s fly HOST PORT [SECONDS [BATCH]]\n",
+            argv[0], argv[0], argv[0]);
+    return 1;
+}
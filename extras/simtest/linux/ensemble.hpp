@@ -0,0 +1,195 @@
+/*
+   ensemble.hpp : Constant-memory statistics for Monte-Carlo ensembles of simulation runs
+
+   RunningStats keeps count, mean, variance (Welford's update, and Chan's formula to merge two), min, and max.
+   QuantileSketch keeps counts in logarithmic buckets, each RELATIVE_ACCURACY wider than the one below, so any
+   quantile it gives is within that fraction of the true one; merging two sketches just adds their counts, so the
+   quantiles don't depend on the order members finish in.  It is meant for metrics that can't go negative:
+   values under MIN_VALUE count as zero, and values over MAX_VALUE fall in the top bucket.  MetricStats is one of
+   each.  Memory is the same however many members are reduced.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+
+#include <algorithm>
+
+class RunningStats {
+
+    private:
+
+        uint64_t _count;
+        double   _mean;
+        double   _m2;      // sum of squared differences from the mean
+        double   _min;
+        double   _max;
+
+    public:
+
+        RunningStats(void) : _count(0), _mean(0), _m2(0), _min(0), _max(0) { }
+
+        void add(double x)
+        {
+            _min = _count ? std::min(_min, x) : x;
+            _max = _count ? std::max(_max, x) : x;
+            _count++;
+            double delta = x - _mean;
+            _mean += delta / _count;
+            _m2 += delta * (x - _mean);
+        }
+
+        void merge(const RunningStats & other)
+        {
+            if (!other._count) {
+                return;
+            }
+            if (!_count) {
+                *this = other;
+                return;
+            }
+            uint64_t count = _count + other._count;
+            double delta = other._mean - _mean;
+            _mean += delta * other._count / count;
+            _m2 += other._m2 + delta * delta * ((double)_count * other._count / count);
+            _min = std::min(_min, other._min);
+            _max = std::max(_max, other._max);
+            _count = count;
+        }
+
+        uint64_t count(void) const { return _count; }
+        double   mean(void) const  { return _mean; }
+        double   min(void) const   { return _min; }
+        double   max(void) const   { return _max; }
+
+        // Sample variance
+        double variance(void) const
+        {
+            return _count > 1 ? _m2 / (_count - 1) : 0;
+        }
+
+        double stdev(void) const
+        {
+            return sqrt(variance());
+        }
+
+}; // class RunningStats
+
+class QuantileSketch {
+
+    public:
+
+        static constexpr double RELATIVE_ACCURACY = 0.02;
+        static constexpr double MIN_VALUE = 1e-6;
+        static constexpr double MAX_VALUE = 1e3;
+
+        // Buckets from MIN_VALUE to MAX_VALUE, each (1+a)/(1-a) times as wide as the one below
+        static const uint16_t BUCKETS = 1 + (uint16_t)(20.72326584 / 0.04000533461); // ln(MAX/MIN) / ln(gamma)
+
+    private:
+
+        uint32_t _zeros;
+        uint32_t _buckets[BUCKETS];
+        uint64_t _count;
+
+        static double gamma(void)
+        {
+            return (1 + RELATIVE_ACCURACY) / (1 - RELATIVE_ACCURACY);
+        }
+
+    public:
+
+        QuantileSketch(void) : _zeros(0), _count(0)
+        {
+            std::fill(_buckets, _buckets+BUCKETS, 0);
+        }
+
+        void add(double x)
+        {
+            _count++;
+
+            if (!(x >= MIN_VALUE)) {
+                _zeros++;
+                return;
+            }
+
+            int k = (int)ceil(log(x / MIN_VALUE) / log(gamma()));
+            _buckets[std::min(std::max(k, 0), BUCKETS-1)]++;
+        }
+
+        void merge(const QuantileSketch & other)
+        {
+            _zeros += other._zeros;
+            for (uint16_t k=0; k<BUCKETS; ++k) {
+                _buckets[k] += other._buckets[k];
+            }
+            _count += other._count;
+        }
+
+        uint64_t count(void) const
+        {
+            return _count;
+        }
+
+        // The value at quantile q in [0,1]: the middle of the bucket holding the member of that rank
+        double quantile(double q) const
+        {
+            if (!_count) {
+                return 0;
+            }
+
+            uint64_t rank = (uint64_t)(q * (_count - 1));
+
+            if (rank < _zeros) {
+                return 0;
+            }
+
+            uint64_t seen = _zeros;
+
+            for (uint16_t k=0; k<BUCKETS; ++k) {
+                seen += _buckets[k];
+                if (seen > rank) {
+                    return MIN_VALUE * pow(gamma(), k) * 2 / (1 + gamma());
+                }
+            }
+
+            return MAX_VALUE;
+        }
+
+}; // class QuantileSketch
+
+class MetricStats {
+
+    public:
+
+        RunningStats   stats;
+        QuantileSketch sketch;
+
+        void add(double x)
+        {
+            stats.add(x);
+            sketch.add(x);
+        }
+
+        void merge(const MetricStats & other)
+        {
+            stats.merge(other.stats);
+            sketch.merge(other.sketch);
+        }
+
+}; // class MetricStats
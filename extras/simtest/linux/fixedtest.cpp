@@ -0,0 +1,120 @@
+/*
+   fixedtest.cpp : Compares the Q16.16 fixed-point stabilizer/mixer core with the float core in simulation
+
+   Usage: fixedtest
+
+   Flies each scripted scenario twice on a simulated clock, once with each core, and reports how far the
+   fixed-point motor outputs and attitude stray from the float ones.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <stdio.h>
+
+#include <vector>
+
+#include <hackflight.hpp>
+#include <fixed.hpp>
+#include <receivers/sim/scripted.hpp>
+#include <boards/sim/linux-console.hpp>
+
+static const uint32_t GYRO_RATE = 1000;
+
+typedef struct {
+
+    float motors[4];
+    float euler[3];
+
+} sample_t;
+
+// Arm, climb, then roll and pitch doublets
+static void script(float t, float rawvals[])
+{
+    bool arming = t < 1;
+    rawvals[0] = arming ? -1 : 0;
+    rawvals[1] = (t > 3 && t < 3.5) ? +0.3f : (t > 3.5 && t < 4) ? -0.3f : 0;
+    rawvals[2] = (t > 5 && t < 5.5) ? +0.3f : (t > 5.5 && t < 6) ? -0.3f : 0;
+    rawvals[3] = arming ? +1 : 0;
+    rawvals[4] = -1;
+}
+
+template <typename T>
+static void fly(float duration, std::vector<sample_t> & samples)
+{
+    hf::HackflightT<hf::SimBoard, hf::ScriptedReceiver, hf::MixerT<hf::MixerQuadXTable<>, T>, hf::StabilizerT<T> > hackflight;
+
+    hf::SimBoard board = hf::SimBoard(GYRO_RATE);
+    hf::ScriptedReceiver receiver = hf::ScriptedReceiver(&board, script);
+
+    hf::StabilizerT<T> stabilizer = hf::StabilizerT<T>(
+            0.20f,      // Level P
+            0.225f,     // Gyro cyclic P
+            0.001875f,  // Gyro cyclic I
+            0.375f,     // Gyro cyclic D
+            1.0625f,    // Gyro yaw P
+            0.005625f); // Gyro yaw I
+
+    hackflight.init(&board, &receiver, &stabilizer);
+
+    uint32_t steps = (uint32_t)(duration * GYRO_RATE);
+
+    for (uint32_t k=0; k<steps; ++k) {
+        hackflight.update();
+        sample_t s;
+        float gyroRates[3], translationRates[3], position[3];
+        board.simGetVehicleState(gyroRates, translationRates, position, s.euler, s.motors);
+        samples.push_back(s);
+    }
+}
+
+int main(int argc, char ** argv)
+{
+    (void)argc;
+    (void)argv;
+
+    const float duration = 8;
+
+    std::vector<sample_t> floatSamples, fixedSamples;
+
+    fly<float>(duration, floatSamples);
+    fly<hf::Q16_16>(duration, fixedSamples);
+
+    double motorSq = 0, eulerSq = 0;
+    float motorMax = 0, eulerMax = 0;
+
+    for (size_t k=0; k<floatSamples.size(); ++k) {
+
+        for (uint8_t i=0; i<4; ++i) {
+            float d = fabs(fixedSamples[k].motors[i] - floatSamples[k].motors[i]);
+            motorSq += d*d;
+            if (d > motorMax) motorMax = d;
+        }
+
+        for (uint8_t i=0; i<3; ++i) {
+            float d = fabs(fixedSamples[k].euler[i] - floatSamples[k].euler[i]);
+            eulerSq += d*d;
+            if (d > eulerMax) eulerMax = d;
+        }
+    }
+
+    size_t n = floatSamples.size();
+
+    printf("Q16.16 vs float over %zu steps:\n", n);
+    printf("  motor output   RMS %.3e  max %.3e\n", sqrt(motorSq / (4*n)), motorMax);
+    printf("  attitude (rad) RMS %.3e  max %.3e\n", sqrt(eulerSq / (3*n)), eulerMax);
+
+    return 0;
+}
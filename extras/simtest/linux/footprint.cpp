@@ -0,0 +1,149 @@
+/*
+   footprint.cpp : What each optional subsystem (see features.hpp) costs in RAM and code
+
+   Usage: footprint
+
+   Builds a stand-in real board and receiver with every feature set, and prints the RAM they take together with
+   Hackflight: first with everything in, then with just the angle-stabilization core, then what each subsystem
+   adds on its own.  RAM sizes come from sizeof, so they hold for any target with the same type sizes and
+   alignment as this host.
+
+   Compiled with -DFOOTPRINT_FEATURES=<set> (e.g. NoAltitude), the program flies only that set, so its code size
+   is that set's; 'make codesize' does this for every set, optimizing for size and dropping unused sections as the
+   embedded toolchains do.  Host code sizes differ from a target's, but the differences between sets carry over.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+
+#include <hackflight.hpp>
+#include <features.hpp>
+#include <boards/real/realboard.hpp>
+
+// Everything but one subsystem
+struct NoAltitude     : hf::AllFeatures { static const bool ALTITUDE      = false; };
+struct NoSerial       : hf::AllFeatures { static const bool SERIAL        = false; };
+struct NoHeadless     : hf::AllFeatures { static const bool HEADLESS      = false; };
+struct NoBlackbox     : hf::AllFeatures { static const bool BLACKBOX      = false; };
+struct NoDynamicNotch : hf::AllFeatures { static const bool DYNAMIC_NOTCH = false; };
+struct NoRcSmoothing  : hf::AllFeatures { static const bool RC_SMOOTHING  = false; };
+struct NoDebugLog     : hf::AllFeatures { static const bool DEBUG_LOG     = false; };
+
+// Sensor values the compiler can't see through, so no code path is folded away
+static volatile float sensor = 0;
+static volatile bool  fresh = false;
+
+// Real boards print debug messages on their serial ports
+uint16_t hf::Board::outbufWrite(const uint8_t * buf, uint16_t len)
+{
+    fresh = buf[0];
+    return len;
+}
+
+template <class Features>
+class FootprintBoard final : public hf::RealBoardT<Features> {
+
+    public:
+
+        void     init(void) { hf::RealBoardT<Features>::init(); }
+        bool     getEulerAngles(float eulerAngles[3]) { eulerAngles[0] = eulerAngles[1] = eulerAngles[2] = sensor; return fresh; }
+        bool     getGyroRates(float gyroRates[3]) { gyroRates[0] = gyroRates[1] = gyroRates[2] = sensor; return fresh; }
+        bool     getAccelerometer(float accelGs[3]) { accelGs[0] = accelGs[1] = accelGs[2] = sensor; return fresh; }
+        bool     getBarometer(float & pressure) { pressure = sensor; return fresh; }
+        uint32_t getMicroseconds() { return (uint32_t)sensor; }
+        void     writeMotor(uint8_t index, float value) { (void)index; sensor = value; }
+        bool     hasBlackbox(void) { return fresh; }
+        uint16_t blackboxWrite(const uint8_t * buf, uint16_t len) { (void)buf; return fresh ? len : 0; }
+};
+
+class FootprintReceiver final : public hf::Receiver {
+
+    protected:
+
+        void begin(void) { }
+        bool gotNewFrame(void) { return fresh; }
+
+        void readRawvals(void)
+        {
+            for (uint8_t k=0; k<5; ++k) {
+                rawvals[k] = sensor;
+            }
+        }
+};
+
+template <class Features>
+struct Vehicle {
+
+    FootprintBoard<Features> board;
+    FootprintReceiver        receiver;
+    hf::Stabilizer           stabilizer = hf::Stabilizer(0.2f, 0.2f, 0.1f, 0.01f, 0.1f, 0.01f);
+
+    hf::HackflightT<FootprintBoard<Features>, FootprintReceiver, hf::MixerQuadX, hf::Stabilizer, hf::AltitudeEstimator,
+        Features> hackflight;
+
+    void fly(uint32_t passes)
+    {
+        hackflight.init(&board, &receiver, &stabilizer);
+        hackflight.initDynamicNotch(1000, 80, 400);
+        hackflight.initRcSmoothing(hf::RcSmoother::RAMP);
+        for (uint32_t k=0; k<passes; ++k) {
+            hackflight.update();
+        }
+    }
+};
+
+// The vehicle, plus the static debug output queues: outbuf's always, DebugLog's when it is drained
+template <class Features>
+static unsigned ram(void)
+{
+    return sizeof(Vehicle<Features>) + hf::OutbufQueue::ramSize() + (Features::DEBUG_LOG ? hf::DebugLog::ramSize() : 0);
+}
+
+template <class Features>
+static void reportSubsystem(const char * name)
+{
+    printf("  %-14s %6u\n", name, ram<hf::AllFeatures>() - ram<Features>());
+}
+
+int main(int argc, char ** argv)
+{
+    (void)argv;
+
+    printf("RAM (bytes) for board, receiver, stabilizer, and Hackflight\n\n");
+    printf("  %-14s %6u\n", "all features", ram<hf::AllFeatures>());
+    printf("  %-14s %6u\n\n", "core only", ram<hf::CoreFeatures>());
+
+    printf("RAM (bytes) each subsystem adds\n\n");
+    reportSubsystem<NoAltitude>("altitude");
+    reportSubsystem<NoSerial>("serial");
+    reportSubsystem<NoHeadless>("headless");
+    reportSubsystem<NoBlackbox>("blackbox");
+    reportSubsystem<NoDynamicNotch>("dynamic notch");
+    reportSubsystem<NoRcSmoothing>("rc smoothing");
+    reportSubsystem<NoDebugLog>("debug log");
+
+#ifdef FOOTPRINT_FEATURES
+    // Runs only when given an argument, which the compiler can't rule out, so the set's code is all linked in
+    if (argc > 1) {
+        static Vehicle<FOOTPRINT_FEATURES> vehicle;
+        vehicle.fly(argc);
+    }
+#else
+    (void)argc;
+#endif
+
+    return 0;
+}
@@ -0,0 +1,177 @@
+/*
+   hiltest.cpp : Flies Hackflight on a HILBoard, against a SimBoard behind a HILBridge
+
+   Usage: hiltest [SECONDS [GYRO_HZ [FLUSH_USEC]]]
+
+   Stands a paced SimBoard in for the real board: a HILBridge on one thread streams its sensors over a socket
+   pair, in real time, to a LinuxHILBoard on another, which runs the flight code on them through a scripted
+   arm-and-climb and sends the motor values back.  Reports what crossed the link and how late, and where the
+   vehicle got to.  GYRO_HZ defaults to 1000 and FLUSH_USEC to the bridge's own.  Exits nonzero if the host
+   dropped any gyro samples for want of queue.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <linux/sockios.h>
+
+#include <atomic>
+#include <thread>
+
+#include <hackflight.hpp>
+#include <receivers/sim/scripted.hpp>
+#include <boards/sim/linux-console.hpp>
+#include <boards/real/hilbridge.hpp>
+#include <boards/hil/linux.hpp>
+
+// The bridge's end of the socket pair, as an Arduino Stream
+class SocketStream {
+
+    private:
+
+        int _fd;
+        int _sendBuffer;
+
+    public:
+
+        SocketStream(int fd) : _fd(fd)
+        {
+            socklen_t len = sizeof(_sendBuffer);
+            getsockopt(_fd, SOL_SOCKET, SO_SNDBUF, &_sendBuffer, &len);
+        }
+
+        int available(void)
+        {
+            int n = 0;
+            ioctl(_fd, FIONREAD, &n);
+            return n;
+        }
+
+        size_t readBytes(uint8_t * buf, size_t len)
+        {
+            ssize_t n = recv(_fd, buf, len, MSG_DONTWAIT);
+            return n > 0 ? n : 0;
+        }
+
+        int availableForWrite(void)
+        {
+            int queued = 0;
+            ioctl(_fd, SIOCOUTQ, &queued);
+            return _sendBuffer - queued;
+        }
+
+        size_t write(const uint8_t * buf, size_t len)
+        {
+            ssize_t n = send(_fd, buf, len, MSG_DONTWAIT);
+            return n > 0 ? n : 0;
+        }
+};
+
+// Arm with throttle down, yaw right; then bring throttle up to a climb
+static void climb(float t, float rawvals[])
+{
+    bool arming = t < 1;
+    rawvals[0] = arming ? -1 : 0;
+    rawvals[1] = 0;
+    rawvals[2] = 0;
+    rawvals[3] = arming ? +1 : 0;
+    rawvals[4] = -1;
+}
+
+int main(int argc, char ** argv)
+{
+    float    duration  = (argc > 1) ? atof(argv[1]) : 5;
+    uint32_t gyroHz    = (argc > 2) ? atoi(argv[2]) : 1000;
+    uint32_t flush     = (argc > 3) ? atoi(argv[3]) : hf::HILBridge<hf::SimBoard, SocketStream>::FLUSH_MICROS;
+
+    if (!(duration > 0) || gyroHz == 0 || gyroHz > 100000) {
+        fprintf(stderr, "Usage: hiltest [SECONDS [GYRO_HZ [FLUSH_USEC]]], with GYRO_HZ between 1 and 100000\n");
+        return 1;
+    }
+
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+        perror("socketpair");
+        return 1;
+    }
+
+    // The real board's side
+    hf::SimBoard physics(gyroHz);
+    physics.simSetPaced();
+    SocketStream stream(fds[0]);
+    hf::HILBridge<hf::SimBoard, SocketStream> bridge(physics, stream, flush);
+
+    std::atomic<bool> done(false);
+
+    std::thread firmware([&]() {
+        bridge.init();
+        while (!done) {
+            bridge.update();
+        }
+    });
+
+    // The host's side
+    hf::LinuxHILBoard board(fds[1]);
+    hf::ScriptedReceiver receiver = hf::ScriptedReceiver(&board, climb);
+
+    hf::Stabilizer stabilizer = hf::Stabilizer(
+            0.20f,      // Level P
+            0.225f,     // Gyro cyclic P
+            0.001875f,  // Gyro cyclic I
+            0.375f,     // Gyro cyclic D
+            1.0625f,    // Gyro yaw P
+            0.005625f); // Gyro yaw I
+
+    hf::HackflightT<hf::LinuxHILBoard, hf::ScriptedReceiver, hf::MixerQuadX, hf::Stabilizer> hackflight;
+
+    hackflight.init(&board, &receiver, &stabilizer);
+
+    uint32_t start = board.getMicroseconds();
+    while (board.getMicroseconds() - start < (uint32_t)(duration * 1e6)) {
+        hackflight.update();
+    }
+
+    done = true;
+    firmware.join();
+
+    hf::HILBridge<hf::SimBoard, SocketStream>::stats_t sent;
+    bridge.getStats(sent);
+
+    hf::LinuxHILBoard::stats_t received;
+    board.getStats(received);
+
+    float gyroRates[3], translationRates[3], position[3], eulerAngles[3], motors[4];
+    physics.simGetVehicleState(gyroRates, translationRates, position, eulerAngles, motors);
+
+    printf("Board:    %u samples in %u packets (%.1f per packet, %.0f packets/sec), %u dropped\n",
+            sent.samplesSent, sent.packetsSent, sent.packetsSent ? (float)sent.samplesSent / sent.packetsSent : 0,
+            sent.packetsSent / duration, sent.packetsDropped);
+    printf("Host:     %u packets, %u lost, %u bad; %u gyro samples read, %u overflowed\n",
+            received.packets, received.lostPackets, received.badPackets, received.gyroSamples, received.overflows);
+    printf("Age:      gyro sample to flight code min %u  mean %.1f  max %u usec\n",
+            received.gyroSamples ? received.ageMin : 0,
+            received.gyroSamples ? (double)received.ageSum / received.gyroSamples : 0, received.ageMax);
+    printf("Motors:   %u packets, %u bad, %u lost, %u timeouts; round trip min %u  mean %.1f  max %u usec\n",
+            sent.motorPackets, sent.badPackets, sent.lostPackets, sent.timeouts,
+            sent.motorPackets ? sent.roundTripMin : 0,
+            sent.motorPackets ? (double)sent.roundTripSum / sent.motorPackets : 0, sent.roundTripMax);
+    printf("Vehicle:  altitude %.2f m, roll %+.4f, pitch %+.4f\n", position[2], eulerAngles[0], eulerAngles[1]);
+
+    return received.overflows ? 1 : 0;
+}
@@ -0,0 +1,133 @@
+/*
+   replaytest.cpp : Records a simulated flight to a replay log, or replays a log and checks it bit-for-bit
+
+   Usage: replaytest record LOGFILE [SECONDS]
+          replaytest LOGFILE
+
+   Recording flies a scripted arm, climb, and roll/pitch doublets on a simulated clock.  Replaying runs the log back
+   through Hackflight as fast as possible, reports any gyro samples whose motor outputs differ from the recording,
+   and times the core per sample.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+
+#include <hackflight.hpp>
+#include <receivers/sim/scripted.hpp>
+#include <receivers/sim/replay.hpp>
+#include <boards/sim/linux-console.hpp>
+#include <boards/sim/replay.hpp>
+
+static const uint32_t GYRO_RATE = 1000;
+
+// Same gains as batchtest
+static hf::Stabilizer stabilizer = hf::Stabilizer(0.20f, 0.225f, 0.001875f, 0.375f, 1.0625f, 0.005625f);
+
+// Arm, climb, then roll and pitch doublets
+static void script(float t, float rawvals[])
+{
+    bool arming = t < 1;
+    rawvals[0] = arming ? -1 : 0;
+    rawvals[1] = (t > 3 && t < 3.5) ? +0.3f : (t > 3.5 && t < 4) ? -0.3f : 0;
+    rawvals[2] = (t > 5 && t < 5.5) ? +0.3f : (t > 5.5 && t < 6) ? -0.3f : 0;
+    rawvals[3] = arming ? +1 : 0;
+    rawvals[4] = -1;
+}
+
+static int record(const char * filename, float duration)
+{
+    FILE * fp = fopen(filename, "wb");
+    if (!fp) {
+        fprintf(stderr, "Unable to open %s\n", filename);
+        return 1;
+    }
+
+    hf::HackflightT<hf::RecordingBoard, hf::ScriptedReceiver> hackflight;
+    hf::SimBoard simboard = hf::SimBoard(GYRO_RATE);
+    hf::ScriptedReceiver receiver = hf::ScriptedReceiver(&simboard, script);
+    hf::RecordingBoard board = hf::RecordingBoard(&simboard, fp, &receiver);
+
+    hackflight.init(&board, &receiver, &stabilizer);
+
+    uint32_t steps = (uint32_t)(duration * GYRO_RATE);
+
+    for (uint32_t k=0; k<steps; ++k) {
+        hackflight.update();
+    }
+
+    board.finish();
+    fclose(fp);
+
+    printf("Recorded %u gyro samples to %s\n", steps, filename);
+
+    return 0;
+}
+
+static int replay(const char * filename)
+{
+    hf::HackflightT<hf::ReplayBoard, hf::ReplayReceiver> hackflight;
+    hf::ReplayBoard board;
+    hf::ReplayReceiver receiver = hf::ReplayReceiver(&board);
+
+    if (!board.open(filename)) {
+        fprintf(stderr, "Unable to open replay log %s\n", filename);
+        return 1;
+    }
+
+    hackflight.init(&board, &receiver, &stabilizer);
+
+    auto start = std::chrono::steady_clock::now();
+
+    // One more pass than there are records, so the last one gets checked
+    while (!board.done()) {
+        hackflight.update();
+    }
+    hackflight.update();
+
+    double nsec = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+    uint32_t records = board.recordCount();
+
+    printf("Replayed %u gyro samples in %.3f sec (%.0f nsec/sample)\n", records, nsec/1e9, records ? nsec/records : 0);
+
+    if (board.mismatchCount()) {
+        printf("MISMATCH: %u samples differ from the recording, first at sample %u\n",
+                board.mismatchCount(), board.firstMismatch());
+        return 2;
+    }
+
+    printf("Motor outputs match the recording\n");
+
+    return 0;
+}
+
+int main(int argc, char ** argv)
+{
+    if (argc > 2 && !strcmp(argv[1], "record")) {
+        return record(argv[2], argc > 3 ? atof(argv[3]) : 8);
+    }
+
+    if (argc == 2) {
+        return replay(argv[1]);
+    }
+
+    fprintf(stderr, "Usage: %s record LOGFILE [SECONDS]\n       %s LOGFILE\n", argv[0], argv[0]);
+    return 1;
+}
@@ -0,0 +1,83 @@
+#!/usr/bin/env python3
+'''
+shmview.py : Prints the vehicle state that simtest publishes in shared memory, and optionally injects sticks
+
+Usage: shmview.py NAME [THROTTLE ROLL PITCH YAW AUX]
+
+Run simtest with a third argument NAME first (e.g. ./simtest 0 - hackflight).
+
+This file is part of Hackflight.
+
+Hackflight is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Hackflight is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+'''
+
+import mmap
+import os
+import struct
+import sys
+import time
+
+MAGIC = 0x4D534648
+
+# Layout from src/boards/sim/sharedstate.hpp
+STATE_OFFSET   = 8
+STATE_FORMAT   = '=I3f3f3f3f4f'
+COMMAND_OFFSET = 96
+COMMAND_FORMAT = '=8f'
+
+
+def read_block(mem, offset, fmt):
+    '''Seqlock read: retry until the sequence is even and unchanged across the copy'''
+    while True:
+        before = struct.unpack_from('=I', mem, offset)[0]
+        if before & 1:
+            continue
+        values = struct.unpack_from(fmt, mem, offset+4)
+        if struct.unpack_from('=I', mem, offset)[0] == before:
+            return before, values
+
+
+def write_block(mem, offset, fmt, values):
+    '''Seqlock write: this process must be the only writer of the block'''
+    seq = struct.unpack_from('=I', mem, offset)[0]
+    struct.pack_into('=I', mem, offset, seq+1)
+    struct.pack_into(fmt, mem, offset+4, *values)
+    struct.pack_into('=I', mem, offset, seq+2)
+
+
+def main():
+
+    if len(sys.argv) < 2:
+        print('Usage: %s NAME [THROTTLE ROLL PITCH YAW AUX]' % sys.argv[0])
+        exit(1)
+
+    fd = os.open('/dev/shm/' + sys.argv[1], os.O_RDWR)
+    mem = mmap.mmap(fd, 0)
+    os.close(fd)
+
+    if struct.unpack_from('=I', mem, 0)[0] != MAGIC:
+        print('%s is not a Hackflight state segment' % sys.argv[1])
+        exit(1)
+
+    if len(sys.argv) > 2:
+        sticks = [float(s) for s in sys.argv[2:7]]
+        write_block(mem, COMMAND_OFFSET, COMMAND_FORMAT, sticks + [0]*(8-len(sticks)))
+
+    while True:
+        seq, s = read_block(mem, STATE_OFFSET, STATE_FORMAT)
+        print('t=%8.3fs  euler: %+6.3f %+6.3f %+6.3f  pos: %+7.2f %+7.2f %+7.2f  motors: %5.3f %5.3f %5.3f %5.3f' %
+              ((s[0]/1e6,) + s[10:13] + s[7:10] + s[13:17]))
+        time.sleep(0.1)
+
+
+main()
@@ -18,17 +18,82 @@
 
 
 #include <math.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include <hackflight.hpp>
 #include <receivers/sim/linux.hpp>
+#include <receivers/sim/scripted.hpp>
+#include <receivers/sim/scenarios.hpp>
 #include <boards/sim/linux-console.hpp>
 
+// Gyro rate for simulated time, whether flown as fast as possible or paced to real time
+static const uint32_t SIM_GYRO_RATE = 1000;
+
+// Barometer rate for the altitude-hold scenarios
+static const float SIM_BARO_RATE = 50;
+
 int main(int argc, char ** argv)
 {
+    // An optional argument gives a flight duration in seconds, flown on a simulated clock as fast as possible
+    // (0 = fly forever, with the simulated clock paced to real time), or names a standard scenario
+    // (receivers/sim/scenarios.hpp) to fly unattended instead of the joystick; a second names a file for the
+    // blackbox log ("-" for none); a third names a shared-memory segment where the vehicle state is published for
+    // visualizers
+    const hf::scenario_t * scenario = (argc > 1) ? hf::Scenarios::find(argv[1]) : NULL;
+
+    float duration = 0;
+
+    if (scenario) {
+        duration = scenario->duration;
+    }
+
+    else if (argc > 1) {
+        char * end = NULL;
+        duration = strtof(argv[1], &end);
+        if (*end) {
+            fprintf(stderr, "%s is neither a duration nor one of these scenarios:\n", argv[1]);
+            for (uint8_t k=0; k<hf::Scenarios::COUNT; ++k) {
+                fprintf(stderr, "    %s\n", hf::Scenarios::get(k).name);
+            }
+            return 1;
+        }
+    }
+
 	hf::Hackflight hackflight;
-	hf::SimBoard   board;
+	hf::SimBoard   board = hf::SimBoard(SIM_GYRO_RATE);
     hf::Controller controller;
 
+    hf::Receiver * receiver = &controller;
+
+    if (scenario) {
+        receiver = new hf::ScriptedReceiver(&board, scenario->script);
+        if (scenario->altitudeHold) {
+            board.simSetSensorModel(hf::SimBoard::SENSOR_BARO, SIM_BARO_RATE, 0);
+        }
+    }
+
+    FILE * blackboxFile = NULL;
+
+    if (argc > 2 && strcmp(argv[2], "-")) {
+        blackboxFile = fopen(argv[2], "wb");
+        if (!blackboxFile) {
+            fprintf(stderr, "Unable to open %s\n", argv[2]);
+            return 1;
+        }
+        board.simSetBlackboxFile(blackboxFile);
+    }
+
+    hf::SimStateChannel stateChannel;
+
+    if (argc > 3) {
+        if (!stateChannel.create(argv[3])) {
+            fprintf(stderr, "Unable to create shared memory %s\n", argv[3]);
+            return 1;
+        }
+        board.simSetStateChannel(&stateChannel);
+    }
+
     hf::Stabilizer stabilizer = hf::Stabilizer(
             0.20f,      // Level P
             0.225f,     // Gyro cyclic P
@@ -37,7 +102,32 @@ int main(int argc, char ** argv)
             1.0625f,    // Gyro yaw P
             0.005625f); // Gyro yaw I
 
-    hackflight.init(&board, &controller, &stabilizer);
+    if (duration == 0) {
+        board.simSetPaced();
+    }
+
+    hackflight.init(&board, receiver, &stabilizer);
+
+    if (duration > 0) {
+
+        uint32_t steps = (uint32_t)(duration * SIM_GYRO_RATE);
+
+        for (uint32_t k=0; k<steps; ++k) {
+            hackflight.update();
+        }
+
+        float gyroRates[3], translationRates[3], motors[4];
+        board.simGetVehicleState(gyroRates, translationRates, motors);
+        printf("t=%3.3fs  gyro: %+3.3f %+3.3f %+3.3f  motors: %3.3f %3.3f %3.3f %3.3f\n", 
+                board.getMicroseconds()/1.e6, gyroRates[0], gyroRates[1], gyroRates[2], 
+                motors[0], motors[1], motors[2], motors[3]);
+
+        if (blackboxFile) {
+            fclose(blackboxFile);
+        }
+
+        return 0;
+    }
 
     while (true) {
 
@@ -0,0 +1,219 @@
+/*
+   swarmtest.cpp : Checks SimSwarm against the scalar code, then measures how many vehicles it can fly
+
+   Usage: swarmtest [VEHICLES [SECONDS [THREADS]]]
+
+   First flies CHECK_VEHICLES vehicles both ways, each through its own stick inputs: a SimBoard, Stabilizer, and
+   MixerQuadX per vehicle, and one SimSwarm for all of them, and reports how many end up bit-for-bit the same
+   and the largest difference in any state variable.  Then flies VEHICLES (default 10000) vehicles for SECONDS
+   (default 2) of simulated time at 1 kHz, split across THREADS threads (default one per core), each with a
+   SimSwarm of its own, and reports vehicle-steps per second and how that compares with real time.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <stabilizer.hpp>
+#include <mixer.hpp>
+#include <boards/sim/linux-console.hpp>
+#include <boards/sim/swarm.hpp>
+
+static const uint32_t GYRO_RATE = 1000;
+
+// New stick demands at a typical receiver frame rate
+static const uint32_t FRAME_STEPS = 20;
+
+static const uint32_t CHECK_VEHICLES = 64;
+static const float    CHECK_SECONDS  = 10;
+
+// Same gains as simtest
+static hf::Stabilizer makeStabilizer(void)
+{
+    return hf::Stabilizer(
+            0.20f,      // Level P
+            0.225f,     // Gyro cyclic P
+            0.001875f,  // Gyro cyclic I
+            0.375f,     // Gyro cyclic D
+            1.0625f,    // Gyro yaw P
+            0.005625f); // Gyro yaw I
+}
+
+// Each vehicle arms at its own time, then climbs while stirring its sticks at its own rates
+static bool script(uint32_t vehicle, float t, demands_t & demands)
+{
+    float phase = 0.37f * vehicle;
+
+    demands.throttle = 0.5f + 0.05f * sinf(0.5f*t + phase);
+    demands.roll     = 0.2f * sinf((1 + 0.10f * (vehicle % 7)) * t + phase);
+    demands.pitch    = 0.2f * sinf((1 + 0.13f * (vehicle % 5)) * t + 2*phase);
+    demands.yaw      = 0.1f * sinf(0.3f*t + 3*phase);
+    demands.aux      = 0;
+
+    return t >= 0.1f * (vehicle % 10);
+}
+
+static void compare(const float a[], const float b[], uint8_t n, float & maxDifference, bool & same)
+{
+    for (uint8_t k=0; k<n; ++k) {
+        maxDifference = std::max(maxDifference, fabsf(a[k] - b[k]));
+    }
+    same = same && !memcmp(a, b, n*sizeof(float));
+}
+
+static void check(const hf::gains_t & gains)
+{
+    hf::SimSwarm swarm(CHECK_VEHICLES, GYRO_RATE, gains);
+
+    uint32_t steps = (uint32_t)(CHECK_SECONDS * GYRO_RATE);
+
+    uint32_t matches = 0;
+    float maxDifference = 0;
+
+    for (uint32_t i=0; i<CHECK_VEHICLES; ++i) {
+
+        hf::SimBoard board(GYRO_RATE);
+        hf::Stabilizer stabilizer = makeStabilizer();
+        hf::MixerQuadX mixer;
+
+        board.init();
+        stabilizer.init();
+        mixer.init(&board);
+
+        demands_t demands = {};
+        bool armed = false;
+
+        for (uint32_t k=0; k<steps; ++k) {
+
+            if (k % FRAME_STEPS == 0) {
+                armed = script(i, (float)k / GYRO_RATE, demands);
+                stabilizer.updateDemands(demands);
+            }
+
+            float gyroRates[3], eulerAngles[3];
+
+            board.getGyroRates(gyroRates);
+
+            if (board.getEulerAngles(eulerAngles)) {
+                stabilizer.updateEulerAngles(eulerAngles);
+            }
+
+            demands_t modified = demands;
+            stabilizer.modifyDemands(gyroRates, modified);
+
+            if (armed) {
+                mixer.runArmed(modified, &board);
+            }
+        }
+
+        float scalar[5][4], batched[5][4];
+        board.simGetVehicleState(scalar[0], scalar[1], scalar[2], scalar[3], scalar[4]);
+
+        // Fly the swarm alongside, the first time through
+        if (i == 0) {
+            for (uint32_t k=0; k<steps; ++k) {
+                if (k % FRAME_STEPS == 0) {
+                    for (uint32_t j=0; j<CHECK_VEHICLES; ++j) {
+                        demands_t d;
+                        swarm.setArmed(j, script(j, (float)k / GYRO_RATE, d));
+                        swarm.setDemands(j, d);
+                    }
+                }
+                swarm.step();
+            }
+        }
+
+        swarm.simGetVehicleState(i, batched[0], batched[1], batched[2], batched[3], batched[4]);
+
+        bool same = true;
+        for (uint8_t v=0; v<5; ++v) {
+            compare(scalar[v], batched[v], v==4 ? 4 : 3, maxDifference, same);
+        }
+        matches += same;
+    }
+
+    printf("Check:    %u of %u vehicles identical after %.0f sec, largest difference %g\n",
+            matches, CHECK_VEHICLES, CHECK_SECONDS, maxDifference);
+}
+
+static void flySwarm(uint32_t first, uint32_t count, uint32_t steps, const hf::gains_t & gains, float * altitude)
+{
+    hf::SimSwarm swarm(count, GYRO_RATE, gains);
+
+    for (uint32_t k=0; k<steps; ++k) {
+        if (k % FRAME_STEPS == 0) {
+            for (uint32_t j=0; j<count; ++j) {
+                demands_t d;
+                swarm.setArmed(j, script(first+j, (float)k / GYRO_RATE, d));
+                swarm.setDemands(j, d);
+            }
+        }
+        swarm.step();
+    }
+
+    float state[5][4];
+    swarm.simGetVehicleState(0, state[0], state[1], state[2], state[3], state[4]);
+    *altitude = state[2][2];
+}
+
+int main(int argc, char ** argv)
+{
+    uint32_t vehicles = (argc > 1) ? atoi(argv[1]) : 10000;
+    float    seconds  = (argc > 2) ? atof(argv[2]) : 2;
+    uint32_t threads  = (argc > 3) ? atoi(argv[3]) : std::max(1u, std::thread::hardware_concurrency());
+
+    threads = std::max(1u, std::min(threads, vehicles));
+
+    hf::gains_t gains = {};
+    makeStabilizer().getGains(gains);
+
+    check(gains);
+
+    uint32_t steps = (uint32_t)(seconds * GYRO_RATE);
+
+    std::vector<std::thread> pool;
+    std::vector<float> altitudes(threads);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    for (uint32_t t=0; t<threads; ++t) {
+        uint32_t first = (uint64_t)vehicles * t / threads;
+        uint32_t last  = (uint64_t)vehicles * (t+1) / threads;
+        pool.push_back(std::thread(flySwarm, first, last-first, steps, gains, &altitudes[t]));
+    }
+
+    for (std::thread & thread : pool) {
+        thread.join();
+    }
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    double rate = (double)vehicles * steps / elapsed;
+
+    printf("Swarm:    %u vehicles for %.1f sec on %u thread%s in %.2f sec wall\n",
+            vehicles, seconds, threads, threads==1 ? "" : "s", elapsed);
+    printf("          %.2fM vehicle-steps/sec, %.2fx real time at %u Hz (first vehicle at %.2f m)\n",
+            rate / 1e6, rate / ((double)vehicles * GYRO_RATE), GYRO_RATE, altitudes[0]);
+
+    return 0;
+}
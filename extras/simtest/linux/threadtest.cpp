@@ -0,0 +1,148 @@
+/*
+   threadtest.cpp : Flies Hackflight in real time against physics on a thread of its own
+
+   Usage: threadtest [SECONDS [PHYSICS_HZ [dual]]]
+
+   Runs a ThreadedSimBoard's physics at PHYSICS_HZ (default 1000) on one thread and the flight code on another,
+   through a scripted arm-and-climb, then reports how the controller kept up: gyro samples read and missed, how
+   old they were when read, and how long they took to reach the motors.  With 'dual', the flight code is itself split across a control thread and a
+   background thread (Features::DUAL_CORE).  Try it on a loaded host, or under taskset with fewer cores than
+   threads, to see scheduling effects.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <thread>
+
+#include <hackflight.hpp>
+#include <receivers/sim/scripted.hpp>
+#include <boards/sim/linux-console.hpp>
+#include <boards/sim/threaded.hpp>
+
+// Arm with throttle down, yaw right; then bring throttle up to a climb
+static void climb(float t, float rawvals[])
+{
+    bool arming = t < 1;
+    rawvals[0] = arming ? -1 : 0;
+    rawvals[1] = 0;
+    rawvals[2] = 0;
+    rawvals[3] = arming ? +1 : 0;
+    rawvals[4] = -1;
+}
+
+// Runs the flight code until endMicros on this thread
+template <bool DUAL_CORE>
+struct Flight {
+
+    template <class HackflightType>
+    static void run(HackflightType & hackflight, hf::ThreadedSimBoard & board, uint32_t endMicros)
+    {
+        while (board.getMicroseconds() < endMicros) {
+            hackflight.update();
+        }
+    }
+};
+
+// Runs the control half on this thread and the background half on another
+template <>
+struct Flight<true> {
+
+    template <class HackflightType>
+    static void run(HackflightType & hackflight, hf::ThreadedSimBoard & board, uint32_t endMicros)
+    {
+        std::atomic<bool> done(false);
+
+        std::thread background([&]() {
+            while (!done) {
+                hackflight.update();
+            }
+        });
+
+        while (board.getMicroseconds() < endMicros) {
+            hackflight.updateControl();
+        }
+
+        done = true;
+        background.join();
+    }
+};
+
+template <class Features>
+static void fly(float duration, uint32_t physicsHz)
+{
+    hf::ThreadedSimBoard board(physicsHz);
+    hf::ScriptedReceiver receiver = hf::ScriptedReceiver(&board, climb);
+
+    hf::Stabilizer stabilizer = hf::Stabilizer(
+            0.20f,      // Level P
+            0.225f,     // Gyro cyclic P
+            0.001875f,  // Gyro cyclic I
+            0.375f,     // Gyro cyclic D
+            1.0625f,    // Gyro yaw P
+            0.005625f); // Gyro yaw I
+
+    hf::HackflightT<hf::ThreadedSimBoard, hf::ScriptedReceiver, hf::MixerQuadX, hf::Stabilizer, hf::AltitudeEstimator,
+        Features> hackflight;
+
+    hackflight.init(&board, &receiver, &stabilizer);
+
+    Flight<Features::DUAL_CORE>::run(hackflight, board, (uint32_t)(duration * 1e6));
+
+    board.simStop();
+
+    hf::ThreadedSimBoard::stats_t stats;
+    board.simGetStats(stats);
+
+    float gyroRates[3], translationRates[3], position[3], eulerAngles[3], motors[4];
+    board.simPhysics().simGetVehicleState(gyroRates, translationRates, position, eulerAngles, motors);
+
+    printf("Physics:  %u steps at %u Hz, %u started late (worst %u usec)\n",
+            stats.steps, physicsHz, stats.lateSteps, stats.latenessMax);
+    printf("Gyro:     %u samples read, %u missed (%.2f%%)\n",
+            stats.samples, stats.missed, stats.steps ? 100.f * stats.missed / stats.steps : 0);
+    printf("Age:      min %u  mean %.1f  max %u usec\n",
+            stats.samples ? stats.ageMin : 0, stats.samples ? (double)stats.ageSum / stats.samples : 0, stats.ageMax);
+    hf::Profiler & profiler = hackflight.getProfiler();
+    printf("Latency:  %u samples to motors, mean %u  p50 %u  p90 %u  p99 %u  max %u usec\n",
+            profiler.getLatencyCount(), profiler.getLatencyMean(), profiler.getLatencyPercentile(.50f),
+            profiler.getLatencyPercentile(.90f), profiler.getLatencyPercentile(.99f), profiler.getLatencyMax());
+    printf("Vehicle:  altitude %.2f m, roll %+.4f, pitch %+.4f\n", position[2], eulerAngles[0], eulerAngles[1]);
+}
+
+int main(int argc, char ** argv)
+{
+    float    duration  = (argc > 1) ? atof(argv[1]) : 5;
+    uint32_t physicsHz = (argc > 2) ? atoi(argv[2]) : 1000;
+    bool     dual      = (argc > 3) && !strcmp(argv[3], "dual");
+
+    if (physicsHz == 0 || physicsHz > 1000000) {
+        fprintf(stderr, "PHYSICS_HZ must be between 1 and 1000000\n");
+        return 1;
+    }
+
+    if (dual) {
+        fly<hf::DualCoreFeatures>(duration, physicsHz);
+    }
+    else {
+        fly<hf::AllFeatures>(duration, physicsHz);
+    }
+
+    return 0;
+}
@@ -0,0 +1,384 @@
+/*
+   unittest.cpp : Host checks of components that don't need a simulated flight
+
+   Usage: unittest
+
+   Runs each component against inputs with known answers, prints each check that fails, and exits nonzero if any
+   did.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <stdio.h>
+
+#include <vector>
+
+#include <dshot.hpp>
+#include <rcsmoother.hpp>
+#include <boards/real/msp.hpp>
+
+static uint32_t checks, failures;
+
+static void check(bool ok, const char * what)
+{
+    checks++;
+    if (!ok) {
+        failures++;
+        printf("FAILED: %s\n", what);
+    }
+}
+
+static bool near(float a, float b)
+{
+    return fabsf(a - b) < 1e-6f;
+}
+
+// RcSmoother ------------------------------------------------------------------------------------
+
+static demands_t rollDemand(float roll)
+{
+    demands_t demands = {};
+    demands.roll = roll;
+    return demands;
+}
+
+// Frames at 10 and 20 msec, rolling from 0 to 0.4; returns the roll handed out at nowMicros
+static float smoothRoll(hf::RcSmoother::mode_t mode, uint32_t nowMicros)
+{
+    hf::RcSmoother smoother;
+    smoother.init(mode);
+
+    smoother.update(rollDemand(0), 10000, 10000, false);
+    smoother.update(rollDemand(0.4f), 20000, 10000, false);
+
+    demands_t demands = rollDemand(0.4f);
+    smoother.apply(demands, nowMicros);
+    return demands.roll;
+}
+
+static void testRcSmoother(void)
+{
+    check(near(smoothRoll(hf::RcSmoother::RAMP, 25000), 0.2f), "RcSmoother ramps halfway at half an interval");
+    check(near(smoothRoll(hf::RcSmoother::RAMP, 40000), 0.4f), "RcSmoother ramp stops at the newest frame");
+    check(near(smoothRoll(hf::RcSmoother::EXTRAPOLATE, 25000), 0.6f), "RcSmoother extrapolates along the slope");
+
+    // A gyro sample stamped before the frame arrived is at the start of the ramp, not its end
+    check(near(smoothRoll(hf::RcSmoother::RAMP, 19900), 0), "RcSmoother ramp holds for a sample before the frame");
+    check(near(smoothRoll(hf::RcSmoother::EXTRAPOLATE, 19900), 0.4f),
+            "RcSmoother doesn't extrapolate for a sample before the frame");
+}
+
+// DShot ----------------------------------------------------------------------------------------
+
+// Keeps the buffer the encoder hands to the timer DMA
+template <uint8_t MOTORS>
+class CapturedDShot : public hf::DShotT<MOTORS> {
+
+    public:
+
+        const uint16_t * buffer;
+        uint16_t         words;
+        uint8_t          count;
+
+    protected:
+
+        bool startTransfer(const uint16_t * buffer, uint16_t words, uint8_t count)
+        {
+            this->buffer = buffer;
+            this->words = words;
+            this->count = count;
+            return true;
+        }
+};
+
+// An ESC's eRPM response for a period in microseconds (or the stopped-motor code, 0x0FFF): twelve bits of
+// exponent and mantissa, an inverted checksum, each nibble in GCR, every one bit a transition, and a start bit
+static uint32_t escResponse(uint16_t data)
+{
+    static const uint8_t GCR[16] = {
+        0x19, 0x1B, 0x12, 0x13, 0x1D, 0x15, 0x16, 0x17, 0x1A, 0x09, 0x0A, 0x0B, 0x1E, 0x0D, 0x0E, 0x0F
+    };
+
+    uint16_t crc = ~(data ^ (data >> 4) ^ (data >> 8)) & 0x0F;
+    uint16_t value = (data << 4) | crc;
+
+    uint32_t gcr = 0;
+    for (int8_t nibble=3; nibble>=0; --nibble) {
+        gcr = (gcr << 5) | GCR[(value >> (4*nibble)) & 0x0F];
+    }
+
+    uint32_t line = 1;
+    for (int8_t bit=19; bit>=0; --bit) {
+        line = (line << 1) | ((line & 1) ^ ((gcr >> bit) & 1));
+    }
+    return line;
+}
+
+static void testDShot(void)
+{
+    // The worked example of the DShot specification: throttle 1046, no telemetry, is 1000001011000110
+    check(hf::DShot::encodeFrame(1046, false, false) == 0x82C6, "DShot frame for throttle 1046");
+    check(hf::DShot::encodeFrame(1046, false, true) == 0x82C9, "DShot bidirectional frame inverts the checksum");
+    check(hf::DShot::encodeFrame(1046, true, false) == 0x82D7, "DShot frame with the telemetry bit");
+    check(hf::DShot::encodeFrame(0, false, false) == 0x0000, "DShot stop frame");
+
+    check(hf::DShot::throttleValue(0) == 0, "DShot throttle zero stops the motor");
+    check(hf::DShot::throttleValue(0.5f) == 1048, "DShot throttle halfway");
+    check(hf::DShot::throttleValue(1) == hf::DShot::THROTTLE_MAX, "DShot full throttle");
+
+    // 72 MHz timer at DShot600: 120 ticks a bit, 90 for a one, 45 for a zero, then two idle periods; sized for an
+    // octocopter but sending to two motors, so packed two to a bit
+    CapturedDShot<8> dshot;
+    dshot.init(72000000, hf::DShot::DSHOT600);
+    const uint16_t raw[2] = {1046, 0};
+    dshot.writeRaw(raw, 2);
+
+    bool laidOut = dshot.periodTicks() == 120 && dshot.count == 2 && dshot.words == hf::DShot::BUFFER_BITS * 2;
+    for (uint8_t b=0; b<hf::DShot::BUFFER_BITS; ++b) {
+        const uint16_t * row = &dshot.buffer[b * 2];
+        uint16_t expected = b < 16 ? ((0x82C6 & (0x8000 >> b)) ? 90 : 45) : 0;
+        laidOut = laidOut && row[0] == expected && row[1] == (b < 16 ? 45 : 0);
+    }
+    check(laidOut, "DShot buffer holds each motor's bits, bit-major, packed for the motors sent, then idle");
+
+    // A quad's output handed a hexacopter's motors sends only its own four
+    CapturedDShot<4> quad;
+    quad.init(72000000, hf::DShot::DSHOT600);
+    const float motors[6] = {0, 0.5f, 1, 0, 0, 0};
+    quad.write(motors, 6);
+    check(quad.count == 4 && quad.words == hf::DShot::BUFFER_BITS * 4 && quad.buffer[2] == 90,
+            "DShot write stops at the output's motor count");
+
+    quad.setTelemetry(1, 0x112ADA);
+    quad.setTelemetry(4, 0x112ADA);
+    check(quad.getErpm(1) == 60000 && quad.getErpm(4) == 0 && quad.getErpm(255) == 0,
+            "DShot eRPM is kept only for the output's motors");
+
+    // 1000 usec is mantissa 500, exponent 1: value 0x3F47, GCR 0x9BFB7
+    check(escResponse(0x3F4) == 0x112ADA, "DShot test ESC response matches its worked example");
+    check(hf::DShot::decodeTelemetry(0x112ADA) == 60000, "DShot telemetry for a 1000 usec period");
+    check(hf::DShot::decodeTelemetry(escResponse(0x0FFF)) == 0, "DShot telemetry for a stopped motor");
+
+    // Mantissa 511 at exponent 7 would be the stopped-motor code
+    bool roundTrip = true;
+    for (uint16_t exponent=0; exponent<8; ++exponent) {
+        for (uint16_t mantissa=1; mantissa<511; mantissa+=17) {
+            uint32_t period = (uint32_t)mantissa << exponent;
+            roundTrip = roundTrip && hf::DShot::decodeTelemetry(escResponse((exponent << 9) | mantissa)) ==
+                (int32_t)(60000000UL / period);
+        }
+    }
+    check(roundTrip, "DShot telemetry decodes every exponent");
+
+    bool corrupt = true;
+    for (uint8_t bit=0; bit<20; ++bit) {
+        corrupt = corrupt && hf::DShot::decodeTelemetry(0x112ADA ^ (1u << bit)) == -1;
+    }
+    check(corrupt, "DShot telemetry with any one bit flipped is corrupt");
+}
+
+// MSP ------------------------------------------------------------------------------------------
+
+typedef std::vector<uint8_t> bytes_t;
+
+// Kept apart from MSP's own, so a slip there doesn't vanish from both sides
+static uint8_t crc8(uint8_t crc, uint8_t a)
+{
+    crc ^= a;
+    for (uint8_t k=0; k<8; ++k) {
+        crc = (crc & 0x80) ? (crc << 1) ^ 0xD5 : crc << 1;
+    }
+    return crc;
+}
+
+static bytes_t frameV1(char direction, uint8_t id, const uint8_t * payload=NULL, uint8_t size=0)
+{
+    bytes_t frame = {'$', 'M', (uint8_t)direction, size, id};
+    uint8_t checksum = size ^ id;
+    for (uint8_t k=0; k<size; ++k) {
+        frame.push_back(payload[k]);
+        checksum ^= payload[k];
+    }
+    frame.push_back(checksum);
+    return frame;
+}
+
+static bytes_t frameV2(char direction, uint16_t id, const uint8_t * payload=NULL, uint16_t size=0)
+{
+    bytes_t frame = {'$', 'X', (uint8_t)direction, 0, (uint8_t)(id & 0xFF), (uint8_t)(id >> 8),
+        (uint8_t)(size & 0xFF), (uint8_t)(size >> 8)};
+    for (uint16_t k=0; k<size; ++k) {
+        frame.push_back(payload[k]);
+    }
+    uint8_t crc = 0;
+    for (uint16_t k=3; k<frame.size(); ++k) {
+        crc = crc8(crc, frame[k]);
+    }
+    frame.push_back(crc);
+    return frame;
+}
+
+static bytes_t operator+(bytes_t a, const bytes_t & b)
+{
+    a.insert(a.end(), b.begin(), b.end());
+    return a;
+}
+
+// An MSP parser bound to a vehicle state with a known attitude
+class MSPBench {
+
+    private:
+
+        class NullReceiver final : public hf::Receiver {
+
+            protected:
+
+                void begin(void) { }
+                bool gotNewFrame(void) { return false; }
+                void readRawvals(void) { }
+        };
+
+        NullReceiver    _receiver;
+        hf::VehicleState _state;
+        hf::ReplyCache  _replies;
+        hf::Profiler    _profiler;
+        hf::MSPContext  _context;
+
+    public:
+
+        hf::MSP msp;
+
+        MSPBench(void)
+        {
+            const float eulerAngles[3] = {0.1f, -0.2f, 1.5f};
+            _state.publish(eulerAngles, &_receiver);
+            _replies.refresh(&_state);
+            _profiler.init();
+
+            hf::MSPContext context = {&_state, 0, &_profiler, 0, 0, 0, 0};
+            _context = context;
+
+            msp.init();
+            msp.bind(&_replies, &_context);
+        }
+
+        bytes_t drain(void)
+        {
+            bytes_t out;
+            while (msp.availableBytes() > 0) {
+                out.push_back(msp.readByte());
+            }
+            return out;
+        }
+
+        // Replies to buf handed over whole, in chunks of at most chunk bytes, or (chunk zero) byte by byte
+        bytes_t reply(const bytes_t & buf, uint16_t chunk)
+        {
+            bytes_t out;
+            for (uint16_t k=0; k<buf.size(); k+=(chunk ? chunk : 1)) {
+                uint16_t n = chunk ? std::min<size_t>(chunk, buf.size() - k) : 1;
+                if (chunk) {
+                    msp.parse(&buf[k], n);
+                }
+                else {
+                    msp.update(buf[k]);
+                }
+                out = out + drain();
+            }
+            return out;
+        }
+};
+
+static bool repliesAttitude(const bytes_t & out, bool v2)
+{
+    typedef hf::mspmsg::ATTITUDE_RADIANS msg_t;
+
+    uint8_t payload[msg_t::SIZE];
+    msg_t msg = {0.1f, -0.2f, 1.5f};
+    msg.encode(payload);
+
+    return out == (v2 ? frameV2('>', msg_t::ID, payload, msg_t::SIZE) :
+                        frameV1('>', msg_t::ID, payload, msg_t::SIZE));
+}
+
+static void testMSP(void)
+{
+    typedef hf::mspmsg::ATTITUDE_RADIANS attitude_t;
+
+    bytes_t v1 = frameV1('<', attitude_t::ID);
+    bytes_t v2 = frameV2('<', attitude_t::ID);
+
+    check(repliesAttitude(MSPBench().reply(v1, 64), false), "MSP answers a v1 request with a v1 reply");
+    check(repliesAttitude(MSPBench().reply(v2, 64), true), "MSP answers a v2 request with a v2 reply");
+
+    // A command, and the reply it changes: the chosen stage, with an empty histogram
+    typedef hf::mspmsg::LOOP_HISTOGRAM histogram_t;
+    uint8_t stage = hf::Profiler::STAGE_DEBUG;
+    uint8_t histogram[histogram_t::SIZE] = {};
+    hf::mspmsg::setField<histogram_t>(histogram, 0, stage);
+    bytes_t selected = MSPBench().reply(frameV2('<', hf::mspmsg::SET_LOOP_HISTOGRAM::ID, &stage, 1) +
+            frameV2('<', histogram_t::ID), 64);
+    check(selected == frameV2('>', hf::mspmsg::SET_LOOP_HISTOGRAM::ID) + frameV2('>', histogram_t::ID, histogram,
+                histogram_t::SIZE), "MSP acknowledges a v2 command, which takes effect");
+
+    bytes_t badV1 = v1, badV2 = v2;
+    badV1.back() ^= 1;
+    badV2.back() ^= 1;
+    check(MSPBench().reply(badV1, 64).empty() && MSPBench().reply(badV2, 64).empty(),
+            "MSP ignores a request with a bad checksum or CRC");
+    check(repliesAttitude(MSPBench().reply(badV2 + v2, 64), true), "MSP answers a good request after a bad one");
+
+    bool split = true;
+    for (uint16_t k=1; k<v2.size(); ++k) {
+        MSPBench bench;
+        bench.msp.parse(&v2[0], k);
+        bytes_t out = bench.drain();
+        bench.msp.parse(&v2[k], v2.size() - k);
+        split = split && out.empty() && repliesAttitude(bench.drain(), true);
+    }
+    check(split, "MSP answers a request split anywhere across parse() calls");
+
+    // Noise, bad checksums, headers broken off by a '$', and sizes too big for the input buffer whose would-be
+    // payload holds good frames: parse() in any chunking must find what the state machine finds
+    bytes_t oversize = {'$', 'M', '<', 200, '$'};
+    bytes_t oversizeV2 = {'$', 'X', '<', 0, attitude_t::ID, 0, 0x00, 0x02};
+    bytes_t stream = bytes_t({'x', '$', '$'}) + v1 + bytes_t({'$', 'M', '$'}) + v2 + badV1 + v2 + badV2 + oversize +
+        v1 + oversizeV2 + v2 + bytes_t({'$', 'X'}) + v1 + bytes_t({'$'});
+
+    bytes_t byByte = MSPBench().reply(stream, 0);
+    check(byByte == MSPBench().reply(v1 + v2 + v2 + v1 + v2 + v1, 0),
+            "MSP state machine finds every good request in a noisy stream");
+
+    bool agree = true;
+    for (uint16_t chunk=1; chunk<=stream.size(); ++chunk) {
+        agree = agree && MSPBench().reply(stream, chunk) == byByte;
+    }
+    check(agree, "MSP parse() agrees with the state machine byte for byte, however the stream is chunked");
+}
+
+int main(int argc, char ** argv)
+{
+    (void)argc;
+    (void)argv;
+
+    testRcSmoother();
+    testDShot();
+    testMSP();
+
+    printf("%u of %u checks passed\n", checks - failures, checks);
+
+    return failures ? 1 : 0;
+}
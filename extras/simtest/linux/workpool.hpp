@@ -0,0 +1,105 @@
+/*
+   workpool.hpp : Simple work-stealing thread pool for batch simulation
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <functional>
+
+class WorkPool {
+
+    private:
+
+        // Each worker owns a queue of job indices; idle workers steal from the others
+        typedef struct {
+            std::mutex         lock;
+            std::deque<size_t> jobs;
+        } queue_t;
+
+        unsigned _nthreads;
+
+        std::vector<queue_t> _queues;
+
+        bool popOwn(unsigned worker, size_t & job)
+        {
+            queue_t & q = _queues[worker];
+            std::lock_guard<std::mutex> guard(q.lock);
+            if (q.jobs.empty()) return false;
+            job = q.jobs.back();
+            q.jobs.pop_back();
+            return true;
+        }
+
+        bool steal(unsigned thief, size_t & job)
+        {
+            for (unsigned k=1; k<_nthreads; ++k) {
+                queue_t & q = _queues[(thief+k) % _nthreads];
+                std::lock_guard<std::mutex> guard(q.lock);
+                if (!q.jobs.empty()) {
+                    job = q.jobs.front();
+                    q.jobs.pop_front();
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void work(unsigned worker, std::function<void(size_t)> & fun)
+        {
+            size_t job;
+            while (popOwn(worker, job) || steal(worker, job)) {
+                fun(job);
+            }
+        }
+
+    public:
+
+        // Zero threads means one per hardware core
+        WorkPool(unsigned nthreads=0) : _queues(nthreads ? nthreads : std::max(1u, std::thread::hardware_concurrency()))
+        {
+            _nthreads = _queues.size();
+        }
+
+        unsigned threadCount(void)
+        {
+            return _nthreads;
+        }
+
+        // Runs fun(0) ... fun(count-1) across all workers, returning when every job is done
+        void run(size_t count, std::function<void(size_t)> fun)
+        {
+            for (size_t k=0; k<count; ++k) {
+                _queues[k % _nthreads].jobs.push_back(k);
+            }
+
+            std::vector<std::thread> threads;
+
+            for (unsigned k=0; k<_nthreads; ++k) {
+                threads.push_back(std::thread(&WorkPool::work, this, k, std::ref(fun)));
+            }
+
+            for (std::thread & t : threads) {
+                t.join();
+            }
+        }
+
+}; // class WorkPool
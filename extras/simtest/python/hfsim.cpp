@@ -0,0 +1,331 @@
+/*
+   hfsim.cpp : Python extension stepping many simulated Hackflight vehicles at once
+
+   hfsim.Envs(count, gyro_rate=1000, threads=1) makes count environments, each a Hackflight flight loop on its
+   own SimBoard, flown on a simulated clock by an ActionReceiver, with the gains simtest flies.  step() takes the
+   stick actions of all of them and writes their observations straight into the caller's arrays, through the
+   buffer protocol, so NumPy arrays (or array.array, or anything else exposing a C-contiguous float32 buffer) are
+   used as they are, with nothing allocated per step:
+
+       actions       count x ACTION_SIZE       throttle, roll, pitch, yaw, aux, each in [-1,+1]
+       observations  count x OBSERVATION_SIZE  gyro rates (3), translation rates (3), position (3),
+                                               Euler angles (3), motors (4), as SimBoard::simGetVehicleState()
+
+   step(actions, observations, steps=1) holds each action for steps flight-loop passes and reports the state after
+   the last.  The GIL is released while stepping, and with threads other than one the environments are split into
+   one contiguous block per thread (zero means one per core).
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <string.h>
+
+#include <vector>
+
+#include <hackflight.hpp>
+#include <receivers/sim/action.hpp>
+#if defined(_WIN32)
+#include <boards/sim/windows-console.hpp>
+#else
+#include <boards/sim/linux-console.hpp>
+#endif
+
+#include "workpool.hpp"
+
+static const uint32_t ACTION_SIZE      = 5; // ActionReceiver channels
+static const uint32_t OBSERVATION_SIZE = 16;
+
+// One vehicle and the flight loop flying it
+class Env {
+
+    private:
+
+        // Concrete board and receiver types let the compiler inline their calls into the core
+        hf::HackflightT<hf::SimBoard, hf::ActionReceiver> _hackflight;
+        hf::SimBoard _board;
+        hf::ActionReceiver _receiver;
+        hf::Stabilizer _stabilizer;
+
+    public:
+
+        // Same gains as simtest
+        Env(uint32_t gyroRate)
+            : _board(gyroRate),
+              _receiver(&_board),
+              _stabilizer(
+                    0.20f,      // Level P
+                    0.225f,     // Gyro cyclic P
+                    0.001875f,  // Gyro cyclic I
+                    0.375f,     // Gyro cyclic D
+                    1.0625f,    // Gyro yaw P
+                    0.005625f)  // Gyro yaw I
+        {
+            _hackflight.init(&_board, &_receiver, &_stabilizer);
+        }
+
+        void step(const float * action, float * observation, uint32_t steps)
+        {
+            _receiver.setRawvals(action);
+
+            for (uint32_t k=0; k<steps; ++k) {
+                _hackflight.update();
+            }
+
+            _board.simGetVehicleState(&observation[0], &observation[3], &observation[6], &observation[9],
+                    &observation[12]);
+        }
+
+}; // class Env
+
+typedef struct {
+
+    PyObject_HEAD
+
+    std::vector<Env *> * envs;
+    uint32_t             gyroRate;
+    WorkPool           * pool;
+
+} EnvsObject;
+
+static int Envs_init(EnvsObject * self, PyObject * args, PyObject * kwds)
+{
+    static const char * kwlist[] = {"count", "gyro_rate", "threads", NULL};
+
+    unsigned count = 0;
+    unsigned gyroRate = 1000;
+    unsigned threads = 1;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "I|II", (char **)kwlist, &count, &gyroRate, &threads)) {
+        return -1;
+    }
+
+    if (count == 0 || gyroRate == 0) {
+        PyErr_SetString(PyExc_ValueError, "count and gyro_rate must be positive");
+        return -1;
+    }
+
+    self->gyroRate = gyroRate;
+    self->envs = new std::vector<Env *>(count);
+    for (unsigned k=0; k<count; ++k) {
+        (*self->envs)[k] = new Env(gyroRate);
+    }
+    self->pool = new WorkPool(threads);
+
+    return 0;
+}
+
+static void Envs_dealloc(EnvsObject * self)
+{
+    if (self->envs) {
+        for (Env * env : *self->envs) {
+            delete env;
+        }
+        delete self->envs;
+    }
+    delete self->pool;
+
+    PyTypeObject * type = Py_TYPE(self);
+    type->tp_free((PyObject *)self);
+    Py_DECREF(type);
+}
+
+// An Envs made by __new__ alone, or whose __init__ failed, has no environments to touch
+static bool initialized(EnvsObject * self)
+{
+    if (!self->envs) {
+        PyErr_SetString(PyExc_RuntimeError, "Envs object is not initialized");
+        return false;
+    }
+    return true;
+}
+
+// Gets a C-contiguous float32 buffer of exactly the given number of floats
+static bool getFloats(PyObject * obj, Py_buffer * view, Py_ssize_t count, bool writable, const char * name)
+{
+    int flags = PyBUF_C_CONTIGUOUS | PyBUF_FORMAT | (writable ? PyBUF_WRITABLE : 0);
+
+    if (PyObject_GetBuffer(obj, view, flags) < 0) {
+        return false;
+    }
+
+    const char * format = view->format ? view->format : "B";
+    if (format[0] == '<' || format[0] == '=' || format[0] == '@') {
+        format++;
+    }
+
+    if (strcmp(format, "f") || view->itemsize != sizeof(float) || view->len != count * (Py_ssize_t)sizeof(float)) {
+        PyErr_Format(PyExc_ValueError, "%s must be a contiguous float32 buffer of %zd values", name, count);
+        PyBuffer_Release(view);
+        return false;
+    }
+
+    return true;
+}
+
+static PyObject * Envs_step(EnvsObject * self, PyObject * args, PyObject * kwds)
+{
+    static const char * kwlist[] = {"actions", "observations", "steps", NULL};
+
+    PyObject * actionsObj = NULL;
+    PyObject * observationsObj = NULL;
+    unsigned steps = 1;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "OO|I", (char **)kwlist, &actionsObj, &observationsObj, &steps)) {
+        return NULL;
+    }
+
+    if (!initialized(self)) {
+        return NULL;
+    }
+
+    std::vector<Env *> & envs = *self->envs;
+    Py_ssize_t count = envs.size();
+
+    Py_buffer actions, observations;
+
+    if (!getFloats(actionsObj, &actions, count * ACTION_SIZE, false, "actions")) {
+        return NULL;
+    }
+
+    if (!getFloats(observationsObj, &observations, count * OBSERVATION_SIZE, true, "observations")) {
+        PyBuffer_Release(&actions);
+        return NULL;
+    }
+
+    const float * a = (const float *)actions.buf;
+    float * o = (float *)observations.buf;
+
+    Py_BEGIN_ALLOW_THREADS
+
+    if (self->pool->threadCount() == 1) {
+        for (Py_ssize_t k=0; k<count; ++k) {
+            envs[k]->step(&a[k*ACTION_SIZE], &o[k*OBSERVATION_SIZE], steps);
+        }
+    }
+
+    // One block of neighboring environments per thread, so each thread writes its own stretch of the arrays
+    else {
+        size_t blocks = self->pool->threadCount();
+        size_t per = (count + blocks - 1) / blocks;
+        self->pool->run(blocks, [&](size_t block) {
+                for (size_t k=block*per; k<(size_t)count && k<(block+1)*per; ++k) {
+                    envs[k]->step(&a[k*ACTION_SIZE], &o[k*OBSERVATION_SIZE], steps);
+                }
+            });
+    }
+
+    Py_END_ALLOW_THREADS
+
+    PyBuffer_Release(&observations);
+    PyBuffer_Release(&actions);
+
+    Py_RETURN_NONE;
+}
+
+// Starts one environment (or, with no index, all of them) over from the ground, disarmed
+static PyObject * Envs_reset(EnvsObject * self, PyObject * args)
+{
+    Py_ssize_t index = -1;
+
+    if (!PyArg_ParseTuple(args, "|n", &index)) {
+        return NULL;
+    }
+
+    if (!initialized(self)) {
+        return NULL;
+    }
+
+    std::vector<Env *> & envs = *self->envs;
+
+    if (index >= (Py_ssize_t)envs.size()) {
+        PyErr_SetString(PyExc_IndexError, "environment index out of range");
+        return NULL;
+    }
+
+    for (size_t k=0; k<envs.size(); ++k) {
+        if (index < 0 || (size_t)index == k) {
+            delete envs[k];
+            envs[k] = new Env(self->gyroRate);
+        }
+    }
+
+    Py_RETURN_NONE;
+}
+
+static Py_ssize_t Envs_len(EnvsObject * self)
+{
+    if (!initialized(self)) {
+        return -1;
+    }
+
+    return self->envs->size();
+}
+
+static PyMethodDef Envs_methods[] = {
+    {"step",  (PyCFunction)(void(*)(void))Envs_step, METH_VARARGS | METH_KEYWORDS,
+        "step(actions, observations, steps=1): fly every environment steps loop passes on its action"},
+    {"reset", (PyCFunction)Envs_reset, METH_VARARGS,
+        "reset(index=-1): start one environment, or all of them, over"},
+    {NULL, NULL, 0, NULL}
+};
+
+static PyType_Slot Envs_slots[] = {
+    {Py_tp_doc,     (void *)"Envs(count, gyro_rate=1000, threads=1): many simulated Hackflight vehicles"},
+    {Py_tp_new,     (void *)PyType_GenericNew},
+    {Py_tp_init,    (void *)Envs_init},
+    {Py_tp_dealloc, (void *)Envs_dealloc},
+    {Py_tp_methods, (void *)Envs_methods},
+    {Py_sq_length,  (void *)Envs_len},
+    {0, NULL}
+};
+
+static PyType_Spec Envs_spec = {
+    "hfsim.Envs",
+    sizeof(EnvsObject),
+    0,
+    Py_TPFLAGS_DEFAULT,
+    Envs_slots
+};
+
+static PyModuleDef hfsim_module = {
+    PyModuleDef_HEAD_INIT,
+    "hfsim",
+    "Batched Hackflight simulation",
+    -1,
+    NULL, NULL, NULL, NULL, NULL
+};
+
+PyMODINIT_FUNC PyInit_hfsim(void)
+{
+    PyObject * module = PyModule_Create(&hfsim_module);
+    if (!module) {
+        return NULL;
+    }
+
+    PyObject * type = PyType_FromSpec(&Envs_spec);
+    if (!type || PyModule_AddObject(module, "Envs", type) < 0) {
+        Py_XDECREF(type);
+        Py_DECREF(module);
+        return NULL;
+    }
+
+    PyModule_AddIntConstant(module, "ACTION_SIZE", ACTION_SIZE);
+    PyModule_AddIntConstant(module, "OBSERVATION_SIZE", OBSERVATION_SIZE);
+
+    return module;
+}
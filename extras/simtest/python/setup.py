@@ -0,0 +1,36 @@
+'''
+setup.py : builds hfsim, the Python extension for batched Hackflight simulation
+
+   python3 setup.py build_ext --inplace
+
+This file is part of Hackflight.
+
+Hackflight is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Hackflight is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+'''
+
+import sys
+
+from setuptools import setup, Extension
+
+args = ['/O2'] if sys.platform == 'win32' else ['-std=c++11', '-O3', '-pthread']
+libs = [] if sys.platform == 'win32' else ['-pthread']
+
+setup(name = 'hfsim',
+      version = '0.1',
+      description = 'Batched Hackflight simulation',
+      ext_modules = [Extension('hfsim',
+                               sources = ['hfsim.cpp'],
+                               include_dirs = ['../../../src', '../linux'],
+                               extra_compile_args = args,
+                               extra_link_args = libs,
+                               language = 'c++')])
@@ -0,0 +1,90 @@
+#!/usr/bin/env python3
+'''
+steptest.py : Flies a batch of hfsim environments through an arm-and-climb and reports the step rate
+
+Usage: steptest.py [ENVIRONMENTS [SECONDS [THREADS]]]
+
+Uses NumPy arrays if NumPy is installed, otherwise array.array; either way step() writes the observations
+into the same buffer every time.
+
+This file is part of Hackflight.
+
+Hackflight is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Hackflight is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+'''
+
+import sys
+import time
+
+import hfsim
+
+GYRO_RATE = 1000
+
+# Loop passes per action, as at a typical receiver frame rate
+FRAME_STEPS = 10
+
+def arrays(count):
+
+    try:
+        import numpy as np
+        return (np.zeros((count, hfsim.ACTION_SIZE), dtype=np.float32),
+                np.zeros((count, hfsim.OBSERVATION_SIZE), dtype=np.float32))
+
+    except ImportError:
+        from array import array
+        return (array('f', bytes(4*count*hfsim.ACTION_SIZE)),
+                array('f', bytes(4*count*hfsim.OBSERVATION_SIZE)))
+
+def setAction(actions, k, action):
+
+    if hasattr(actions, 'shape'):
+        actions[k] = action
+    else:
+        actions[k*hfsim.ACTION_SIZE:(k+1)*hfsim.ACTION_SIZE] = type(actions)('f', action)
+
+def main():
+
+    count   = int(sys.argv[1]) if len(sys.argv) > 1 else 1000
+    seconds = float(sys.argv[2]) if len(sys.argv) > 2 else 5
+    threads = int(sys.argv[3]) if len(sys.argv) > 3 else 0
+
+    envs = hfsim.Envs(count, GYRO_RATE, threads)
+    actions, observations = arrays(count)
+
+    frames = int(seconds * GYRO_RATE / FRAME_STEPS)
+
+    start = time.time()
+
+    for frame in range(frames):
+
+        t = frame * FRAME_STEPS / GYRO_RATE
+
+        # Arm with throttle down, yaw right; then bring throttle up to a climb
+        arming = t < 1
+        action = (-1 if arming else 0, 0, 0, +1 if arming else 0, -1)
+
+        # Only write the actions when they change
+        if frame == 0 or t == 1:
+            for k in range(count):
+                setAction(actions, k, action)
+
+        envs.step(actions, observations, FRAME_STEPS)
+
+    elapsed = time.time() - start
+
+    z = observations[0][8] if hasattr(observations, 'shape') else observations[8]
+
+    print('%d environments, %d steps each, in %.2f sec: %.2e steps/sec' %
+            (count, frames*FRAME_STEPS, elapsed, count*frames*FRAME_STEPS/elapsed))
+    print('Altitude after %.1f sec: %+.3f m' % (seconds, z))
+
+main()
@@ -23,7 +23,10 @@
 #pragma once
 
 #include "filter.hpp"
+#include "altitudekf.hpp"
 #include "barometer.hpp"
+#include "calibration.hpp"
+#include "gainprofile.hpp"
 #include "imu.hpp"
 #include "debug.hpp"
 #include "datatypes.hpp"
@@ -31,7 +34,10 @@
 
 namespace hf {
 
-    class AltitudeEstimator {
+    // BaroType chooses the barometer's pressure filter, e.g. BarometerT<PressureDecimator<>> to save RAM; a gain
+    // profile (see gainprofile.hpp) fixes the hold gains at compile time
+    template <class BaroType=Barometer, class Profile=void>
+    class AltitudeEstimatorT {
 
         private: 
 
@@ -39,8 +45,22 @@ namespace hf {
             const float    cfAlt  = 0.965f;
             const float    cfVel  = 0.985f;
 
+            // Sonar readings are used below this altitude (cm) while no older than this
+            const float    SONAR_CEILING = 300;
+            const uint32_t SONAR_TIMEOUT_MICROS = 200000;
+
+            // Complementary filter for the offset from barometer to sonar altitude
+            const float    cfSonarOffset = 0.95f;
+
+            // Barometer samples at rest before the calibration is worth saving
+            const uint16_t CALIBRATION_REST_SAMPLES = 300;
+
+            // Smallest changes worth a write to the board's storage
+            static constexpr float CALIBRATION_PRESSURE_CHANGE = 0.05f;
+            static constexpr float CALIBRATION_ACCEL_CHANGE    = 0.002f;
+
             // Barometer
-            Barometer baro;
+            BaroType baro;
 
             // IMU
             IMU imu;
@@ -49,11 +69,11 @@ namespace hf {
             float fusedAlt;
             float fusedVel;
 
-            // PIDS: XXX Use uint8_t for now; eventually will be float
-            uint8_t altP;
-            uint8_t velP;
-            uint8_t velI;
-            uint8_t velD;
+            // When the complementary filters last ran
+            uint32_t baroPreviousTime;
+
+            // PIDS: whole numbers when tunable
+            AltitudeGainsT<Profile> gains;
 
             // State variables
             float altHold;
@@ -66,25 +86,146 @@ namespace hf {
             // No velocity control for now
             bool velocityControl = false;
 
+            IMU::propagation_t imuPropagation;
+
+            // Optional Kalman fusion in place of the complementary filters
+            AltitudeKalman kalman;
+            bool useKalman = false;
+            uint32_t kalmanPreviousTime;
+
+            // Sonar altitude above where it read at rest (cm), and when it was taken
+            bool     haveSonar;
+            float    sonarAlt;
+            float    sonarGround;
+            uint32_t sonarTime;
+
+            // Takes barometer altitude onto the sonar's, so that handing back to the barometer doesn't step
+            float    baroOffset;
+
+            // Sensor calibration as loaded from the board at startup, saved back once it has settled at rest
+            Calibration calibration;
+            bool        calibrationSaved;
+
         public:
 
-            AltitudeEstimator(uint8_t _altP, uint8_t _velP, uint8_t _velI, uint8_t _velD) 
+            // Whether setGains() takes effect
+            static const bool TUNABLE = AltitudeGainsT<Profile>::TUNABLE;
+
+            AltitudeEstimatorT(uint8_t _altP, uint8_t _velP, uint8_t _velI, uint8_t _velD, 
+                    IMU::propagation_t _imuPropagation=IMU::PROPAGATE_MATRIX) 
+                : gains(_altP, _velP, _velI, _velD)
             {
-                altP = _altP;  
-                velP = _velP;  
-                velI = _velI;  
-                velD = _velD; 
+                imuPropagation = _imuPropagation;
+            }
+
+            // With the default gains, or the profile's
+            AltitudeEstimatorT(IMU::propagation_t _imuPropagation=IMU::PROPAGATE_MATRIX)
+            {
+                imuPropagation = _imuPropagation;
             }
 
             void init(void)
             {
                 baro.init();
-                imu.init();
+                imu.init(imuPropagation);
                 initialThrottleHold = 0;
                 holding = false;
                 pid = 0;
                 errorVelocityI = 0;
                 accZ_old = 0;
+                baroPreviousTime = 0;
+                kalmanPreviousTime = 0;
+                kalman.reset();
+                haveSonar = false;
+                sonarAlt = 0;
+                sonarGround = 0;
+                sonarTime = 0;
+                baroOffset = 0;
+            }
+
+            // Fills in the altitude-hold part of gains
+            void getGains(gains_t & g)
+            {
+                gains.get(g);
+            }
+
+            // Takes the altitude-hold part of gains, rounded to the whole numbers the hold controller uses;
+            // ignored with a profile
+            void setGains(const gains_t & g)
+            {
+                gains.set(g);
+            }
+
+            // Call after init() to start from calibration saved on an earlier boot
+            void seedCalibration(const Calibration & calibration)
+            {
+                if (calibration.groundPressure) {
+                    baro.seed(calibration.groundPressure);
+                }
+                if (calibration.accelZoffset) {
+                    imu.seedAccelZoffset(calibration.accelZoffset);
+                }
+            }
+
+            // Returns false until the vehicle has been at rest long enough for the calibration to have settled
+            bool getCalibration(Calibration & calibration)
+            {
+                if (baro.getRestSamples() < CALIBRATION_REST_SAMPLES) {
+                    return false;
+                }
+
+                calibration.groundPressure = baro.getGroundPressure();
+                calibration.accelZoffset = imu.getAccelZoffset();
+
+                return true;
+            }
+
+            // Call after init() to start from the calibration the board saved on an earlier boot
+            template <class BoardT>
+            void loadCalibration(BoardT * board)
+            {
+                uint8_t buf[Calibration::SIZE];
+                uint16_t len = board->calibrationRead(buf, sizeof(buf));
+
+                if (calibration.decode(buf, len)) {
+                    seedCalibration(calibration);
+                }
+
+                calibrationSaved = false;
+            }
+
+            // Call after each barometer update while disarmed: writes the calibration back to the board once it
+            // has settled, once per boot, and only if it has changed, to spare the EEPROM or flash
+            template <class BoardT>
+            void saveCalibration(BoardT * board)
+            {
+                Calibration latest;
+                if (calibrationSaved || !getCalibration(latest)) {
+                    return;
+                }
+
+                calibrationSaved = true;
+
+                if (fabsf(latest.groundPressure - calibration.groundPressure) < CALIBRATION_PRESSURE_CHANGE &&
+                        fabsf(latest.accelZoffset - calibration.accelZoffset) < CALIBRATION_ACCEL_CHANGE) {
+                    return;
+                }
+
+                uint8_t buf[Calibration::SIZE];
+                latest.encode(buf);
+                board->calibrationWrite(buf, sizeof(buf));
+
+                calibration = latest;
+            }
+
+            // Fuses with a steady-state Kalman filter instead of the complementary filters.  The gains are
+            // computed here for the rate at which updateBaro() will be called and the given noise levels (baro cm;
+            // accel cm/sec^2; accel bias cm/sec^2 per root second; sonar cm), so call it once, before flight.
+            void useKalmanFilter(float baroRateHz, float baroNoise=30, float accelNoise=50, float biasNoise=2,
+                    float sonarNoise=3)
+            {
+                kalman.init(baroRateHz, baroNoise, accelNoise, biasNoise, sonarNoise);
+                useKalman = true;
             }
 
             void handleAuxSwitch(demands_t & demands)
@@ -114,26 +255,48 @@ namespace hf {
                 imu.updateGyro(gyro, currentTime);
             }
 
+            // Distance in cm straight down (already corrected for tilt), taken at timestamp; the next barometer
+            // update fuses it in place of the barometer altitude
+            void updateSonar(bool armed, float distance, uint32_t timestamp)
+            {
+                if (!armed) {
+                    sonarGround = distance;
+                }
+
+                haveSonar = true;
+                sonarAlt = distance - sonarGround;
+                sonarTime = timestamp;
+            }
+
             void updateBaro(bool armed, float pressure, uint32_t currentTime)
             {  
                 // Send pressure to baro for altitude estimation
                 baro.update(pressure);
 
+                if (useKalman) {
+                    updateKalman(armed, currentTime);
+                    if (armed) {
+                        updatePid();
+                    }
+                    return;
+                }
+
                 // Calibrate baro AGL at rest
                 if (!armed) {
                     baro.calibrate();
                     fusedAlt = 0;
                     fusedVel = 0;
+                    baroOffset = 0;
                     return;
                 }
 
                 // Track delta time in seconds
-                static uint32_t previousTime;
-                float dt = (currentTime-previousTime) / 1.e6;
-                previousTime = currentTime;
+                float dt = (currentTime-baroPreviousTime) / 1.e6;
+                baroPreviousTime = currentTime;
 
-                // Get estimated altitude from barometer
-                float baroAlt = baro.getAltitude();
+                // Get estimated altitude from barometer, or from sonar near the ground
+                bool fromSonar = false;
+                float baroAlt = measuredAltitude(baro.getAltitude(), currentTime, fromSonar);
 
                 //Debug::printf("%+f\n", baroAlt);
 
@@ -152,6 +315,73 @@ namespace hf {
 
                 fusedVel = Filter::complementary(fusedVel, baroVel, cfVel);
 
+                updatePid();
+
+            } // updateBaro
+
+            bool isHolding(void)
+            {
+                return holding;
+            }
+
+            void modifyDemands(demands_t & demands)
+            {
+                if (holding) {
+
+                    demands.throttle = initialThrottleHold+pid;
+                }
+            }
+
+        private:
+
+            // The sonar's altitude while it has a recent reading below its ceiling, brought forward to now with
+            // the fused velocity; otherwise the barometer's
+            float measuredAltitude(float baroAlt, uint32_t currentTime, bool & fromSonar)
+            {
+                int32_t age = (int32_t)(currentTime - sonarTime);
+
+                if (haveSonar && age >= 0 && (uint32_t)age < SONAR_TIMEOUT_MICROS && sonarAlt < SONAR_CEILING) {
+                    float alt = sonarAlt + fusedVel * age / 1.e6f;
+                    baroOffset = Filter::complementary(baroOffset, alt - baroAlt, cfSonarOffset);
+                    fromSonar = true;
+                    return alt;
+                }
+
+                return baroAlt + baroOffset;
+            }
+
+            void updateKalman(bool armed, uint32_t currentTime)
+            {
+                float dt = (currentTime - kalmanPreviousTime) / 1.e6f;
+                kalmanPreviousTime = currentTime;
+
+                // Velocity increment integrated by the IMU since the last baro sample; the filter estimates the
+                // accelerometer bias itself, so it takes the increment before the IMU's own offset removal
+                float dv = imu.getVerticalVelocityIncrement();
+
+                // Keeps the vertical acceleration current for the hold controller's D term
+                imu.getVerticalVelocity();
+
+                // Calibrate baro AGL at rest
+                if (!armed) {
+                    baro.calibrate();
+                    kalman.reset();
+                    fusedAlt = 0;
+                    fusedVel = 0;
+                    baroOffset = 0;
+                    return;
+                }
+
+                bool fromSonar = false;
+                float alt = measuredAltitude(baro.getInstantAltitude(), currentTime, fromSonar);
+                kalman.update(dt, dv, alt, fromSonar);
+
+                fusedAlt = kalman.getAltitude();
+                fusedVel = kalman.getVelocity();
+            }
+
+            void updatePid(void)
+            {
                 float accZ_tmp = imu.getVerticalAcceleration();
 
                 if (holding) {
@@ -163,7 +393,7 @@ namespace hf {
                     if (!velocityControl) {
                         error = Filter::constrainAbs(altHold - fusedAlt, 500);
                         error = Filter::deadband(error, 10);       // remove small P parametr to reduce noise near zero position
-                        setVel = Filter::constrainAbs((altP * error / 128), 300); // limit velocity to +/- 3 m/s
+                        setVel = Filter::constrainAbs(error * (gains.altP() / 128), 300); // limit velocity to +/- 3 m/s
                     } else {
                         //setVel = setVelocity;
                     }
@@ -171,31 +401,67 @@ namespace hf {
                     // Velocity PID-Controller
                     // P
                     error = setVel - fusedVel;
-                    pid = Filter::constrainAbs((velP * error / 32), 300);
+                    pid = Filter::constrainAbs(error * (gains.velP() / 32), 300);
 
                     // I
-                    errorVelocityI += (velI * error);
+                    errorVelocityI += error * gains.velI();
                     errorVelocityI = Filter::constrainAbs(errorVelocityI, 8196 * 200);
                     pid += errorVelocityI / 8196;     // I in the range of +/-200
 
                     // D
-                    pid -= Filter::constrainAbs(velD * (accZ_tmp + accZ_old) / 512, 150);
+                    pid -= Filter::constrainAbs((accZ_tmp + accZ_old) * (gains.velD() / 512), 150);
                     
                     pid /= 500; // scale down to [-1,+1]
                 }
 
                 accZ_old = accZ_tmp;
 
-            } // updateBaro
+            } // updatePid
 
-            void modifyDemands(demands_t & demands)
+    }; // class AltitudeEstimatorT
+
+    typedef AltitudeEstimatorT<> AltitudeEstimator;
+
+    // Takes the altitude estimator's place when AllFeatures::ALTITUDE is switched off
+    class NoAltitudeEstimator {
+
+        public:
+
+            static const bool TUNABLE = true;
+
+            NoAltitudeEstimator(uint8_t _altP, uint8_t _velP, uint8_t _velI, uint8_t _velD,
+                    IMU::propagation_t _imuPropagation=IMU::PROPAGATE_MATRIX)
             {
-                if (holding) {
+                (void)_altP; (void)_velP; (void)_velI; (void)_velD; (void)_imuPropagation;
+            }
 
-                    demands.throttle = initialThrottleHold+pid;
-                }
+            NoAltitudeEstimator(IMU::propagation_t _imuPropagation=IMU::PROPAGATE_MATRIX)
+            {
+                (void)_imuPropagation;
             }
 
-    }; // class AltitudeEstimator
+            void init(void) { }
+            void setGains(const gains_t & gains) { (void)gains; }
+            void handleAuxSwitch(demands_t & demands) { (void)demands; }
+            void updateAccel(float accel[3], uint32_t currentTime) { (void)accel; (void)currentTime; }
+            void updateGyro(float gyro[3], uint32_t currentTime) { (void)gyro; (void)currentTime; }
+            void updateSonar(bool armed, float distance, uint32_t timestamp) { (void)armed; (void)distance; (void)timestamp; }
+            void updateBaro(bool armed, float pressure, uint32_t currentTime) { (void)armed; (void)pressure; (void)currentTime; }
+            void modifyDemands(demands_t & demands) { (void)demands; }
+            bool isHolding(void) { return false; }
+
+            // No altitude hold to tune
+            void getGains(gains_t & gains)
+            {
+                gains.altP = gains.velP = gains.velI = gains.velD = 0;
+            }
+
+            template <class BoardT>
+            void loadCalibration(BoardT * board) { (void)board; }
+
+            template <class BoardT>
+            void saveCalibration(BoardT * board) { (void)board; }
+
+    }; // class NoAltitudeEstimator
 
 } // namespace hf
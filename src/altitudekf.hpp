@@ -0,0 +1,176 @@
+/*
+    altitudekf.hpp: Steady-state Kalman filter for barometer/accelerometer altitude fusion
+
+    Three states: altitude (cm), vertical velocity (cm/sec), and accelerometer bias (cm/sec^2).  Each barometer
+    sample predicts with the velocity increment the IMU has integrated since the last one, then corrects with
+    the barometer altitude.  With a fixed barometer rate the filter gain converges to a constant, so it is found
+    once in init() by iterating the Riccati recursion, and each update is a handful of multiply-adds with no
+    covariance propagation or matrix inversion.  Sonar altitude, far less noisy than the barometer's, gets a gain
+    of its own.
+
+    This file is part of Hackflight.
+
+    Hackflight is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Hackflight is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <math.h>
+
+namespace hf {
+
+    class AltitudeKalman {
+
+        private:
+
+            static const uint16_t MAX_ITERATIONS = 10000;
+
+            // Nominal barometer period, seconds
+            float _dt;
+
+            // Steady-state gain for altitude, velocity, bias with barometer and with sonar measurements
+            float _gain[3];
+            float _sonarGain[3];
+
+            // State
+            float _alt;
+            float _vel;
+            float _bias;
+
+            // Iterates predict/update (measuring altitude only) until the gain for measurement noise variance R
+            // settles
+            static void steadyStateGain(float dt, float accelNoise, float biasNoise, float R, float steady[3])
+            {
+                // Transition for [alt, vel, bias] over one baro period
+                const float F[3][3] = {
+                    {1, dt, -dt*dt/2},
+                    {0,  1,      -dt},
+                    {0,  0,        1}
+                };
+
+                // White acceleration noise on [alt, vel], random walk on bias
+                float qa = accelNoise * accelNoise;
+                float qb = biasNoise * biasNoise * dt;
+                const float Q[3][3] = {
+                    {qa*dt*dt*dt*dt/4, qa*dt*dt*dt/2, 0},
+                    {qa*dt*dt*dt/2,    qa*dt*dt,      0},
+                    {0,                0,             qb}
+                };
+
+                steady[0] = 0;
+                steady[1] = 0;
+                steady[2] = 0;
+
+                // Start uncertain
+                float P[3][3] = {{R, 0, 0}, {0, R, 0}, {0, 0, R}};
+
+                for (uint16_t n=0; n<MAX_ITERATIONS; ++n) {
+
+                    // P = F P F' + Q
+                    float FP[3][3];
+                    for (uint8_t i=0; i<3; ++i) {
+                        for (uint8_t j=0; j<3; ++j) {
+                            FP[i][j] = F[i][0]*P[0][j] + F[i][1]*P[1][j] + F[i][2]*P[2][j];
+                        }
+                    }
+                    for (uint8_t i=0; i<3; ++i) {
+                        for (uint8_t j=0; j<3; ++j) {
+                            P[i][j] = FP[i][0]*F[j][0] + FP[i][1]*F[j][1] + FP[i][2]*F[j][2] + Q[i][j];
+                        }
+                    }
+
+                    // K = P H' / (H P H' + R), with H = [1 0 0]
+                    float gain[3];
+                    float s = P[0][0] + R;
+                    for (uint8_t i=0; i<3; ++i) {
+                        gain[i] = P[i][0] / s;
+                    }
+
+                    // P = (I - K H) P
+                    float row[3] = {P[0][0], P[0][1], P[0][2]};
+                    for (uint8_t i=0; i<3; ++i) {
+                        for (uint8_t j=0; j<3; ++j) {
+                            P[i][j] -= gain[i] * row[j];
+                        }
+                    }
+
+                    float change = fabsf(gain[0]-steady[0]) + fabsf(gain[1]-steady[1]) + fabsf(gain[2]-steady[2]);
+
+                    steady[0] = gain[0];
+                    steady[1] = gain[1];
+                    steady[2] = gain[2];
+
+                    if (change < 1e-7f) {
+                        break;
+                    }
+                }
+            }
+
+        public:
+
+            // Noise is given as standard deviations: baro altitude (cm), accelerometer (cm/sec^2, as white noise
+            // driving velocity), the random walk of its bias (cm/sec^2 per root second), and sonar altitude (cm)
+            void init(float baroRateHz, float baroNoise=30, float accelNoise=50, float biasNoise=2, float sonarNoise=3)
+            {
+                _dt = 1 / baroRateHz;
+
+                steadyStateGain(_dt, accelNoise, biasNoise, baroNoise * baroNoise, _gain);
+                steadyStateGain(_dt, accelNoise, biasNoise, sonarNoise * sonarNoise, _sonarGain);
+
+                reset();
+            }
+
+            void reset(float alt=0)
+            {
+                _alt = alt;
+                _vel = 0;
+                _bias = 0;
+            }
+
+            // Took dt seconds since the last call, over which the IMU integrated velocity increment dv (cm/sec);
+            // measuredAlt is the barometer altitude (cm), or the sonar's when fromSonar is set
+            void update(float dt, float dv, float measuredAlt, bool fromSonar=false)
+            {
+                const float * gain = fromSonar ? _sonarGain : _gain;
+
+                // Predict
+                float dvb = dv - _bias * dt;
+                _alt += (_vel + dvb / 2) * dt;
+                _vel += dvb;
+
+                // Correct
+                float innovation = measuredAlt - _alt;
+                _alt  += gain[0] * innovation;
+                _vel  += gain[1] * innovation;
+                _bias += gain[2] * innovation;
+            }
+
+            float getAltitude(void)
+            {
+                return _alt;
+            }
+
+            float getVelocity(void)
+            {
+                return _vel;
+            }
+
+            float getGain(uint8_t index)
+            {
+                return _gain[index];
+            }
+
+    }; // class AltitudeKalman
+
+} // namespace hf
@@ -27,74 +27,270 @@
 
 namespace hf {
 
-    class Barometer {
+    // Pressure smoothing for Barometer: the average of the latest HISTORY_SIZE-1 samples, kept as a running float
+    // sum.  Costs HISTORY_SIZE floats, and the sum slowly drifts from rounding over a long flight.
+    class PressureMovingAverage {
+
+        private:
+
+            static const uint8_t HISTORY_SIZE = 48;
+
+            float   history[HISTORY_SIZE];
+            uint8_t historyIdx;
+            float   pressureSum;
+
+        public:
+
+            void init(void)
+            {
+                pressureSum = 0;
+                historyIdx = 0;
+
+                for (uint8_t k=0; k<HISTORY_SIZE; ++k) {
+                    history[k] = 0;
+                }
+            }
+
+            void update(float pressure)
+            {
+                uint8_t indexplus1 = (historyIdx + 1) % HISTORY_SIZE;
+                history[historyIdx] = pressure;
+                pressureSum += history[historyIdx];
+                pressureSum -= history[indexplus1];
+                historyIdx = indexplus1;
+            }
+
+            float get(void)
+            {
+                return pressureSum / (HISTORY_SIZE-1);
+            }
+
+            // Fills the history as though this pressure had always been read
+            void seed(float pressure)
+            {
+                for (uint8_t k=0; k<HISTORY_SIZE; ++k) {
+                    history[k] = pressure;
+                }
+                pressureSum = (HISTORY_SIZE-1) * pressure;
+            }
+
+    }; // class PressureMovingAverage
+
+    // Cascaded integrator-comb decimator: STAGES integrators run on every sample and STAGES combs on every
+    // RATIOth, giving a weighted average of the latest STAGES*(RATIO-1)+1 samples (a triangle for two stages).
+    // Between decimations the output is interpolated from the last two, so it ramps rather than steps (which
+    // would put spikes in the barometer's velocity); the group delay is about STAGES*(RATIO-1)/2 + RATIO samples.
+    // RATIO and STAGES set the delay: the defaults match the 47-sample moving average's in 28 bytes rather than
+    // 200.  Samples are fixed-point (1/1024 mbar) and the accumulators wrap modulo 2^32, which cancels exactly in
+    // the combs, so there is no drift however long the flight.
+    template <uint8_t RATIO=12, uint8_t STAGES=2>
+    class PressureDecimator {
+
+        private:
+
+            static const int32_t SCALE = 1024;
+
+            // Overall gain RATIO^STAGES times 1100 mbar of fixed-point input must fit in 31 bits
+            static constexpr uint32_t gain(uint8_t stages)
+            {
+                return stages ? RATIO * gain(stages-1) : 1;
+            }
+
+            uint32_t integrator[STAGES];
+            uint32_t comb[STAGES];
+            uint8_t  count;
+            float    previous;
+            float    output;
+
+        public:
+
+            void init(void)
+            {
+                static_assert(STAGES >= 1 && RATIO >= 1 && gain(STAGES) <= 1024, "PressureDecimator gain too large");
+
+                for (uint8_t k=0; k<STAGES; ++k) {
+                    integrator[k] = 0;
+                    comb[k] = 0;
+                }
+                count = 0;
+                previous = 0;
+                output = 0;
+            }
+
+            void update(float pressure)
+            {
+                uint32_t x = (uint32_t)(int32_t)(pressure * SCALE + 0.5f);
+
+                integrator[0] += x;
+                for (uint8_t k=1; k<STAGES; ++k) {
+                    integrator[k] += integrator[k-1];
+                }
+
+                if (++count < RATIO) {
+                    return;
+                }
+
+                count = 0;
+
+                uint32_t y = integrator[STAGES-1];
+                for (uint8_t k=0; k<STAGES; ++k) {
+                    uint32_t tmp = y;
+                    y -= comb[k];
+                    comb[k] = tmp;
+                }
+
+                previous = output;
+                output = (int32_t)y / (float)(gain(STAGES) * SCALE);
+            }
+
+            float get(void)
+            {
+                return previous + (output - previous) * count / RATIO;
+            }
+
+            // Runs enough of this pressure through for both the integrators and combs to settle on it
+            void seed(float pressure)
+            {
+                init();
+                for (uint16_t k=0; k<(STAGES+1)*RATIO; ++k) {
+                    update(pressure);
+                }
+                previous = output;
+            }
+
+    }; // class PressureDecimator
+
+    template <class PressureFilter=PressureMovingAverage>
+    class BarometerT {
 
         private: // constants
 
             const float NOISE_LPF             = 0.5f;
             const float VELOCITY_BOUND        = 300.f;
             const float VELOCITY_DEADBAND     = 10.f;
-            static const uint8_t HISTORY_SIZE = 48;
+
+            // A saved ground pressure this close to the first sample is trusted; any further off and the vehicle
+            // or the weather has moved since it was saved
+            const float SEED_TOLERANCE        = 1.f;
+
+            PressureFilter filter;
 
             float   alt;
-            float   history[HISTORY_SIZE];
-            uint8_t historyIdx;
+            float   latestPressure;
             float   groundAltitude;
+            float   groundPressure;
             float   previousAlt;
-            float   pressureSum;
+            uint32_t previousTime;
+
+            // Ground pressure saved from an earlier boot, if any, and whether the first sample has been seen
+            float    seededPressure;
+            bool     primed;
+            uint16_t restSamples;
+
+            // Flight band for the polynomial pressure-to-altitude approximation, in millibars
+            // (roughly -700m to +3000m in the standard atmosphere)
+            const float BAND_LOW  = 700.f;
+            const float BAND_HIGH = 1100.f;
 
             // Pressure in millibars to altitude in centimeters
-            float millibarsToCentimeters(float pa)
+            static float millibarsToCentimetersExact(float pa)
             {
                 //return (1.0f - powf(pa / 1013.25f, 0.190295f)) * 44330.0f;
                 return (1.0f - powf(pa / 1013.25f, 0.190295f)) * 4433000.0f;
             }
 
+            // Within the flight band, a degree-5 Chebyshev fit to the formula above, in u = (pa-900)/200, stays
+            // within 0.5cm of it; outside the band we fall back to powf()
+            float millibarsToCentimeters(float pa)
+            {
+                if (pa < BAND_LOW || pa > BAND_HIGH) {
+                    return millibarsToCentimetersExact(pa);
+                }
+
+                float u = (pa - 900.f) / 200.f;
+
+                return 98865.02126f + u * (-183281.01476f + u * (16483.11623f + u * (-2209.28525f + 
+                                u * (361.28334f + u * -61.42364f))));
+            }
+
         public:
 
             void init(void)
             {
-                pressureSum = 0;
-                historyIdx = 0;
+                filter.init();
+                latestPressure = 0;
                 groundAltitude = 0;
+                groundPressure = 0;
                 alt = 0;
                 previousAlt = 0;
+                previousTime = 0;
+                seededPressure = 0;
+                primed = false;
+                restSamples = 0;
+            }
 
-                for (uint8_t k=0; k<HISTORY_SIZE; ++k) {
-                    history[k] = 0;
-                }
+            // Call after init() with a saved ground pressure (mbar), checked against the first sample
+            void seed(float pressure)
+            {
+                seededPressure = pressure;
             }
 
             void calibrate(void)
             {
-                static float   groundPressure;
-
                 groundPressure -= groundPressure / 8;
-                groundPressure += pressureSum / (HISTORY_SIZE - 1);
+                groundPressure += filter.get();
                 groundAltitude = millibarsToCentimeters(groundPressure/8);
+
+                if (restSamples < UINT16_MAX) {
+                    restSamples++;
+                }
             }
 
             void update(float pressure)
             {
-                uint8_t indexplus1 = (historyIdx + 1) % HISTORY_SIZE;
-                history[historyIdx] = pressure;
-                pressureSum += history[historyIdx];
-                pressureSum -= history[indexplus1];
-                historyIdx = indexplus1;
+                latestPressure = pressure;
+
+                // Start the filter and ground pressure from the first sample, or the saved ground pressure if it
+                // agrees, rather than ramping up from zero
+                if (!primed) {
+                    filter.seed(pressure);
+                    float ground = fabsf(seededPressure - pressure) < SEED_TOLERANCE ? seededPressure : pressure;
+                    groundPressure = 8 * ground;
+                    groundAltitude = millibarsToCentimeters(ground);
+                    primed = true;
+                }
+
+                filter.update(pressure);
+            }
+
+            // Ground pressure (mbar) as calibrated so far, and how many samples at rest went into it
+            float getGroundPressure(void)
+            {
+                return groundPressure / 8;
+            }
+
+            uint16_t getRestSamples(void)
+            {
+                return restSamples;
             }
 
             float getAltitude(void)
             {
-                float alt_tmp = millibarsToCentimeters(pressureSum/(HISTORY_SIZE-1)) - groundAltitude;
+                float alt_tmp = millibarsToCentimeters(filter.get()) - groundAltitude;
                 alt = Filter::complementary(alt, alt_tmp, NOISE_LPF);
 
                 return alt;
             }
 
+            // Latest sample alone, without the moving average or low-pass filter, for estimators that model
+            // the noise themselves
+            float getInstantAltitude(void)
+            {
+                return millibarsToCentimeters(latestPressure) - groundAltitude;
+            }
+
             float getVelocity(uint32_t currentTime)
             {
-                static float previousAlt;
-                static uint32_t previousTime;
                 float vel = (alt - previousAlt) * 1000000.0f / (currentTime-previousTime);
                 previousAlt = alt;
                 previousTime = currentTime;
@@ -103,6 +299,8 @@ namespace hf {
             }
 
 
-    }; // class Barometer
+    }; // class BarometerT
+
+    typedef BarometerT<> Barometer;
 
 } // namespace hf
@@ -0,0 +1,144 @@
+/*
+   binaryangle.hpp : Angles as 16-bit fractions of a turn
+
+   A turn is 65536 units (about 9.6e-5 radian each), so angles wrap by plain integer overflow, with no branch and
+   no 2*pi, and the difference of two headings is exact and already in range.  The same 16 bits read as
+   unsigned give [0,2*pi) and as signed give [-pi,+pi).  Sine and cosine come from a quarter-wave table.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+namespace hf {
+
+    class BinaryAngle {
+
+        private:
+
+            static constexpr float UNITS_PER_RADIAN = 10430.3784f;  // 65536 / (2*pi)
+            static constexpr float RADIANS_PER_UNIT = 9.58737992e-5f;
+
+            uint16_t _units;
+
+            // Sine of n/256 of a turn, for any n
+            static float sinStep(uint16_t n)
+            {
+                // sin(k*pi/128) for k = 0 .. 64
+                static const float QUARTER[65] = {
+                    0.00000000f, 0.02454123f, 0.04906767f, 0.07356456f, 0.09801714f, 0.12241068f, 0.14673047f,
+                    0.17096189f, 0.19509032f, 0.21910124f, 0.24298018f, 0.26671276f, 0.29028468f, 0.31368174f,
+                    0.33688985f, 0.35989504f, 0.38268343f, 0.40524131f, 0.42755509f, 0.44961133f, 0.47139674f,
+                    0.49289819f, 0.51410274f, 0.53499762f, 0.55557023f, 0.57580819f, 0.59569930f, 0.61523159f,
+                    0.63439328f, 0.65317284f, 0.67155895f, 0.68954054f, 0.70710678f, 0.72424708f, 0.74095113f,
+                    0.75720885f, 0.77301045f, 0.78834643f, 0.80320753f, 0.81758481f, 0.83146961f, 0.84485357f,
+                    0.85772861f, 0.87008699f, 0.88192126f, 0.89322430f, 0.90398929f, 0.91420976f, 0.92387953f,
+                    0.93299280f, 0.94154407f, 0.94952818f, 0.95694034f, 0.96377607f, 0.97003125f, 0.97570213f,
+                    0.98078528f, 0.98527764f, 0.98917651f, 0.99247953f, 0.99518473f, 0.99729046f, 0.99879546f,
+                    0.99969882f, 1.00000000f
+                };
+
+                uint8_t k = n & 63;
+                float s = (n & 64) ? QUARTER[64-k] : QUARTER[k];
+                return (n & 128) ? -s : s;
+            }
+
+        public:
+
+            BinaryAngle(void) : _units(0) { }
+
+            explicit BinaryAngle(uint16_t units) : _units(units) { }
+
+            // Any angle in radians (up to about 2e5 of them), rounded to the nearest unit and wrapped into a turn
+            static BinaryAngle fromRadians(float radians)
+            {
+                float units = radians * UNITS_PER_RADIAN;
+                return BinaryAngle((uint16_t)(int32_t)(units + (units < 0 ? -.5f : +.5f)));
+            }
+
+            uint16_t units(void) const
+            {
+                return _units;
+            }
+
+            // The angle as a two-byte [-pi,+pi) value, for telemetry
+            int16_t signedUnits(void) const
+            {
+                return (int16_t)_units;
+            }
+
+            // In [0,2*pi)
+            float radians(void) const
+            {
+                return _units * RADIANS_PER_UNIT;
+            }
+
+            // In [-pi,+pi)
+            float signedRadians(void) const
+            {
+                return (int16_t)_units * RADIANS_PER_UNIT;
+            }
+
+            // Sine and cosine together, by linear interpolation in a 256-step-per-turn table; the absolute error is
+            // under 8e-5
+            void sincos(float & s, float & c) const
+            {
+                uint16_t n = _units >> 8;
+                float f = (_units & 0xFF) * (1 / 256.f);
+
+                float s0 = sinStep(n), s1 = sinStep(n+1);
+                float c0 = sinStep(n+64), c1 = sinStep(n+65);
+
+                s = s0 + f * (s1 - s0);
+                c = c0 + f * (c1 - c0);
+            }
+
+            BinaryAngle operator+(BinaryAngle other) const
+            {
+                return BinaryAngle((uint16_t)(_units + other._units));
+            }
+
+            BinaryAngle operator-(BinaryAngle other) const
+            {
+                return BinaryAngle((uint16_t)(_units - other._units));
+            }
+
+            BinaryAngle & operator+=(BinaryAngle other)
+            {
+                _units += other._units;
+                return *this;
+            }
+
+            BinaryAngle & operator-=(BinaryAngle other)
+            {
+                _units -= other._units;
+                return *this;
+            }
+
+            bool operator==(BinaryAngle other) const
+            {
+                return _units == other._units;
+            }
+
+            bool operator!=(BinaryAngle other) const
+            {
+                return _units != other._units;
+            }
+
+    }; // class BinaryAngle
+
+} // namespace hf
@@ -0,0 +1,234 @@
+/*
+   blackbox.hpp : On-board flight recorder
+
+   Each gyro loop quantizes one fixed-size record (timestamp, gyro rates, demands before and after stabilization,
+   motor outputs) into a RAM ring; that is all the time-critical path does.  A low-priority flush drains the ring,
+   delta-encoding each record against the previous one as zigzag varints, and hands the bytes to the board's
+   blackbox device (flash, SD card, serial port, or a file in simulation).
+
+   Stream format (decoded by extras/blackbox/bbdecode.py):
+
+       header:  'H' 'F' 'B' 'B' version nmotors
+       frames:  'I' field...   key frame: every field as an absolute value
+                'P' field...   delta frame: every field as the difference from the previous record
+
+   Fields in order: time (usec), gyro[3] (mrad/s), demands in[4], demands out[4] (x10000), motors[nmotors] (x1000).
+   Time is an unsigned varint; all other fields are zigzag varints.  A key frame is sent every KEY_INTERVAL
+   records and after any record is dropped, so a decoder can always resynchronize.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include "datatypes.hpp"
+#include "ringbuffer.hpp"
+
+namespace hf {
+
+    class Blackbox {
+
+        public:
+
+            static const uint8_t VERSION      = 1;
+            static const uint8_t MAXMOTORS    = 8;
+            static const uint8_t KEY_INTERVAL = 32;
+
+            // Records buffered in RAM between flushes: at 1 kHz this rides out 64 msec without a flush
+            static const uint16_t RING_SIZE = 64;
+
+            typedef struct {
+
+                uint32_t time;
+                int16_t  gyro[3];
+                int16_t  demandsIn[4];
+                int16_t  demandsOut[4];
+                int16_t  motors[MAXMOTORS];
+
+            } record_t;
+
+        private:
+
+            // Worst case for one encoded frame: type byte, 5-byte time, 3-byte zigzag varints for the rest
+            static const uint8_t STAGING_SIZE = 1 + 5 + 3*(3+4+4+MAXMOTORS);
+
+            RingBuffer<record_t, RING_SIZE> _ring;
+
+            record_t _prev;
+
+            uint8_t  _nmotors;
+            uint8_t  _sinceKey;
+            bool     _needKey;
+            uint32_t _dropped;
+
+            uint8_t  _staging[STAGING_SIZE];
+            uint8_t  _stagingIndex;
+            uint8_t  _stagingSize;
+
+            static int16_t quantize(float value, float scale)
+            {
+                float q = value * scale;
+                return q > 32767 ? 32767 : q < -32767 ? -32767 : (int16_t)(q + (q >= 0 ? 0.5f : -0.5f));
+            }
+
+            static void quantizeDemands(const demands_t & demands, int16_t q[4])
+            {
+                q[0] = quantize(demands.throttle, 10000);
+                q[1] = quantize(demands.roll,     10000);
+                q[2] = quantize(demands.pitch,    10000);
+                q[3] = quantize(demands.yaw,      10000);
+            }
+
+            void putVarint(uint32_t value)
+            {
+                while (value >= 0x80) {
+                    _staging[_stagingSize++] = (uint8_t)(value | 0x80);
+                    value >>= 7;
+                }
+                _staging[_stagingSize++] = (uint8_t)value;
+            }
+
+            void putZigzag(int32_t value)
+            {
+                putVarint(((uint32_t)value << 1) ^ (uint32_t)(value >> 31));
+            }
+
+            void putFields(const int16_t * fields, const int16_t * prev, uint8_t count, bool key)
+            {
+                for (uint8_t k=0; k<count; ++k) {
+                    putZigzag(key ? fields[k] : fields[k] - prev[k]);
+                }
+            }
+
+            void encode(const record_t & r)
+            {
+                bool key = _needKey || _sinceKey >= KEY_INTERVAL;
+
+                _stagingIndex = 0;
+                _stagingSize = 0;
+
+                _staging[_stagingSize++] = key ? 'I' : 'P';
+                putVarint(key ? r.time : r.time - _prev.time);
+                putFields(r.gyro,       _prev.gyro,       3,        key);
+                putFields(r.demandsIn,  _prev.demandsIn,  4,        key);
+                putFields(r.demandsOut, _prev.demandsOut, 4,        key);
+                putFields(r.motors,     _prev.motors,     _nmotors, key);
+
+                _sinceKey = key ? 1 : _sinceKey + 1;
+                _needKey = false;
+                _prev = r;
+            }
+
+        public:
+
+            void init(uint8_t nmotors)
+            {
+                _ring.clear();
+                _nmotors = nmotors < MAXMOTORS ? nmotors : MAXMOTORS;
+                _sinceKey = 0;
+                _needKey = true;
+                _dropped = 0;
+
+                // Stream header goes out with the first flush
+                const uint8_t header[] = {'H', 'F', 'B', 'B', VERSION, _nmotors};
+                for (_stagingSize=0; _stagingSize<sizeof(header); ++_stagingSize) {
+                    _staging[_stagingSize] = header[_stagingSize];
+                }
+                _stagingIndex = 0;
+            }
+
+            // Called from the gyro loop; cheap enough for every iteration
+            void record(uint32_t usec, const float gyroRates[3], const demands_t & demandsIn, const demands_t & demandsOut,
+                        const float * motors)
+            {
+                record_t r;
+
+                r.time = usec;
+
+                for (uint8_t k=0; k<3; ++k) {
+                    r.gyro[k] = quantize(gyroRates[k], 1000);
+                }
+
+                quantizeDemands(demandsIn,  r.demandsIn);
+                quantizeDemands(demandsOut, r.demandsOut);
+
+                for (uint8_t k=0; k<_nmotors; ++k) {
+                    r.motors[k] = quantize(motors[k], 1000);
+                }
+
+                if (!_ring.push(r)) {
+                    _dropped++;
+                    _needKey = true;
+                }
+            }
+
+            // Called from a low-priority slot: encodes and writes up to maxRecords records.  The board's write
+            // routine may accept fewer bytes than offered; the remainder waits for the next flush.
+            template <class BoardT>
+            void flush(BoardT * board, uint8_t maxRecords)
+            {
+                uint8_t records = 0;
+
+                while (true) {
+
+                    if (_stagingIndex < _stagingSize) {
+                        uint8_t pending = _stagingSize - _stagingIndex;
+                        uint16_t written = board->blackboxWrite(&_staging[_stagingIndex], pending);
+                        _stagingIndex += written;
+                        if (written < pending) {
+                            break;
+                        }
+                    }
+
+                    record_t r;
+                    if (records >= maxRecords || !_ring.pop(r)) {
+                        break;
+                    }
+
+                    encode(r);
+                    records++;
+                }
+            }
+
+            uint32_t droppedCount(void)
+            {
+                return _dropped;
+            }
+
+    }; // class Blackbox
+
+    // Takes Blackbox's place when AllFeatures::BLACKBOX is switched off
+    class NoBlackbox {
+
+        public:
+
+            void init(uint8_t nmotors) { (void)nmotors; }
+
+            void record(uint32_t usec, const float gyroRates[3], const demands_t & demandsIn, const demands_t & demandsOut,
+                        const float * motors)
+            {
+                (void)usec; (void)gyroRates; (void)demandsIn; (void)demandsOut; (void)motors;
+            }
+
+            template <class BoardT>
+            void flush(BoardT * board, uint8_t maxRecords) { (void)board; (void)maxRecords; }
+
+            uint32_t droppedCount(void) { return 0; }
+
+    }; // class NoBlackbox
+
+} // namespace hf
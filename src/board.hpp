@@ -21,13 +21,40 @@
 #include <stdarg.h>
 
 #include "datatypes.hpp"
+#include "outbuf.hpp"
+#include "fastmath.hpp"
 
 namespace hf {
 
+    // What the flight code hands MSP: filled once by Hackflight, which keeps it up to date, and passed to
+    // doSerialComms() by pointer.  Null where a subsystem is built out or switched off, and for the mixer in
+    // dual-core mode.
+    struct MSPContext {
+        const class VehicleState * state;
+        class Mixer              * mixer;
+        class Profiler           * profiler;
+        class GyroSpectrum       * spectrum;
+        class GainBuffer         * gains;
+        class TelemetryEnvelope  * envelope;
+        class LoadGovernor       * governor;
+    };
+
+    // Takes MSPContext's place in Hackflight built without Features::SERIAL
+    struct NoMSPContext { };
+
     class Board {
 
         public:
 
+            // Data sources, as bits for pollEvents()
+            enum {
+                EVENT_GYRO     = 0x01,
+                EVENT_ATTITUDE = 0x02, // Euler angles or quaternion
+                EVENT_ACCEL    = 0x04,
+                EVENT_BARO     = 0x08,
+                EVENT_ALL      = 0xFF
+            };
+
             //------------------------------------ Core functionality ----------------------------------------------------
             virtual void     init(void) = 0;
             virtual bool     getEulerAngles(float eulerAngles[3]) = 0;
@@ -35,19 +62,108 @@ namespace hf {
             virtual uint32_t getMicroseconds() = 0;
             virtual void     writeMotor(uint8_t index, float value) = 0;
 
+            // Gets new gyro rates along with the time they were acquired, on the getMicroseconds() clock.  Boards
+            // that timestamp the sensor's data-ready signal (or, in simulation, know when the sample was taken)
+            // override this; by default the sample is taken to have been acquired when it was read.
+            virtual bool     getGyroSample(float gyroRates[3], uint32_t & usec)
+            {
+                if (!getGyroRates(gyroRates)) {
+                    return false;
+                }
+                usec = getMicroseconds();
+                return true;
+            }
+
+            // Which sources have fresh data, as EVENT_* bits, so the flight loop calls into only those.  Called once
+            // per loop pass, before any of their get*() methods (from the background core, in dual-core mode, where
+            // the gyro is read regardless).  A source's bit should stay set until its get*() method consumes the
+            // data.  Boards that can't tell cheaply, from interrupt flags or a single status read, keep this default
+            // and have every source read as before.
+            virtual uint8_t  pollEvents(void) { return EVENT_ALL; }
+
+            // Called when the loop has nothing to do for up to maxMicros: boards that can sleep until an interrupt
+            // brings new data (e.g. with WFI) do so, returning on that interrupt or once maxMicros have gone by,
+            // whichever is first.  Boards that poll for their data must return at once, as this default does.
+            virtual void     idle(uint32_t maxMicros) { (void)maxMicros; }
+
+            // Writes all motors at once; boards can override to update every output together
+            virtual void     writeMotors(const float * values, uint8_t count)
+            {
+                for (uint8_t i=0; i<count; ++i) {
+                    writeMotor(i, values[i]);
+                }
+            }
+
+            // Attitude as a unit quaternion (w, x, y, z), for leveling with Features::QUATERNION.  Boards whose sensor
+            // fuses to a quaternion (e.g. the EM7180) override this to skip the Euler conversion; by default the
+            // Euler angles are converted back, which costs more than it saves.
+            virtual bool     getQuaternion(float quaternion[4])
+            {
+                float eulerAngles[3];
+                if (!getEulerAngles(eulerAngles)) {
+                    return false;
+                }
+                FastMath::quaternionFromEuler(eulerAngles, quaternion);
+                return true;
+            }
+
             //------------------------ Support for additional PID controllers --------------------------------------------
             virtual bool     getAccelerometer(float accelGs[3]) { (void)accelGs; return false; }
             virtual bool     getBarometer(float & pressure) { (void)pressure; return false; }
 
+            // Boards with a downward sonar (see sonars.hpp) return each new reading: distance in cm along the
+            // sensor's axis, and the time it was taken.  Must not block.
+            virtual bool     getSonarAltitude(float & distance, uint32_t & timestamp) { (void)distance; (void)timestamp; return false; }
+
             //----------------------------------------- Safety ----------------------------------------------------------
             virtual void     showArmedStatus(bool armed) { (void)armed; }
 
+            // Boards whose sensors come up in the background, after init() has returned, return false until they
+            // are, and report nothing from pollEvents() meanwhile.  The loop runs from the start, but won't arm.
+            virtual bool     ready(void) { return true; }
+
+            // Called on every receiver check until the vehicle can arm, with booting true, then once with it false
+            virtual void     showBootStatus(bool booting) { (void)booting; }
+
             //---------------------------------- Serial communications  -------------------------------------------------
-            virtual void     doSerialComms(float eulerAngles[3], bool armed, class Receiver * receiver, class Mixer * mixer)  
-                                { (void)eulerAngles; (void)armed; (void)receiver; (void)mixer; }
+            // Replies with the vehicle state as of the last control cycle
+            virtual void     doSerialComms(const MSPContext * context, bool armed) { (void)context; (void)armed; }
+
+            //--------------------------------------- Profiling ---------------------------------------------------------
+            // Override with a hardware cycle counter where available, along with its rate
+            virtual uint32_t getCycleCount(void) { return getMicroseconds(); }
+            virtual uint32_t getCyclesPerMicrosecond(void) { return 1; }
+
+            //------------------------------------- Flight recording ----------------------------------------------------
+            // Boards with somewhere to put a blackbox log (flash, SD, a spare serial port, a file) override both.
+            // blackboxWrite() must not block; it returns how many of the bytes it accepted.
+            virtual bool     hasBlackbox(void) { return false; }
+            virtual uint16_t blackboxWrite(const uint8_t * buf, uint16_t len) { (void)buf; (void)len; return 0; }
+
+            //--------------------------------------- Calibration -------------------------------------------------------
+            // Boards with nonvolatile storage (EEPROM, flash, a file) override both to keep sensor calibration across
+            // power cycles.  calibrationRead() returns the number of bytes read; calibrationWrite() is only called
+            // while disarmed, so it may take a few msec.
+            virtual uint16_t calibrationRead(uint8_t * buf, uint16_t len) { (void)buf; (void)len; return 0; }
+            virtual void     calibrationWrite(const uint8_t * buf, uint16_t len) { (void)buf; (void)len; }
 
             //--------------------------------------- Debugging ---------------------------------------------------------
-            static void      outbuf(char * buf);
+            // Queues text to print, dropping it if the queue is full, so it never waits on the port (see outbuf.hpp)
+            static void      outbuf(char * buf) { OutbufQueue::write(buf); }
+
+            // Each board (or sim platform header) defines this to pass queued text to its port.  Must not block; it
+            // returns how many of the bytes it accepted.
+            static uint16_t  outbufWrite(const uint8_t * buf, uint16_t len);
+
+            // Called from a low-priority slot.  Boards whose port also carries other traffic override it to hold the
+            // text back until that traffic is out of the way.
+            virtual void     drainOutbuf(void) { OutbufQueue::drain(outbufWrite); }
+
+            // Boards that can carry DebugLog's binary stream to a host decoder (see debuglog.hpp) override both;
+            // others get the messages formatted, through outbuf().  debugLogWrite() must not block; it returns how
+            // many of the bytes it accepted.
+            virtual bool     hasDebugLog(void) { return false; }
+            virtual uint16_t debugLogWrite(const uint8_t * buf, uint16_t len) { (void)buf; (void)len; return 0; }
 
     }; // class Board
 
@@ -0,0 +1,371 @@
+/*
+   hilboard.hpp : Board on a host, for flight code run against a real board's sensors
+
+   The real board runs a HILBridge (see boards/real/hilbridge.hpp), which streams its sensor samples here in
+   the packets of hil.hpp; HILBoard hands them to Hackflight like any board's, and sends the motor values back.
+   Gyro samples are queued, so each one reaches the flight code however many come in a packet; the
+   accelerometer, attitude, and barometer give their latest, as the flight code reads them at their own rates.
+   Every motor write goes out at once, in a packet of its own.
+
+   The clock is the real board's, so sample times and the loop's timing agree: HILBoard keeps the smallest
+   difference seen between the host's clock and the newest sample of each packet (the packet least held up on
+   the way), takes a fresh smallest difference each CLOCK_WINDOW_MICROS to follow drift between the two clocks,
+   and never lets the time go backward.  init() waits up to SYNC_TIMEOUT_MICROS for the first packet, so the
+   clock is set before the loop starts.
+
+   Subclasses supply the transport, through readBytes(), which must not block, and writeBytes(), which must take
+   the whole packet; and the host's clock.  LinuxHILBoard (see linux.hpp) does this for a serial device.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include "board.hpp"
+#include "fastmath.hpp"
+#include "hil.hpp"
+#include "ringbuffer.hpp"
+
+namespace hf {
+
+    class HILBoard : public Board {
+
+        public:
+
+            static const uint32_t CLOCK_WINDOW_MICROS = 1000000;
+            static const uint32_t SYNC_TIMEOUT_MICROS = 2000000;
+
+            typedef struct {
+
+                uint32_t packets;
+                uint32_t lostPackets;     // gaps in the board's sequence numbers
+                uint32_t badPackets;      // failed their CRC
+                uint32_t samples;         // of every kind
+                uint32_t overflows;       // gyro samples dropped for want of queue
+
+                // Microseconds from a gyro sample to the flight code reading it, on the board's clock
+                uint32_t gyroSamples;
+                uint32_t ageMin;
+                uint32_t ageMax;
+                uint64_t ageSum;
+
+            } stats_t;
+
+        private:
+
+            // Most gyro samples held, less one
+            static const uint16_t QUEUE_SIZE = 32;
+
+            typedef struct {
+                uint32_t usec;
+                float    values[3];
+            } sample_t;
+
+            HILReader _reader;
+            HILWriter _writer;
+
+            RingBuffer<sample_t, QUEUE_SIZE> _gyro;
+
+            float _accel[3];
+            bool  _haveAccel;
+            float _quaternion[4];
+            bool  _haveQuaternion;
+            float _pressure;
+            bool  _haveBaro;
+
+            float   _motors[HIL::MAX_MOTORS];
+            uint8_t _motorCount;
+
+            // Board time of the latest gyro sample read, which motor packets carry back
+            uint32_t _gyroMicros;
+
+            // Host time less board time
+            bool     _clockSet;
+            uint32_t _offset;
+            uint32_t _windowMin;
+            uint32_t _windowStart;
+            uint32_t _lastMicros;
+
+            stats_t _stats;
+
+            void queue(const HIL::record_t & record)
+            {
+                sample_t sample = {record.usec, {record.values[0], record.values[1], record.values[2]}};
+                if (!_gyro.push(sample)) {
+                    _stats.overflows++;
+                }
+            }
+
+            void updateClock(uint32_t boardMicros)
+            {
+                uint32_t host = hostMicros();
+                uint32_t delta = host - boardMicros;
+
+                if (!_clockSet) {
+                    _offset = _windowMin = delta;
+                    _windowStart = host;
+                    _clockSet = true;
+                    return;
+                }
+
+                if ((int32_t)(delta - _windowMin) < 0) {
+                    _windowMin = delta;
+                }
+
+                // A packet less held up than any before it means the offset was too big
+                if ((int32_t)(delta - _offset) < 0) {
+                    _offset = delta;
+                }
+
+                if (host - _windowStart >= CLOCK_WINDOW_MICROS) {
+                    _offset = _windowMin;
+                    _windowMin = delta;
+                    _windowStart = host;
+                }
+            }
+
+            void receive(void)
+            {
+                uint8_t buf[HIL::PACKET_SIZE];
+
+                uint16_t count;
+
+                while ((count = readBytes(buf, sizeof(buf))) > 0) {
+
+                    for (uint16_t k=0; k<count; ++k) {
+
+                        if (!_reader.parse(buf[k])) {
+                            continue;
+                        }
+
+                        uint32_t newest = _reader.base();
+
+                        HIL::record_t record;
+                        while (_reader.next(record)) {
+                            take(record);
+                            newest = (int32_t)(record.usec - newest) > 0 ? record.usec : newest;
+                        }
+
+                        updateClock(newest);
+                    }
+                }
+
+                _stats.packets = _reader.packets();
+                _stats.lostPackets = _reader.lost();
+                _stats.badPackets = _reader.bad();
+            }
+
+            void take(const HIL::record_t & record)
+            {
+                _stats.samples++;
+
+                switch (record.type) {
+
+                    case HIL::GYRO:
+                        queue(record);
+                        break;
+
+                    case HIL::ACCEL:
+                        memcpy(_accel, record.values, sizeof(_accel));
+                        _haveAccel = true;
+                        break;
+
+                    case HIL::QUATERNION:
+                        memcpy(_quaternion, record.values, sizeof(_quaternion));
+                        _haveQuaternion = true;
+                        break;
+
+                    case HIL::BARO:
+                        _pressure = record.values[0];
+                        _haveBaro = true;
+                        break;
+
+                    default:
+                        _stats.samples--;
+                        break;
+                }
+            }
+
+            void sendMotors(void)
+            {
+                _writer.motors(_gyroMicros, _motors, _motorCount);
+                uint8_t size = 0;
+                const uint8_t * packet = _writer.finish(size);
+                writeBytes(packet, size);
+            }
+
+        protected:
+
+            // Copies up to maxlen already-received bytes into buf, returning the number copied
+            virtual uint16_t readBytes(uint8_t * buf, uint16_t maxlen) = 0;
+
+            // Sends all of a packet
+            virtual void     writeBytes(const uint8_t * buf, uint16_t len) = 0;
+
+            // Microseconds on a steady host clock
+            virtual uint32_t hostMicros(void) = 0;
+
+            // Waits up to maxMicros for bytes to come in; the default doesn't wait
+            virtual void     waitForBytes(uint32_t maxMicros) { (void)maxMicros; }
+
+        public:
+
+            void init(void)
+            {
+                _reader.init();
+                _gyro.clear();
+                _haveAccel = false;
+                _haveQuaternion = false;
+                _haveBaro = false;
+                memset(_motors, 0, sizeof(_motors));
+                _motorCount = 0;
+                _gyroMicros = 0;
+                _clockSet = false;
+                _offset = 0;
+                _lastMicros = 0;
+
+                memset(&_stats, 0, sizeof(_stats));
+                _stats.ageMin = UINT32_MAX;
+
+                uint32_t start = hostMicros();
+                while (!_clockSet && hostMicros() - start < SYNC_TIMEOUT_MICROS) {
+                    waitForBytes(SYNC_TIMEOUT_MICROS - (hostMicros() - start));
+                    receive();
+                }
+            }
+
+            void getStats(stats_t & stats)
+            {
+                stats = _stats;
+            }
+
+            // methods called by Hackflight -------------------------------------------------
+
+            uint8_t pollEvents(void)
+            {
+                receive();
+
+                return (_gyro.available() ? EVENT_GYRO : 0) | (_haveAccel ? EVENT_ACCEL : 0) |
+                    (_haveQuaternion ? EVENT_ATTITUDE : 0) | (_haveBaro ? EVENT_BARO : 0);
+            }
+
+            // Sleeps until bytes come in, when the transport can
+            void idle(uint32_t maxMicros)
+            {
+                if (!_gyro.available()) {
+                    waitForBytes(maxMicros);
+                }
+            }
+
+            bool getGyroRates(float gyroRates[3])
+            {
+                uint32_t usec;
+                return getGyroSample(gyroRates, usec);
+            }
+
+            bool getGyroSample(float gyroRates[3], uint32_t & usec)
+            {
+                sample_t sample;
+                if (!_gyro.pop(sample)) {
+                    return false;
+                }
+
+                memcpy(gyroRates, sample.values, sizeof(sample.values));
+                usec = sample.usec;
+                _gyroMicros = sample.usec;
+
+                uint32_t age = getMicroseconds() - sample.usec;
+                _stats.gyroSamples++;
+                _stats.ageSum += age;
+                _stats.ageMin = age < _stats.ageMin ? age : _stats.ageMin;
+                _stats.ageMax = age > _stats.ageMax ? age : _stats.ageMax;
+
+                return true;
+            }
+
+            bool getQuaternion(float quaternion[4])
+            {
+                if (!_haveQuaternion) {
+                    return false;
+                }
+                memcpy(quaternion, _quaternion, sizeof(_quaternion));
+                _haveQuaternion = false;
+                return true;
+            }
+
+            bool getEulerAngles(float eulerAngles[3])
+            {
+                float quaternion[4];
+                if (!getQuaternion(quaternion)) {
+                    return false;
+                }
+                FastMath::eulerFromQuaternion(quaternion, eulerAngles);
+                return true;
+            }
+
+            bool getAccelerometer(float accelGs[3])
+            {
+                if (!_haveAccel) {
+                    return false;
+                }
+                memcpy(accelGs, _accel, sizeof(_accel));
+                _haveAccel = false;
+                return true;
+            }
+
+            bool getBarometer(float & pressure)
+            {
+                if (!_haveBaro) {
+                    return false;
+                }
+                pressure = _pressure;
+                _haveBaro = false;
+                return true;
+            }
+
+            // The board's clock, as near as the host can tell
+            uint32_t getMicroseconds()
+            {
+                uint32_t usec = hostMicros() - _offset;
+                if ((int32_t)(usec - _lastMicros) < 0) {
+                    usec = _lastMicros;
+                }
+                _lastMicros = usec;
+                return usec;
+            }
+
+            void writeMotor(uint8_t index, float value)
+            {
+                if (index >= HIL::MAX_MOTORS) {
+                    return;
+                }
+                _motors[index] = value;
+                _motorCount = index >= _motorCount ? index + 1 : _motorCount;
+                sendMotors();
+            }
+
+            void writeMotors(const float * values, uint8_t count)
+            {
+                _motorCount = count < HIL::MAX_MOTORS ? count : HIL::MAX_MOTORS;
+                memcpy(_motors, values, _motorCount * sizeof(float));
+                sendMotors();
+            }
+
+    }; // class HILBoard
+
+} // namespace hf
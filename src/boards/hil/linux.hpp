@@ -0,0 +1,118 @@
+/*
+   linux.hpp: HILBoard on a Linux serial device (e.g. /dev/ttyACM0 for a board on USB), or on any file
+   descriptor that carries the bridge's stream
+
+   Programs also need a Board::outbufWrite(), e.g. from boards/sim/linux-console.hpp.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "hilboard.hpp"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace hf {
+
+    class LinuxHILBoard final : public HILBoard {
+
+        private:
+
+            int  _fd;
+            bool _owned;
+
+        protected:
+
+            uint16_t readBytes(uint8_t * buf, uint16_t maxlen)
+            {
+                ssize_t n = read(_fd, buf, maxlen);
+                return n > 0 ? (uint16_t)n : 0;
+            }
+
+            void writeBytes(const uint8_t * buf, uint16_t len)
+            {
+                while (len > 0) {
+                    ssize_t n = write(_fd, buf, len);
+                    if (n > 0) {
+                        buf += n;
+                        len -= n;
+                    }
+                    else if (n < 0 && errno != EAGAIN && errno != EINTR) {
+                        return;
+                    }
+                    else {
+                        struct pollfd p = {_fd, POLLOUT, 0};
+                        poll(&p, 1, 1);
+                    }
+                }
+            }
+
+            uint32_t hostMicros(void)
+            {
+                struct timespec t;
+                clock_gettime(CLOCK_MONOTONIC, &t);
+                return (uint32_t)((uint64_t)t.tv_sec * 1000000 + t.tv_nsec / 1000);
+            }
+
+            void waitForBytes(uint32_t maxMicros)
+            {
+                struct pollfd p = {_fd, POLLIN, 0};
+                struct timespec t = {(time_t)(maxMicros / 1000000), (long)(maxMicros % 1000000) * 1000};
+                ppoll(&p, 1, &t, NULL);
+            }
+
+        public:
+
+            // Opens the device raw, without waiting on reads; check isOpen() before init()
+            LinuxHILBoard(const char * device) : _owned(true)
+            {
+                _fd = open(device, O_RDWR | O_NOCTTY | O_NONBLOCK);
+
+                if (_fd >= 0) {
+                    struct termios tio;
+                    if (tcgetattr(_fd, &tio) == 0) {
+                        cfmakeraw(&tio);
+                        tcsetattr(_fd, TCSANOW, &tio);
+                    }
+                }
+            }
+
+            // A descriptor opened elsewhere, which is set to not wait on reads
+            LinuxHILBoard(int fd) : _fd(fd), _owned(false)
+            {
+                fcntl(_fd, F_SETFL, fcntl(_fd, F_GETFL) | O_NONBLOCK);
+            }
+
+            ~LinuxHILBoard(void)
+            {
+                if (_owned && _fd >= 0) {
+                    close(_fd);
+                }
+            }
+
+            bool isOpen(void) const
+            {
+                return _fd >= 0;
+            }
+
+    }; // class LinuxHILBoard
+
+} // namespace hf
@@ -0,0 +1,108 @@
+/*
+   bitbangdshot.hpp : DShot output clocked out on GPIO pins, timed from the CPU's cycle counter
+
+   For boards without a timer and DMA set up to send DShot.  Each bit period raises every motor's pin, then drops
+   the pins sending a zero at 37.5% of the period and the rest at 75%, writing the pins' output registers and
+   timing from the Cortex-M DWT cycle counter, which the board must have enabled.  Interrupts are masked while a
+   frame goes out, so an ISR can't stretch a bit: 18 bit periods, 60 usec at DShot300, on every motor write.
+   DShot300 and slower leave room for the register writes on an 80 MHz part.  Bidirectional telemetry, which
+   needs the pins captured as inputs between frames, isn't supported.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+
+#include "dshot.hpp"
+
+namespace hf {
+
+    template <uint8_t MOTORS>
+    class BitBangDShot final : public DShotT<MOTORS> {
+
+        private:
+
+            const uint8_t * _pins;
+
+            // Each motor pin's output register and bit, looked up once so a frame is just register writes
+            volatile uint32_t * _out[MOTORS];
+            uint32_t            _mask[MOTORS];
+
+        protected:
+
+            // Sends the whole frame before returning, so there is never a transfer still going out
+            bool startTransfer(const uint16_t * buffer, uint16_t words, uint8_t count)
+            {
+                uint32_t period = this->periodTicks();
+                uint16_t half = period / 2;
+
+                __disable_irq();
+
+                for (uint16_t k=0; k<words; k+=count) {
+
+                    const uint16_t * row = &buffer[k];
+
+                    uint32_t start = DWT->CYCCNT;
+
+                    // An idle period (compare value zero) leaves the pin low throughout
+                    for (uint8_t i=0; i<count; ++i) {
+                        if (row[i]) {
+                            *_out[i] |= _mask[i];
+                        }
+                    }
+
+                    // The zeros' pins drop first, then the ones'
+                    for (uint8_t pass=0; pass<2; ++pass) {
+                        for (uint8_t i=0; i<count; ++i) {
+                            if (row[i] && (row[i] > half) == (pass == 1)) {
+                                while (DWT->CYCCNT - start < row[i]) {
+                                }
+                                *_out[i] &= ~_mask[i];
+                            }
+                        }
+                    }
+
+                    while (DWT->CYCCNT - start < period) {
+                    }
+                }
+
+                __enable_irq();
+
+                return true;
+            }
+
+        public:
+
+            // pins holds the MOTORS motor pins, in motor order, and must outlive this
+            BitBangDShot(const uint8_t * pins) : _pins(pins) { }
+
+            // Sets the pins up as outputs, low, and the bit timings from the cycle counter's rate
+            void begin(DShot::speed_t speed)
+            {
+                for (uint8_t i=0; i<MOTORS; ++i) {
+                    pinMode(_pins[i], OUTPUT);
+                    digitalWrite(_pins[i], LOW);
+                    _out[i] = portOutputRegister(digitalPinToPort(_pins[i]));
+                    _mask[i] = digitalPinToBitMask(_pins[i]);
+                }
+
+                this->init(F_CPU, speed);
+            }
+
+    }; // class BitBangDShot
+
+} // namespace hf
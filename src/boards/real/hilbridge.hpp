@@ -0,0 +1,243 @@
+/*
+   hilbridge.hpp : Hardware-in-the-loop mode for real boards: sensors out to a host, motor values back
+
+   Instead of running Hackflight, the sketch runs the board's sensors through a HILBridge, which sends every
+   sample, timestamped, to flight code on a host (see boards/hil/hilboard.hpp) over a serial stream such as
+   USB, and writes whatever motor values come back.  Samples are batched into packets of at most one USB
+   full-speed packet (see hil.hpp), and a packet goes out as soon as the next sample won't fit or its first
+   sample is flushMicros old, so at kHz gyro rates the link carries a few packets per millisecond, not one per
+   sample, and no sample waits long.  A packet the stream hasn't room for is dropped whole, so a host that falls
+   behind gets fresh samples, not stale ones, and the gap shows in the sequence numbers.
+
+   If motor values stop coming for MOTOR_TIMEOUT_MICROS, the bridge cuts the motors until they start again.
+
+       hf::Ladybug board;
+       hf::HILBridge<hf::Ladybug, USBSerial> bridge(board, Serial);
+
+       void setup(void) { Serial.begin(115200); bridge.init(); }
+       void loop(void)  { bridge.update(); }
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include "board.hpp"
+#include "hil.hpp"
+
+namespace hf {
+
+    template <class BoardT, class StreamT>
+    class HILBridge {
+
+        public:
+
+            // A USB full-speed link moves data in one-millisecond frames, so waiting up to one costs little
+            static const uint32_t FLUSH_MICROS = 1000;
+
+            static const uint32_t MOTOR_TIMEOUT_MICROS = 100000;
+
+            typedef struct {
+
+                uint32_t packetsSent;
+                uint32_t packetsDropped;  // for want of room in the stream
+                uint32_t samplesSent;
+
+                uint32_t motorPackets;
+                uint32_t badPackets;      // failed their CRC
+                uint32_t lostPackets;     // gaps in the host's sequence numbers
+                uint32_t timeouts;        // times the motors were cut for want of motor values
+
+                // Microseconds from a gyro sample to the motor values the host worked out from it
+                uint32_t roundTripMin;
+                uint32_t roundTripMax;
+                uint64_t roundTripSum;
+
+            } stats_t;
+
+        private:
+
+            BoardT  & _board;
+            StreamT & _stream;
+
+            uint32_t _flushMicros;
+
+            HILWriter _writer;
+            HILReader _reader;
+
+            uint8_t  _motorCount;
+            bool     _spinning;
+            uint32_t _motorMicros;   // when the last motor values came
+
+            stats_t _stats;
+
+            void send(void)
+            {
+                uint8_t size = 0;
+                const uint8_t * packet = _writer.finish(size);
+
+                if (_stream.availableForWrite() < size) {
+                    _stats.packetsDropped++;
+                    return;
+                }
+
+                _stream.write(packet, size);
+                _stats.packetsSent++;
+            }
+
+            // Sends the packet as it stands if a record of this type won't fit in it
+            void makeRoom(uint8_t type, uint32_t usec)
+            {
+                if (!_writer.fits(type, usec)) {
+                    send();
+                }
+                _stats.samplesSent++;
+            }
+
+            void sample(uint32_t usec)
+            {
+                uint8_t events = _board.pollEvents();
+
+                float values[4];
+                uint32_t gyroMicros = 0;
+
+                if ((events & Board::EVENT_GYRO) && _board.getGyroSample(values, gyroMicros)) {
+                    makeRoom(HIL::GYRO, gyroMicros);
+                    _writer.gyro(gyroMicros, values);
+                }
+
+                if ((events & Board::EVENT_ACCEL) && _board.getAccelerometer(values)) {
+                    makeRoom(HIL::ACCEL, usec);
+                    _writer.accel(usec, values);
+                }
+
+                if ((events & Board::EVENT_ATTITUDE) && _board.getQuaternion(values)) {
+                    makeRoom(HIL::QUATERNION, usec);
+                    _writer.quaternion(usec, values);
+                }
+
+                float pressure = 0;
+                if ((events & Board::EVENT_BARO) && _board.getBarometer(pressure)) {
+                    makeRoom(HIL::BARO, usec);
+                    _writer.baro(usec, pressure);
+                }
+            }
+
+            void receive(uint32_t usec)
+            {
+                uint8_t buf[HIL::PACKET_SIZE];
+
+                int available = _stream.available();
+                uint16_t count = _stream.readBytes(buf, available < (int)sizeof(buf) ? available : sizeof(buf));
+
+                for (uint16_t k=0; k<count; ++k) {
+
+                    if (!_reader.parse(buf[k])) {
+                        continue;
+                    }
+
+                    HIL::record_t record;
+                    while (_reader.next(record)) {
+                        if (record.type == HIL::MOTORS) {
+                            applyMotors(usec, record);
+                        }
+                    }
+                }
+
+                _stats.badPackets = _reader.bad();
+                _stats.lostPackets = _reader.lost();
+            }
+
+            void applyMotors(uint32_t usec, const HIL::record_t & record)
+            {
+                _board.writeMotors(record.values, record.count);
+
+                _motorCount = record.count;
+                _motorMicros = usec;
+                _spinning = false;
+                for (uint8_t k=0; k<record.count; ++k) {
+                    _spinning |= record.values[k] > 0;
+                }
+
+                uint32_t roundTrip = usec - _reader.base();
+                _stats.motorPackets++;
+                _stats.roundTripSum += roundTrip;
+                _stats.roundTripMin = roundTrip < _stats.roundTripMin ? roundTrip : _stats.roundTripMin;
+                _stats.roundTripMax = roundTrip > _stats.roundTripMax ? roundTrip : _stats.roundTripMax;
+            }
+
+            void checkTimeout(uint32_t usec)
+            {
+                if (!_spinning || usec - _motorMicros < MOTOR_TIMEOUT_MICROS) {
+                    return;
+                }
+
+                float zeros[HIL::MAX_MOTORS] = {};
+                _board.writeMotors(zeros, _motorCount);
+                _spinning = false;
+                _stats.timeouts++;
+            }
+
+        public:
+
+            HILBridge(BoardT & board, StreamT & stream, uint32_t flushMicros=FLUSH_MICROS)
+                : _board(board), _stream(stream), _flushMicros(flushMicros) { }
+
+            // Initializes the board, with the motors off.  Begin the stream first.
+            void init(void)
+            {
+                _board.init();
+
+                _reader.init();
+
+                _motorCount = 0;
+                _spinning = false;
+                _motorMicros = 0;
+
+                memset(&_stats, 0, sizeof(_stats));
+                _stats.roundTripMin = UINT32_MAX;
+            }
+
+            // Call as often as possible
+            void update(void)
+            {
+                uint32_t usec = _board.getMicroseconds();
+
+                receive(usec);
+
+                checkTimeout(usec);
+
+                sample(usec);
+
+                if (!_writer.empty() && _board.getMicroseconds() - _writer.base() >= _flushMicros) {
+                    send();
+                }
+
+                // Boards that can sleep till their next sample do, but no later than the packet is due
+                uint32_t age = _writer.empty() ? 0 : _board.getMicroseconds() - _writer.base();
+                _board.idle(age < _flushMicros ? _flushMicros - age : 0);
+            }
+
+            void getStats(stats_t & stats)
+            {
+                stats = _stats;
+            }
+
+    }; // class HILBridge
+
+} // namespace hf
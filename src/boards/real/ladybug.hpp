@@ -3,6 +3,18 @@
 
    Uses EM7180 SENtral Sensor Hub in master mode mode
 
+   By default the SENtral's event status is polled over I^2C on every gyro check.  Passing the pin wired to the
+   SENtral's interrupt output to the constructor instead reads the status only after the data-ready interrupt fires.
+
+   The SENtral is brought up from pollEvents() after init() has returned, so the loop, MSP, and the receiver are
+   running while it starts; ready() tells when it is done.
+
+   The status and result reads go through an I2CQueue, so that where the Wire library can run a transfer in the
+   background the loop computes on the previous sample while the next one is clocked in.
+
+   On the STM32L4 core, MSP bytes are moved into the board's RX ring from Serial's receive callback, as they
+   arrive, rather than read from the loop.
+
    This file is part of Hackflight.
 
    Hackflight is free software: you can redistribute it and/or modify
@@ -21,36 +33,326 @@
 #pragma once
 
 #include <Wire.h>
+#include <EEPROM.h>
 #include <EM7180.h>
 #include <stdarg.h>
 #include "hackflight.hpp"
 #include "realboard.hpp"
+#include "i2cqueue.hpp"
+#include "wiretransport.hpp"
 
 namespace hf {
 
-    class Ladybug : public RealBoard {
+    class Ladybug final : public RealBoard {
 
         private:
 
             const uint8_t _motorPins[4] = {13, A2, 3, 11};
 
+            // Calibration record lives at the start of the (flash-emulated) EEPROM
+            static const uint16_t CALIBRATION_ADDRESS = 0;
+
+            // In interrupt mode, read the status anyway if no interrupt has come for this long, so a missed
+            // edge can't stall the sensors
+            static const uint32_t INTERRUPT_TIMEOUT_MICROS = 10000;
+
+            // Pauses before and after starting the SENtral
+            static const uint32_t SENTRAL_STARTUP_MICROS = 100000;
+            static const uint32_t SENTRAL_SETTLE_MICROS  = 100000;
+
+            // How often to repeat the error if the SENtral won't start
+            static const uint32_t SENTRAL_ERROR_MICROS = 1000000;
+
+            // I^2C fast mode, which the SENtral supports
+            static const uint32_t I2C_CLOCK_HZ = 400000;
+
+            // The SENtral's result registers, which sit together at the bottom of its register map, so that a
+            // status read is followed by one burst read of all that is new rather than one library call per sensor
+            static const uint8_t SENTRAL_ADDRESS = 0x28;
+            static const uint8_t REG_QUATERNION  = 0x00; // x, y, z, w: floats
+            static const uint8_t REG_ACCEL       = 0x1A; // x, y, z: int16
+            static const uint8_t REG_GYRO        = 0x22; // x, y, z: int16
+            static const uint8_t REG_BARO        = 0x2A; // int16: hundredths of a mbar from 1013.25
+            static const uint8_t RESULTS_SIZE    = 0x2C;
+
+            // The event status register, which clears on being read, and its bits
+            static const uint8_t REG_EVENT_STATUS = 0x35;
+            static const uint8_t STATUS_ERROR     = 0x02;
+            static const uint8_t STATUS_QUAT      = 0x04;
+            static const uint8_t STATUS_ACCEL     = 0x10;
+            static const uint8_t STATUS_GYRO      = 0x20;
+            static const uint8_t STATUS_BARO      = 0x40;
+
             float gyroAdcToRadians;
 
+            // Last value written to each motor, so we don't send the same one over and over
+            uint8_t _motorValuesPrev[4];
+
             EM7180 _sentral;
 
-            void checkEventStatus(void)
+            // Bringing up the SENtral
+            typedef enum {
+                SENTRAL_STARTUP,  // powering up
+                SENTRAL_SETTLE,   // started; letting its first samples come through
+                SENTRAL_READY,
+                SENTRAL_FAILED
+            } sentralState_t;
+
+            sentralState_t _sentralState;
+            uint32_t       _sentralMicros; // when the state was entered, or the error last shown
+
+            int8_t   _interruptPin;
+            uint32_t _lastStatusMicros;
+            uint8_t  _pendingEvents; // seen in the SENtral status but not yet consumed by the get*() methods
+
+            // Result registers as of the latest burst read to finish
+            uint8_t  _results[RESULTS_SIZE];
+
+            WireTransport          _wire;
+            I2CQueue<WireTransport> _i2c;
+
+            // The status read
+            uint8_t  _status;
+            bool     _statusDone;
+            bool     _statusInFlight;
+            uint32_t _statusMicros; // when the events it reports came in
+
+            // The burst read of the results the status reported, into a buffer of its own so that the get*()
+            // methods keep reading the previous sample from _results while it is in flight
+            uint8_t  _burst[RESULTS_SIZE];
+            bool     _burstDone;
+            bool     _burstInFlight;
+            uint8_t  _burstEvents;
+            uint8_t  _burstFirst;
+            uint8_t  _burstEnd;
+
+            // When the pending gyro sample was acquired: its data-ready edge in interrupt mode, otherwise the
+            // status read that found it
+            uint32_t _gyroMicros;
+
+            // Set by the data-ready ISR
+            static volatile bool     _dataReady;
+            static volatile uint32_t _dataReadyMicros;
+
+            static void dataReadyHandler(void)
             {
-                _sentral.checkEventStatus();
+                _dataReadyMicros = micros();
+                _dataReady = true;
+            }
+
+#if defined(ARDUINO_ARCH_STM32L4)
+            // The board whose RX ring Serial's receive callback feeds
+            static Ladybug * _serialBoard;
+
+            // Bytes that don't fit the ring are dropped, as on a UART overrun
+            static void serialReceived(void)
+            {
+                uint8_t buf[64];
+                uint16_t n;
+                while ((n = Serial.available()) > 0) {
+                    n = Serial.readBytes(buf, n < sizeof(buf) ? n : sizeof(buf));
+                    _serialBoard->serialRxPush(buf, n);
+                }
+            }
+#endif
 
-                if (_sentral.gotError()) {
+            // Steps the SENtral through its startup, one stage per call once its pause is up
+            void bringUpSentral(void)
+            {
+                uint32_t elapsed = micros() - _sentralMicros;
+
+                switch (_sentralState) {
+
+                    case SENTRAL_STARTUP:
+
+                        if (elapsed < SENTRAL_STARTUP_MICROS) {
+                            return;
+                        }
+
+                        // Goose up the EM7180 ODRs
+                        _sentral.accelRate = 330;
+                        _sentral.gyroRate = 330;
+                        _sentral.baroRate = 50;
+                        _sentral.qRateDivisor = 5;
+
+                        // Start the EM7180 in master mode; it raises its interrupt line on each new sample.  On
+                        // failure, keep saying why, without stopping the loop, so MSP still answers.
+                        if (!_sentral.begin()) {
+                            _sentralState = SENTRAL_FAILED;
+                            _sentralMicros = micros() - SENTRAL_ERROR_MICROS;
+                            return;
+                        }
+
+                        // Optionally listen for that interrupt, instead of polling the event status
+                        if (_interruptPin >= 0) {
+                            _dataReady = true; // read status once to clear anything already pending
+                            pinMode(_interruptPin, INPUT);
+                            attachInterrupt(_interruptPin, dataReadyHandler, RISING);
+                        }
+
+                        // Get actual gyro rate for conversion to radians
+                        uint8_t accFs; uint16_t gyroFs; uint16_t magFs;
+                        _sentral.getFullScaleRanges(accFs, gyroFs, magFs);
+                        gyroAdcToRadians = M_PI * (float)gyroFs / (1<<15) / 180.;  
+
+                        _sentralState = SENTRAL_SETTLE;
+                        _sentralMicros = micros();
+                        return;
+
+                    case SENTRAL_SETTLE:
+
+                        if (elapsed >= SENTRAL_SETTLE_MICROS) {
+                            _sentralState = SENTRAL_READY;
+                        }
+                        return;
+
+                    case SENTRAL_FAILED:
+
+                        if (elapsed >= SENTRAL_ERROR_MICROS) {
+                            Serial.println(_sentral.getErrorString());
+                            _sentralMicros = micros();
+                        }
+                        return;
+
+                    default:
+                        return;
+                }
+            }
+
+            // Queues a status read, unless one or the burst it leads to is still going
+            void startStatusRead(void)
+            {
+                if (_statusInFlight || _burstInFlight) {
+                    return;
+                }
+
+                uint32_t eventMicros = micros();
+
+                if (_interruptPin >= 0) {
+
+                    // Skip the I^2C transaction until the SENtral says it has something new
+                    if (!_dataReady && (micros() - _lastStatusMicros) < INTERRUPT_TIMEOUT_MICROS) {
+                        return;
+                    }
+
+                    if (_dataReady) {
+                        eventMicros = _dataReadyMicros;
+                    }
+
+                    // Clear before reading, so an event arriving during the read raises the flag again
+                    _dataReady = false;
+                }
+
+                _lastStatusMicros = micros();
+                _statusMicros = eventMicros;
+
+                _statusInFlight = _i2c.submit(SENTRAL_ADDRESS, REG_EVENT_STATUS, &_status, 1, &_statusDone);
+            }
+
+            // Once the status is in, queues a burst read of the span of result registers covering the new events:
+            // usually one span, as the gyro and accelerometer sit side by side
+            void finishStatusRead(void)
+            {
+                if (!_statusInFlight || !_statusDone) {
+                    return;
+                }
+
+                _statusInFlight = false;
+
+                if (_status & STATUS_ERROR) {
                     while (true) {
                         Serial.print("ERROR: ");
                         Serial.println(_sentral.getErrorString());
                     }
                 }
+
+                uint8_t events = 0;
+
+                if (_status & STATUS_GYRO)  events |= EVENT_GYRO;
+                if (_status & STATUS_ACCEL) events |= EVENT_ACCEL;
+                if (_status & STATUS_QUAT)  events |= EVENT_ATTITUDE;
+                if (_status & STATUS_BARO)  events |= EVENT_BARO;
+
+                if (!events) {
+                    return;
+                }
+
+                uint8_t first = (events & EVENT_ATTITUDE) ? REG_QUATERNION : (events & EVENT_ACCEL) ? REG_ACCEL :
+                    (events & EVENT_GYRO) ? REG_GYRO : REG_BARO;
+
+                uint8_t end = (events & EVENT_BARO) ? REG_BARO+2 : (events & EVENT_GYRO) ? REG_GYRO+6 :
+                    (events & EVENT_ACCEL) ? REG_ACCEL+6 : REG_QUATERNION+16;
+
+                _burstEvents = events;
+                _burstFirst = first;
+                _burstEnd = end;
+
+                _burstInFlight = _i2c.submit(SENTRAL_ADDRESS, first, &_burst[first], end-first, &_burstDone);
+            }
+
+            // Once the burst is in, makes it the current sample
+            void finishBurstRead(void)
+            {
+                if (!_burstInFlight || !_burstDone) {
+                    return;
+                }
+
+                _burstInFlight = false;
+
+                memcpy(&_results[_burstFirst], &_burst[_burstFirst], _burstEnd-_burstFirst);
+
+                if (_burstEvents & EVENT_GYRO) {
+                    _gyroMicros = _statusMicros;
+                }
+
+                _pendingEvents |= _burstEvents;
             }
 
-        protected:
+            // The SENtral and the MCU are both little-endian
+            void decodeThreeAxis(uint8_t reg, int16_t & x, int16_t & y, int16_t & z)
+            {
+                int16_t v[3];
+                memcpy(v, &_results[reg], sizeof(v));
+                x = v[0];
+                y = v[1];
+                z = v[2];
+            }
+
+            // Quaternion in w, x, y, z order
+            void decodeQuaternion(float q[4])
+            {
+                float v[4];
+                memcpy(v, &_results[REG_QUATERNION], sizeof(v));
+                q[0] = v[3];
+                q[1] = v[0];
+                q[2] = v[1];
+                q[3] = v[2];
+            }
+
+            // Consumes a pending event, so each sample is read only once
+            bool gotEvent(uint8_t event)
+            {
+                bool got = _pendingEvents & event;
+                _pendingEvents &= ~event;
+                return got;
+            }
+
+        public:
+
+            // Pass the pin connected to the SENtral's interrupt output to use data-ready interrupts
+            Ladybug(int8_t interruptPin=-1) : _interruptPin(interruptPin), _lastStatusMicros(0), _pendingEvents(0), _gyroMicros(0) 
+            { 
+                memset(_motorValuesPrev, 0, sizeof(_motorValuesPrev));
+                memset(_results, 0, sizeof(_results));
+                memset(_burst, 0, sizeof(_burst));
+                _status = 0;
+                _statusDone = _burstDone = false;
+                _statusInFlight = _burstInFlight = false;
+                _statusMicros = 0;
+                _burstEvents = _burstFirst = _burstEnd = 0;
+                _sentralState = SENTRAL_STARTUP;
+                _sentralMicros = 0;
+            }
 
             void init(void)
             {
@@ -63,27 +365,8 @@ namespace hf {
 
                 // Start I^2C
                 Wire.begin();
-
-                // Hang a bit before starting up the EM7180
-                delay(100);
-
-                // Goose up the EM7180 ODRs
-                _sentral.accelRate = 330;
-                _sentral.gyroRate = 330;
-                _sentral.baroRate = 50;
-                _sentral.qRateDivisor = 5;
-
-                // Start the EM7180 in master mode, no interrupt
-                if (!_sentral.begin()) {
-                    while (true) {
-                        Serial.println(_sentral.getErrorString());
-                    }
-                }
-
-                // Get actual gyro rate for conversion to radians
-                uint8_t accFs; uint16_t gyroFs; uint16_t magFs;
-                _sentral.getFullScaleRanges(accFs, gyroFs, magFs);
-                gyroAdcToRadians = M_PI * (float)gyroFs / (1<<15) / 180.;  
+                Wire.setClock(I2C_CLOCK_HZ);
+                _i2c.init(&_wire);
 
                 // Initialize the motors
                 for (int k=0; k<4; ++k) {
@@ -91,16 +374,24 @@ namespace hf {
                     analogWrite(_motorPins[k], 0);  
                 }
 
-                // Hang a bit more
-                delay(100);
+                // Enable the Cortex-M DWT cycle counter for loop profiling
+                CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+                DWT->CYCCNT = 0;
+                DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
 
                 // Do general real-board initialization
                 RealBoard::init();
-            }
 
-            void delayMilliseconds(uint32_t msec)
-            {
-                delay(msec);
+#if defined(ARDUINO_ARCH_STM32L4)
+                // Feed MSP from the receive callback from now on
+                _serialBoard = this;
+                serialUseRxPush();
+                Serial.onReceive(serialReceived);
+#endif
+
+                // Start the SENtral from the loop
+                _sentralState = SENTRAL_STARTUP;
+                _sentralMicros = micros();
             }
 
             uint32_t getMicroseconds()
@@ -108,51 +399,110 @@ namespace hf {
                 return micros();
             }
 
-            void ledSet(bool is_on)
-            { 
-                digitalWrite(A1, is_on ? HIGH : LOW);
+            uint32_t getCycleCount(void)
+            {
+                return DWT->CYCCNT;
             }
 
-            uint8_t serialAvailableBytes(void)
+            uint32_t getCyclesPerMicrosecond(void)
             {
-                return Serial.available();
+                return F_CPU / 1000000;
             }
 
-            uint8_t serialReadByte(void)
+            void writeMotor(uint8_t index, float value)
             {
-                return Serial.read();
+                // Scale motor value from [0,1] to [0,255]
+                uint8_t aval = (uint8_t)(value * 255);
+
+                // Avoid sending the motor the same value over and over
+                if (aval != _motorValuesPrev[index]) {
+                    analogWrite(_motorPins[index], aval);
+                }
+
+                _motorValuesPrev[index] = aval;
             }
 
-            void serialWriteByte(uint8_t c)
+            void writeMotors(const float * values, uint8_t count)
             {
-                Serial.write(c);
+                if (count > 4) {
+                    count = 4;
+                }
+
+                // Scale everything first, so the compare registers are then written back to back
+                uint8_t avals[4];
+                for (uint8_t i=0; i<count; ++i) {
+                    avals[i] = (uint8_t)(values[i] * 255);
+                }
+
+                for (uint8_t i=0; i<count; ++i) {
+                    if (avals[i] != _motorValuesPrev[i]) {
+                        analogWrite(_motorPins[i], avals[i]);
+                        _motorValuesPrev[i] = avals[i];
+                    }
+                }
             }
 
-            void writeMotor(uint8_t index, float value)
+            // One status read (none, in interrupt mode, until the data-ready line fires) for all the sensors, then
+            // one burst read of what it reports.  Each step that finishes starts the next, which a blocking transport
+            // gets through in one call; otherwise the events show up on a later pass, once their bytes are in.
+            uint8_t pollEvents(void)
             {
-                // Scale motor value from [0,1] to [0,255]
-                uint8_t aval = (uint8_t)(value * 255);
+                if (_sentralState != SENTRAL_READY) {
+                    bringUpSentral();
+                    return 0;
+                }
 
-                // Avoid sending the motor the same value over and over
-                static uint8_t avalPrev[4];
+                startStatusRead();
+                _i2c.service();
+                finishStatusRead();
+                _i2c.service();
+                finishBurstRead();
 
-                if (aval != avalPrev[index]) {
-                    analogWrite(_motorPins[index], aval);
+                return _pendingEvents;
+            }
+
+            bool ready(void)
+            {
+                return _sentralState == SENTRAL_READY;
+            }
+
+            // With data-ready interrupts, sleep until the next one; in polling mode nothing would wake us for new data
+            void idle(uint32_t maxMicros)
+            {
+                if (_interruptPin < 0 || _sentralState != SENTRAL_READY) {
+                    return;
                 }
 
-                avalPrev[index] = aval;
+                // The status gets read anyway on timeout, so don't sleep past that
+                uint32_t start = micros();
+                uint32_t sinceStatus = start - _lastStatusMicros;
+                if (sinceStatus >= INTERRUPT_TIMEOUT_MICROS) {
+                    return;
+                }
+                if (maxMicros > INTERRUPT_TIMEOUT_MICROS - sinceStatus) {
+                    maxMicros = INTERRUPT_TIMEOUT_MICROS - sinceStatus;
+                }
+
+                // Any interrupt (data-ready, I^2C, serial, or the millisecond tick) ends a WFI; with interrupts masked
+                // around the check, one arriving between the check and the WFI still ends it
+                while ((micros() - start) < maxMicros) {
+                    __disable_irq();
+                    if (_dataReady || _i2c.finished()) {
+                        __enable_irq();
+                        break;
+                    }
+                    __WFI();
+                    __enable_irq();
+                }
             }
 
             bool getGyroRates(float gyroRates[3])
             {
-                // Since gyro is updated most frequently, use it to drive SENtral polling
-                checkEventStatus();
-
-                if (_sentral.gotGyrometer()) {
+                if (gotEvent(EVENT_GYRO)) {
 
                     int16_t gx, gy, gz;
 
-                    _sentral.readGyrometer(gx, gy, gz);
+                    decodeThreeAxis(REG_GYRO, gx, gy, gz);
 
                     // invert pitch, yaw gyro direction to keep other code simpler
                     gy = -gy;
@@ -168,12 +518,22 @@ namespace hf {
                 return false;
             }
 
+            bool getGyroSample(float gyroRates[3], uint32_t & usec)
+            {
+                if (!getGyroRates(gyroRates)) {
+                    return false;
+                }
+                usec = _gyroMicros;
+                return true;
+            }
+
             bool getEulerAngles(float eulerAngles[3])
             {
-                if (_sentral.gotQuaternions()) {
+                if (gotEvent(EVENT_ATTITUDE)) {
 
-                    static float qw, qx, qy, qz;
-                    _sentral.readQuaternions(qw, qx, qy, qz);
+                    float q[4];
+                    decodeQuaternion(q);
+                    float qw = q[0], qx = q[1], qy = q[2], qz = q[3];
 
                     eulerAngles[0] = atan2(2.0f * (qw * qx + qy * qz), qw * qw - qx * qx - qy * qy + qz * qz);
                     eulerAngles[1] = asin(2.0f * (qx * qz - qw * qy));
@@ -185,11 +545,22 @@ namespace hf {
                 return false;
             }
 
+            // The SENtral fuses to a quaternion, so hand that over as it is
+            bool getQuaternion(float quaternion[4])
+            {
+                if (gotEvent(EVENT_ATTITUDE)) {
+                    decodeQuaternion(quaternion);
+                    return true;
+                }
+
+                return false;
+            }
+
             bool getAccelerometer(float accelGs[3])
             {
-                if (_sentral.gotAccelerometer()) {
+                if (gotEvent(EVENT_ACCEL)) {
                     int16_t ax, ay, az;
-                    _sentral.readAccelerometer(ax, ay, az);
+                    decodeThreeAxis(REG_ACCEL, ax, ay, az);
                     accelGs[0] = ax / 2048.f;
                     accelGs[1] = ay / 2048.f;
                     accelGs[2] = az / 2048.f;
@@ -201,20 +572,87 @@ namespace hf {
 
             bool getBarometer(float & pressure)
             {
-                if (_sentral.gotBarometer()) {
-                    float temperature; // ignored
-                    _sentral.readBarometer(pressure, temperature);
+                if (gotEvent(EVENT_BARO)) {
+                    int16_t raw;
+                    memcpy(&raw, &_results[REG_BARO], sizeof(raw));
+                    pressure = raw * 0.01f + 1013.25f;
                     return true;
                 }
  
                 return false;
             }
 
+            uint16_t calibrationRead(uint8_t * buf, uint16_t len)
+            {
+                for (uint16_t k=0; k<len; ++k) {
+                    buf[k] = EEPROM.read(CALIBRATION_ADDRESS + k);
+                }
+                return len;
+            }
+
+            // Rewrites only the bytes that changed
+            void calibrationWrite(const uint8_t * buf, uint16_t len)
+            {
+                for (uint16_t k=0; k<len; ++k) {
+                    EEPROM.update(CALIBRATION_ADDRESS + k, buf[k]);
+                }
+            }
+
+        protected:
+
+            void delayMilliseconds(uint32_t msec)
+            {
+                delay(msec);
+            }
+
+            void ledSet(bool is_on)
+            { 
+                digitalWrite(A1, is_on ? HIGH : LOW);
+            }
+
+            uint8_t serialAvailableBytes(void)
+            {
+                return Serial.available();
+            }
+
+            uint8_t serialReadByte(void)
+            {
+                return Serial.read();
+            }
+
+            void serialWriteByte(uint8_t c)
+            {
+                Serial.write(c);
+            }
+
+            // The core's UART interrupt fills its own receive buffer; take only what is already there so we never block
+            uint16_t serialReadBytes(uint8_t * buf, uint16_t maxlen)
+            {
+                uint16_t n = Serial.available();
+                return Serial.readBytes(buf, n < maxlen ? n : maxlen);
+            }
+
+            // Hand over only what fits in the core's transmit buffer, which its interrupt drains in the background
+            uint16_t serialWriteBytes(const uint8_t * buf, uint16_t len)
+            {
+                uint16_t n = Serial.availableForWrite();
+                return Serial.write(buf, n < len ? n : len);
+            }
+
     }; // class Ladybug
 
-    void Board::outbuf(char * buf)
+    volatile bool     Ladybug::_dataReady = false;
+    volatile uint32_t Ladybug::_dataReadyMicros = 0;
+
+#if defined(ARDUINO_ARCH_STM32L4)
+    Ladybug * Ladybug::_serialBoard = NULL;
+#endif
+
+    // Only what fits in the core's transmit buffer, like serialWriteBytes()
+    uint16_t Board::outbufWrite(const uint8_t * buf, uint16_t len)
     {
-        Serial.print(buf);
+        uint16_t n = Serial.availableForWrite();
+        return Serial.write(buf, n < len ? n : len);
     }
 
 } // namespace hf
@@ -18,14 +18,33 @@
 
 #pragma once
 
+#include <string.h>
+
+#include "board.hpp"
 #include "receiver.hpp"
 #include "mixer.hpp"
+#include "profiler.hpp"
+#include "spectrum.hpp"
+#include "gains.hpp"
+#include "envelope.hpp"
+#include "governor.hpp"
+#include "replycache.hpp"
+#include "binaryangle.hpp"
 #include "datatypes.hpp"
+#include "mspmessages.hpp"
 
-// See http://www.multiwii.com/wiki/index.php?title=Multiwii_Serial_Protocol
-#define MSP_RC_NORMAL            121    
-#define MSP_ATTITUDE_RADIANS     122    
-#define MSP_SET_MOTOR_NORMAL     215    
+// See http://www.multiwii.com/wiki/index.php?title=Multiwii_Serial_Protocol.  Message IDs, sizes, and payload
+// layouts come from mspmessages.hpp, generated from extras/parser/messages.json; each message the firmware
+// handles has an entry in the table in MSP::findHandler().
+//
+// Requests may use either the original framing ($M: 8-bit size and command, XOR checksum) or MSPv2 framing
+// ($X: flag byte, 16-bit command and size, CRC8-DVB-S2), and are answered in kind.  Subscriptions made over MSPv2
+// are streamed together: all that are due on a pass go out in one BATCH frame, whose payload is a run of
+// (16-bit command, 16-bit size, payload) records.
+//
+// Attitude and stick messages are made from the vehicle-state snapshot in a ReplyCache (see replycache.hpp), so
+// each reply holds values from a single control cycle, and each is encoded once per snapshot however many
+// requests and subscriptions it answers.
 
 namespace hf {
 
@@ -33,8 +52,33 @@ namespace hf {
 
         private:
 
-            static const int INBUF_SIZE  = 128;
-            static const int OUTBUF_SIZE = 128;
+            static const uint16_t INBUF_SIZE  = 128;
+            static const uint16_t OUTBUF_SIZE = 256;
+
+            static const uint8_t MAX_SUBSCRIPTIONS = 4;
+
+            // Header ($, M, >, size, command) plus checksum
+            static const uint8_t FRAME_OVERHEAD = 6;
+
+            // Header ($, X, >, flag, command, size) plus CRC
+            static const uint8_t FRAME_OVERHEAD_V2 = 9;
+
+            // Command and size ahead of each message in a batch
+            static const uint8_t BATCH_RECORD_OVERHEAD = 4;
+
+            // IDs below this are replies sent by the firmware; the rest are commands to it
+            static const uint8_t FIRST_COMMAND_ID = 200;
+
+            // Samples in an ATTITUDE_DELTA
+            static const uint8_t ATTITUDE_SAMPLES = 8;
+
+            // A reply message pushed by the firmware every 'divider' calls to stream()
+            typedef struct {
+                uint8_t messageId;  // 0 = slot unused
+                uint8_t divider;
+                uint8_t counter;
+                bool    v2;         // batched in MSPv2 frames
+            } subscription_t;
 
             typedef enum serialState_t {
                 IDLE,
@@ -42,187 +86,926 @@ namespace hf {
                 HEADER_M,
                 HEADER_ARROW,
                 HEADER_SIZE,
-                HEADER_CMD
+                HEADER_CMD,
+                HEADER_X,
+                HEADER_V2_ARROW,
+                HEADER_V2_FLAG,
+                HEADER_V2_CMD_LO,
+                HEADER_V2_CMD_HI,
+                HEADER_V2_SIZE_LO,
+                HEADER_V2_SIZE_HI,
+                HEADER_V2_PAYLOAD
             } serialState_t;
 
-            uint8_t checksum;
-            uint8_t inBuf[INBUF_SIZE];
-            uint8_t inBufIndex;
-            uint8_t outBuf[OUTBUF_SIZE];
-            uint8_t outBufIndex;
-            uint8_t outBufSize;
-            uint8_t cmdMSP;
-            uint8_t offset;
-            uint8_t dataSize;
+            // A reply handler fills its payload, in place in the output buffer; a command handler reads its payload
+            // (size bytes) from the input buffer and returns false to reject it
+            typedef bool (MSP::*handler_t)(uint8_t * payload, uint16_t size, const MSPContext & context);
+
+            // Snapshot replies are encoded from the ReplyCache's snapshot, and cached there
+            typedef struct {
+                uint8_t   id;
+                uint16_t  size;
+                handler_t handler;
+                bool      snapshot;
+            } dispatch_t;
+
+            uint8_t  checksum;   // XOR checksum for $M frames
+            uint8_t  crc;        // CRC8-DVB-S2 for $X frames
+            uint8_t  inBuf[INBUF_SIZE];
+            uint8_t  outBuf[OUTBUF_SIZE];
+            uint16_t outBufIndex;
+            uint16_t outBufSize;
+            uint16_t cmdMSP;
+            uint16_t offset;
+            uint16_t dataSize;
+            bool     v2;         // framing of the request being parsed, and of its reply
             serialState_t c_state;
 
-            void serialize8(uint8_t a)
+            // Stage whose histogram is sent in LOOP_HISTOGRAM
+            uint8_t histogramStage;
+
+            // This parser's window in the TelemetryEnvelope, opened by the first ENVELOPE request
+            uint8_t envelopeWindow;
+
+            // Attitudes from the last few serial passes, in ATTITUDE_COMPACT units, for ATTITUDE_DELTA; oldest at
+            // attitudeIndex
+            int16_t attitudeHistory[ATTITUDE_SAMPLES][3];
+            uint8_t attitudeIndex;
+
+            subscription_t subscriptions[MAX_SUBSCRIPTIONS];
+
+            // What requests and subscriptions are answered from; see bind()
+            ReplyCache       * replies;
+            const MSPContext * boundContext;
+
+            static const dispatch_t * findHandler(uint8_t id)
             {
-                outBuf[outBufSize++] = a;
-                checksum ^= a;
+                // Messages the firmware handles, with their payload sizes, and whether each is made from the
+                // vehicle-state snapshot.  Command handlers check the size they are given instead, so the size
+                // listed for a command is just its nominal one.  Local to this function so that the header can
+                // define it without violating the one-definition rule.
+                static const dispatch_t DISPATCH[] = {
+                    {mspmsg::RC_NORMAL::ID,          mspmsg::RC_NORMAL::SIZE,          &MSP::replyRcNormal,           true},
+                    {mspmsg::ATTITUDE_RADIANS::ID,   mspmsg::ATTITUDE_RADIANS::SIZE,   &MSP::replyAttitudeRadians,    true},
+                    {mspmsg::LOOP_STATS::ID,         mspmsg::LOOP_STATS::SIZE,         &MSP::replyLoopStats,          false},
+                    {mspmsg::LOOP_HISTOGRAM::ID,     mspmsg::LOOP_HISTOGRAM::SIZE,     &MSP::replyLoopHistogram,      false},
+                    {mspmsg::GYRO_SPECTRUM::ID,      mspmsg::GYRO_SPECTRUM::SIZE,      &MSP::replyGyroSpectrum,       false},
+                    {mspmsg::PID_GAINS::ID,          mspmsg::PID_GAINS::SIZE,          &MSP::replyPidGains,           false},
+                    {mspmsg::GYRO_LATENCY::ID,       mspmsg::GYRO_LATENCY::SIZE,       &MSP::replyGyroLatency,        false},
+                    {mspmsg::CPU_LOAD::ID,           mspmsg::CPU_LOAD::SIZE,           &MSP::replyCpuLoad,            false},
+                    {mspmsg::RC_PACKED::ID,          mspmsg::RC_PACKED::SIZE,          &MSP::replyRcPacked,           true},
+                    {mspmsg::ATTITUDE_COMPACT::ID,   mspmsg::ATTITUDE_COMPACT::SIZE,   &MSP::replyAttitudeCompact,    true},
+                    {mspmsg::ATTITUDE_DELTA::ID,     mspmsg::ATTITUDE_DELTA::SIZE,     &MSP::replyAttitudeDelta,      false},
+                    {mspmsg::BOOT_TIMES::ID,         mspmsg::BOOT_TIMES::SIZE,         &MSP::replyBootTimes,          false},
+                    {mspmsg::ENVELOPE::ID,           mspmsg::ENVELOPE::SIZE,           &MSP::replyEnvelope,           false},
+                    {mspmsg::LOAD_GOVERNOR::ID,      mspmsg::LOAD_GOVERNOR::SIZE,      &MSP::replyLoadGovernor,       false},
+                    {mspmsg::SET_MOTOR_NORMAL::ID,   mspmsg::SET_MOTOR_NORMAL::SIZE,   &MSP::commandSetMotorNormal,   false},
+                    {mspmsg::SET_LOOP_HISTOGRAM::ID, mspmsg::SET_LOOP_HISTOGRAM::SIZE, &MSP::commandSetLoopHistogram, false},
+                    {mspmsg::SET_SUBSCRIPTION::ID,   mspmsg::SET_SUBSCRIPTION::SIZE,   &MSP::commandSetSubscription,  false},
+                    {mspmsg::SET_PID_GAINS::ID,      mspmsg::SET_PID_GAINS::SIZE,      &MSP::commandSetPidGains,      false}
+                };
+
+                static const uint8_t DISPATCH_COUNT = sizeof(DISPATCH) / sizeof(dispatch_t);
+
+                for (uint8_t k=0; k<DISPATCH_COUNT; ++k) {
+                    if (DISPATCH[k].id == id) {
+                        return &DISPATCH[k];
+                    }
+                }
+                return 0;
             }
 
-            void serialize16(int16_t a)
+            // Reply handler for a message we know how to send, or null
+            static const dispatch_t * findReply(uint8_t id)
             {
-                serialize8(a & 0xFF);
-                serialize8((a >> 8) & 0xFF);
+                return id < FIRST_COMMAND_ID ? findHandler(id) : 0;
+            }
+
+            // Reply handlers --------------------------------------------------------------------------------
+
+            bool replyRcNormal(uint8_t * payload, uint16_t size, const MSPContext & context)
+            {
+                (void)size;
+
+                const vehicle_state_t & state = replies->state();
+
+                // Channels the receiver doesn't have go out as zero
+                for (uint8_t k=0; k<mspmsg::RC_NORMAL::FIELD_COUNT; ++k) {
+                    mspmsg::setField<mspmsg::RC_NORMAL>(payload, k, k < state.channelCount ? state.rawvals[k] : 0.f);
+                }
+                return true;
+            }
+
+            bool replyAttitudeRadians(uint8_t * payload, uint16_t size, const MSPContext & context) 
+            {
+                (void)size;
+
+                const float * angles = replies->state().eulerAngles;
+
+                mspmsg::ATTITUDE_RADIANS msg = {angles[0], angles[1], angles[2]};
+                msg.encode(payload);
+                return true;
+            }
+
+            bool replyLoopStats(uint8_t * payload, uint16_t size, const MSPContext & context) 
+            {
+                (void)size;
+
+                static_assert(mspmsg::LOOP_STATS::FIELD_COUNT == 3*Profiler::STAGE_COUNT, "LOOP_STATS doesn't match profiler stages");
+
+                for (uint8_t k=0; k<Profiler::STAGE_COUNT; ++k) {
+                    mspmsg::setField<mspmsg::LOOP_STATS>(payload, 3*k,   context.profiler->getMin(k));
+                    mspmsg::setField<mspmsg::LOOP_STATS>(payload, 3*k+1, context.profiler->getMean(k));
+                    mspmsg::setField<mspmsg::LOOP_STATS>(payload, 3*k+2, context.profiler->getMax(k));
+                }
+                return true;
+            }
+
+            bool replyLoopHistogram(uint8_t * payload, uint16_t size, const MSPContext & context) 
+            {
+                (void)size;
+
+                static_assert(mspmsg::LOOP_HISTOGRAM::FIELD_COUNT == 1+Profiler::HISTOGRAM_BINS, "LOOP_HISTOGRAM doesn't match profiler bins");
+
+                mspmsg::setField<mspmsg::LOOP_HISTOGRAM>(payload, 0, histogramStage);
+                for (uint8_t k=0; k<Profiler::HISTOGRAM_BINS; ++k) {
+                    mspmsg::setField<mspmsg::LOOP_HISTOGRAM>(payload, 1+k, context.profiler->getHistogramBin(histogramStage, k));
+                }
+                return true;
+            }
+
+            bool replyGyroSpectrum(uint8_t * payload, uint16_t size, const MSPContext & context) 
+            {
+                (void)size;
+
+                static_assert(mspmsg::GYRO_SPECTRUM::FIELD_COUNT == 2+GyroSpectrum::BINS, "GYRO_SPECTRUM doesn't match analyzer bins");
+
+                // Peak, bin spacing, then bin magnitudes; all zero when the analyzer is off or built out
+                GyroSpectrum * spectrum = context.spectrum;
+                bool on = spectrum && spectrum->enabled();
+                mspmsg::setField<mspmsg::GYRO_SPECTRUM>(payload, 0, on ? spectrum->getPeakHz() : 0.f);
+                mspmsg::setField<mspmsg::GYRO_SPECTRUM>(payload, 1, on ? spectrum->getBinHz() : 0.f);
+                for (uint8_t k=0; k<GyroSpectrum::BINS; ++k) {
+                    mspmsg::setField<mspmsg::GYRO_SPECTRUM>(payload, 2+k, on ? spectrum->getMagnitude(k) : 0.f);
+                }
+                return true;
+            }
+
+            bool replyPidGains(uint8_t * payload, uint16_t size, const MSPContext & context) 
+            {
+                (void)size;
+
+                // All zero when the gains are fixed at compile time (see gainprofile.hpp)
+                gains_t gains = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+                if (context.gains) {
+                    context.gains->get(gains);
+                }
+
+                mspmsg::PID_GAINS msg = {gains.levelP, gains.gyroCyclicP, gains.gyroCyclicI, gains.gyroCyclicD,
+                    gains.gyroYawP, gains.gyroYawI, gains.altP, gains.velP, gains.velI, gains.velD};
+                msg.encode(payload);
+                return true;
+            }
+
+            bool replyGyroLatency(uint8_t * payload, uint16_t size, const MSPContext & context) 
+            {
+                (void)size;
+
+                Profiler * profiler = context.profiler;
+
+                mspmsg::GYRO_LATENCY msg = {
+                    (int32_t)profiler->getLatencyCount(), (int32_t)profiler->getLatencyMean(),
+                    (int32_t)profiler->getLatencyPercentile(.50f), (int32_t)profiler->getLatencyPercentile(.90f),
+                    (int32_t)profiler->getLatencyPercentile(.99f), (int32_t)profiler->getLatencyMax()};
+                msg.encode(payload);
+                return true;
+            }
+
+            bool replyCpuLoad(uint8_t * payload, uint16_t size, const MSPContext & context) 
+            {
+                (void)size;
+
+                mspmsg::CPU_LOAD msg = {context.profiler->getCpuLoad()};
+                msg.encode(payload);
+                return true;
+            }
+
+            bool replyBootTimes(uint8_t * payload, uint16_t size, const MSPContext & context) 
+            {
+                (void)size;
+
+                Profiler * profiler = context.profiler;
+
+                mspmsg::BOOT_TIMES msg = {
+                    (int32_t)profiler->getBootMicros(Profiler::BOOT_INIT),
+                    (int32_t)profiler->getBootMicros(Profiler::BOOT_SENSORS),
+                    (int32_t)profiler->getBootMicros(Profiler::BOOT_ATTITUDE),
+                    (int32_t)profiler->getBootMicros(Profiler::BOOT_RECEIVER),
+                    (int32_t)profiler->getBootMicros(Profiler::BOOT_READY)};
+                msg.encode(payload);
+                return true;
+            }
+
+            // Mean, min, and max of each channel since the last one, which starts the next window; subscribed to,
+            // that is one window per subscription period.  Each port has a window of its own, so the first reply
+            // on a port is empty.  All zero when the flight code keeps no envelope.
+            bool replyEnvelope(uint8_t * payload, uint16_t size, const MSPContext & context) 
+            {
+                (void)size;
+
+                static_assert(mspmsg::ENVELOPE::FIELD_COUNT == 2+3*TelemetryEnvelope::CHANNEL_COUNT, "ENVELOPE doesn't match envelope channels");
+
+                TelemetryEnvelope * envelope = context.envelope;
+
+                if (envelope && envelopeWindow == TelemetryEnvelope::NO_WINDOW) {
+                    envelopeWindow = envelope->open();
+                }
+
+                for (uint8_t k=0; k<TelemetryEnvelope::CHANNEL_COUNT; ++k) {
+                    TelemetryEnvelope::window_t w = {0, 0, 0, 0};
+                    if (envelope) {
+                        w = envelope->take(envelopeWindow, k);
+                    }
+                    // Channels come in threes, the gyro's and the attitude's, each with its one count
+                    if (k % 3 == 0) {
+                        mspmsg::setField<mspmsg::ENVELOPE>(payload, k/3, w.count);
+                    }
+                    mspmsg::setField<mspmsg::ENVELOPE>(payload, 2+3*k,   w.mean);
+                    mspmsg::setField<mspmsg::ENVELOPE>(payload, 2+3*k+1, w.min);
+                    mspmsg::setField<mspmsg::ENVELOPE>(payload, 2+3*k+2, w.max);
+                }
+                return true;
+            }
+
+            // The governor's shedding level (255 when no governor is running), the load it last acted on, and how
+            // often it has changed level
+            bool replyLoadGovernor(uint8_t * payload, uint16_t size, const MSPContext & context) 
+            {
+                (void)size;
+
+                LoadGovernor * governor = context.governor;
+
+                mspmsg::LOAD_GOVERNOR msg = {255, 0, 0};
+                if (governor) {
+                    msg.level = governor->level();
+                    msg.load = context.profiler->getCpuLoad();
+                    msg.changes = (int32_t)governor->changes();
+                }
+                msg.encode(payload);
+                return true;
+            }
+
+            // All of the receiver's channels in about half the bytes of RC_NORMAL's first eight, for slow links
+            bool replyRcPacked(uint8_t * payload, uint16_t size, const MSPContext & context) 
+            {
+                (void)size;
+
+                static_assert(mspmsg::RC_PACKED::FIELD_COUNT == 1+Receiver::MAXCHANNELS, "RC_PACKED doesn't match receiver channels");
+
+                const vehicle_state_t & state = replies->state();
+
+                mspmsg::setField<mspmsg::RC_PACKED>(payload, 0, state.channelCount);
+                for (uint8_t k=0; k<Receiver::MAXCHANNELS; ++k) {
+                    float value = k < state.channelCount ? state.rawvals[k] : 0.f;
+                    value = value < -1 ? -1 : (value > +1 ? +1 : value);
+                    mspmsg::setField<mspmsg::RC_PACKED>(payload, 1+k, (int16_t)(value * 32767 + (value < 0 ? -.5f : +.5f)));
+                }
+                return true;
+            }
+
+            // For the plain int16 encoding, at half the bytes of ATTITUDE_RADIANS
+            bool replyAttitudeCompact(uint8_t * payload, uint16_t size, const MSPContext & context) 
+            {
+                (void)size;
+
+                const float * angles = replies->state().eulerAngles;
+
+                mspmsg::ATTITUDE_COMPACT msg = {quantizeAngle(angles[0]), quantizeAngle(angles[1]), quantizeAngle(angles[2])};
+                msg.encode(payload);
+                return true;
+            }
+
+            // Eight samples in 34 framed bytes, against 144 for as many ATTITUDE_RADIANS.  Each message starts
+            // from an absolute sample, so a lost frame loses only its own samples.  The deltas run against the
+            // previous sample as the receiver will reconstruct it, so rounding and clipping don't accumulate, and
+            // the shift is the smallest that fits the biggest step.
+            bool replyAttitudeDelta(uint8_t * payload, uint16_t size, const MSPContext & context) 
+            {
+                (void)size;
+                (void)context;
+
+                static_assert(mspmsg::ATTITUDE_DELTA::FIELD_COUNT == 4 + 3*(ATTITUDE_SAMPLES-1), "ATTITUDE_DELTA doesn't match attitude samples");
+
+                const int16_t * base = attitudeHistory[attitudeIndex];
+
+                int32_t biggest = 0;
+                for (uint8_t k=1; k<ATTITUDE_SAMPLES; ++k) {
+                    const int16_t * prev = attitudeHistory[(attitudeIndex + k - 1) % ATTITUDE_SAMPLES];
+                    const int16_t * curr = attitudeHistory[(attitudeIndex + k) % ATTITUDE_SAMPLES];
+                    for (uint8_t j=0; j<3; ++j) {
+                        int32_t step = wrapAngle(curr[j] - prev[j]);
+                        step = step < 0 ? -step : step;
+                        biggest = step > biggest ? step : biggest;
+                    }
+                }
+
+                uint8_t shift = 0;
+                while ((127 << shift) < biggest) {
+                    shift++;
+                }
+
+                mspmsg::setField<mspmsg::ATTITUDE_DELTA>(payload, 0, shift);
+
+                int32_t decoded[3];
+                for (uint8_t j=0; j<3; ++j) {
+                    mspmsg::setField<mspmsg::ATTITUDE_DELTA>(payload, 1+j, base[j]);
+                    decoded[j] = base[j];
+                }
+
+                const int32_t half = (1 << shift) >> 1;
+
+                for (uint8_t k=1; k<ATTITUDE_SAMPLES; ++k) {
+                    const int16_t * curr = attitudeHistory[(attitudeIndex + k) % ATTITUDE_SAMPLES];
+                    for (uint8_t j=0; j<3; ++j) {
+                        int32_t step = wrapAngle(curr[j] - decoded[j]);
+                        int32_t code = (step + (step < 0 ? -half : half)) / (1 << shift);
+                        code = code < -127 ? -127 : (code > 127 ? 127 : code);
+                        decoded[j] = wrapAngle(decoded[j] + code * (1 << shift));
+                        mspmsg::setField<mspmsg::ATTITUDE_DELTA>(payload, 1 + 3*k + j, (int8_t)code);
+                    }
+                }
+
+                return true;
             }
 
-            uint8_t read8(void)
+            // Angles in ATTITUDE_COMPACT and ATTITUDE_DELTA are signed binary angles, 65536 to the turn, so a yaw
+            // in [0,2*pi) comes out in [-pi,+pi) like the others
+            static int16_t quantizeAngle(float angle)
             {
-                return inBuf[inBufIndex++] & 0xff;
+                return BinaryAngle::fromRadians(angle).signedUnits();
             }
 
-            uint16_t read16(void)
+            // Wraps a difference of two angles back into [-pi,+pi), by 16-bit overflow
+            static int32_t wrapAngle(int32_t units)
             {
-                uint16_t t = read8();
-                t += (uint16_t)read8() << 8;
-                return t;
+                return (int16_t)units;
             }
 
-            uint32_t read32(void)
+            void sampleAttitude(const float eulerAngles[3])
             {
-                uint32_t t = read16();
-                t += (uint32_t)read16() << 16;
-                return t;
+                for (uint8_t j=0; j<3; ++j) {
+                    attitudeHistory[attitudeIndex][j] = quantizeAngle(eulerAngles[j]);
+                }
+                attitudeIndex = (attitudeIndex + 1) % ATTITUDE_SAMPLES;
             }
 
-            float readFloat(void)
+            // Command handlers ------------------------------------------------------------------------------
+
+            bool commandSetMotorNormal(uint8_t * payload, uint16_t size, const MSPContext & context) 
             {
-                float f = 0;
-                uint32_t t = read32();
-                memcpy(&f, &t, 4);
-                return f;
+                Mixer * mixer = context.mixer;
+
+                // No motor testing when the flight code doesn't offer the mixer (e.g. dual-core mode)
+                if (!mixer) {
+                    return false;
+                }
+
+                for (uint8_t i=0; i<size/4 && i<mspmsg::SET_MOTOR_NORMAL::FIELD_COUNT && i<mixer->motorCount(); ++i) {
+                    mixer->motorsDisarmed[i] = mspmsg::getField<mspmsg::SET_MOTOR_NORMAL,float>(payload, i);
+                }
+                return true;
             }
 
-            void serializeFloats(float f[], uint8_t n)
+            bool commandSetLoopHistogram(uint8_t * payload, uint16_t size, const MSPContext & context) 
             {
-                headSerialReply(4*n);
+                (void)context;
 
-                for (uint8_t k=0; k<n; ++k) {
-                    uint32_t a;
-                    memcpy(&a, &f[k], 4);
-                    serialize32(a);
+                if (size < mspmsg::SET_LOOP_HISTOGRAM::SIZE) {
+                    return false;
                 }
+
+                mspmsg::SET_LOOP_HISTOGRAM msg;
+                msg.decode(payload);
+                histogramStage = msg.stage % Profiler::STAGE_COUNT;
+                return true;
             }
 
-            void serialize32(uint32_t a)
+            bool commandSetSubscription(uint8_t * payload, uint16_t size, const MSPContext & context) 
+            {
+                (void)context;
+
+                if (size < mspmsg::SET_SUBSCRIPTION::SIZE) {
+                    return false;
+                }
+
+                mspmsg::SET_SUBSCRIPTION msg;
+                msg.decode(payload);
+
+                if (!findReply(msg.messageId)) {
+                    return false;
+                }
+
+                subscribe(msg.messageId, msg.divider, v2);
+                return true;
+            }
+
+            // Stages a whole new set of gains for the next gyro cycle; a negative (or NaN) gain rejects the set
+            bool commandSetPidGains(uint8_t * payload, uint16_t size, const MSPContext & context) 
+            {
+                if (!context.gains || size < mspmsg::SET_PID_GAINS::SIZE) {
+                    return false;
+                }
+
+                for (uint8_t k=0; k<mspmsg::SET_PID_GAINS::FIELD_COUNT; ++k) {
+                    if (!(mspmsg::getField<mspmsg::SET_PID_GAINS,float>(payload, k) >= 0)) {
+                        return false;
+                    }
+                }
+
+                mspmsg::SET_PID_GAINS msg;
+                msg.decode(payload);
+
+                gains_t gains = {msg.levelP, msg.cyclicP, msg.cyclicI, msg.cyclicD, msg.yawP, msg.yawI,
+                    msg.altP, msg.velP, msg.velI, msg.velD};
+                context.gains->stage(gains);
+                return true;
+            }
+
+            // Output ----------------------------------------------------------------------------------------
+
+            static uint8_t crc8_dvb_s2(uint8_t crc, uint8_t a)
+            {
+                crc ^= a;
+                for (uint8_t k=0; k<8; ++k) {
+                    crc = (crc & 0x80) ? (crc << 1) ^ 0xD5 : crc << 1;
+                }
+                return crc;
+            }
+
+            void serialize8(uint8_t a)
+            {
+                outBuf[outBufIndex + outBufSize++] = a;
+                checksum ^= a;
+                crc = crc8_dvb_s2(crc, a);
+            }
+
+            void serialize16(uint16_t a)
             {
                 serialize8(a & 0xFF);
-                serialize8((a >> 8) & 0xFF);
-                serialize8((a >> 16) & 0xFF);
-                serialize8((a >> 24) & 0xFF);
+                serialize8(a >> 8);
+            }
+
+            // Makes room for a frame with the given payload size after any unsent output, moving that output to the
+            // front of the buffer if needed.  Returns false if the frame won't fit yet.
+            bool reserveFrame(uint16_t payloadSize, bool v2frame)
+            {
+                uint16_t frameSize = payloadSize + (v2frame ? FRAME_OVERHEAD_V2 : FRAME_OVERHEAD);
+
+                if (outBufSize + frameSize > OUTBUF_SIZE) {
+                    return false;
+                }
+                if (outBufIndex + outBufSize + frameSize > OUTBUF_SIZE) {
+                    memmove(outBuf, &outBuf[outBufIndex], outBufSize);
+                    outBufIndex = 0;
+                }
+                return true;
+            }
+
+            // Runs a reply handler on a payload written straight into the output buffer, or copies in what it gave
+            // for the current snapshot
+            void serializePayload(const dispatch_t * reply, const MSPContext & context)
+            {
+                uint8_t * payload = &outBuf[outBufIndex + outBufSize];
+                const uint8_t * encoded = reply->snapshot ? replies->find(reply->id) : 0;
+                if (encoded) {
+                    memcpy(payload, encoded, reply->size);
+                }
+                else {
+                    (this->*reply->handler)(payload, reply->size, context);
+                    if (reply->snapshot) {
+                        replies->store(reply->id, payload, reply->size);
+                    }
+                }
+                for (uint16_t k=0; k<reply->size; ++k) {
+                    checksum ^= payload[k];
+                    crc = crc8_dvb_s2(crc, payload[k]);
+                }
+                outBufSize += reply->size;
             }
 
+            // Appends a complete reply frame, assuming reserveFrame() succeeded
+            void serializeReply(const dispatch_t * reply, const MSPContext & context, bool v2frame)
+            {
+                cmdMSP = reply->id;
+                headSerialResponse(0, reply->size, v2frame);
+                serializePayload(reply, context);
+                tailSerialReply(v2frame);
+            }
+
+            // Sends every due MSPv2 subscription that fits in one BATCH frame.  Anything left over stays due.
+            void streamBatch(const MSPContext & context)
+            {
+                const dispatch_t * due[MAX_SUBSCRIPTIONS];
+                subscription_t   * subs[MAX_SUBSCRIPTIONS];
+                uint8_t  count = 0;
+                uint16_t size = 0;
+
+                for (uint8_t k=0; k<MAX_SUBSCRIPTIONS; ++k) {
+                    subscription_t * sub = &subscriptions[k];
+                    if (sub->messageId && sub->v2 && sub->counter >= sub->divider) {
+                        const dispatch_t * reply = findReply(sub->messageId);
+                        uint16_t recordSize = BATCH_RECORD_OVERHEAD + reply->size;
+                        if (reserveFrame(size + recordSize, true)) {
+                            due[count] = reply;
+                            subs[count] = sub;
+                            count++;
+                            size += recordSize;
+                        }
+                    }
+                }
+
+                if (count == 0) {
+                    return;
+                }
+
+                reserveFrame(size, true);
+
+                cmdMSP = BATCH;
+                headSerialResponse(0, size, true);
+                for (uint8_t k=0; k<count; ++k) {
+                    serialize16(due[k]->id);
+                    serialize16(due[k]->size);
+                    serializePayload(due[k], context);
+                    subs[k]->counter = 0;
+                }
+                tailSerialReply(true);
+            }
+
+            void subscribe(uint8_t id, uint8_t divider, bool v2frame)
+            {
+                subscription_t * freeSlot = 0;
+
+                for (uint8_t k=0; k<MAX_SUBSCRIPTIONS; ++k) {
+                    subscription_t * sub = &subscriptions[k];
+                    if (sub->messageId == id) {
+                        // Divider 0 cancels an existing subscription
+                        sub->messageId = divider ? id : 0;
+                        sub->divider = divider;
+                        sub->counter = 0;
+                        sub->v2 = v2frame;
+                        return;
+                    }
+                    if (!sub->messageId && !freeSlot) {
+                        freeSlot = sub;
+                    }
+                }
+
+                if (divider && freeSlot) {
+                    freeSlot->messageId = id;
+                    freeSlot->divider = divider;
+                    freeSlot->counter = 0;
+                    freeSlot->v2 = v2frame;
+                }
+            }
 
-            void headSerialResponse(uint8_t err, uint8_t s)
+            void headSerialResponse(uint8_t err, uint16_t s, bool v2frame)
             {
                 serialize8('$');
-                serialize8('M');
+                serialize8(v2frame ? 'X' : 'M');
                 serialize8(err ? '!' : '>');
                 checksum = 0;               // start calculating a new checksum
-                serialize8(s);
-                serialize8(cmdMSP);
+                crc = 0;
+                if (v2frame) {
+                    serialize8(0);          // flag
+                    serialize16(cmdMSP);
+                    serialize16(s);
+                }
+                else {
+                    serialize8(s);
+                    serialize8(cmdMSP);
+                }
             }
 
-            void headSerialReply(uint8_t s)
+            void tailSerialReply(bool v2frame)
             {
-                headSerialResponse(0, s);
+                serialize8(v2frame ? crc : checksum);
             }
 
-            void headSerialError(uint8_t s)
+            // Handles a complete, verified request in inBuf
+            void dispatch(const MSPContext & context)
             {
-                headSerialResponse(1, s);
+                const dispatch_t * reply = cmdMSP < 256 ? findReply(cmdMSP) : 0;
+
+                // A request for a reply message
+                if (reply) {
+                    if (reserveFrame(reply->size, v2)) {
+                        serializeReply(reply, context, v2);
+                    }
+                }
+
+                // Everything else is a command, acknowledged with an empty reply (or error) when there is room; 
+                // one we don't know how to handle gets an error
+                else {
+
+                    const dispatch_t * command = cmdMSP < 256 ? findHandler(cmdMSP) : 0;
+
+                    bool ok = command && (this->*command->handler)(inBuf, dataSize, context);
+
+                    if (reserveFrame(0, v2)) {
+                        headSerialResponse(!ok, 0, v2);
+                        tailSerialReply(v2);
+                    }
+                }
             }
 
-            void tailSerialReply(void)
+            // Byte-at-a-time state machine, for frames split across parse() calls
+            void parseByte(uint8_t c, const MSPContext & context)
             {
-                serialize8(checksum);
+                switch (c_state) {
+
+                    case IDLE:
+                        c_state = (c == '$') ? HEADER_START : IDLE;
+                        break;
+
+                    // A '$' that breaks off a header may start the next one, as in parseFrame()
+                    case HEADER_START:
+                        c_state = (c == 'M') ? HEADER_M : (c == 'X') ? HEADER_X : (c == '$') ? HEADER_START : IDLE;
+                        break;
+
+                    // $M framing --------------------------------------------------------------------------------
+
+                    case HEADER_M:
+                        c_state = (c == '<') ? HEADER_ARROW : (c == '$') ? HEADER_START : IDLE;
+                        break;
+
+                    case HEADER_ARROW:
+                        if (c > INBUF_SIZE) {       // now we are expecting the payload size
+                            c_state = IDLE;
+                            break;
+                        }
+                        v2 = false;
+                        dataSize = c;
+                        offset = 0;
+                        checksum = 0;
+                        checksum ^= c;
+                        c_state = HEADER_SIZE;      // the command is to follow
+                        break;
+
+                    case HEADER_SIZE:
+                        cmdMSP = c;
+                        checksum ^= c;
+                        c_state = HEADER_CMD;
+                        break;
+
+                    case HEADER_CMD:
+                        if (offset < dataSize) {
+                            checksum ^= c;
+                            inBuf[offset++] = c;
+                        }
+                        else {
+                            if (checksum == c) {    // compare calculated and transferred checksum
+                                dispatch(context);
+                            }
+                            c_state = IDLE;
+                        }
+                        break;
+
+                    // $X framing --------------------------------------------------------------------------------
+
+                    case HEADER_X:
+                        c_state = (c == '<') ? HEADER_V2_ARROW : (c == '$') ? HEADER_START : IDLE;
+                        break;
+
+                    case HEADER_V2_ARROW:           // flag byte, unused
+                        crc = crc8_dvb_s2(0, c);
+                        c_state = HEADER_V2_FLAG;
+                        break;
+
+                    case HEADER_V2_FLAG:
+                        crc = crc8_dvb_s2(crc, c);
+                        cmdMSP = c;
+                        c_state = HEADER_V2_CMD_LO;
+                        break;
+
+                    case HEADER_V2_CMD_LO:
+                        crc = crc8_dvb_s2(crc, c);
+                        cmdMSP |= (uint16_t)c << 8;
+                        c_state = HEADER_V2_CMD_HI;
+                        break;
+
+                    case HEADER_V2_CMD_HI:
+                        crc = crc8_dvb_s2(crc, c);
+                        dataSize = c;
+                        c_state = HEADER_V2_SIZE_LO;
+                        break;
+
+                    case HEADER_V2_SIZE_LO:
+                        crc = crc8_dvb_s2(crc, c);
+                        dataSize |= (uint16_t)c << 8;
+                        offset = 0;
+                        v2 = true;
+                        c_state = dataSize > INBUF_SIZE ? IDLE : HEADER_V2_PAYLOAD;
+                        break;
+
+                    case HEADER_V2_PAYLOAD:
+                        if (offset < dataSize) {
+                            crc = crc8_dvb_s2(crc, c);
+                            inBuf[offset++] = c;
+                        }
+                        else {
+                            if (crc == c) {
+                                dispatch(context);
+                            }
+                            c_state = IDLE;
+                        }
+                        break;
+
+                    default:
+                        c_state = IDLE;
+                        break;
+                }
+            }
+
+            // Checks and dispatches the frame at the start of buf (which begins with '$').  Returns the bytes it
+            // used, or 0 if the frame runs past len.  A bad header uses just the '$', so the search resumes after
+            // it.  A size too big for inBuf uses the header up to and including the size, so the search resumes
+            // where the byte-at-a-time parser's does; the size may be corrupt, and waiting for that many bytes
+            // could swallow good frames.  A frame with a bad checksum is skipped whole.
+            uint16_t parseFrame(const uint8_t * buf, uint16_t len, const MSPContext & context)
+            {
+                if (len < 3) {
+                    return 0;
+                }
+
+                if ((buf[1] != 'M' && buf[1] != 'X') || buf[2] != '<') {
+                    return 1;
+                }
+
+                bool v2frame = buf[1] == 'X';
+
+                // Offset of the payload; the size ends the header in v2 and comes just ahead of the command in v1
+                uint8_t headerSize = v2frame ? 8 : 5;
+
+                if (len < headerSize) {
+                    return 0;
+                }
+
+                uint16_t size = v2frame ? (uint16_t)(buf[6] | (buf[7] << 8)) : buf[3];
+
+                if (size > INBUF_SIZE) {
+                    return v2frame ? headerSize : headerSize - 1;
+                }
+
+                uint16_t frameSize = headerSize + size + 1;
+
+                if (len < frameSize) {
+                    return 0;
+                }
+
+                // Checksum or CRC over everything after the direction byte, up to the check byte itself
+                uint8_t check = 0;
+                if (v2frame) {
+                    for (uint16_t k=3; k<frameSize-1; ++k) {
+                        check = crc8_dvb_s2(check, buf[k]);
+                    }
+                }
+                else {
+                    for (uint16_t k=3; k<frameSize-1; ++k) {
+                        check ^= buf[k];
+                    }
+                }
+
+                if (check == buf[frameSize-1]) {
+                    v2 = v2frame;
+                    cmdMSP = v2frame ? (uint16_t)(buf[4] | (buf[5] << 8)) : buf[4];
+                    dataSize = size;
+                    memcpy(inBuf, &buf[headerSize], size);
+                    dispatch(context);
+                }
+
+                return frameSize;
             }
 
         public:
 
+            // MSPv2 command carrying several replies
+            static const uint16_t BATCH = 0x4801;
+
             void init(void)
             {
                 checksum = 0;
+                crc = 0;
+                v2 = false;
                 outBufIndex = 0;
                 outBufSize = 0;
                 cmdMSP = 0;
                 offset = 0;
                 dataSize = 0;
                 c_state = IDLE;
+                histogramStage = 0;
+                envelopeWindow = TelemetryEnvelope::NO_WINDOW;
+                memset(subscriptions, 0, sizeof(subscriptions));
+                memset(attitudeHistory, 0, sizeof(attitudeHistory));
+                attitudeIndex = 0;
+                replies = 0;
+                boundContext = 0;
             }
 
-            void update(uint8_t c, float eulerAngles[3], bool armed, Receiver * receiver, Mixer * mixer)
+            // Sets what update(), parse(), and stream() answer from; both must stay valid while they are in use.
+            // The context is read through the pointer, so changes to it need no new bind().
+            void bind(ReplyCache * replies, const MSPContext * context)
             {
-                if (c_state == IDLE) {
-                    c_state = (c == '$') ? HEADER_START : IDLE;
-                    if (c_state == IDLE && !armed) {
+                this->replies = replies;
+                boundContext = context;
+            }
+
+            // Handles one received byte
+            void update(uint8_t c)
+            {
+                parseByte(c, *boundContext);
+            }
+
+            // Handles a run of received bytes, e.g. a chunk of a DMA ring.  Frames are found with memchr, and each
+            // one whole in buf is checked and dispatched in one go; only a frame split across calls, or a
+            // byte that starts no frame, goes through the state machine.
+            void parse(const uint8_t * buf, uint16_t len)
+            {
+                const MSPContext & context = *boundContext;
+
+                uint16_t k = 0;
+
+                while (k < len) {
+
+                    // Finish a frame begun in an earlier call
+                    if (c_state != IDLE) {
+                        parseByte(buf[k++], context);
+                        continue;
                     }
-                } else if (c_state == HEADER_START) {
-                    c_state = (c == 'M') ? HEADER_M : IDLE;
-                } else if (c_state == HEADER_M) {
-                    c_state = (c == '<') ? HEADER_ARROW : IDLE;
-                } else if (c_state == HEADER_ARROW) {
-                    if (c > INBUF_SIZE) {       // now we are expecting the payload size
-                        c_state = IDLE;
-                        return;
+
+                    const uint8_t * start = (const uint8_t *)memchr(&buf[k], '$', len-k);
+                    if (!start) {
+                        break;
                     }
-                    dataSize = c;
-                    offset = 0;
-                    checksum = 0;
-                    inBufIndex = 0;
-                    checksum ^= c;
-                    c_state = HEADER_SIZE;      // the command is to follow
-                } else if (c_state == HEADER_SIZE) {
-                    cmdMSP = c;
-                    checksum ^= c;
-                    c_state = HEADER_CMD;
-                } else if (c_state == HEADER_CMD && 
-                        offset < dataSize) {
-                    checksum ^= c;
-                    inBuf[offset++] = c;
-                } else if (c_state == HEADER_CMD && offset >= dataSize) {
-
-                    if (checksum == c) {        // compare calculated and transferred checksum
-
-                        switch (cmdMSP) {
-
-                            case MSP_SET_MOTOR_NORMAL:
-                                for (uint8_t i = 0; i < 4; i++)
-                                    mixer->motorsDisarmed[i] = readFloat();
-                                headSerialReply(0);
-                                break;
-
-                            case MSP_RC_NORMAL:
-                                outBufSize = 0;
-                                outBufIndex = 0;
-                                serializeFloats(receiver->rawvals, 8);
-                                break;
-
-                            case MSP_ATTITUDE_RADIANS: 
-                                {
-                                    outBufSize = 0;
-                                    outBufIndex = 0;
-                                    serializeFloats(eulerAngles, 3);
-                                }
-                                break;
-
-                                // don't know how to handle the (valid) message, indicate error MSP $M!
-                            default:                   
-                                headSerialError(0);
-                                break;
-                        }
-                        tailSerialReply();
+                    k = (uint16_t)(start - buf);
+
+                    uint16_t used = parseFrame(&buf[k], len-k, context);
+
+                    // Not all of the frame is here yet: leave it to the state machine
+                    if (!used) {
+                        parseByte(buf[k++], context);
+                        continue;
+                    }
+
+                    k += used;
+                }
+            }
+
+            // Called once per serial-comms pass: samples the attitude for ATTITUDE_DELTA, and queues each subscribed
+            // message that is due, as long as there is room in the output buffer.  A message that doesn't fit stays
+            // due and goes out on a later pass.
+            void stream(void)
+            {
+                const MSPContext & context = *boundContext;
+
+                sampleAttitude(replies->state().eulerAngles);
+
+                bool batch = false;
+
+                for (uint8_t k=0; k<MAX_SUBSCRIPTIONS; ++k) {
+
+                    subscription_t * sub = &subscriptions[k];
+
+                    if (!sub->messageId) {
+                        continue;
+                    }
+
+                    if (sub->counter < sub->divider) {
+                        sub->counter++;
                     }
 
-                    c_state = IDLE;
+                    if (sub->counter < sub->divider) {
+                        continue;
+                    }
 
-                } 
+                    if (sub->v2) {
+                        batch = true;
+                        continue;
+                    }
 
-            } // writeByte
+                    const dispatch_t * reply = findReply(sub->messageId);
+
+                    if (reserveFrame(reply->size, false)) {
+                        serializeReply(reply, context, false);
+                        sub->counter = 0;
+                    }
+                }
+
+                if (batch) {
+                    streamBatch(context);
+                }
+            }
 
-            uint8_t availableBytes(void)
+            uint16_t availableBytes(void)
             {
                 return outBufSize;
             }
@@ -236,5 +1019,24 @@ namespace hf {
 
     }; // class MSP
 
+    // Takes MSP's place on boards built without AllFeatures::SERIAL
+    class NoMSP {
+
+        public:
+
+            void init(void) { }
+
+            void bind(ReplyCache * replies, const MSPContext * context) { (void)replies; (void)context; }
+
+            void update(uint8_t c) { (void)c; }
+
+            void parse(const uint8_t * buf, uint16_t len) { (void)buf; (void)len; }
+
+            void stream(void) { }
+
+            uint16_t availableBytes(void) { return 0; }
+            uint8_t  readByte(void) { return 0; }
+
+    }; // class NoMSP
 
 } // namespace
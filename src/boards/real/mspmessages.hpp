@@ -0,0 +1,1349 @@
+// AUTO-GENERATED CODE: DO NOT EDIT!!!
+
+/*
+   mspmessages.hpp : MSP message descriptors and payload codecs for the firmware
+
+   Generated by extras/parser/msppg.py from messages.json; run 'make firmware' there after changing a message.
+
+   Each message is a struct with its ID, payload size, and field layout as compile-time constants, typed members,
+   and encode()/decode() that go straight between the members and a payload in the serial buffers.  setField()
+   and getField() reach a field by index, for filling repeated fields in a loop.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+namespace hf {
+
+    namespace mspmsg {
+
+        typedef enum {
+            FIELD_BYTE,
+            FIELD_SHORT,
+            FIELD_INT,
+            FIELD_FLOAT
+        } fieldType_t;
+
+        typedef struct {
+            uint8_t     offset;
+            fieldType_t type;
+        } field_t;
+
+        typedef struct {
+            uint8_t         id;
+            uint8_t         size;
+            uint8_t         fieldCount;
+            const field_t * fields;
+        } descriptor_t;
+
+        // Little-endian field access -------------------------------------------------------------------------
+
+        inline void put(uint8_t * p, uint8_t v)
+        {
+            p[0] = v;
+        }
+
+        inline void put(uint8_t * p, int16_t v)
+        {
+            p[0] = v & 0xFF;
+            p[1] = (v >> 8) & 0xFF;
+        }
+
+        inline void put(uint8_t * p, int32_t v)
+        {
+            p[0] = v & 0xFF;
+            p[1] = (v >> 8) & 0xFF;
+            p[2] = (v >> 16) & 0xFF;
+            p[3] = (v >> 24) & 0xFF;
+        }
+
+        inline void put(uint8_t * p, float v)
+        {
+            int32_t a;
+            memcpy(&a, &v, 4);
+            put(p, a);
+        }
+
+        inline void get(const uint8_t * p, uint8_t & v)
+        {
+            v = p[0];
+        }
+
+        inline void get(const uint8_t * p, int16_t & v)
+        {
+            v = (int16_t)(p[0] | (p[1] << 8));
+        }
+
+        inline void get(const uint8_t * p, int32_t & v)
+        {
+            v = (int32_t)((uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24));
+        }
+
+        inline void get(const uint8_t * p, float & v)
+        {
+            int32_t a;
+            get(p, a);
+            memcpy(&v, &a, 4);
+        }
+
+        // Field access by index, converting to and from the field's wire type --------------------------------
+
+        template <class M, typename V>
+        inline void setField(uint8_t * payload, uint8_t index, V value)
+        {
+            const field_t & f = M::FIELDS[index];
+            uint8_t * p = payload + f.offset;
+            switch (f.type) {
+                case FIELD_BYTE:  put(p, (uint8_t)value); break;
+                case FIELD_SHORT: put(p, (int16_t)value); break;
+                case FIELD_INT:   put(p, (int32_t)value); break;
+                case FIELD_FLOAT: put(p, (float)value);   break;
+            }
+        }
+
+        template <class M, typename V>
+        inline V getField(const uint8_t * payload, uint8_t index)
+        {
+            const field_t & f = M::FIELDS[index];
+            const uint8_t * p = payload + f.offset;
+            switch (f.type) {
+                case FIELD_BYTE:  { uint8_t v; get(p, v); return (V)v; }
+                case FIELD_SHORT: { int16_t v; get(p, v); return (V)v; }
+                case FIELD_INT:   { int32_t v; get(p, v); return (V)v; }
+                case FIELD_FLOAT: { float   v; get(p, v); return (V)v; }
+            }
+            return V();
+        }
+
+        // Messages -------------------------------------------------------------------------------------------
+
+        // Each message is a template, used through the typedef after it, only so that this header can define its
+        // FIELDS without violating the one-definition rule
+
+        template <typename T=void>
+        struct RC_NORMAL_T {
+
+            static const uint8_t ID = 121;
+            static const uint8_t SIZE = 32;
+            static const uint8_t FIELD_COUNT = 8;
+
+            static constexpr field_t FIELDS[FIELD_COUNT] = {
+                { 0, FIELD_FLOAT},
+                { 4, FIELD_FLOAT},
+                { 8, FIELD_FLOAT},
+                {12, FIELD_FLOAT},
+                {16, FIELD_FLOAT},
+                {20, FIELD_FLOAT},
+                {24, FIELD_FLOAT},
+                {28, FIELD_FLOAT}
+            };
+
+            float c1;
+            float c2;
+            float c3;
+            float c4;
+            float c5;
+            float c6;
+            float c7;
+            float c8;
+
+            void encode(uint8_t * payload) const
+            {
+                put(payload + 0, c1);
+                put(payload + 4, c2);
+                put(payload + 8, c3);
+                put(payload + 12, c4);
+                put(payload + 16, c5);
+                put(payload + 20, c6);
+                put(payload + 24, c7);
+                put(payload + 28, c8);
+            }
+
+            void decode(const uint8_t * payload)
+            {
+                get(payload + 0, c1);
+                get(payload + 4, c2);
+                get(payload + 8, c3);
+                get(payload + 12, c4);
+                get(payload + 16, c5);
+                get(payload + 20, c6);
+                get(payload + 24, c7);
+                get(payload + 28, c8);
+            }
+
+        }; // struct RC_NORMAL_T
+
+        template <typename T> constexpr field_t RC_NORMAL_T<T>::FIELDS[];
+
+        typedef RC_NORMAL_T<> RC_NORMAL;
+
+        template <typename T=void>
+        struct ATTITUDE_RADIANS_T {
+
+            static const uint8_t ID = 122;
+            static const uint8_t SIZE = 12;
+            static const uint8_t FIELD_COUNT = 3;
+
+            static constexpr field_t FIELDS[FIELD_COUNT] = {
+                { 0, FIELD_FLOAT},
+                { 4, FIELD_FLOAT},
+                { 8, FIELD_FLOAT}
+            };
+
+            float roll;
+            float pitch;
+            float yaw;
+
+            void encode(uint8_t * payload) const
+            {
+                put(payload + 0, roll);
+                put(payload + 4, pitch);
+                put(payload + 8, yaw);
+            }
+
+            void decode(const uint8_t * payload)
+            {
+                get(payload + 0, roll);
+                get(payload + 4, pitch);
+                get(payload + 8, yaw);
+            }
+
+        }; // struct ATTITUDE_RADIANS_T
+
+        template <typename T> constexpr field_t ATTITUDE_RADIANS_T<T>::FIELDS[];
+
+        typedef ATTITUDE_RADIANS_T<> ATTITUDE_RADIANS;
+
+        template <typename T=void>
+        struct LOOP_STATS_T {
+
+            static const uint8_t ID = 123;
+            static const uint8_t SIZE = 108;
+            static const uint8_t FIELD_COUNT = 27;
+
+            static constexpr field_t FIELDS[FIELD_COUNT] = {
+                { 0, FIELD_INT},
+                { 4, FIELD_INT},
+                { 8, FIELD_INT},
+                {12, FIELD_INT},
+                {16, FIELD_INT},
+                {20, FIELD_INT},
+                {24, FIELD_INT},
+                {28, FIELD_INT},
+                {32, FIELD_INT},
+                {36, FIELD_INT},
+                {40, FIELD_INT},
+                {44, FIELD_INT},
+                {48, FIELD_INT},
+                {52, FIELD_INT},
+                {56, FIELD_INT},
+                {60, FIELD_INT},
+                {64, FIELD_INT},
+                {68, FIELD_INT},
+                {72, FIELD_INT},
+                {76, FIELD_INT},
+                {80, FIELD_INT},
+                {84, FIELD_INT},
+                {88, FIELD_INT},
+                {92, FIELD_INT},
+                {96, FIELD_INT},
+                {100, FIELD_INT},
+                {104, FIELD_INT}
+            };
+
+            int32_t gyroMin;
+            int32_t gyroMean;
+            int32_t gyroMax;
+            int32_t eulerMin;
+            int32_t eulerMean;
+            int32_t eulerMax;
+            int32_t receiverMin;
+            int32_t receiverMean;
+            int32_t receiverMax;
+            int32_t accelMin;
+            int32_t accelMean;
+            int32_t accelMax;
+            int32_t baroMin;
+            int32_t baroMean;
+            int32_t baroMax;
+            int32_t serialMin;
+            int32_t serialMean;
+            int32_t serialMax;
+            int32_t blackboxMin;
+            int32_t blackboxMean;
+            int32_t blackboxMax;
+            int32_t sonarMin;
+            int32_t sonarMean;
+            int32_t sonarMax;
+            int32_t debugMin;
+            int32_t debugMean;
+            int32_t debugMax;
+
+            void encode(uint8_t * payload) const
+            {
+                put(payload + 0, gyroMin);
+                put(payload + 4, gyroMean);
+                put(payload + 8, gyroMax);
+                put(payload + 12, eulerMin);
+                put(payload + 16, eulerMean);
+                put(payload + 20, eulerMax);
+                put(payload + 24, receiverMin);
+                put(payload + 28, receiverMean);
+                put(payload + 32, receiverMax);
+                put(payload + 36, accelMin);
+                put(payload + 40, accelMean);
+                put(payload + 44, accelMax);
+                put(payload + 48, baroMin);
+                put(payload + 52, baroMean);
+                put(payload + 56, baroMax);
+                put(payload + 60, serialMin);
+                put(payload + 64, serialMean);
+                put(payload + 68, serialMax);
+                put(payload + 72, blackboxMin);
+                put(payload + 76, blackboxMean);
+                put(payload + 80, blackboxMax);
+                put(payload + 84, sonarMin);
+                put(payload + 88, sonarMean);
+                put(payload + 92, sonarMax);
+                put(payload + 96, debugMin);
+                put(payload + 100, debugMean);
+                put(payload + 104, debugMax);
+            }
+
+            void decode(const uint8_t * payload)
+            {
+                get(payload + 0, gyroMin);
+                get(payload + 4, gyroMean);
+                get(payload + 8, gyroMax);
+                get(payload + 12, eulerMin);
+                get(payload + 16, eulerMean);
+                get(payload + 20, eulerMax);
+                get(payload + 24, receiverMin);
+                get(payload + 28, receiverMean);
+                get(payload + 32, receiverMax);
+                get(payload + 36, accelMin);
+                get(payload + 40, accelMean);
+                get(payload + 44, accelMax);
+                get(payload + 48, baroMin);
+                get(payload + 52, baroMean);
+                get(payload + 56, baroMax);
+                get(payload + 60, serialMin);
+                get(payload + 64, serialMean);
+                get(payload + 68, serialMax);
+                get(payload + 72, blackboxMin);
+                get(payload + 76, blackboxMean);
+                get(payload + 80, blackboxMax);
+                get(payload + 84, sonarMin);
+                get(payload + 88, sonarMean);
+                get(payload + 92, sonarMax);
+                get(payload + 96, debugMin);
+                get(payload + 100, debugMean);
+                get(payload + 104, debugMax);
+            }
+
+        }; // struct LOOP_STATS_T
+
+        template <typename T> constexpr field_t LOOP_STATS_T<T>::FIELDS[];
+
+        typedef LOOP_STATS_T<> LOOP_STATS;
+
+        template <typename T=void>
+        struct LOOP_HISTOGRAM_T {
+
+            static const uint8_t ID = 124;
+            static const uint8_t SIZE = 65;
+            static const uint8_t FIELD_COUNT = 17;
+
+            static constexpr field_t FIELDS[FIELD_COUNT] = {
+                { 0, FIELD_BYTE},
+                { 1, FIELD_INT},
+                { 5, FIELD_INT},
+                { 9, FIELD_INT},
+                {13, FIELD_INT},
+                {17, FIELD_INT},
+                {21, FIELD_INT},
+                {25, FIELD_INT},
+                {29, FIELD_INT},
+                {33, FIELD_INT},
+                {37, FIELD_INT},
+                {41, FIELD_INT},
+                {45, FIELD_INT},
+                {49, FIELD_INT},
+                {53, FIELD_INT},
+                {57, FIELD_INT},
+                {61, FIELD_INT}
+            };
+
+            uint8_t stage;
+            int32_t h0;
+            int32_t h1;
+            int32_t h2;
+            int32_t h3;
+            int32_t h4;
+            int32_t h5;
+            int32_t h6;
+            int32_t h7;
+            int32_t h8;
+            int32_t h9;
+            int32_t h10;
+            int32_t h11;
+            int32_t h12;
+            int32_t h13;
+            int32_t h14;
+            int32_t h15;
+
+            void encode(uint8_t * payload) const
+            {
+                put(payload + 0, stage);
+                put(payload + 1, h0);
+                put(payload + 5, h1);
+                put(payload + 9, h2);
+                put(payload + 13, h3);
+                put(payload + 17, h4);
+                put(payload + 21, h5);
+                put(payload + 25, h6);
+                put(payload + 29, h7);
+                put(payload + 33, h8);
+                put(payload + 37, h9);
+                put(payload + 41, h10);
+                put(payload + 45, h11);
+                put(payload + 49, h12);
+                put(payload + 53, h13);
+                put(payload + 57, h14);
+                put(payload + 61, h15);
+            }
+
+            void decode(const uint8_t * payload)
+            {
+                get(payload + 0, stage);
+                get(payload + 1, h0);
+                get(payload + 5, h1);
+                get(payload + 9, h2);
+                get(payload + 13, h3);
+                get(payload + 17, h4);
+                get(payload + 21, h5);
+                get(payload + 25, h6);
+                get(payload + 29, h7);
+                get(payload + 33, h8);
+                get(payload + 37, h9);
+                get(payload + 41, h10);
+                get(payload + 45, h11);
+                get(payload + 49, h12);
+                get(payload + 53, h13);
+                get(payload + 57, h14);
+                get(payload + 61, h15);
+            }
+
+        }; // struct LOOP_HISTOGRAM_T
+
+        template <typename T> constexpr field_t LOOP_HISTOGRAM_T<T>::FIELDS[];
+
+        typedef LOOP_HISTOGRAM_T<> LOOP_HISTOGRAM;
+
+        template <typename T=void>
+        struct GYRO_SPECTRUM_T {
+
+            static const uint8_t ID = 125;
+            static const uint8_t SIZE = 76;
+            static const uint8_t FIELD_COUNT = 19;
+
+            static constexpr field_t FIELDS[FIELD_COUNT] = {
+                { 0, FIELD_FLOAT},
+                { 4, FIELD_FLOAT},
+                { 8, FIELD_FLOAT},
+                {12, FIELD_FLOAT},
+                {16, FIELD_FLOAT},
+                {20, FIELD_FLOAT},
+                {24, FIELD_FLOAT},
+                {28, FIELD_FLOAT},
+                {32, FIELD_FLOAT},
+                {36, FIELD_FLOAT},
+                {40, FIELD_FLOAT},
+                {44, FIELD_FLOAT},
+                {48, FIELD_FLOAT},
+                {52, FIELD_FLOAT},
+                {56, FIELD_FLOAT},
+                {60, FIELD_FLOAT},
+                {64, FIELD_FLOAT},
+                {68, FIELD_FLOAT},
+                {72, FIELD_FLOAT}
+            };
+
+            float peakHz;
+            float binHz;
+            float m0;
+            float m1;
+            float m2;
+            float m3;
+            float m4;
+            float m5;
+            float m6;
+            float m7;
+            float m8;
+            float m9;
+            float m10;
+            float m11;
+            float m12;
+            float m13;
+            float m14;
+            float m15;
+            float m16;
+
+            void encode(uint8_t * payload) const
+            {
+                put(payload + 0, peakHz);
+                put(payload + 4, binHz);
+                put(payload + 8, m0);
+                put(payload + 12, m1);
+                put(payload + 16, m2);
+                put(payload + 20, m3);
+                put(payload + 24, m4);
+                put(payload + 28, m5);
+                put(payload + 32, m6);
+                put(payload + 36, m7);
+                put(payload + 40, m8);
+                put(payload + 44, m9);
+                put(payload + 48, m10);
+                put(payload + 52, m11);
+                put(payload + 56, m12);
+                put(payload + 60, m13);
+                put(payload + 64, m14);
+                put(payload + 68, m15);
+                put(payload + 72, m16);
+            }
+
+            void decode(const uint8_t * payload)
+            {
+                get(payload + 0, peakHz);
+                get(payload + 4, binHz);
+                get(payload + 8, m0);
+                get(payload + 12, m1);
+                get(payload + 16, m2);
+                get(payload + 20, m3);
+                get(payload + 24, m4);
+                get(payload + 28, m5);
+                get(payload + 32, m6);
+                get(payload + 36, m7);
+                get(payload + 40, m8);
+                get(payload + 44, m9);
+                get(payload + 48, m10);
+                get(payload + 52, m11);
+                get(payload + 56, m12);
+                get(payload + 60, m13);
+                get(payload + 64, m14);
+                get(payload + 68, m15);
+                get(payload + 72, m16);
+            }
+
+        }; // struct GYRO_SPECTRUM_T
+
+        template <typename T> constexpr field_t GYRO_SPECTRUM_T<T>::FIELDS[];
+
+        typedef GYRO_SPECTRUM_T<> GYRO_SPECTRUM;
+
+        template <typename T=void>
+        struct PID_GAINS_T {
+
+            static const uint8_t ID = 126;
+            static const uint8_t SIZE = 40;
+            static const uint8_t FIELD_COUNT = 10;
+
+            static constexpr field_t FIELDS[FIELD_COUNT] = {
+                { 0, FIELD_FLOAT},
+                { 4, FIELD_FLOAT},
+                { 8, FIELD_FLOAT},
+                {12, FIELD_FLOAT},
+                {16, FIELD_FLOAT},
+                {20, FIELD_FLOAT},
+                {24, FIELD_FLOAT},
+                {28, FIELD_FLOAT},
+                {32, FIELD_FLOAT},
+                {36, FIELD_FLOAT}
+            };
+
+            float levelP;
+            float cyclicP;
+            float cyclicI;
+            float cyclicD;
+            float yawP;
+            float yawI;
+            float altP;
+            float velP;
+            float velI;
+            float velD;
+
+            void encode(uint8_t * payload) const
+            {
+                put(payload + 0, levelP);
+                put(payload + 4, cyclicP);
+                put(payload + 8, cyclicI);
+                put(payload + 12, cyclicD);
+                put(payload + 16, yawP);
+                put(payload + 20, yawI);
+                put(payload + 24, altP);
+                put(payload + 28, velP);
+                put(payload + 32, velI);
+                put(payload + 36, velD);
+            }
+
+            void decode(const uint8_t * payload)
+            {
+                get(payload + 0, levelP);
+                get(payload + 4, cyclicP);
+                get(payload + 8, cyclicI);
+                get(payload + 12, cyclicD);
+                get(payload + 16, yawP);
+                get(payload + 20, yawI);
+                get(payload + 24, altP);
+                get(payload + 28, velP);
+                get(payload + 32, velI);
+                get(payload + 36, velD);
+            }
+
+        }; // struct PID_GAINS_T
+
+        template <typename T> constexpr field_t PID_GAINS_T<T>::FIELDS[];
+
+        typedef PID_GAINS_T<> PID_GAINS;
+
+        template <typename T=void>
+        struct GYRO_LATENCY_T {
+
+            static const uint8_t ID = 127;
+            static const uint8_t SIZE = 24;
+            static const uint8_t FIELD_COUNT = 6;
+
+            static constexpr field_t FIELDS[FIELD_COUNT] = {
+                { 0, FIELD_INT},
+                { 4, FIELD_INT},
+                { 8, FIELD_INT},
+                {12, FIELD_INT},
+                {16, FIELD_INT},
+                {20, FIELD_INT}
+            };
+
+            int32_t count;
+            int32_t mean;
+            int32_t p50;
+            int32_t p90;
+            int32_t p99;
+            int32_t max;
+
+            void encode(uint8_t * payload) const
+            {
+                put(payload + 0, count);
+                put(payload + 4, mean);
+                put(payload + 8, p50);
+                put(payload + 12, p90);
+                put(payload + 16, p99);
+                put(payload + 20, max);
+            }
+
+            void decode(const uint8_t * payload)
+            {
+                get(payload + 0, count);
+                get(payload + 4, mean);
+                get(payload + 8, p50);
+                get(payload + 12, p90);
+                get(payload + 16, p99);
+                get(payload + 20, max);
+            }
+
+        }; // struct GYRO_LATENCY_T
+
+        template <typename T> constexpr field_t GYRO_LATENCY_T<T>::FIELDS[];
+
+        typedef GYRO_LATENCY_T<> GYRO_LATENCY;
+
+        template <typename T=void>
+        struct CPU_LOAD_T {
+
+            static const uint8_t ID = 128;
+            static const uint8_t SIZE = 4;
+            static const uint8_t FIELD_COUNT = 1;
+
+            static constexpr field_t FIELDS[FIELD_COUNT] = {
+                { 0, FIELD_FLOAT}
+            };
+
+            float percent;
+
+            void encode(uint8_t * payload) const
+            {
+                put(payload + 0, percent);
+            }
+
+            void decode(const uint8_t * payload)
+            {
+                get(payload + 0, percent);
+            }
+
+        }; // struct CPU_LOAD_T
+
+        template <typename T> constexpr field_t CPU_LOAD_T<T>::FIELDS[];
+
+        typedef CPU_LOAD_T<> CPU_LOAD;
+
+        template <typename T=void>
+        struct RC_PACKED_T {
+
+            static const uint8_t ID = 129;
+            static const uint8_t SIZE = 33;
+            static const uint8_t FIELD_COUNT = 17;
+
+            static constexpr field_t FIELDS[FIELD_COUNT] = {
+                { 0, FIELD_BYTE},
+                { 1, FIELD_SHORT},
+                { 3, FIELD_SHORT},
+                { 5, FIELD_SHORT},
+                { 7, FIELD_SHORT},
+                { 9, FIELD_SHORT},
+                {11, FIELD_SHORT},
+                {13, FIELD_SHORT},
+                {15, FIELD_SHORT},
+                {17, FIELD_SHORT},
+                {19, FIELD_SHORT},
+                {21, FIELD_SHORT},
+                {23, FIELD_SHORT},
+                {25, FIELD_SHORT},
+                {27, FIELD_SHORT},
+                {29, FIELD_SHORT},
+                {31, FIELD_SHORT}
+            };
+
+            uint8_t count;
+            int16_t c1;
+            int16_t c2;
+            int16_t c3;
+            int16_t c4;
+            int16_t c5;
+            int16_t c6;
+            int16_t c7;
+            int16_t c8;
+            int16_t c9;
+            int16_t c10;
+            int16_t c11;
+            int16_t c12;
+            int16_t c13;
+            int16_t c14;
+            int16_t c15;
+            int16_t c16;
+
+            void encode(uint8_t * payload) const
+            {
+                put(payload + 0, count);
+                put(payload + 1, c1);
+                put(payload + 3, c2);
+                put(payload + 5, c3);
+                put(payload + 7, c4);
+                put(payload + 9, c5);
+                put(payload + 11, c6);
+                put(payload + 13, c7);
+                put(payload + 15, c8);
+                put(payload + 17, c9);
+                put(payload + 19, c10);
+                put(payload + 21, c11);
+                put(payload + 23, c12);
+                put(payload + 25, c13);
+                put(payload + 27, c14);
+                put(payload + 29, c15);
+                put(payload + 31, c16);
+            }
+
+            void decode(const uint8_t * payload)
+            {
+                get(payload + 0, count);
+                get(payload + 1, c1);
+                get(payload + 3, c2);
+                get(payload + 5, c3);
+                get(payload + 7, c4);
+                get(payload + 9, c5);
+                get(payload + 11, c6);
+                get(payload + 13, c7);
+                get(payload + 15, c8);
+                get(payload + 17, c9);
+                get(payload + 19, c10);
+                get(payload + 21, c11);
+                get(payload + 23, c12);
+                get(payload + 25, c13);
+                get(payload + 27, c14);
+                get(payload + 29, c15);
+                get(payload + 31, c16);
+            }
+
+        }; // struct RC_PACKED_T
+
+        template <typename T> constexpr field_t RC_PACKED_T<T>::FIELDS[];
+
+        typedef RC_PACKED_T<> RC_PACKED;
+
+        template <typename T=void>
+        struct ATTITUDE_COMPACT_T {
+
+            static const uint8_t ID = 130;
+            static const uint8_t SIZE = 6;
+            static const uint8_t FIELD_COUNT = 3;
+
+            static constexpr field_t FIELDS[FIELD_COUNT] = {
+                { 0, FIELD_SHORT},
+                { 2, FIELD_SHORT},
+                { 4, FIELD_SHORT}
+            };
+
+            int16_t roll;
+            int16_t pitch;
+            int16_t yaw;
+
+            void encode(uint8_t * payload) const
+            {
+                put(payload + 0, roll);
+                put(payload + 2, pitch);
+                put(payload + 4, yaw);
+            }
+
+            void decode(const uint8_t * payload)
+            {
+                get(payload + 0, roll);
+                get(payload + 2, pitch);
+                get(payload + 4, yaw);
+            }
+
+        }; // struct ATTITUDE_COMPACT_T
+
+        template <typename T> constexpr field_t ATTITUDE_COMPACT_T<T>::FIELDS[];
+
+        typedef ATTITUDE_COMPACT_T<> ATTITUDE_COMPACT;
+
+        template <typename T=void>
+        struct ATTITUDE_DELTA_T {
+
+            static const uint8_t ID = 131;
+            static const uint8_t SIZE = 28;
+            static const uint8_t FIELD_COUNT = 25;
+
+            static constexpr field_t FIELDS[FIELD_COUNT] = {
+                { 0, FIELD_BYTE},
+                { 1, FIELD_SHORT},
+                { 3, FIELD_SHORT},
+                { 5, FIELD_SHORT},
+                { 7, FIELD_BYTE},
+                { 8, FIELD_BYTE},
+                { 9, FIELD_BYTE},
+                {10, FIELD_BYTE},
+                {11, FIELD_BYTE},
+                {12, FIELD_BYTE},
+                {13, FIELD_BYTE},
+                {14, FIELD_BYTE},
+                {15, FIELD_BYTE},
+                {16, FIELD_BYTE},
+                {17, FIELD_BYTE},
+                {18, FIELD_BYTE},
+                {19, FIELD_BYTE},
+                {20, FIELD_BYTE},
+                {21, FIELD_BYTE},
+                {22, FIELD_BYTE},
+                {23, FIELD_BYTE},
+                {24, FIELD_BYTE},
+                {25, FIELD_BYTE},
+                {26, FIELD_BYTE},
+                {27, FIELD_BYTE}
+            };
+
+            uint8_t shift;
+            int16_t roll;
+            int16_t pitch;
+            int16_t yaw;
+            uint8_t r1;
+            uint8_t p1;
+            uint8_t y1;
+            uint8_t r2;
+            uint8_t p2;
+            uint8_t y2;
+            uint8_t r3;
+            uint8_t p3;
+            uint8_t y3;
+            uint8_t r4;
+            uint8_t p4;
+            uint8_t y4;
+            uint8_t r5;
+            uint8_t p5;
+            uint8_t y5;
+            uint8_t r6;
+            uint8_t p6;
+            uint8_t y6;
+            uint8_t r7;
+            uint8_t p7;
+            uint8_t y7;
+
+            void encode(uint8_t * payload) const
+            {
+                put(payload + 0, shift);
+                put(payload + 1, roll);
+                put(payload + 3, pitch);
+                put(payload + 5, yaw);
+                put(payload + 7, r1);
+                put(payload + 8, p1);
+                put(payload + 9, y1);
+                put(payload + 10, r2);
+                put(payload + 11, p2);
+                put(payload + 12, y2);
+                put(payload + 13, r3);
+                put(payload + 14, p3);
+                put(payload + 15, y3);
+                put(payload + 16, r4);
+                put(payload + 17, p4);
+                put(payload + 18, y4);
+                put(payload + 19, r5);
+                put(payload + 20, p5);
+                put(payload + 21, y5);
+                put(payload + 22, r6);
+                put(payload + 23, p6);
+                put(payload + 24, y6);
+                put(payload + 25, r7);
+                put(payload + 26, p7);
+                put(payload + 27, y7);
+            }
+
+            void decode(const uint8_t * payload)
+            {
+                get(payload + 0, shift);
+                get(payload + 1, roll);
+                get(payload + 3, pitch);
+                get(payload + 5, yaw);
+                get(payload + 7, r1);
+                get(payload + 8, p1);
+                get(payload + 9, y1);
+                get(payload + 10, r2);
+                get(payload + 11, p2);
+                get(payload + 12, y2);
+                get(payload + 13, r3);
+                get(payload + 14, p3);
+                get(payload + 15, y3);
+                get(payload + 16, r4);
+                get(payload + 17, p4);
+                get(payload + 18, y4);
+                get(payload + 19, r5);
+                get(payload + 20, p5);
+                get(payload + 21, y5);
+                get(payload + 22, r6);
+                get(payload + 23, p6);
+                get(payload + 24, y6);
+                get(payload + 25, r7);
+                get(payload + 26, p7);
+                get(payload + 27, y7);
+            }
+
+        }; // struct ATTITUDE_DELTA_T
+
+        template <typename T> constexpr field_t ATTITUDE_DELTA_T<T>::FIELDS[];
+
+        typedef ATTITUDE_DELTA_T<> ATTITUDE_DELTA;
+
+        template <typename T=void>
+        struct BOOT_TIMES_T {
+
+            static const uint8_t ID = 132;
+            static const uint8_t SIZE = 20;
+            static const uint8_t FIELD_COUNT = 5;
+
+            static constexpr field_t FIELDS[FIELD_COUNT] = {
+                { 0, FIELD_INT},
+                { 4, FIELD_INT},
+                { 8, FIELD_INT},
+                {12, FIELD_INT},
+                {16, FIELD_INT}
+            };
+
+            int32_t init;
+            int32_t sensors;
+            int32_t attitude;
+            int32_t receiver;
+            int32_t ready;
+
+            void encode(uint8_t * payload) const
+            {
+                put(payload + 0, init);
+                put(payload + 4, sensors);
+                put(payload + 8, attitude);
+                put(payload + 12, receiver);
+                put(payload + 16, ready);
+            }
+
+            void decode(const uint8_t * payload)
+            {
+                get(payload + 0, init);
+                get(payload + 4, sensors);
+                get(payload + 8, attitude);
+                get(payload + 12, receiver);
+                get(payload + 16, ready);
+            }
+
+        }; // struct BOOT_TIMES_T
+
+        template <typename T> constexpr field_t BOOT_TIMES_T<T>::FIELDS[];
+
+        typedef BOOT_TIMES_T<> BOOT_TIMES;
+
+        template <typename T=void>
+        struct ENVELOPE_T {
+
+            static const uint8_t ID = 133;
+            static const uint8_t SIZE = 76;
+            static const uint8_t FIELD_COUNT = 20;
+
+            static constexpr field_t FIELDS[FIELD_COUNT] = {
+                { 0, FIELD_SHORT},
+                { 2, FIELD_SHORT},
+                { 4, FIELD_FLOAT},
+                { 8, FIELD_FLOAT},
+                {12, FIELD_FLOAT},
+                {16, FIELD_FLOAT},
+                {20, FIELD_FLOAT},
+                {24, FIELD_FLOAT},
+                {28, FIELD_FLOAT},
+                {32, FIELD_FLOAT},
+                {36, FIELD_FLOAT},
+                {40, FIELD_FLOAT},
+                {44, FIELD_FLOAT},
+                {48, FIELD_FLOAT},
+                {52, FIELD_FLOAT},
+                {56, FIELD_FLOAT},
+                {60, FIELD_FLOAT},
+                {64, FIELD_FLOAT},
+                {68, FIELD_FLOAT},
+                {72, FIELD_FLOAT}
+            };
+
+            int16_t gyroCount;
+            int16_t angleCount;
+            float gyroRollMean;
+            float gyroRollMin;
+            float gyroRollMax;
+            float gyroPitchMean;
+            float gyroPitchMin;
+            float gyroPitchMax;
+            float gyroYawMean;
+            float gyroYawMin;
+            float gyroYawMax;
+            float angleRollMean;
+            float angleRollMin;
+            float angleRollMax;
+            float anglePitchMean;
+            float anglePitchMin;
+            float anglePitchMax;
+            float angleYawMean;
+            float angleYawMin;
+            float angleYawMax;
+
+            void encode(uint8_t * payload) const
+            {
+                put(payload + 0, gyroCount);
+                put(payload + 2, angleCount);
+                put(payload + 4, gyroRollMean);
+                put(payload + 8, gyroRollMin);
+                put(payload + 12, gyroRollMax);
+                put(payload + 16, gyroPitchMean);
+                put(payload + 20, gyroPitchMin);
+                put(payload + 24, gyroPitchMax);
+                put(payload + 28, gyroYawMean);
+                put(payload + 32, gyroYawMin);
+                put(payload + 36, gyroYawMax);
+                put(payload + 40, angleRollMean);
+                put(payload + 44, angleRollMin);
+                put(payload + 48, angleRollMax);
+                put(payload + 52, anglePitchMean);
+                put(payload + 56, anglePitchMin);
+                put(payload + 60, anglePitchMax);
+                put(payload + 64, angleYawMean);
+                put(payload + 68, angleYawMin);
+                put(payload + 72, angleYawMax);
+            }
+
+            void decode(const uint8_t * payload)
+            {
+                get(payload + 0, gyroCount);
+                get(payload + 2, angleCount);
+                get(payload + 4, gyroRollMean);
+                get(payload + 8, gyroRollMin);
+                get(payload + 12, gyroRollMax);
+                get(payload + 16, gyroPitchMean);
+                get(payload + 20, gyroPitchMin);
+                get(payload + 24, gyroPitchMax);
+                get(payload + 28, gyroYawMean);
+                get(payload + 32, gyroYawMin);
+                get(payload + 36, gyroYawMax);
+                get(payload + 40, angleRollMean);
+                get(payload + 44, angleRollMin);
+                get(payload + 48, angleRollMax);
+                get(payload + 52, anglePitchMean);
+                get(payload + 56, anglePitchMin);
+                get(payload + 60, anglePitchMax);
+                get(payload + 64, angleYawMean);
+                get(payload + 68, angleYawMin);
+                get(payload + 72, angleYawMax);
+            }
+
+        }; // struct ENVELOPE_T
+
+        template <typename T> constexpr field_t ENVELOPE_T<T>::FIELDS[];
+
+        typedef ENVELOPE_T<> ENVELOPE;
+
+        template <typename T=void>
+        struct LOAD_GOVERNOR_T {
+
+            static const uint8_t ID = 134;
+            static const uint8_t SIZE = 9;
+            static const uint8_t FIELD_COUNT = 3;
+
+            static constexpr field_t FIELDS[FIELD_COUNT] = {
+                { 0, FIELD_BYTE},
+                { 1, FIELD_FLOAT},
+                { 5, FIELD_INT}
+            };
+
+            uint8_t level;
+            float load;
+            int32_t changes;
+
+            void encode(uint8_t * payload) const
+            {
+                put(payload + 0, level);
+                put(payload + 1, load);
+                put(payload + 5, changes);
+            }
+
+            void decode(const uint8_t * payload)
+            {
+                get(payload + 0, level);
+                get(payload + 1, load);
+                get(payload + 5, changes);
+            }
+
+        }; // struct LOAD_GOVERNOR_T
+
+        template <typename T> constexpr field_t LOAD_GOVERNOR_T<T>::FIELDS[];
+
+        typedef LOAD_GOVERNOR_T<> LOAD_GOVERNOR;
+
+        template <typename T=void>
+        struct SET_MOTOR_NORMAL_T {
+
+            static const uint8_t ID = 215;
+            static const uint8_t SIZE = 16;
+            static const uint8_t FIELD_COUNT = 4;
+
+            static constexpr field_t FIELDS[FIELD_COUNT] = {
+                { 0, FIELD_FLOAT},
+                { 4, FIELD_FLOAT},
+                { 8, FIELD_FLOAT},
+                {12, FIELD_FLOAT}
+            };
+
+            float m1;
+            float m2;
+            float m3;
+            float m4;
+
+            void encode(uint8_t * payload) const
+            {
+                put(payload + 0, m1);
+                put(payload + 4, m2);
+                put(payload + 8, m3);
+                put(payload + 12, m4);
+            }
+
+            void decode(const uint8_t * payload)
+            {
+                get(payload + 0, m1);
+                get(payload + 4, m2);
+                get(payload + 8, m3);
+                get(payload + 12, m4);
+            }
+
+        }; // struct SET_MOTOR_NORMAL_T
+
+        template <typename T> constexpr field_t SET_MOTOR_NORMAL_T<T>::FIELDS[];
+
+        typedef SET_MOTOR_NORMAL_T<> SET_MOTOR_NORMAL;
+
+        template <typename T=void>
+        struct SET_LOOP_HISTOGRAM_T {
+
+            static const uint8_t ID = 216;
+            static const uint8_t SIZE = 1;
+            static const uint8_t FIELD_COUNT = 1;
+
+            static constexpr field_t FIELDS[FIELD_COUNT] = {
+                { 0, FIELD_BYTE}
+            };
+
+            uint8_t stage;
+
+            void encode(uint8_t * payload) const
+            {
+                put(payload + 0, stage);
+            }
+
+            void decode(const uint8_t * payload)
+            {
+                get(payload + 0, stage);
+            }
+
+        }; // struct SET_LOOP_HISTOGRAM_T
+
+        template <typename T> constexpr field_t SET_LOOP_HISTOGRAM_T<T>::FIELDS[];
+
+        typedef SET_LOOP_HISTOGRAM_T<> SET_LOOP_HISTOGRAM;
+
+        template <typename T=void>
+        struct SET_SUBSCRIPTION_T {
+
+            static const uint8_t ID = 217;
+            static const uint8_t SIZE = 2;
+            static const uint8_t FIELD_COUNT = 2;
+
+            static constexpr field_t FIELDS[FIELD_COUNT] = {
+                { 0, FIELD_BYTE},
+                { 1, FIELD_BYTE}
+            };
+
+            uint8_t messageId;
+            uint8_t divider;
+
+            void encode(uint8_t * payload) const
+            {
+                put(payload + 0, messageId);
+                put(payload + 1, divider);
+            }
+
+            void decode(const uint8_t * payload)
+            {
+                get(payload + 0, messageId);
+                get(payload + 1, divider);
+            }
+
+        }; // struct SET_SUBSCRIPTION_T
+
+        template <typename T> constexpr field_t SET_SUBSCRIPTION_T<T>::FIELDS[];
+
+        typedef SET_SUBSCRIPTION_T<> SET_SUBSCRIPTION;
+
+        template <typename T=void>
+        struct SET_PID_GAINS_T {
+
+            static const uint8_t ID = 218;
+            static const uint8_t SIZE = 40;
+            static const uint8_t FIELD_COUNT = 10;
+
+            static constexpr field_t FIELDS[FIELD_COUNT] = {
+                { 0, FIELD_FLOAT},
+                { 4, FIELD_FLOAT},
+                { 8, FIELD_FLOAT},
+                {12, FIELD_FLOAT},
+                {16, FIELD_FLOAT},
+                {20, FIELD_FLOAT},
+                {24, FIELD_FLOAT},
+                {28, FIELD_FLOAT},
+                {32, FIELD_FLOAT},
+                {36, FIELD_FLOAT}
+            };
+
+            float levelP;
+            float cyclicP;
+            float cyclicI;
+            float cyclicD;
+            float yawP;
+            float yawI;
+            float altP;
+            float velP;
+            float velI;
+            float velD;
+
+            void encode(uint8_t * payload) const
+            {
+                put(payload + 0, levelP);
+                put(payload + 4, cyclicP);
+                put(payload + 8, cyclicI);
+                put(payload + 12, cyclicD);
+                put(payload + 16, yawP);
+                put(payload + 20, yawI);
+                put(payload + 24, altP);
+                put(payload + 28, velP);
+                put(payload + 32, velI);
+                put(payload + 36, velD);
+            }
+
+            void decode(const uint8_t * payload)
+            {
+                get(payload + 0, levelP);
+                get(payload + 4, cyclicP);
+                get(payload + 8, cyclicI);
+                get(payload + 12, cyclicD);
+                get(payload + 16, yawP);
+                get(payload + 20, yawI);
+                get(payload + 24, altP);
+                get(payload + 28, velP);
+                get(payload + 32, velI);
+                get(payload + 36, velD);
+            }
+
+        }; // struct SET_PID_GAINS_T
+
+        template <typename T> constexpr field_t SET_PID_GAINS_T<T>::FIELDS[];
+
+        typedef SET_PID_GAINS_T<> SET_PID_GAINS;
+
+        constexpr descriptor_t DESCRIPTORS[] = {
+            {RC_NORMAL::ID, RC_NORMAL::SIZE, RC_NORMAL::FIELD_COUNT, RC_NORMAL::FIELDS},
+            {ATTITUDE_RADIANS::ID, ATTITUDE_RADIANS::SIZE, ATTITUDE_RADIANS::FIELD_COUNT, ATTITUDE_RADIANS::FIELDS},
+            {LOOP_STATS::ID, LOOP_STATS::SIZE, LOOP_STATS::FIELD_COUNT, LOOP_STATS::FIELDS},
+            {LOOP_HISTOGRAM::ID, LOOP_HISTOGRAM::SIZE, LOOP_HISTOGRAM::FIELD_COUNT, LOOP_HISTOGRAM::FIELDS},
+            {GYRO_SPECTRUM::ID, GYRO_SPECTRUM::SIZE, GYRO_SPECTRUM::FIELD_COUNT, GYRO_SPECTRUM::FIELDS},
+            {PID_GAINS::ID, PID_GAINS::SIZE, PID_GAINS::FIELD_COUNT, PID_GAINS::FIELDS},
+            {GYRO_LATENCY::ID, GYRO_LATENCY::SIZE, GYRO_LATENCY::FIELD_COUNT, GYRO_LATENCY::FIELDS},
+            {CPU_LOAD::ID, CPU_LOAD::SIZE, CPU_LOAD::FIELD_COUNT, CPU_LOAD::FIELDS},
+            {RC_PACKED::ID, RC_PACKED::SIZE, RC_PACKED::FIELD_COUNT, RC_PACKED::FIELDS},
+            {ATTITUDE_COMPACT::ID, ATTITUDE_COMPACT::SIZE, ATTITUDE_COMPACT::FIELD_COUNT, ATTITUDE_COMPACT::FIELDS},
+            {ATTITUDE_DELTA::ID, ATTITUDE_DELTA::SIZE, ATTITUDE_DELTA::FIELD_COUNT, ATTITUDE_DELTA::FIELDS},
+            {BOOT_TIMES::ID, BOOT_TIMES::SIZE, BOOT_TIMES::FIELD_COUNT, BOOT_TIMES::FIELDS},
+            {ENVELOPE::ID, ENVELOPE::SIZE, ENVELOPE::FIELD_COUNT, ENVELOPE::FIELDS},
+            {LOAD_GOVERNOR::ID, LOAD_GOVERNOR::SIZE, LOAD_GOVERNOR::FIELD_COUNT, LOAD_GOVERNOR::FIELDS},
+            {SET_MOTOR_NORMAL::ID, SET_MOTOR_NORMAL::SIZE, SET_MOTOR_NORMAL::FIELD_COUNT, SET_MOTOR_NORMAL::FIELDS},
+            {SET_LOOP_HISTOGRAM::ID, SET_LOOP_HISTOGRAM::SIZE, SET_LOOP_HISTOGRAM::FIELD_COUNT, SET_LOOP_HISTOGRAM::FIELDS},
+            {SET_SUBSCRIPTION::ID, SET_SUBSCRIPTION::SIZE, SET_SUBSCRIPTION::FIELD_COUNT, SET_SUBSCRIPTION::FIELDS},
+            {SET_PID_GAINS::ID, SET_PID_GAINS::SIZE, SET_PID_GAINS::FIELD_COUNT, SET_PID_GAINS::FIELDS}
+        };
+
+        static const uint8_t MESSAGE_COUNT = sizeof(DESCRIPTORS) / sizeof(descriptor_t);
+
+        // Descriptor for a message ID, or null if there's no such message
+        inline const descriptor_t * findDescriptor(uint8_t id)
+        {
+            for (uint8_t k=0; k<MESSAGE_COUNT; ++k) {
+                if (DESCRIPTORS[k].id == id) {
+                    return &DESCRIPTORS[k];
+                }
+            }
+            return 0;
+        }
+
+    } // namespace mspmsg
+
+} // namespace hf
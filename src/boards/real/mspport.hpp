@@ -0,0 +1,293 @@
+/*
+   mspport.hpp : One MSP endpoint on one serial stream, with its own byte budget
+
+   Each port has its own MSP parser and subscriptions and its own receive and transmit rings, so a board can
+   talk to a bench GCS over USB and to a telemetry radio at the same time.  Each pass of the serial-comms task
+   gives every port a share of bytes to move, counting what it parses and what it hands its driver: its
+   bytes-per-second budget times the time since its last pass, saved up for at most BURST_MICROS.  A chatty port
+   then just falls behind on its own requests and subscriptions (which stay due in its output buffer), without
+   holding up the other ports or stretching the task.  A budget of zero leaves the port limited only by
+   SERIAL_RX_BUDGET and its driver.
+
+   Subclasses supply the driver, through readBytes() and writeBytes(), which must not block; SerialMSPPort does
+   this for an Arduino Stream.  A driver that receives in an interrupt or DMA callback can instead call
+   useRxPush() once and then feed the RX ring with rxPush(), which stops service() reading it, so that the ring
+   keeps a single producer.  RealBoard has a port of its own on its serial hooks, and takes more through
+   addMSPPort().
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include "msp.hpp"
+#include "ringbuffer.hpp"
+
+namespace hf {
+
+    class MSPPort {
+
+        private:
+
+            // Most bytes handed to MSP per pass, so a burst of GCS traffic can't stretch the loop
+            static const uint16_t SERIAL_RX_BUDGET = 64;
+
+            static const uint16_t RING_SIZE = 256;
+
+            // Longest the budget is saved up for while a port is quiet
+            static const uint32_t BURST_MICROS = 50000;
+
+            MSP _msp;
+
+            RingBuffer<uint8_t, RING_SIZE> _rxRing;
+            RingBuffer<uint8_t, RING_SIZE> _txRing;
+
+            uint32_t _bytesPerSecond;
+            uint64_t _microbytes;     // budget saved up, in millionths of a byte
+            uint32_t _lastMicros;
+            bool     _started;
+            bool     _rxPushed;       // the RX ring is fed by rxPush() rather than readBytes()
+
+            // What the parser is bound to, so it is bound on the first pass and again only when either changes
+            ReplyCache       * _replies;
+            const MSPContext * _context;
+
+            // Bytes the port may move on this pass
+            uint16_t allowance(uint32_t usec)
+            {
+                if (!_bytesPerSecond) {
+                    return UINT16_MAX;
+                }
+
+                uint32_t elapsed = _started ? usec - _lastMicros : BURST_MICROS;
+                _lastMicros = usec;
+                _started = true;
+
+                uint64_t most = (uint64_t)_bytesPerSecond * BURST_MICROS;
+
+                _microbytes += (uint64_t)_bytesPerSecond * (elapsed < BURST_MICROS ? elapsed : BURST_MICROS);
+                _microbytes = _microbytes < most ? _microbytes : most;
+
+                uint64_t bytes = _microbytes / 1000000;
+                return bytes < UINT16_MAX ? (uint16_t)bytes : UINT16_MAX;
+            }
+
+            void spend(uint16_t bytes)
+            {
+                if (_bytesPerSecond) {
+                    _microbytes -= (uint64_t)bytes * 1000000;
+                }
+            }
+
+            // Pulls whatever the driver already has, in bulk, straight into the RX ring, unless an interrupt is
+            // feeding it
+            void fillRxRing(void)
+            {
+                if (_rxPushed) {
+                    return;
+                }
+
+                uint8_t * ptr;
+                uint16_t free = _rxRing.reserveContiguous(&ptr);
+                if (free > 0) {
+                    uint16_t n = readBytes(ptr, free);
+                    if (n > 0) {
+                        _rxRing.commit(n);
+                    }
+                }
+            }
+
+            // Hands at most budget bytes of the TX ring to the driver in contiguous chunks, stopping when the
+            // driver is full; returns the number handed over
+            uint16_t drainTxRing(uint16_t budget)
+            {
+                uint16_t total = 0;
+
+                for (uint8_t pass=0; pass<2 && budget > 0; ++pass) { // at most two chunks when the data wraps
+                    const uint8_t * ptr;
+                    uint16_t count = _txRing.peekContiguous(&ptr);
+                    count = count < budget ? count : budget;
+                    if (count == 0) {
+                        break;
+                    }
+                    uint16_t sent = writeBytes(ptr, count);
+                    _txRing.consume(sent);
+                    total += sent;
+                    budget -= sent;
+                    if (sent < count) {
+                        break;
+                    }
+                }
+
+                return total;
+            }
+
+        protected:
+
+            // Copies up to maxlen already-received bytes into buf, returning the number copied
+            virtual uint16_t readBytes(uint8_t * buf, uint16_t maxlen) = 0;
+
+            // Accepts up to len bytes for transmission, returning the number accepted
+            virtual uint16_t writeBytes(const uint8_t * buf, uint16_t len) = 0;
+
+        public:
+
+            MSPPort(uint32_t bytesPerSecond=0) : _bytesPerSecond(bytesPerSecond), _rxPushed(false) { }
+
+            virtual ~MSPPort(void) { }
+
+            void init(void)
+            {
+                _msp.init();
+                _rxRing.clear();
+                _txRing.clear();
+                _microbytes = 0;
+                _lastMicros = 0;
+                _started = false;
+                _replies = 0;
+                _context = 0;
+            }
+
+            // Zero for no limit
+            void setBytesPerSecond(uint32_t bytesPerSecond)
+            {
+                _bytesPerSecond = bytesPerSecond;
+            }
+
+            // Hands the RX ring over to rxPush(), for good: service() no longer calls readBytes().  Call before the
+            // interrupt that calls rxPush() is enabled.
+            void useRxPush(void)
+            {
+                _rxPushed = true;
+            }
+
+            // For drivers that receive through a UART interrupt or DMA-complete callback instead of readBytes(),
+            // after useRxPush().  Safe to call from that ISR, as the ring's only producer: it is lock-free.  Returns
+            // the number of bytes that fit.
+            uint16_t rxPush(const uint8_t * buf, uint16_t len)
+            {
+                return _rxRing.write(buf, len);
+            }
+
+            // True when every byte of every reply queued so far has been handed to the driver
+            bool txIdle(void) const
+            {
+                return _txRing.available() == 0;
+            }
+
+            // One pass of the serial-comms task at time usec: parses requests, streams subscriptions, and sends
+            // replies, within the port's budget.  Every port on a board shares its ReplyCache.
+            void service(uint32_t usec, ReplyCache * replies, const MSPContext * context)
+            {
+                uint16_t start = allowance(usec);
+
+                // Replies already queued go out before any more requests are taken, so a port out of budget can't
+                // spend it all on parsing
+                uint16_t budget = start - drainTxRing(start);
+
+                fillRxRing();
+
+                if (replies != _replies || context != _context) {
+                    _msp.bind(replies, context);
+                    _replies = replies;
+                    _context = context;
+                }
+
+                // Parse a bounded number of bytes, straight from the ring; the rest wait for the next pass
+                uint16_t rxBudget = budget < SERIAL_RX_BUDGET ? budget : SERIAL_RX_BUDGET;
+                for (uint8_t pass=0; pass<2 && rxBudget > 0; ++pass) { // at most two chunks when the data wraps
+                    const uint8_t * ptr;
+                    uint16_t count = _rxRing.peekContiguous(&ptr);
+                    if (count == 0) {
+                        break;
+                    }
+                    count = count < rxBudget ? count : rxBudget;
+                    _msp.parse(ptr, count);
+                    _rxRing.consume(count);
+                    rxBudget -= count;
+                    budget -= count;
+                }
+
+                // Push any subscribed telemetry that is due
+                _msp.stream();
+
+                // Queue replies; anything that doesn't fit stays in the MSP output buffer until next time
+                while (_msp.availableBytes() > 0 && _txRing.space() > 0) {
+                    _txRing.push(_msp.readByte());
+                }
+
+                budget -= drainTxRing(budget);
+
+                spend(start - budget);
+            }
+
+    }; // class MSPPort
+
+    // A port on an Arduino Stream (e.g. HardwareSerial or USB serial), begun by the sketch
+    template <class StreamT>
+    class SerialMSPPort final : public MSPPort {
+
+        private:
+
+            StreamT & _stream;
+
+        protected:
+
+            uint16_t readBytes(uint8_t * buf, uint16_t maxlen)
+            {
+                uint16_t n = _stream.available();
+                return _stream.readBytes(buf, n < maxlen ? n : maxlen);
+            }
+
+            uint16_t writeBytes(const uint8_t * buf, uint16_t len)
+            {
+                uint16_t n = _stream.availableForWrite();
+                return _stream.write(buf, n < len ? n : len);
+            }
+
+        public:
+
+            SerialMSPPort(StreamT & stream, uint32_t bytesPerSecond=0) : MSPPort(bytesPerSecond), _stream(stream) { }
+
+    }; // class SerialMSPPort
+
+    // Takes the board's own port's place on boards built without AllFeatures::SERIAL
+    class NoMSPPort {
+
+        public:
+
+            template <class BoardT>
+            NoMSPPort(BoardT * board) { (void)board; }
+
+            void init(void) { }
+
+            void setBytesPerSecond(uint32_t bytesPerSecond) { (void)bytesPerSecond; }
+
+            void useRxPush(void) { }
+
+            uint16_t rxPush(const uint8_t * buf, uint16_t len) { (void)buf; (void)len; return 0; }
+
+            bool txIdle(void) const { return true; }
+
+            void service(uint32_t usec, ReplyCache * replies, const MSPContext * context)
+            {
+                (void)usec; (void)replies; (void)context;
+            }
+
+    }; // class NoMSPPort
+
+} // namespace hf
@@ -19,19 +19,60 @@
 #pragma once
 
 #include "board.hpp"
-#include "msp.hpp"
+#include "mspport.hpp"
 #include "datatypes.hpp"
+#include "features.hpp"
 
 namespace hf {
 
-    class RealBoard : public Board {
+    // Features::SERIAL chooses whether MSP and its serial buffers are built in (see features.hpp), and with them
+    // any ports added through addMSPPort() (see mspport.hpp)
+    template <class Features=AllFeatures>
+    class RealBoardT : public Board {
 
         private:
 
-            const uint32_t ledFlashMilli = 1000;
-            const uint32_t ledFlashCount = 20;
+            // LED half-period while booting
+            const uint32_t ledFlashMicros = 50000;
 
-            MSP msp;
+            // Serial ports besides the board's own, down to a single unused slot when there is no MSP
+            static const uint8_t MAX_MSP_PORTS = Features::SERIAL ? 3 : 1;
+
+            // The board's own MSP port, on the serial hooks below
+            class BoardPort final : public MSPPort {
+
+                private:
+
+                    RealBoardT * _board;
+
+                protected:
+
+                    uint16_t readBytes(uint8_t * buf, uint16_t maxlen)
+                    {
+                        return _board->serialReadBytes(buf, maxlen);
+                    }
+
+                    uint16_t writeBytes(const uint8_t * buf, uint16_t len)
+                    {
+                        return _board->serialWriteBytes(buf, len);
+                    }
+
+                public:
+
+                    BoardPort(RealBoardT * board) : _board(board) { }
+
+            }; // class BoardPort
+
+            typename Select<Features::SERIAL, BoardPort, NoMSPPort>::type _port;
+
+            MSPPort * _ports[MAX_MSP_PORTS];
+            uint8_t   _portCount;
+
+            // The snapshot all of the ports reply from, and the replies encoded from it
+            typename Select<Features::SERIAL, ReplyCache, NoReplyCache>::type _replies;
+
+            static ReplyCache * pointer(ReplyCache & r) { return &r; }
+            static ReplyCache * pointer(NoReplyCache & r) { (void)r; return 0; }
 
         protected:
 
@@ -41,48 +82,120 @@ namespace hf {
             virtual uint8_t  serialReadByte(void)  { return 0; }
             virtual void     serialWriteByte(uint8_t c) { (void)c; }
 
-            void init(void)
+            // Bulk hooks: must not block.  Boards whose driver has a buffered or DMA-capable UART should override
+            // these to move whole chunks; the defaults fall back on the byte-at-a-time hooks above.
+
+            // Copies up to maxlen already-received bytes into buf, returning the number copied
+            virtual uint16_t serialReadBytes(uint8_t * buf, uint16_t maxlen)
             {
-                // Flash LED
-                uint32_t pauseMilli = ledFlashMilli / ledFlashCount;
-                ledSet(false);
-                for (uint8_t i = 0; i < ledFlashCount; i++) {
-                    ledSet(true);
-                    delayMilliseconds(pauseMilli);
-                    ledSet(false);
-                    delayMilliseconds(pauseMilli);
+                uint16_t n = 0;
+                while (n < maxlen && serialAvailableBytes()) {
+                    buf[n++] = serialReadByte();
+                }
+                return n;
+            }
+
+            // Accepts up to len bytes for transmission, returning the number accepted.  A DMA board should copy
+            // them to its transfer buffer (or return 0 while a transfer is still in flight).
+            virtual uint16_t serialWriteBytes(const uint8_t * buf, uint16_t len)
+            {
+                for (uint16_t k=0; k<len; ++k) {
+                    serialWriteByte(buf[k]);
                 }
+                return len;
+            }
+
+            // Boards that receive through a UART interrupt or DMA-complete callback can push bytes from there
+            // instead of overriding serialReadBytes(), once they have called serialUseRxPush() (after init(), before
+            // enabling the interrupt).  Safe to call from that ISR, as the RX ring's only producer: it is lock-free.
+            void serialUseRxPush(void)
+            {
+                _port.useRxPush();
+            }
+
+            uint16_t serialRxPush(const uint8_t * buf, uint16_t len)
+            {
+                return _port.rxPush(buf, len);
+            }
+
+            // The LED flashes while booting, from the loop (see showBootStatus()), so there is no pause here
+            void init(void)
+            {
                 ledSet(false);
 
                 // Set up MSP
-                msp.init();
+                _port.init();
             }
 
         public:
 
+            RealBoardT(void) : _port(this), _portCount(0) { }
+
+            // Adds an MSP port (e.g. a telemetry radio) to be serviced along with the board's own, each pass of
+            // the serial-comms task; returns false when there is no room, or no MSP.  The port must outlive the
+            // board.
+            bool addMSPPort(MSPPort * port)
+            {
+                if (!Features::SERIAL || _portCount == MAX_MSP_PORTS) {
+                    return false;
+                }
+
+                port->init();
+                _ports[_portCount++] = port;
+
+                return true;
+            }
+
+            // Bytes per second the board's own port may move, in both directions together; zero for no limit
+            void setMSPBytesPerSecond(uint32_t bytesPerSecond)
+            {
+                _port.setBytesPerSecond(bytesPerSecond);
+            }
+
+            // Debug text shares the port with MSP, so it goes out only between replies, when every byte of them has
+            // been handed to the driver
+            void drainOutbuf(void)
+            {
+                if (_port.txIdle()) {
+                    Board::drainOutbuf();
+                }
+            }
+
             void showArmedStatus(bool armed)
             {
                 // Set LED to indicate armed
                 ledSet(armed);
             }
 
-            void doSerialComms(float eulerAngles[3], bool armed, class Receiver * receiver, class Mixer * mixer) 
+            // Flash the LED until the vehicle can arm, then turn it off
+            void showBootStatus(bool booting)
             {
-                while (serialAvailableBytes()) {
-                    msp.update(serialReadByte(), eulerAngles, armed, receiver, mixer);
-                }
+                ledSet(booting && (getMicroseconds() / ledFlashMicros) % 2);
+            }
+
+            void doSerialComms(const MSPContext * context, bool armed)
+            {
+                uint32_t usec = getMicroseconds();
 
-                while (msp.availableBytes() > 0) {
-                    serialWriteByte(msp.readByte());
+                // Once per pass, so every port replies from the same snapshot
+                _replies.refresh(context->state);
+                ReplyCache * replies = pointer(_replies);
+
+                _port.service(usec, replies, context);
+
+                for (uint8_t k=0; k<_portCount; ++k) {
+                    _ports[k]->service(usec, replies, context);
                 }
 
-                // Support motor testing from GCS
-                if (!armed) {
-                    mixer->runDisarmed();
+                // Support motor testing from GCS, when offered the mixer
+                if (!armed && context->mixer) {
+                    context->mixer->runDisarmed();
                 }
 
             }
 
-    }; // class RealBoard
+    }; // class RealBoardT
+
+    typedef RealBoardT<> RealBoard;
 
 } // namespace hf
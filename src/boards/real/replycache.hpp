@@ -0,0 +1,121 @@
+/*
+   replycache.hpp : The vehicle-state snapshot MSP replies are made from, and the replies already encoded from it
+
+   A serial pass starts by refreshing the cache, which copies out the latest snapshot only if a new one has been
+   published.  MSP encodes each snapshot message the first time it is asked for one, requested or subscribed, on
+   any port, and copies that encoding for every other request until the next snapshot comes in.  Messages that
+   aren't made from the snapshot (e.g. the profiler's) are encoded afresh every time.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include "vehiclestate.hpp"
+
+namespace hf {
+
+    class ReplyCache {
+
+        public:
+
+            // Enough for every snapshot message (RC_NORMAL, ATTITUDE_RADIANS, RC_PACKED, and ATTITUDE_COMPACT);
+            // one that won't fit is just encoded every time
+            static const uint8_t  SLOTS = 4;
+            static const uint16_t SLOT_SIZE = 40;
+
+        private:
+
+            typedef struct {
+                uint8_t id;
+                uint8_t payload[SLOT_SIZE];
+            } slot_t;
+
+            vehicle_state_t _state;
+            uint32_t        _sequence;
+            bool            _loaded;
+
+            slot_t  _slots[SLOTS];
+            uint8_t _used;
+
+        public:
+
+            ReplyCache(void)
+            {
+                init();
+            }
+
+            void init(void)
+            {
+                memset(&_state, 0, sizeof(_state));
+                _sequence = 0;
+                _loaded = false;
+                _used = 0;
+            }
+
+            // Takes up the latest snapshot, dropping the replies encoded from the last one, if there is a new one
+            void refresh(const VehicleState * state)
+            {
+                if (_loaded && state->sequence() == _sequence) {
+                    return;
+                }
+
+                _sequence = state->read(_state);
+                _loaded = true;
+                _used = 0;
+            }
+
+            const vehicle_state_t & state(void) const
+            {
+                return _state;
+            }
+
+            // The payload already encoded for message id from this snapshot, or null
+            const uint8_t * find(uint8_t id) const
+            {
+                for (uint8_t k=0; k<_used; ++k) {
+                    if (_slots[k].id == id) {
+                        return _slots[k].payload;
+                    }
+                }
+                return 0;
+            }
+
+            void store(uint8_t id, const uint8_t * payload, uint16_t size)
+            {
+                if (_used < SLOTS && size <= SLOT_SIZE) {
+                    _slots[_used].id = id;
+                    memcpy(_slots[_used].payload, payload, size);
+                    _used++;
+                }
+            }
+
+    }; // class ReplyCache
+
+    // Takes ReplyCache's place on boards built without AllFeatures::SERIAL
+    class NoReplyCache {
+
+        public:
+
+            void init(void) { }
+
+            void refresh(const VehicleState * state) { (void)state; }
+
+    }; // class NoReplyCache
+
+} // namespace hf
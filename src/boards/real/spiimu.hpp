@@ -0,0 +1,493 @@
+/*
+   spiimu.hpp : Hackflight Board routines for a flight controller with a raw IMU on SPI
+
+   For the InvenSense MPU6000 and the parts that share its register map (ICM-20602, ICM-20689), running with the
+   digital low-pass filter off so the gyro comes at 8 kHz.  The IMU's data-ready interrupt starts one burst read of
+   the accelerometer, temperature, and gyro registers, and the attitude is estimated here, by an IMU object that
+   integrates every gyro sample and corrects toward the accelerometer's gravity direction.  With a gyro eight times
+   faster than the SENtral's, pair this board with Hackflight::initGyroOversampling() on MCUs that can't run the
+   PIDs on every sample.
+
+   The accelerometer is only updated at 1 kHz, so it and the attitude are reported on every eighth gyro sample.
+   Roll and pitch come from the accelerometer; with no magnetometer, yaw is the integrated gyro and drifts.  The
+   motors are driven with analogWrite(), as on the Ladybug, or after useDShot() with DShot, bit-banged on the same
+   pins (see bitbangdshot.hpp).
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <SPI.h>
+#include <EEPROM.h>
+#include "hackflight.hpp"
+#include "realboard.hpp"
+#include "bitbangdshot.hpp"
+#include "imu.hpp"
+
+namespace hf {
+
+    class SpiImu final : public RealBoard {
+
+        private:
+
+            // Registers
+            static const uint8_t REG_SMPLRT_DIV        = 0x19;
+            static const uint8_t REG_CONFIG            = 0x1A;
+            static const uint8_t REG_GYRO_CONFIG       = 0x1B;
+            static const uint8_t REG_ACCEL_CONFIG      = 0x1C;
+            static const uint8_t REG_INT_PIN_CFG       = 0x37;
+            static const uint8_t REG_INT_ENABLE        = 0x38;
+            static const uint8_t REG_ACCEL_XOUT_H      = 0x3B; // accel x,y,z; temperature; gyro x,y,z: big-endian int16
+            static const uint8_t REG_SIGNAL_PATH_RESET = 0x68;
+            static const uint8_t REG_USER_CTRL         = 0x6A;
+            static const uint8_t REG_PWR_MGMT_1        = 0x6B;
+            static const uint8_t REG_WHO_AM_I          = 0x75;
+
+            static const uint8_t READ_FLAG = 0x80;
+
+            // Register values
+            static const uint8_t DEVICE_RESET     = 0x80;
+            static const uint8_t CLOCK_PLL_GYRO_X = 0x01;
+            static const uint8_t SIGNAL_RESET_ALL = 0x07;
+            static const uint8_t I2C_IF_DIS       = 0x10; // SPI only
+            static const uint8_t DLPF_OFF         = 0x00; // 256 Hz gyro bandwidth, 8 kHz output
+            static const uint8_t GYRO_2000_DPS    = 0x18;
+            static const uint8_t ACCEL_16_G       = 0x18;
+            static const uint8_t INT_ANYRD_CLEAR  = 0x10; // the burst read clears the interrupt
+            static const uint8_t DATA_RDY_EN      = 0x01;
+
+            // What WHO_AM_I reads on each supported part
+            static const uint8_t WHOAMI_MPU6000   = 0x68;
+            static const uint8_t WHOAMI_ICM20602  = 0x12;
+            static const uint8_t WHOAMI_ICM20689  = 0x98;
+
+            // The configuration registers take at most 1 MHz; the sensor registers can be read faster, up to the
+            // ICM-20689's 8 MHz
+            static const uint32_t SPI_CONFIG_HZ = 1000000;
+            static const uint32_t SPI_READ_HZ   = 8000000;
+
+            static const uint8_t BURST_SIZE = 14;
+
+            // Full-scale conversions for the ranges set above
+            static constexpr float GYRO_RADIANS_PER_LSB = M_PI / 180 / 16.4f;
+            static constexpr float ACCEL_G_PER_LSB      = 1 / 2048.f;
+
+            // Gyro samples per accelerometer update
+            static const uint8_t ACCEL_DIVIDER = 8;
+
+            // Pull toward the accelerometer's gravity direction, in 1/sec
+            static constexpr float ACCEL_CORRECTION = 2.0f;
+
+            // Calibration record lives at the start of the (flash-emulated) EEPROM
+            static const uint16_t CALIBRATION_ADDRESS = 0;
+
+            const uint8_t _csPin;
+            const uint8_t _interruptPin;
+            const uint8_t _ledPin;
+            const uint8_t _motorPins[4];
+
+            // Last value written to each motor, so we don't send the same one over and over
+            uint8_t _motorValuesPrev[4];
+
+            // With DShot, every write sends a frame to each of the quad's motors
+            BitBangDShot<MixerQuadX::MOTORS> _dshot;
+            bool           _useDShot;
+            DShot::speed_t _dshotSpeed;
+            float          _motorValues[4];
+
+            IMU _imu;
+
+            uint8_t  _pendingEvents; // sampled but not yet consumed by the get*() methods
+            uint8_t  _accelCount;
+
+            // Latest sample, in the IMU's own axes
+            float    _gyro[3];
+            float    _accel[3];
+            uint32_t _gyroMicros;
+
+            // Set by the data-ready ISR
+            static volatile bool     _dataReady;
+            static volatile uint32_t _dataReadyMicros;
+
+            static void dataReadyHandler(void)
+            {
+                _dataReadyMicros = micros();
+                _dataReady = true;
+            }
+
+            void writeRegister(uint8_t reg, uint8_t value)
+            {
+                SPI.beginTransaction(SPISettings(SPI_CONFIG_HZ, MSBFIRST, SPI_MODE3));
+                digitalWrite(_csPin, LOW);
+                SPI.transfer(reg);
+                SPI.transfer(value);
+                digitalWrite(_csPin, HIGH);
+                SPI.endTransaction();
+            }
+
+            void readRegisters(uint8_t reg, uint8_t * buf, uint8_t count, uint32_t clockHz)
+            {
+                SPI.beginTransaction(SPISettings(clockHz, MSBFIRST, SPI_MODE3));
+                digitalWrite(_csPin, LOW);
+                SPI.transfer(reg | READ_FLAG);
+                memset(buf, 0, count);
+                SPI.transfer(buf, count);
+                digitalWrite(_csPin, HIGH);
+                SPI.endTransaction();
+            }
+
+            static int16_t bigEndian(const uint8_t * buf)
+            {
+                return (int16_t)((buf[0] << 8) | buf[1]);
+            }
+
+            // Reads the sample the interrupt announced and feeds it to the attitude estimate
+            void readSample(uint32_t usec)
+            {
+                uint8_t buf[BURST_SIZE];
+                readRegisters(REG_ACCEL_XOUT_H, buf, BURST_SIZE, SPI_READ_HZ);
+
+                for (uint8_t k=0; k<3; ++k) {
+                    _gyro[k] = bigEndian(&buf[8+2*k]) * GYRO_RADIANS_PER_LSB;
+                }
+                _gyroMicros = usec;
+                _imu.updateGyro(_gyro, usec);
+                _pendingEvents |= EVENT_GYRO;
+
+                if (++_accelCount < ACCEL_DIVIDER) {
+                    return;
+                }
+                _accelCount = 0;
+
+                for (uint8_t k=0; k<3; ++k) {
+                    _accel[k] = bigEndian(&buf[2*k]) * ACCEL_G_PER_LSB;
+                }
+                _imu.updateAccel(_accel, usec);
+                _pendingEvents |= EVENT_ACCEL | EVENT_ATTITUDE;
+            }
+
+            void halt(const char * message)
+            {
+                while (true) {
+                    Serial.println(message);
+                    delay(500);
+                }
+            }
+
+            // Consumes a pending event, so each sample is read only once
+            bool gotEvent(uint8_t event)
+            {
+                bool got = _pendingEvents & event;
+                _pendingEvents &= ~event;
+                return got;
+            }
+
+        public:
+
+            // Pass the IMU's chip-select and interrupt pins, the LED pin, and the four motor pins
+            SpiImu(uint8_t csPin, uint8_t interruptPin, uint8_t ledPin, uint8_t m1, uint8_t m2, uint8_t m3, uint8_t m4)
+                : _csPin(csPin), _interruptPin(interruptPin), _ledPin(ledPin), _motorPins{m1, m2, m3, m4},
+                  _dshot(_motorPins), _useDShot(false), _dshotSpeed(DShot::DSHOT300),
+                  _pendingEvents(0), _accelCount(0), _gyroMicros(0)
+            {
+                memset(_motorValuesPrev, 0, sizeof(_motorValuesPrev));
+                memset(_motorValues, 0, sizeof(_motorValues));
+                memset(_gyro, 0, sizeof(_gyro));
+                memset(_accel, 0, sizeof(_accel));
+            }
+
+            // Drives the ESCs with DShot instead of PWM; call before init()
+            void useDShot(DShot::speed_t speed=DShot::DSHOT300)
+            {
+                _useDShot = true;
+                _dshotSpeed = speed;
+            }
+
+            void init(void)
+            {
+                // Begin serial comms
+                Serial.begin(115200);
+
+                // Setup LED and turn it off
+                pinMode(_ledPin, OUTPUT);
+                digitalWrite(_ledPin, LOW);
+
+                // Start SPI, with the IMU deselected
+                pinMode(_csPin, OUTPUT);
+                digitalWrite(_csPin, HIGH);
+                SPI.begin();
+
+                // Reset the IMU and its signal paths
+                writeRegister(REG_PWR_MGMT_1, DEVICE_RESET);
+                delay(100);
+                writeRegister(REG_SIGNAL_PATH_RESET, SIGNAL_RESET_ALL);
+                delay(100);
+
+                uint8_t whoami = 0;
+                readRegisters(REG_WHO_AM_I, &whoami, 1, SPI_CONFIG_HZ);
+                if (whoami != WHOAMI_MPU6000 && whoami != WHOAMI_ICM20602 && whoami != WHOAMI_ICM20689) {
+                    halt("ERROR: unrecognized IMU");
+                }
+
+                // Clock from the gyro's PLL, SPI only, gyro at 8 kHz with the widest ranges, and a data-ready
+                // interrupt for each sample
+                writeRegister(REG_PWR_MGMT_1, CLOCK_PLL_GYRO_X);
+                writeRegister(REG_USER_CTRL, I2C_IF_DIS);
+                writeRegister(REG_SMPLRT_DIV, 0);
+                writeRegister(REG_CONFIG, DLPF_OFF);
+                writeRegister(REG_GYRO_CONFIG, GYRO_2000_DPS);
+                writeRegister(REG_ACCEL_CONFIG, ACCEL_16_G);
+                writeRegister(REG_INT_PIN_CFG, INT_ANYRD_CLEAR);
+                writeRegister(REG_INT_ENABLE, DATA_RDY_EN);
+
+                // Estimate the attitude ourselves
+                _imu.init(IMU::PROPAGATE_QUATERNION);
+                _imu.setAccelCorrection(ACCEL_CORRECTION);
+
+                pinMode(_interruptPin, INPUT);
+                attachInterrupt(_interruptPin, dataReadyHandler, RISING);
+
+                // Enable the Cortex-M DWT cycle counter for loop profiling, and for timing DShot
+                CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+                DWT->CYCCNT = 0;
+                DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+                // Initialize the motors, stopped
+                if (_useDShot) {
+                    _dshot.begin(_dshotSpeed);
+                    _dshot.write(_motorValues, 4);
+                }
+                else {
+                    for (int k=0; k<4; ++k) {
+                        analogWriteFrequency(_motorPins[k], 10000);
+                        analogWrite(_motorPins[k], 0);
+                    }
+                }
+
+                // Hang a bit more
+                delay(100);
+
+                // Do general real-board initialization
+                RealBoard::init();
+            }
+
+            uint32_t getMicroseconds()
+            {
+                return micros();
+            }
+
+            uint32_t getCycleCount(void)
+            {
+                return DWT->CYCCNT;
+            }
+
+            uint32_t getCyclesPerMicrosecond(void)
+            {
+                return F_CPU / 1000000;
+            }
+
+            void writeMotor(uint8_t index, float value)
+            {
+                if (_useDShot) {
+                    _motorValues[index] = value;
+                    _dshot.write(_motorValues, 4);
+                    return;
+                }
+
+                // Scale motor value from [0,1] to [0,255]
+                uint8_t aval = (uint8_t)(value * 255);
+
+                // Avoid sending the same value over and over
+                if (aval != _motorValuesPrev[index]) {
+                    analogWrite(_motorPins[index], aval);
+                    _motorValuesPrev[index] = aval;
+                }
+            }
+
+            // With DShot, one frame for all the motors
+            void writeMotors(const float * values, uint8_t count)
+            {
+                if (!_useDShot) {
+                    RealBoard::writeMotors(values, count);
+                    return;
+                }
+
+                count = count < 4 ? count : 4;
+                memcpy(_motorValues, values, count * sizeof(float));
+                _dshot.write(_motorValues, 4);
+            }
+
+            // One burst read per data-ready interrupt
+            uint8_t pollEvents(void)
+            {
+                if (_dataReady) {
+
+                    // Clear before reading, so an interrupt arriving during the read raises the flag again
+                    __disable_irq();
+                    uint32_t usec = _dataReadyMicros;
+                    _dataReady = false;
+                    __enable_irq();
+
+                    readSample(usec);
+                }
+
+                return _pendingEvents;
+            }
+
+            // Sleep until the next data-ready interrupt
+            void idle(uint32_t maxMicros)
+            {
+                // Any interrupt (data-ready, serial, or the millisecond tick) ends a WFI; with interrupts masked
+                // around the check, one arriving between the check and the WFI still ends it
+                uint32_t start = micros();
+                while ((micros() - start) < maxMicros) {
+                    __disable_irq();
+                    if (_dataReady) {
+                        __enable_irq();
+                        break;
+                    }
+                    __WFI();
+                    __enable_irq();
+                }
+            }
+
+            bool getGyroRates(float gyroRates[3])
+            {
+                if (gotEvent(EVENT_GYRO)) {
+
+                    // invert pitch, yaw gyro direction to keep other code simpler
+                    gyroRates[0] = +_gyro[0];
+                    gyroRates[1] = -_gyro[1];
+                    gyroRates[2] = -_gyro[2];
+
+                    return true;
+                }
+
+                return false;
+            }
+
+            bool getGyroSample(float gyroRates[3], uint32_t & usec)
+            {
+                if (!getGyroRates(gyroRates)) {
+                    return false;
+                }
+                usec = _gyroMicros;
+                return true;
+            }
+
+            bool getEulerAngles(float eulerAngles[3])
+            {
+                if (gotEvent(EVENT_ATTITUDE)) {
+                    float q[4];
+                    _imu.getQuaternion(q);
+                    FastMath::eulerFromQuaternion(q, eulerAngles);
+                    return true;
+                }
+
+                return false;
+            }
+
+            // The estimate is a quaternion, so hand that over as it is
+            bool getQuaternion(float quaternion[4])
+            {
+                if (gotEvent(EVENT_ATTITUDE)) {
+                    _imu.getQuaternion(quaternion);
+                    return true;
+                }
+
+                return false;
+            }
+
+            bool getAccelerometer(float accelGs[3])
+            {
+                if (gotEvent(EVENT_ACCEL)) {
+                    memcpy(accelGs, _accel, sizeof(_accel));
+                    return true;
+                }
+
+                return false;
+            }
+
+            uint16_t calibrationRead(uint8_t * buf, uint16_t len)
+            {
+                for (uint16_t k=0; k<len; ++k) {
+                    buf[k] = EEPROM.read(CALIBRATION_ADDRESS + k);
+                }
+                return len;
+            }
+
+            // Rewrites only the bytes that changed
+            void calibrationWrite(const uint8_t * buf, uint16_t len)
+            {
+                for (uint16_t k=0; k<len; ++k) {
+                    EEPROM.update(CALIBRATION_ADDRESS + k, buf[k]);
+                }
+            }
+
+        protected:
+
+            void delayMilliseconds(uint32_t msec)
+            {
+                delay(msec);
+            }
+
+            void ledSet(bool is_on)
+            {
+                digitalWrite(_ledPin, is_on ? HIGH : LOW);
+            }
+
+            uint8_t serialAvailableBytes(void)
+            {
+                return Serial.available();
+            }
+
+            uint8_t serialReadByte(void)
+            {
+                return Serial.read();
+            }
+
+            void serialWriteByte(uint8_t c)
+            {
+                Serial.write(c);
+            }
+
+            // The core's UART interrupt fills its own receive buffer; take only what is already there so we never block
+            uint16_t serialReadBytes(uint8_t * buf, uint16_t maxlen)
+            {
+                uint16_t n = Serial.available();
+                return Serial.readBytes(buf, n < maxlen ? n : maxlen);
+            }
+
+            // Hand over only what fits in the core's transmit buffer, which its interrupt drains in the background
+            uint16_t serialWriteBytes(const uint8_t * buf, uint16_t len)
+            {
+                uint16_t n = Serial.availableForWrite();
+                return Serial.write(buf, n < len ? n : len);
+            }
+
+    }; // class SpiImu
+
+    volatile bool     SpiImu::_dataReady = false;
+    volatile uint32_t SpiImu::_dataReadyMicros = 0;
+
+    // Only what fits in the core's transmit buffer, like serialWriteBytes()
+    uint16_t Board::outbufWrite(const uint8_t * buf, uint16_t len)
+    {
+        uint16_t n = Serial.availableForWrite();
+        return Serial.write(buf, n < len ? n : len);
+    }
+
+} // namespace hf
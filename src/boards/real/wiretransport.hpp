@@ -0,0 +1,103 @@
+/*
+   wiretransport.hpp : I^2C register reads through the Arduino Wire library, for I2CQueue
+
+   On the STM32L4 core, reads go through its asynchronous TwoWire::transfer(), which runs the transaction from the
+   I^2C interrupt and calls back when it is over, so the CPU is free while the bytes clock in.  Other cores have
+   only blocking Wire calls; there a read is done by the time start() returns, in chunks the size of the Wire
+   buffer.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <Wire.h>
+
+namespace hf {
+
+    class WireTransport {
+
+        private:
+
+            // Most bytes the Wire library buffers for one blocking read
+            static const uint8_t WIRE_CHUNK = 32;
+
+            // What the transfer sends: the register to read from
+            uint8_t _reg;
+
+#if defined(ARDUINO_ARCH_STM32L4)
+
+            // Set from the I^2C interrupt when the transfer is over
+            static volatile bool    _done;
+            static volatile uint8_t _status;
+
+            static void transferHandler(void)
+            {
+                _done = true;
+            }
+
+        public:
+
+            WireTransport(void) : _reg(0) { }
+
+            bool start(uint8_t address, uint8_t reg, uint8_t * buf, uint8_t count)
+            {
+                _reg = reg;
+                _done = false;
+                return Wire.transfer(address, &_reg, 1, buf, count, &_status, transferHandler);
+            }
+
+            bool done(void)
+            {
+                return _done;
+            }
+
+#else
+
+        public:
+
+            WireTransport(void) : _reg(0) { }
+
+            bool start(uint8_t address, uint8_t reg, uint8_t * buf, uint8_t count)
+            {
+                for (uint8_t k=0; k<count; k+=WIRE_CHUNK) {
+                    uint8_t n = (count - k) < WIRE_CHUNK ? (count - k) : WIRE_CHUNK;
+                    _reg = reg + k;
+                    Wire.beginTransmission(address);
+                    Wire.write(_reg);
+                    Wire.endTransmission(false); // repeated start
+                    Wire.requestFrom(address, n);
+                    for (uint8_t j=0; j<n && Wire.available(); ++j) {
+                        buf[k+j] = Wire.read();
+                    }
+                }
+                return true;
+            }
+
+            bool done(void)
+            {
+                return true;
+            }
+
+#endif
+
+    }; // class WireTransport
+
+#if defined(ARDUINO_ARCH_STM32L4)
+    volatile bool    WireTransport::_done = true;
+    volatile uint8_t WireTransport::_status = 0;
+#endif
+
+} // namespace hf
@@ -0,0 +1,412 @@
+/*
+   cosim.hpp: Board that runs Hackflight in lockstep with an external physics engine
+
+   Instead of integrating its own physics, CoSimBoard sends the motor values for each controller tick to an
+   engine over UDP and blocks until the engine replies with the sensor frame for the next tick.  The engine owns
+   the simulated clock, so the control dynamics are the same however fast or slow the engine (or its renderer)
+   runs.
+
+   Each exchange can carry a batch of ticks, so a fast engine needn't pay a round trip per tick.  The board
+   offers a batch size of at most MAXBATCH; the engine answers each motor packet with as many sensor frames as it
+   wants (at least one, at most what was offered), and the board sends back motors for exactly that many ticks
+   next time.  Batches of one are true lockstep.  A batch of N holds the motors of each tick for N ticks before
+   the engine applies them, so it adds N-1 ticks of actuator delay: use it for speed, not for tuning.
+
+   Packets, in host byte order:
+
+       board -> engine:  magic 'HFCM' (u32), sequence (u32), ticks (u8), motors per tick (u8), batch offered (u8),
+                         pad (u8), then float motors [ticks][motors per tick]
+
+       engine -> board:  magic 'HFCS' (u32), sequence (u32, echoed), frames (u8), pad [3], then frames of
+                         time usec (u32), flags (u8: 1 gyro, 2 Euler, 4 accel, 8 baro), pad [3],
+                         float gyro [3], Euler angles [3], accel [3], pressure
+
+   The first packet carries no motors (ticks = 0) and asks for the initial sensor frames.  If no reply arrives
+   in time the board resends the same packet; an engine that sees a sequence it has already answered must resend
+   its previous reply instead of stepping again.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <board.hpp>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+
+#if defined(_WIN32)
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace hf {
+
+    class CoSimBoard final : public Board {
+
+        public:
+
+            static const uint32_t MOTOR_MAGIC  = 0x4D434648; // 'HFCM'
+            static const uint32_t SENSOR_MAGIC = 0x53434648; // 'HFCS'
+
+            static const uint8_t  MAXBATCH  = 32;
+            static const uint8_t  MAXMOTORS = 8;
+
+            enum {
+                HAVE_GYRO  = 0x01,
+                HAVE_EULER = 0x02,
+                HAVE_ACCEL = 0x04,
+                HAVE_BARO  = 0x08
+            };
+
+            typedef struct {
+
+                uint32_t timeMicros;
+                uint8_t  flags;
+                uint8_t  pad[3];
+                float    gyroRates[3];
+                float    eulerAngles[3];
+                float    accelGs[3];
+                float    pressure;
+
+            } frame_t;
+
+            typedef struct {
+
+                uint32_t magic;
+                uint32_t sequence;
+                uint8_t  ticks;
+                uint8_t  nmotors;
+                uint8_t  batch;
+                uint8_t  pad;
+                float    motors[MAXBATCH][MAXMOTORS];
+
+            } motor_packet_t;
+
+            typedef struct {
+
+                uint32_t magic;
+                uint32_t sequence;
+                uint8_t  frames;
+                uint8_t  pad[3];
+                frame_t  frame[MAXBATCH];
+
+            } sensor_packet_t;
+
+            static const uint16_t MOTOR_HEADER_SIZE  = 12;
+            static const uint16_t SENSOR_HEADER_SIZE = 12;
+
+            // The engine is at host:port; batch is the most ticks to offer per exchange
+            CoSimBoard(const char * host, uint16_t port, uint8_t nmotors=4, uint8_t batch=1, uint32_t timeoutMillis=1000)
+            {
+                _host = host;
+                _port = port;
+                _nmotors = nmotors < MAXMOTORS ? nmotors : MAXMOTORS;
+                _batch = batch < 1 ? 1 : (batch > MAXBATCH ? MAXBATCH : batch);
+                _timeoutMillis = timeoutMillis;
+                _sock = -1;
+            }
+
+            ~CoSimBoard(void)
+            {
+                closeSocket();
+            }
+
+            // Exchanges with the engine so far, and how many of them needed a resend
+            uint32_t cosimExchanges(void)
+            {
+                return _sequence;
+            }
+
+            uint32_t cosimRetries(void)
+            {
+                return _retries;
+            }
+
+            // False once the engine has stopped answering; the board then reads no new sensors
+            bool cosimConnected(void)
+            {
+                return _connected;
+            }
+
+            // methods called by Hackflight -------------------------------------------------
+
+            void init(void)
+            {
+                _sequence = 0;
+                _retries = 0;
+                _blockedNanos = 0;
+                _frameCount = 0;
+                _frameIndex = 0;
+                _timeMicros = 0;
+                memset(&_current, 0, sizeof(_current));
+                memset(_lastMotors, 0, sizeof(_lastMotors));
+
+                _connected = openSocket();
+
+                if (!_connected) {
+                    fprintf(stderr, "CoSimBoard: unable to reach engine at %s:%u\n", _host, _port);
+                }
+            }
+
+            // Each gyro sample is a tick: move to the next frame of the batch, exchanging when it runs out
+            bool getGyroRates(float gyroRates[3])
+            {
+                if (_frameIndex == _frameCount && !exchange()) {
+                    return false;
+                }
+
+                _current = _reply.frame[_frameIndex++];
+                _timeMicros = _current.timeMicros;
+
+                // Until this tick's motors are written, the engine holds the previous ones
+                memcpy(_outgoing.motors[_frameIndex-1], _lastMotors, sizeof(_lastMotors));
+
+                if (!(_current.flags & HAVE_GYRO)) {
+                    return false;
+                }
+
+                memcpy(gyroRates, _current.gyroRates, 3*sizeof(float));
+
+                return true;
+            }
+
+            bool getEulerAngles(float eulerAngles[3])
+            {
+                if (!(_current.flags & HAVE_EULER)) {
+                    return false;
+                }
+                memcpy(eulerAngles, _current.eulerAngles, 3*sizeof(float));
+                _current.flags &= ~HAVE_EULER;
+                return true;
+            }
+
+            bool getAccelerometer(float accelGs[3])
+            {
+                if (!(_current.flags & HAVE_ACCEL)) {
+                    return false;
+                }
+                memcpy(accelGs, _current.accelGs, 3*sizeof(float));
+                _current.flags &= ~HAVE_ACCEL;
+                return true;
+            }
+
+            bool getBarometer(float & pressure)
+            {
+                if (!(_current.flags & HAVE_BARO)) {
+                    return false;
+                }
+                pressure = _current.pressure;
+                _current.flags &= ~HAVE_BARO;
+                return true;
+            }
+
+            // The engine's clock
+            uint32_t getMicroseconds()
+            {
+                return _timeMicros;
+            }
+
+            void writeMotor(uint8_t index, float value)
+            {
+                if (index < _nmotors) {
+                    _lastMotors[index] = value;
+                    if (_frameIndex > 0) {
+                        _outgoing.motors[_frameIndex-1][index] = value;
+                    }
+                }
+            }
+
+            void writeMotors(const float * values, uint8_t count)
+            {
+                for (uint8_t k=0; k<count; ++k) {
+                    writeMotor(k, values[k]);
+                }
+            }
+
+            // Wall-clock nanoseconds, leaving out time spent waiting on the engine, so the scheduler and
+            // profiler see only the flight code
+            uint32_t getCycleCount(void)
+            {
+                return (uint32_t)(nanoseconds() - _blockedNanos);
+            }
+
+            uint32_t getCyclesPerMicrosecond(void)
+            {
+                return 1000;
+            }
+
+        private:
+
+            const char * _host;
+            uint16_t     _port;
+            uint8_t      _nmotors;
+            uint8_t      _batch;
+            uint32_t     _timeoutMillis;
+
+#if defined(_WIN32)
+            SOCKET       _sock;
+#else
+            int          _sock;
+#endif
+            struct sockaddr_storage _engine;
+            socklen_t    _engineLength;
+
+            bool         _connected;
+            uint32_t     _sequence;
+            uint32_t     _retries;
+            uint64_t     _blockedNanos;
+
+            motor_packet_t  _outgoing;
+            sensor_packet_t _reply;
+            uint8_t         _frameCount;
+            uint8_t         _frameIndex;
+
+            frame_t         _current;
+            uint32_t        _timeMicros;
+            float           _lastMotors[MAXMOTORS];
+
+            static uint64_t nanoseconds(void)
+            {
+                return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now().time_since_epoch()).count();
+            }
+
+            bool openSocket(void)
+            {
+#if defined(_WIN32)
+                WSADATA wsa;
+                WSAStartup(MAKEWORD(2, 2), &wsa);
+#endif
+                struct addrinfo hints, * info = NULL;
+                memset(&hints, 0, sizeof(hints));
+                hints.ai_family = AF_UNSPEC;
+                hints.ai_socktype = SOCK_DGRAM;
+
+                char service[8];
+                snprintf(service, sizeof(service), "%u", _port);
+
+                if (getaddrinfo(_host, service, &hints, &info) || !info) {
+                    return false;
+                }
+
+                _sock = socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+                memcpy(&_engine, info->ai_addr, info->ai_addrlen);
+                _engineLength = info->ai_addrlen;
+                freeaddrinfo(info);
+
+                return _sock >= 0;
+            }
+
+            void closeSocket(void)
+            {
+                if (_sock >= 0) {
+#if defined(_WIN32)
+                    closesocket(_sock);
+                    WSACleanup();
+#else
+                    close(_sock);
+#endif
+                    _sock = -1;
+                }
+            }
+
+            bool waitReadable(void)
+            {
+#if defined(_WIN32)
+                WSAPOLLFD pfd = {_sock, POLLIN, 0};
+                return WSAPoll(&pfd, 1, _timeoutMillis) > 0;
+#else
+                struct pollfd pfd = {_sock, POLLIN, 0};
+                return poll(&pfd, 1, _timeoutMillis) > 0;
+#endif
+            }
+
+            // Sends the motors for the batch just flown and waits for the next batch of sensor frames, resending
+            // on timeout.  Gives up after a few tries, so a dead engine doesn't hang the flight loop forever.
+            bool exchange(void)
+            {
+                if (!_connected) {
+                    return false;
+                }
+
+                static const uint8_t TRIES = 5;
+
+                uint64_t start = nanoseconds();
+
+                _outgoing.magic = MOTOR_MAGIC;
+                _outgoing.sequence = _sequence;
+                _outgoing.ticks = _frameCount;
+                _outgoing.nmotors = _nmotors;
+                _outgoing.batch = _batch;
+                _outgoing.pad = 0;
+
+                // Only the motors in use go on the wire, packed tick by tick
+                uint8_t packet[sizeof(motor_packet_t)];
+                memcpy(packet, &_outgoing, MOTOR_HEADER_SIZE);
+                uint16_t size = MOTOR_HEADER_SIZE;
+                for (uint8_t k=0; k<_frameCount; ++k) {
+                    memcpy(&packet[size], _outgoing.motors[k], _nmotors*sizeof(float));
+                    size += _nmotors*sizeof(float);
+                }
+
+                bool got = false;
+
+                for (uint8_t tries=0; tries<TRIES && !got; ++tries) {
+
+                    if (tries > 0) {
+                        _retries++;
+                    }
+
+                    sendto(_sock, (const char *)packet, size, 0, (struct sockaddr *)&_engine, _engineLength);
+
+                    // Skip stale replies to an earlier send of this or a previous sequence
+                    while (waitReadable()) {
+                        int n = recv(_sock, (char *)&_reply, sizeof(_reply), 0);
+                        if (n >= SENSOR_HEADER_SIZE && _reply.magic == SENSOR_MAGIC && _reply.sequence == _sequence &&
+                                _reply.frames >= 1 && _reply.frames <= _batch &&
+                                n >= (int)(SENSOR_HEADER_SIZE + _reply.frames*sizeof(frame_t))) {
+                            got = true;
+                            break;
+                        }
+                    }
+                }
+
+                _blockedNanos += nanoseconds() - start;
+
+                if (!got) {
+                    fprintf(stderr, "CoSimBoard: engine stopped answering\n");
+                    _connected = false;
+                    return false;
+                }
+
+                _sequence++;
+                _frameCount = _reply.frames;
+                _frameIndex = 0;
+
+                return true;
+            }
+
+    }; // class CoSimBoard
+
+} // namespace hf
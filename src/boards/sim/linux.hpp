@@ -23,8 +23,26 @@
 #include "sim.hpp"
 
 #include <stdio.h>
+#include <errno.h>
 
 void hf::SimBoard::cputime(struct timespec * tv)
 {
     clock_gettime(CLOCK_PROCESS_CPUTIME_ID, tv);
 }
+
+uint64_t hf::SimBoard::wallclockNanos(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000ull + t.tv_nsec;
+}
+
+// An absolute deadline, so time spent before the call (or waking late from an earlier one) doesn't add up
+void hf::SimBoard::sleepUntilNanos(uint64_t deadline)
+{
+    struct timespec t;
+    t.tv_sec = deadline / 1000000000ull;
+    t.tv_nsec = deadline % 1000000000ull;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t, NULL) == EINTR) {
+    }
+}
@@ -0,0 +1,573 @@
+/*
+   replay.hpp: Hackflight Board classes for recording sensor logs and replaying them
+
+   RecordingBoard wraps another board and writes everything Hackflight reads from it (gyro, Euler angles,
+   accelerometer, barometer), the receiver's raw channels, and the motor values written back, one record per
+   gyro sample.  ReplayBoard memory-maps such a log and feeds it back with the original timestamps, so a control
+   law can be checked bit-for-bit against a recorded flight, or the core benchmarked on a realistic workload, at
+   full CPU speed.  Pair it with a ReplayReceiver (receivers/sim/replay.hpp).
+
+   Log format (host byte order; values are raw floats so replay is exact):
+
+       header:  'H' 'F' 'R' 'P' version nmotors nchannels 0  startMicros(u32)
+       records: time(u32) flags(u8) [gyro f32x3] [euler f32x3] [accel f32x3] [baro f32]
+                                    [rc f32 x nchannels] [motors f32 x nmotors]
+
+   Each bracketed field is present only when its flag is set.  A record covers one gyro sample: time is the
+   board clock just after it, and the fields are what the board returned (or was given) until the next one.
+   Records are decoded lazily: advancing reads only the time and flags, and fields are copied out when asked for.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <board.hpp>
+#include <receiver.hpp>
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace hf {
+
+    class ReplayLog {
+
+        public:
+
+            static const uint8_t VERSION = 1;
+
+            static const uint8_t MAXMOTORS   = 8;
+            static const uint8_t MAXCHANNELS = 16;
+
+            enum {
+                HAVE_GYRO   = 0x01,
+                HAVE_EULER  = 0x02,
+                HAVE_ACCEL  = 0x04,
+                HAVE_BARO   = 0x08,
+                HAVE_RC     = 0x10,
+                HAVE_MOTORS = 0x20
+            };
+
+            typedef struct {
+
+                char     magic[4];
+                uint8_t  version;
+                uint8_t  nmotors;
+                uint8_t  nchannels;
+                uint8_t  reserved;
+                uint32_t startMicros;
+
+            } header_t;
+
+            static const uint8_t RECORD_HEADER_SIZE = sizeof(uint32_t) + 1;
+
+            // Bytes taken by each field, in record order
+            static uint16_t fieldSize(uint8_t flag, uint8_t nmotors, uint8_t nchannels)
+            {
+                switch (flag) {
+                    case HAVE_GYRO:
+                    case HAVE_EULER:
+                    case HAVE_ACCEL:
+                        return 3 * sizeof(float);
+                    case HAVE_BARO:
+                        return sizeof(float);
+                    case HAVE_RC:
+                        return nchannels * sizeof(float);
+                    case HAVE_MOTORS:
+                        return nmotors * sizeof(float);
+                }
+                return 0;
+            }
+
+    }; // class ReplayLog
+
+    class RecordingBoard final : public Board {
+
+        private:
+
+            Board      * _board;
+            Receiver   * _receiver;
+            FILE       * _fp;
+
+            uint8_t      _nmotors;
+            uint8_t      _nchannels;
+
+            uint32_t     _frameCount;
+
+            // The record being filled in for the current gyro sample
+            bool         _open;
+            uint32_t     _time;
+            uint8_t      _flags;
+            float        _gyro[3];
+            float        _euler[3];
+            float        _accel[3];
+            float        _baro;
+            float        _motors[ReplayLog::MAXMOTORS];
+
+            void put(uint8_t flag, const void * data)
+            {
+                if (_flags & flag) {
+                    fwrite(data, 1, ReplayLog::fieldSize(flag, _nmotors, _nchannels), _fp);
+                }
+            }
+
+            void endRecord(void)
+            {
+                if (!_open) {
+                    return;
+                }
+
+                // Pick up a receiver frame read since the gyro sample
+                if (_receiver && _receiver->getFrameCount() != _frameCount) {
+                    _frameCount = _receiver->getFrameCount();
+                    _flags |= ReplayLog::HAVE_RC;
+                }
+
+                fwrite(&_time, sizeof(uint32_t), 1, _fp);
+                fwrite(&_flags, 1, 1, _fp);
+                put(ReplayLog::HAVE_GYRO,   _gyro);
+                put(ReplayLog::HAVE_EULER,  _euler);
+                put(ReplayLog::HAVE_ACCEL,  _accel);
+                put(ReplayLog::HAVE_BARO,   &_baro);
+                put(ReplayLog::HAVE_RC,     _receiver ? _receiver->rawvals : NULL);
+                put(ReplayLog::HAVE_MOTORS, _motors);
+
+                _open = false;
+            }
+
+        public:
+
+            // Records what board returns to a file opened for binary writing.  Give the receiver that Hackflight
+            // uses to record its channels as well; nmotors is the mixer's motor count.
+            RecordingBoard(Board * board, FILE * fp, Receiver * receiver=NULL, uint8_t nmotors=4) :
+                _board(board), _receiver(receiver), _fp(fp)
+            {
+                _nmotors = nmotors < ReplayLog::MAXMOTORS ? nmotors : ReplayLog::MAXMOTORS;
+                _nchannels = receiver ? receiver->channelCount() : 0;
+                if (_nchannels > ReplayLog::MAXCHANNELS) {
+                    _nchannels = ReplayLog::MAXCHANNELS;
+                }
+                _open = false;
+            }
+
+            // Writes out the last record; call when the flight is over, before closing the file
+            void finish(void)
+            {
+                endRecord();
+                fflush(_fp);
+            }
+
+            void init(void)
+            {
+                _board->init();
+
+                ReplayLog::header_t header = {{'H', 'F', 'R', 'P'}, ReplayLog::VERSION, _nmotors, _nchannels, 0,
+                                              _board->getMicroseconds()};
+                fwrite(&header, sizeof(header), 1, _fp);
+
+                _frameCount = _receiver ? _receiver->getFrameCount() : 0;
+                _open = false;
+            }
+
+            bool getGyroRates(float gyroRates[3])
+            {
+                if (!_board->getGyroRates(gyroRates)) {
+                    return false;
+                }
+
+                endRecord();
+
+                _open = true;
+                _time = _board->getMicroseconds();
+                _flags = ReplayLog::HAVE_GYRO;
+                memcpy(_gyro, gyroRates, sizeof(_gyro));
+
+                return true;
+            }
+
+            bool getEulerAngles(float eulerAngles[3])
+            {
+                if (!_board->getEulerAngles(eulerAngles)) {
+                    return false;
+                }
+                if (_open) {
+                    _flags |= ReplayLog::HAVE_EULER;
+                    memcpy(_euler, eulerAngles, sizeof(_euler));
+                }
+                return true;
+            }
+
+            bool getAccelerometer(float accelGs[3])
+            {
+                if (!_board->getAccelerometer(accelGs)) {
+                    return false;
+                }
+                if (_open) {
+                    _flags |= ReplayLog::HAVE_ACCEL;
+                    memcpy(_accel, accelGs, sizeof(_accel));
+                }
+                return true;
+            }
+
+            bool getBarometer(float & pressure)
+            {
+                if (!_board->getBarometer(pressure)) {
+                    return false;
+                }
+                if (_open) {
+                    _flags |= ReplayLog::HAVE_BARO;
+                    _baro = pressure;
+                }
+                return true;
+            }
+
+            uint32_t getMicroseconds()
+            {
+                return _board->getMicroseconds();
+            }
+
+            void writeMotor(uint8_t index, float value)
+            {
+                _board->writeMotor(index, value);
+                if (_open && index < _nmotors) {
+                    _flags |= ReplayLog::HAVE_MOTORS;
+                    _motors[index] = value;
+                }
+            }
+
+            void writeMotors(const float * values, uint8_t count)
+            {
+                _board->writeMotors(values, count);
+                if (_open) {
+                    _flags |= ReplayLog::HAVE_MOTORS;
+                    memcpy(_motors, values, (count < _nmotors ? count : _nmotors) * sizeof(float));
+                }
+            }
+
+            void showArmedStatus(bool armed)
+            {
+                _board->showArmedStatus(armed);
+            }
+
+            uint32_t getCycleCount(void)
+            {
+                return _board->getCycleCount();
+            }
+
+            uint32_t getCyclesPerMicrosecond(void)
+            {
+                return _board->getCyclesPerMicrosecond();
+            }
+
+    }; // class RecordingBoard
+
+    class ReplayBoard final : public Board {
+
+        private:
+
+            const uint8_t * _data;
+            size_t          _size;
+
+            ReplayLog::header_t _header;
+
+            // Current record and the offset of the next one
+            size_t   _record;
+            size_t   _next;
+            uint32_t _time;
+            uint8_t  _flags;
+
+            // Fields not yet handed to Hackflight; a reading is held until it is asked for or superseded
+            uint8_t  _pending;
+            size_t   _eulerAt;
+            size_t   _accelAt;
+            size_t   _baroAt;
+            size_t   _rcAt;
+
+            // Motor check: what was written during the current record, against what was recorded
+            float    _motors[ReplayLog::MAXMOTORS];
+            bool     _motorsWritten;
+            uint32_t _records;
+            uint32_t _mismatches;
+            uint32_t _firstMismatch;
+
+            size_t fieldOffset(size_t record, uint8_t flags, uint8_t flag)
+            {
+                size_t offset = record + ReplayLog::RECORD_HEADER_SIZE;
+                for (uint8_t f=ReplayLog::HAVE_GYRO; f<flag; f<<=1) {
+                    if (flags & f) {
+                        offset += ReplayLog::fieldSize(f, _header.nmotors, _header.nchannels);
+                    }
+                }
+                return offset;
+            }
+
+            void copyField(size_t offset, uint8_t flag, void * dst)
+            {
+                memcpy(dst, _data + offset, ReplayLog::fieldSize(flag, _header.nmotors, _header.nchannels));
+            }
+
+            void checkMotors(void)
+            {
+                if (!(_flags & ReplayLog::HAVE_MOTORS) && !_motorsWritten) {
+                    return;
+                }
+
+                float recorded[ReplayLog::MAXMOTORS];
+                bool match = false;
+
+                if ((_flags & ReplayLog::HAVE_MOTORS) && _motorsWritten) {
+                    copyField(fieldOffset(_record, _flags, ReplayLog::HAVE_MOTORS), ReplayLog::HAVE_MOTORS, recorded);
+                    match = memcmp(recorded, _motors, _header.nmotors * sizeof(float)) == 0;
+                }
+
+                if (!match) {
+                    if (_mismatches == 0) {
+                        _firstMismatch = _records;
+                    }
+                    _mismatches++;
+                }
+            }
+
+            // Moves to the next record, returning false at the end of the log
+            bool advance(void)
+            {
+                if (_record != _next) {
+                    checkMotors();
+                }
+
+                if (_next + ReplayLog::RECORD_HEADER_SIZE > _size) {
+                    return false;
+                }
+
+                _record = _next;
+                memcpy(&_time, _data + _record, sizeof(uint32_t));
+                _flags = _data[_record + sizeof(uint32_t)];
+
+                _next = fieldOffset(_record, _flags, ReplayLog::HAVE_MOTORS << 1);
+                if (_next > _size) {
+                    _next = _record;
+                    return false;
+                }
+
+                if (_flags & ReplayLog::HAVE_EULER) _eulerAt = _record;
+                if (_flags & ReplayLog::HAVE_ACCEL) _accelAt = _record;
+                if (_flags & ReplayLog::HAVE_BARO)  _baroAt  = _record;
+                if (_flags & ReplayLog::HAVE_RC)    _rcAt    = _record;
+                _pending |= _flags;
+
+                _motorsWritten = false;
+                _records++;
+
+                return true;
+            }
+
+            // Hands out a pending field from the record that carried it
+            bool take(uint8_t flag, size_t record, void * dst)
+            {
+                if (!(_pending & flag)) {
+                    return false;
+                }
+                _pending &= ~flag;
+                uint8_t flags = _data[record + sizeof(uint32_t)];
+                copyField(fieldOffset(record, flags, flag), flag, dst);
+                return true;
+            }
+
+        public:
+
+            ReplayBoard(void) : _data(NULL), _size(0) { }
+
+            ~ReplayBoard(void)
+            {
+                close();
+            }
+
+            // Maps a log written by RecordingBoard; returns false if it can't be opened or isn't a replay log
+            bool open(const char * filename)
+            {
+                close();
+
+                int fd = ::open(filename, O_RDONLY);
+                if (fd < 0) {
+                    return false;
+                }
+
+                struct stat st;
+                if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(ReplayLog::header_t)) {
+                    ::close(fd);
+                    return false;
+                }
+
+                void * data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                ::close(fd);
+                if (data == MAP_FAILED) {
+                    return false;
+                }
+
+                // Records are read front to back; let the kernel read ahead
+                madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+                _data = (const uint8_t *)data;
+                _size = st.st_size;
+
+                memcpy(&_header, _data, sizeof(_header));
+
+                if (memcmp(_header.magic, "HFRP", 4) != 0 || _header.version != ReplayLog::VERSION ||
+                        _header.nmotors > ReplayLog::MAXMOTORS || _header.nchannels > ReplayLog::MAXCHANNELS) {
+                    close();
+                    return false;
+                }
+
+                return true;
+            }
+
+            void close(void)
+            {
+                if (_data) {
+                    munmap((void *)_data, _size);
+                    _data = NULL;
+                    _size = 0;
+                }
+            }
+
+            // True once every record has been replayed
+            bool done(void)
+            {
+                return _next + ReplayLog::RECORD_HEADER_SIZE > _size;
+            }
+
+            uint8_t channelCount(void)
+            {
+                return _header.nchannels;
+            }
+
+            // Gyro samples replayed so far
+            uint32_t recordCount(void)
+            {
+                return _records;
+            }
+
+            // Records whose motor outputs differed from the recording, and the first of them (counting from 1).
+            // The last record is checked once replay runs past the end of the log.
+            uint32_t mismatchCount(void)
+            {
+                return _mismatches;
+            }
+
+            uint32_t firstMismatch(void)
+            {
+                return _firstMismatch;
+            }
+
+            // Called by the ReplayReceiver
+            bool getReceiverFrame(float * rawvals, uint8_t nchannels, uint32_t & frameMicros)
+            {
+                if (!(_pending & ReplayLog::HAVE_RC)) {
+                    return false;
+                }
+
+                float channels[ReplayLog::MAXCHANNELS];
+                take(ReplayLog::HAVE_RC, _rcAt, channels);
+                memcpy(&frameMicros, _data + _rcAt, sizeof(uint32_t));
+
+                uint8_t n = nchannels < _header.nchannels ? nchannels : _header.nchannels;
+                memcpy(rawvals, channels, n * sizeof(float));
+                for (uint8_t k=n; k<nchannels; ++k) {
+                    rawvals[k] = 0;
+                }
+
+                return true;
+            }
+
+            // methods called by Hackflight -------------------------------------------------
+
+            void init(void)
+            {
+                _record = sizeof(ReplayLog::header_t);
+                _next = _record;
+                _time = _data ? _header.startMicros : 0;
+                _flags = 0;
+                _pending = 0;
+                _motorsWritten = false;
+                _records = 0;
+                _mismatches = 0;
+                _firstMismatch = 0;
+            }
+
+            // Each gyro sample moves replay on by one record
+            bool getGyroRates(float gyroRates[3])
+            {
+                if (!_data) {
+                    return false;
+                }
+
+                while (advance()) {
+                    if (take(ReplayLog::HAVE_GYRO, _record, gyroRates)) {
+                        return true;
+                    }
+                }
+
+                return false;
+            }
+
+            bool getEulerAngles(float eulerAngles[3])
+            {
+                return take(ReplayLog::HAVE_EULER, _eulerAt, eulerAngles);
+            }
+
+            bool getAccelerometer(float accelGs[3])
+            {
+                return take(ReplayLog::HAVE_ACCEL, _accelAt, accelGs);
+            }
+
+            bool getBarometer(float & pressure)
+            {
+                return take(ReplayLog::HAVE_BARO, _baroAt, &pressure);
+            }
+
+            uint32_t getMicroseconds()
+            {
+                return _time;
+            }
+
+            void writeMotor(uint8_t index, float value)
+            {
+                if (index < ReplayLog::MAXMOTORS) {
+                    _motors[index] = value;
+                    _motorsWritten = true;
+                }
+            }
+
+            void writeMotors(const float * values, uint8_t count)
+            {
+                memcpy(_motors, values, (count < ReplayLog::MAXMOTORS ? count : ReplayLog::MAXMOTORS) * sizeof(float));
+                _motorsWritten = true;
+            }
+
+            // Tasks take no time on the replay clock, so the scheduler never defers one and replay does not
+            // depend on how fast the host is.  (The default would count log time, which jumps a whole gyro
+            // period inside each gyro task.)
+            uint32_t getCycleCount(void)
+            {
+                return 0;
+            }
+
+    }; // class ReplayBoard
+
+} // namespace hf
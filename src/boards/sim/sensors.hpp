@@ -0,0 +1,168 @@
+/*
+   sensors.hpp: Sensor model for simulated boards
+
+   Samples a true value at the sensor's output data rate, adds Gaussian noise, and holds each sample in a delay
+   line for the transport latency (conversion, filtering, bus transfer) before the flight code can read it.
+   Everything runs off the board clock, so on a simulated clock the results are repeatable.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+namespace hf {
+
+    // xorshift32, so noise is repeatable and independent of the C library
+    class SimRandom {
+
+        public:
+
+            SimRandom(uint32_t seed=1)
+            {
+                init(seed);
+            }
+
+            void init(uint32_t seed)
+            {
+                _seed = seed ? seed : 1;
+            }
+
+            uint32_t next(void)
+            {
+                _seed ^= _seed << 13;
+                _seed ^= _seed >> 17;
+                _seed ^= _seed << 5;
+                return _seed;
+            }
+
+            // In [0,1)
+            float uniform(void)
+            {
+                return (next() >> 8) * (1.0f / 16777216.0f);
+            }
+
+            // Box-Muller, with zero mean and unit standard deviation
+            float gaussian(void)
+            {
+                float u1 = uniform();
+                float u2 = uniform();
+                return sqrtf(-2 * logf(u1 > 0 ? u1 : 1e-7f)) * cosf(2 * (float)M_PI * u2);
+            }
+
+        private:
+
+            uint32_t _seed;
+
+    }; // class SimRandom
+
+    template <uint8_t N>
+    class SimSensor {
+
+        public:
+
+            // Samples in flight at once; enough for a latency of DEPTH-1 sample periods
+            static const uint16_t DEPTH = 64;
+
+            SimSensor(void) : _enabled(false) { }
+
+            // An ODR of zero samples on every update; noise is the standard deviation added to each axis
+            void init(float odrHz, uint32_t latencyMicros, float noise, uint32_t seed=1)
+            {
+                _periodMicros = odrHz > 0 ? (uint32_t)(1e6f / odrHz + 0.5f) : 0;
+                _latencyMicros = latencyMicros;
+                _noise = noise;
+                _random.init(seed);
+                _started = false;
+                _oldest = 0;
+                _count = 0;
+                _enabled = true;
+            }
+
+            bool enabled(void)
+            {
+                return _enabled;
+            }
+
+            // Called on every physics step with the true value
+            void update(uint32_t usec, const float truth[N])
+            {
+                if (_started && (int32_t)(usec - _nextSampleMicros) < 0) {
+                    return;
+                }
+
+                // Keep the sampling phase, unless we have fallen a whole period behind
+                _nextSampleMicros = (_started && (int32_t)(usec - _nextSampleMicros) < (int32_t)_periodMicros) ?
+                    _nextSampleMicros + _periodMicros : usec + _periodMicros;
+                _started = true;
+
+                // A full delay line drops the oldest sample
+                if (_count == DEPTH) {
+                    _oldest = (_oldest + 1) % DEPTH;
+                    _count--;
+                }
+
+                sample_t & s = _delay[(_oldest + _count++) % DEPTH];
+                s.readyMicros = usec + _latencyMicros;
+                for (uint8_t k=0; k<N; ++k) {
+                    s.value[k] = truth[k] + (_noise > 0 ? _noise * _random.gaussian() : 0);
+                }
+            }
+
+            // Gets the newest sample whose latency has elapsed, if there is one not yet read
+            bool read(uint32_t usec, float value[N])
+            {
+                bool got = false;
+
+                while (_count > 0 && (int32_t)(usec - _delay[_oldest].readyMicros) >= 0) {
+                    memcpy(value, _delay[_oldest].value, N*sizeof(float));
+                    _oldest = (_oldest + 1) % DEPTH;
+                    _count--;
+                    got = true;
+                }
+
+                return got;
+            }
+
+        private:
+
+            typedef struct {
+
+                uint32_t readyMicros;
+                float    value[N];
+
+            } sample_t;
+
+            bool     _enabled;
+            uint32_t _periodMicros;
+            uint32_t _latencyMicros;
+            float    _noise;
+
+            bool     _started;
+            uint32_t _nextSampleMicros;
+
+            SimRandom _random;
+
+            // Delay line, oldest sample first
+            sample_t _delay[DEPTH];
+            uint16_t _oldest;
+            uint16_t _count;
+
+    }; // class SimSensor
+
+} // namespace hf
@@ -0,0 +1,214 @@
+/*
+   sharedstate.hpp: Shared-memory channel between a simulated board and external visualizers or simulators
+
+   SimBoard publishes the vehicle state here on every physics step; visualizers, plotters, and game-engine front
+   ends map the same segment and read it at their own rate, without copies through sockets and without ever
+   blocking the flight loop.  An optional command block lets an external program inject stick inputs, read by
+   SharedMemoryReceiver (receivers/sim/shared.hpp).
+
+   Both blocks are seqlocks with a single writer.  Segment layout (host byte order; all floats are 32-bit):
+
+       offset  0: magic 'HFSM' (u32), version (u32)
+       offset  8: state sequence (u32), then time usec (u32), gyro rates [3], translation rates [3],
+                  position [3], Euler angles [3], motors [4]
+       offset 96: command sequence (u32), then raw channels [8] in [-1,+1]
+
+   A writer makes the sequence odd, writes the data, then makes it even again (one greater than odd).  A reader
+   copies the data between two reads of an even sequence and retries if they differ.
+
+   On Linux the segment is a POSIX shared-memory object (e.g. /dev/shm/hackflight); on Windows it is a named file
+   mapping.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <new>
+#include <atomic>
+
+#include <seqlock.hpp>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+namespace hf {
+
+    class SimStateChannel {
+
+        public:
+
+            static const uint32_t MAGIC   = 0x4D534648; // 'HFSM'
+            static const uint32_t VERSION = 1;
+
+            static const uint8_t  CHANNELS = 8;
+
+            typedef struct {
+
+                uint32_t timeMicros;
+                float    gyroRates[3];
+                float    translationRates[3];
+                float    position[3];
+                float    eulerAngles[3];
+                float    motors[4];
+
+            } state_t;
+
+            typedef struct {
+
+                float    rawvals[CHANNELS];
+
+            } command_t;
+
+        private:
+
+            typedef struct {
+
+                uint32_t           magic;
+                uint32_t           version;
+                SeqLock<state_t>   state;
+                uint8_t            pad[96 - 8 - sizeof(SeqLock<state_t>)];
+                SeqLock<command_t> command;
+
+            } segment_t;
+
+            segment_t * _segment;
+
+            char _name[64];
+
+#if defined(_WIN32)
+            HANDLE _mapping;
+#endif
+
+        public:
+
+            SimStateChannel(void) : _segment(NULL) { }
+
+            ~SimStateChannel(void)
+            {
+                close();
+            }
+
+            // Creates (or reuses) the named segment and starts it with zero state and no commands
+            bool create(const char * name)
+            {
+                close();
+
+                void * memory = NULL;
+
+#if defined(_WIN32)
+                _mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, sizeof(segment_t), name);
+                if (!_mapping) {
+                    return false;
+                }
+                memory = MapViewOfFile(_mapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(segment_t));
+                if (!memory) {
+                    CloseHandle(_mapping);
+                    return false;
+                }
+#else
+                snprintf(_name, sizeof(_name), "/%s", name);
+                int fd = shm_open(_name, O_CREAT | O_RDWR, 0644);
+                if (fd < 0) {
+                    return false;
+                }
+                if (ftruncate(fd, sizeof(segment_t)) < 0) {
+                    ::close(fd);
+                    return false;
+                }
+                memory = mmap(NULL, sizeof(segment_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                ::close(fd);
+                if (memory == MAP_FAILED) {
+                    return false;
+                }
+#endif
+
+                _segment = new (memory) segment_t();
+                _segment->version = VERSION;
+
+                // Readers check the magic number last, once everything else is in place
+                std::atomic_thread_fence(std::memory_order_release);
+                _segment->magic = MAGIC;
+
+                return true;
+            }
+
+            // Unmaps the segment; it stays around for readers until they let go of it too
+            void close(void)
+            {
+                if (!_segment) {
+                    return;
+                }
+#if defined(_WIN32)
+                UnmapViewOfFile(_segment);
+                CloseHandle(_mapping);
+#else
+                munmap(_segment, sizeof(segment_t));
+#endif
+                _segment = NULL;
+            }
+
+            // Removes the named segment (Linux); call when no reader should find it any more
+            void unlink(void)
+            {
+#if !defined(_WIN32)
+                shm_unlink(_name);
+#endif
+            }
+
+            bool isOpen(void)
+            {
+                return _segment != NULL;
+            }
+
+            // Called by the board on each physics step; never blocks
+            void publish(const state_t & state)
+            {
+                if (_segment) {
+                    _segment->state.write(state);
+                }
+            }
+
+            // Reads injected sticks, returning the command sequence number: zero if nothing has been sent, and
+            // changing whenever a new command arrives
+            uint32_t readCommand(command_t & command)
+            {
+                return _segment ? _segment->command.read(command) : 0;
+            }
+
+            // In-process writers (tests, or a front end linked into the same program) can inject sticks directly
+            void writeCommand(const command_t & command)
+            {
+                if (_segment) {
+                    _segment->command.write(command);
+                }
+            }
+
+            uint32_t commandSequence(void)
+            {
+                return _segment ? _segment->command.sequence() : 0;
+            }
+
+    }; // class SimStateChannel
+
+} // namespace hf
@@ -23,15 +23,21 @@
 #pragma once
 
 #include <board.hpp>
+#include <boards/sim/sensors.hpp>
+#include <boards/sim/sharedstate.hpp>
+#include <sonars.hpp>
 #include <debug.hpp>
 #include <datatypes.hpp>
 
 #include <time.h>
 #include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
 
 namespace hf {
 
-    class SimBoard : public Board {
+    class SimBoard final : public Board {
 
         private:
 
@@ -56,15 +62,401 @@ namespace hf {
             float    _translationRates[3]; // local (body) frame
             float    _position[3];
             float    _motors[4];           // arbitrary in [0,1]
+            float    _motorScales[4];      // thrust of each motor relative to nominal
             bool     _flying;
-            float    _secondsPrev;
+            double   _secondsPrev;
             uint64_t _cycle;               // helps mock up different output data rates (ODRs)
 
+            // Simulated clock: when step is nonzero, time advances by a fixed amount on each gyro sample
+            uint32_t _simStepMicros;
+            uint64_t _simMicros;
+
+            // Pacing of the simulated clock to the wall clock, when on: the wall-clock time of simulated time zero,
+            // and the passes that started late
+            bool     _paced;
+
+            // Cycle counter stopped, so that the flight code takes no time
+            bool     _stoppedCycles;
+            uint64_t _pacedStartNanos;
+            uint32_t _overruns;
+            uint32_t _maxLatenessMicros;
+
+            // A pass this late gives up on catching up, and the schedule restarts from now
+            static const uint32_t PACE_RESYNC_MICROS = 100000;
+
+            // Copies of the board, e.g. forks of a simulation checkpoint, share the files and channel below
+
+            // Blackbox log file, if any
+            FILE *   _blackboxFile;
+
+            // Binary debug log file, if any; otherwise debug messages are formatted to the console
+            FILE *   _debugLogFile;
+
+            // Where calibration is kept between runs, if anywhere
+            const char * _calibrationPath;
+
+            // Shared-memory channel to external visualizers, if any
+            SimStateChannel * _stateChannel;
+
+            // Physics integration
+            uint8_t  _integrator;
+            uint8_t  _substeps;
+
+            // Sensor models; a sensor that hasn't been given one reads the true state on a fixed cycle pattern
+            SimSensor<3> _gyroSensor;
+            SimSensor<3> _eulerSensor;
+            SimSensor<3> _accelSensor;
+            SimSensor<1> _baroSensor;
+
+            // Gusts, if any: roll and pitch rate (rad/s) and vertical acceleration (m/s^2) disturbances, each a
+            // first-order Gauss-Markov process
+            bool      _gusting;
+            float     _gustSigmas[3];
+            float     _gustTauSeconds;
+            float     _gusts[3];
+            SimRandom _gustRandom;
+
+            void updateGusts(float deltaSeconds)
+            {
+                float a = expf(-deltaSeconds / _gustTauSeconds);
+                float b = sqrtf(1 - a*a);
+                for (uint8_t k=0; k<3; ++k) {
+                    _gusts[k] = a * _gusts[k] + b * _gustSigmas[k] * _gustRandom.gaussian();
+                }
+            }
+
+            // Downward sonar, if any, run by the same round-robin code as a real board; its echo edges are
+            // delivered on the physics step in which they would have happened
+            static constexpr float SONAR_MOUNT_CM = 5;
+            SonarArray<1> _sonars;
+            uint16_t      _sonarMaxRange;
+            uint8_t       _sonarEdges;
+            uint32_t      _sonarRiseMicros;
+            uint32_t      _sonarFallMicros;
+
+            void updateSonar(uint32_t usec)
+            {
+                if (_sonarEdges == 2 && (int32_t)(usec - _sonarRiseMicros) >= 0) {
+                    _sonars.echoEdge(0, true, _sonarRiseMicros);
+                    _sonarEdges = 1;
+                }
+                if (_sonarEdges == 1 && (int32_t)(usec - _sonarFallMicros) >= 0) {
+                    _sonars.echoEdge(0, false, _sonarFallMicros);
+                    _sonarEdges = 0;
+                }
+            }
+
+            void updateSensors(float thrust)
+            {
+                uint32_t usec = getMicroseconds();
+
+                if (_gyroSensor.enabled()) {
+                    _gyroSensor.update(usec, _gyroRates);
+                }
+
+                if (_eulerSensor.enabled()) {
+                    _eulerSensor.update(usec, _eulerAngles);
+                }
+
+                // Specific force in the body frame, in Gs: thrust along the body Z axis once flying, the ground
+                // pushing back against gravity before that
+                if (_accelSensor.enabled()) {
+                    float accel[3];
+                    if (_flying) {
+                        accel[0] = 0;
+                        accel[1] = 0;
+                        accel[2] = thrust / GRAVITY;
+                    }
+                    else {
+                        float phi = _eulerAngles[0], theta = _eulerAngles[1];
+                        accel[0] = -sin(theta);
+                        accel[1] = sin(phi) * cos(theta);
+                        accel[2] = cos(phi) * cos(theta);
+                    }
+                    _accelSensor.update(usec, accel);
+                }
+
+                if (_baroSensor.enabled()) {
+                    float pressure = altitudeToPressure(_position[2]);
+                    _baroSensor.update(usec, &pressure);
+                }
+
+                if (_sonarMaxRange) {
+                    updateSonar(usec);
+                }
+            }
+
+            void publishState(void)
+            {
+                SimStateChannel::state_t state;
+                state.timeMicros = getMicroseconds();
+                memcpy(state.gyroRates, _gyroRates, 3*sizeof(float));
+                memcpy(state.translationRates, _translationRates, 3*sizeof(float));
+                memcpy(state.position, _position, 3*sizeof(float));
+                memcpy(state.eulerAngles, _eulerAngles, 3*sizeof(float));
+                memcpy(state.motors, _motors, 4*sizeof(float));
+                _stateChannel->publish(state);
+            }
+
+            // The integrated state, packed for the RK4 stages: Euler angles, translation rates, position
+            enum {
+                STATE_EULER    = 0,
+                STATE_VELOCITY = 3,
+                STATE_POSITION = 6,
+                STATE_SIZE     = 9
+            };
+
+            void getState(float x[STATE_SIZE])
+            {
+                memcpy(&x[STATE_EULER],    _eulerAngles,      3*sizeof(float));
+                memcpy(&x[STATE_VELOCITY], _translationRates, 3*sizeof(float));
+                memcpy(&x[STATE_POSITION], _position,         3*sizeof(float));
+            }
+
+            void setState(const float x[STATE_SIZE])
+            {
+                memcpy(_eulerAngles,      &x[STATE_EULER],    3*sizeof(float));
+                memcpy(_translationRates, &x[STATE_VELOCITY], 3*sizeof(float));
+                memcpy(_position,         &x[STATE_POSITION], 3*sizeof(float));
+            }
+
+            // State derivative for fixed motor outputs (hence fixed gyro rates and thrust) over a step
+            void derivative(const float x[STATE_SIZE], float thrust, float lift, float dxdt[STATE_SIZE])
+            {
+                // Euler angles follow the gyro, negating pitch
+                for (uint8_t k=0; k<3; ++k) {
+                    dxdt[STATE_EULER+k] = ((k==1) ? -1 : +1) * _gyroRates[k];
+                }
+
+                // Vertical force, plus thrust along vehicle coordinates for forward and lateral speeds
+                if (_flying) {
+                    dxdt[STATE_VELOCITY+0] = thrust * sin(x[STATE_EULER+1]);
+                    dxdt[STATE_VELOCITY+1] = thrust * sin(x[STATE_EULER+0]);
+                    dxdt[STATE_VELOCITY+2] = lift;
+                }
+                else {
+                    dxdt[STATE_VELOCITY+0] = 0;
+                    dxdt[STATE_VELOCITY+1] = 0;
+                    dxdt[STATE_VELOCITY+2] = 0;
+                }
+
+                // Speed gives position
+                for (uint8_t k=0; k<3; ++k) {
+                    dxdt[STATE_POSITION+k] = x[STATE_VELOCITY+k];
+                }
+            }
+
+            // Semi-implicit Euler: speeds from the old attitude, then position from the new speeds
+            void stepEuler(float thrust, float lift, float deltaSeconds)
+            {
+                // Rename Euler angles to familiar Greek-letter variables
+                float phi   = _eulerAngles[0];
+                float theta = _eulerAngles[1];
+
+                if (_flying) {
+
+                    // Integrate vertical force to get vertical speed
+                    _translationRates[2] += (lift * deltaSeconds);
+
+                    // To get forward and lateral speeds, integrate thrust along vehicle coordinates
+                    _translationRates[0] += thrust * deltaSeconds * sin(theta);
+                    _translationRates[1] += thrust * deltaSeconds * sin(phi);
+                }
+
+                // Integrate speed to get position 
+                for (int8_t k=0; k<3; ++k) {
+                    _position[k] += _translationRates[k] * deltaSeconds;
+                }
+
+                // Integrate gyro to get eulerAngles, negating pitch
+                for (int k=0; k<3; ++k) {
+                    _eulerAngles[k] += ((k==1) ? -1 : +1) * _gyroRates[k] * deltaSeconds; 
+                }
+            }
+
+            // Classical fourth-order Runge-Kutta
+            void stepRk4(float thrust, float lift, float h)
+            {
+                float x[STATE_SIZE], xt[STATE_SIZE];
+                float k1[STATE_SIZE], k2[STATE_SIZE], k3[STATE_SIZE], k4[STATE_SIZE];
+
+                getState(x);
+
+                derivative(x, thrust, lift, k1);
+
+                for (uint8_t i=0; i<STATE_SIZE; ++i) xt[i] = x[i] + h/2 * k1[i];
+                derivative(xt, thrust, lift, k2);
+
+                for (uint8_t i=0; i<STATE_SIZE; ++i) xt[i] = x[i] + h/2 * k2[i];
+                derivative(xt, thrust, lift, k3);
+
+                for (uint8_t i=0; i<STATE_SIZE; ++i) xt[i] = x[i] + h * k3[i];
+                derivative(xt, thrust, lift, k4);
+
+                for (uint8_t i=0; i<STATE_SIZE; ++i) {
+                    x[i] += h/6 * (k1[i] + 2*k2[i] + 2*k3[i] + k4[i]);
+                }
+
+                setState(x);
+            }
+
             // Gets CPU time in seconds
             void cputime(struct timespec * tv);
 
+            // Monotonic wall-clock time in nanoseconds, and a sleep until such a time, for pacing
+            uint64_t wallclockNanos(void);
+            void     sleepUntilNanos(uint64_t deadline);
+
         public:
 
+            typedef enum {
+                INTEGRATOR_EULER,  // semi-implicit Euler: cheapest, but drifts and can go unstable with big steps
+                INTEGRATOR_RK4     // fourth-order Runge-Kutta: four derivative evaluations per substep
+            } integrator_t;
+
+            // Default to CPU time; passing a gyro rate in Hz runs physics on a deterministic simulated clock,
+            // which lets the simulator run faster than real time and give the same result every run
+            SimBoard(uint32_t simulatedGyroRate=0)
+            {
+                _simStepMicros = simulatedGyroRate ? 1000000 / simulatedGyroRate : 0;
+                _simMicros = 0;
+                _blackboxFile = NULL;
+                _debugLogFile = NULL;
+                _calibrationPath = NULL;
+                _stateChannel = NULL;
+                _sonarMaxRange = 0;
+                _integrator = INTEGRATOR_EULER;
+                _substeps = 1;
+                _paced = false;
+                _stoppedCycles = false;
+                _pacedStartNanos = 0;
+                _overruns = 0;
+                _maxLatenessMicros = 0;
+                _gusting = false;
+                for (uint8_t k=0; k<4; ++k) {
+                    _motorScales[k] = 1;
+                }
+            }
+
+            bool simUsingSimulatedTime(void)
+            {
+                return _simStepMicros > 0;
+            }
+
+            // Paces the simulated clock to the wall clock, for flying interactively: after each pass, the board
+            // sleeps to the absolute time its next gyro sample is due, so the loop runs at the simulated gyro rate
+            // and leaves the CPU idle otherwise.  A pass that overruns is followed at once by the next, until the
+            // schedule catches up.  Needs a simulated gyro rate; call before Hackflight::init().
+            void simSetPaced(bool paced=true)
+            {
+                _paced = paced && simUsingSimulatedTime();
+            }
+
+            // Stops the cycle counter, so that on the simulated clock the flight code takes no time at all: the
+            // scheduler then never defers a task for want of budget, and a run no longer depends on how busy the
+            // host is, but is the same every time.  Profiler timings read zero, and the CPU load never gets a
+            // window.  Needs a simulated gyro rate.
+            void simSetStoppedCycles(bool stopped=true)
+            {
+                _stoppedCycles = stopped && simUsingSimulatedTime();
+            }
+
+            // Passes that ran past the time the next one was due, and the latest any was
+            void simGetPacing(uint32_t & overruns, uint32_t & maxLatenessMicros)
+            {
+                overruns = _overruns;
+                maxLatenessMicros = _maxLatenessMicros;
+            }
+
+            // Chooses how physics is integrated over each gyro period, divided into substeps equal steps.  Pairs
+            // a coarse controller step (a low simulated gyro rate, for speed) with accurate physics.
+            void simSetIntegrator(integrator_t integrator, uint8_t substeps=1)
+            {
+                _integrator = integrator;
+                _substeps = substeps ? substeps : 1;
+            }
+
+            typedef enum {
+                SENSOR_GYRO,
+                SENSOR_EULER,
+                SENSOR_ACCEL,
+                SENSOR_BARO
+            } sensor_t;
+
+            // Models a sensor's output data rate (Hz; for the gyro, zero reads every physics step), the latency
+            // from sampling to the data being readable, and noise (standard deviation in rad/s, rad, G, or mbar),
+            // on the board clock.  For example, the Ladybug's EM7180 with qRateDivisor 5 at a 330 Hz gyro gives
+            // quaternions at 66 Hz.
+            void simSetSensorModel(sensor_t sensor, float odrHz, uint32_t latencyMicros, float noise=0, uint32_t seed=1)
+            {
+                // Give each sensor its own noise sequence
+                seed += (uint32_t)sensor * 0x9E3779B9u;
+
+                switch (sensor) {
+                    case SENSOR_GYRO:
+                        _gyroSensor.init(odrHz, latencyMicros, noise, seed);
+                        break;
+                    case SENSOR_EULER:
+                        _eulerSensor.init(odrHz, latencyMicros, noise, seed);
+                        break;
+                    case SENSOR_ACCEL:
+                        _accelSensor.init(odrHz, latencyMicros, noise, seed);
+                        break;
+                    case SENSOR_BARO:
+                        _baroSensor.init(odrHz, latencyMicros, noise, seed);
+                        break;
+                }
+            }
+
+            // Thrust of each motor relative to nominal, for mismatched motors and props
+            void simSetMotorScales(const float scales[4])
+            {
+                memcpy(_motorScales, scales, 4*sizeof(float));
+            }
+
+            // Random gusts: roll/pitch rate and vertical acceleration sigmas (rad/s, m/s^2), lasting about tauSeconds
+            void simSetGusts(float rateSigma, float accelSigma, float tauSeconds, uint32_t seed=1)
+            {
+                _gustSigmas[0] = rateSigma;
+                _gustSigmas[1] = rateSigma;
+                _gustSigmas[2] = accelSigma;
+                _gustTauSeconds = tauSeconds;
+                memset(_gusts, 0, sizeof(_gusts));
+                _gustRandom.init(seed);
+                _gusting = true;
+            }
+
+            // Adds a downward sonar reading up to maxRange cm; call before Hackflight::init()
+            void simSetSonar(uint16_t maxRange=400)
+            {
+                _sonarMaxRange = maxRange;
+            }
+
+            // Call before Hackflight::init() to record flights to a file (opened for binary writing)
+            void simSetBlackboxFile(FILE * fp)
+            {
+                _blackboxFile = fp;
+            }
+
+            // Call before Hackflight::init() to record DebugLog messages unformatted (opened for binary writing), for
+            // extras/debuglog/dldecode.py
+            void simSetDebugLogFile(FILE * fp)
+            {
+                _debugLogFile = fp;
+            }
+
+            // Call before Hackflight::init() to keep calibration in a file, standing in for a real board's EEPROM
+            void simSetCalibrationFile(const char * path)
+            {
+                _calibrationPath = path;
+            }
+
+            // Publishes the vehicle state to the channel on every physics step; the channel must outlive the board
+            void simSetStateChannel(SimStateChannel * channel)
+            {
+                _stateChannel = channel;
+            }
+
             // accessor available to simulators -----------------------------------------------
 
             void simGetVehicleState(float gyroRates[3], float translationRates[3], float motors[4])
@@ -74,6 +466,13 @@ namespace hf {
                 memcpy(motors, _motors, 4*sizeof(float));
             }
 
+            void simGetVehicleState(float gyroRates[3], float translationRates[3], float position[3], float eulerAngles[3], float motors[4])
+            {
+                simGetVehicleState(gyroRates, translationRates, motors);
+                memcpy(position, _position, 3*sizeof(float));
+                memcpy(eulerAngles, _eulerAngles, 3*sizeof(float));
+            }
+
             // methods called by Hackflight -------------------------------------------------
 
             // Init physics
@@ -88,6 +487,40 @@ namespace hf {
                 _flying = false;
                 _verticalSpeedPrev = 0;
                 _cycle = 0;
+                _simMicros = 0;
+                _sonars.init(0, 2, _sonarMaxRange);
+                _sonarEdges = 0;
+                _pacedStartNanos = _paced ? wallclockNanos() : 0;
+                _overruns = 0;
+                _maxLatenessMicros = 0;
+            }
+
+            // When paced, sleeps till the wall-clock time of the simulated clock, when the next gyro sample is due;
+            // each pass advances the clock by one gyro period
+            void idle(uint32_t maxMicros)
+            {
+                (void)maxMicros;
+
+                if (!_paced) {
+                    return;
+                }
+
+                uint64_t deadline = _pacedStartNanos + _simMicros * 1000;
+                uint64_t now = wallclockNanos();
+
+                if (now > deadline) {
+                    uint64_t lateness = (now - deadline) / 1000;
+                    _overruns++;
+                    if (lateness > _maxLatenessMicros) {
+                        _maxLatenessMicros = lateness > UINT32_MAX ? UINT32_MAX : (uint32_t)lateness;
+                    }
+                    if (lateness > PACE_RESYNC_MICROS) {
+                        _pacedStartNanos += now - deadline;
+                    }
+                    return;
+                }
+
+                sleepUntilNanos(deadline);
             }
 
             // Sync physics update to gyro acquisition
@@ -99,59 +532,72 @@ namespace hf {
                 _gyroRates[2] = motorsToAngularVelocity(1, 2, 0, 3); 
 
                 // Overall thrust vector, scaled by arbitrary constant for realism
-                float thrust = THRUST_SCALE * (_motors[0] + _motors[1] + _motors[2] + _motors[3]);
-
-                // Rename Euler angles to familiar Greek-letter variables
-                float phi   = _eulerAngles[0];
-                float theta = _eulerAngles[1];
+                float thrust = THRUST_SCALE * (motor(0) + motor(1) + motor(2) + motor(3));
 
                 // Overall vertical force = thrust - gravity
                 float lift = thrust - GRAVITY;
 
+                // Advance simulated clock by one gyro period
+                _simMicros += _simStepMicros;
+
                 // Compute delta seconds
-                float secondsCurr = seconds();
+                double secondsCurr = seconds();
                 float deltaSeconds = secondsCurr - _secondsPrev;
                 _secondsPrev = secondsCurr;
 
+                // Gusts blow only once off the ground
+                if (_gusting && _flying) {
+                    updateGusts(deltaSeconds);
+                    _gyroRates[0] += _gusts[0];
+                    _gyroRates[1] += _gusts[1];
+                    lift += _gusts[2];
+                }
+
                 // Once there's enough lift, we're flying
                 if (lift > NOISE_FLOOR) {
                     _flying = true;
                 }
 
-                if (_flying) {
-
-                    // Integrate vertical force to get vertical speed
-                    _translationRates[2] += (lift * deltaSeconds);
-
-                    // To get forward and lateral speeds, integrate thrust along vehicle coordinates
-                    _translationRates[0] += thrust * deltaSeconds * sin(theta);
-                    _translationRates[1] += thrust * deltaSeconds * sin(phi);
-                }
-
-                // Integrate speed to get position 
-                for (int8_t k=0; k<3; ++k) {
-                    _position[k] += _translationRates[k] * deltaSeconds;
-                }
-
-                // Integrate gyro to get eulerAngles, negating pitch
-                for (int k=0; k<3; ++k) {
-                    _eulerAngles[k] += ((k==1) ? -1 : +1) * _gyroRates[k] * deltaSeconds; 
+                // Integrate over the elapsed time in equal substeps
+                float h = deltaSeconds / _substeps;
+                for (uint8_t k=0; k<_substeps; ++k) {
+                    if (_integrator == INTEGRATOR_RK4) {
+                        stepRk4(thrust, lift, h);
+                    }
+                    else {
+                        stepEuler(thrust, lift, h);
+                    }
                 }
 
                 // Differentiate vertical speed to get vertical acceleration in meters per second, then convert to Gs.
                 // Resting = 1G; freefall = 0; climbing = >1G
                 _verticalSpeedPrev = _translationRates[2];
 
-                memcpy(gyroRates, _gyroRates, 3*sizeof(float));
-
                 // Increase cycle counter for ODR mockup
                 _cycle++;
 
+                // Feed modeled sensors the true state
+                updateSensors(thrust);
+
+                if (_stateChannel) {
+                    publishState();
+                }
+
+                if (_gyroSensor.enabled()) {
+                    return _gyroSensor.read(getMicroseconds(), gyroRates);
+                }
+
+                memcpy(gyroRates, _gyroRates, 3*sizeof(float));
+
                 return true;
             }
 
             bool getEulerAngles(float eulerAngles[3]) {
 
+                if (_eulerSensor.enabled()) {
+                    return _eulerSensor.read(getMicroseconds(), eulerAngles);
+                }
+
                 if (_cycle % 5 == 0) {
                     memcpy(eulerAngles, _eulerAngles, 3*sizeof(float));
                     return true;
@@ -161,6 +607,10 @@ namespace hf {
 
             bool getAccelerometer(float accelGs[3]) 
             { 
+                if (_accelSensor.enabled()) {
+                    return _accelSensor.read(getMicroseconds(), accelGs);
+                }
+
                 // XXX need to compute actual values based on thrust and Euler angles
                 accelGs[0] = 0;
                 accelGs[1] = 0;
@@ -173,6 +623,10 @@ namespace hf {
 
             bool getBarometer(float & pressure) 
             {
+                if (_baroSensor.enabled()) {
+                    return _baroSensor.read(getMicroseconds(), &pressure);
+                }
+
                 // Normal situation: flying, so return simulated pressure periodically
                 if (_flying) {
                     if (_cycle % 2 == 0) {
@@ -188,9 +642,31 @@ namespace hf {
                 return true;
             }
 
+            bool getSonarAltitude(float & distance, uint32_t & timestamp)
+            {
+                if (!_sonarMaxRange) {
+                    return false;
+                }
+
+                uint32_t usec = getMicroseconds();
+
+                // Pinged: the echo starts half a msec later and lasts the round trip of the slant range, if the
+                // ground is close enough to answer at all
+                if (_sonars.update(usec) != SonarArray<1>::NONE) {
+                    float range = (100 * _position[2] + SONAR_MOUNT_CM) / (cos(_eulerAngles[0]) * cos(_eulerAngles[1]));
+                    if (range <= _sonarMaxRange) {
+                        _sonarRiseMicros = usec + 500;
+                        _sonarFallMicros = _sonarRiseMicros + (uint32_t)(range / SonarArray<1>::CM_PER_MICROSECOND);
+                        _sonarEdges = 2;
+                    }
+                }
+
+                return _sonars.getDistance(0, distance, timestamp);
+            }
+
             uint32_t getMicroseconds()
             {
-                return seconds() * 1000000;
+                return simUsingSimulatedTime() ? (uint32_t)_simMicros : (uint32_t)(seconds() * 1000000);
             }
 
             void writeMotor(uint8_t index, float value)
@@ -198,6 +674,67 @@ namespace hf {
                 _motors[index] = value;
             }
 
+            void writeMotors(const float * values, uint8_t count)
+            {
+                memcpy(_motors, values, (count < 4 ? count : 4)*sizeof(float));
+            }
+
+            bool hasBlackbox(void)
+            {
+                return _blackboxFile != NULL;
+            }
+
+            uint16_t blackboxWrite(const uint8_t * buf, uint16_t len)
+            {
+                return fwrite(buf, 1, len, _blackboxFile);
+            }
+
+            bool hasDebugLog(void)
+            {
+                return _debugLogFile != NULL;
+            }
+
+            uint16_t debugLogWrite(const uint8_t * buf, uint16_t len)
+            {
+                return fwrite(buf, 1, len, _debugLogFile);
+            }
+
+            uint16_t calibrationRead(uint8_t * buf, uint16_t len)
+            {
+                FILE * fp = _calibrationPath ? fopen(_calibrationPath, "rb") : NULL;
+                if (!fp) {
+                    return 0;
+                }
+                uint16_t n = fread(buf, 1, len, fp);
+                fclose(fp);
+                return n;
+            }
+
+            void calibrationWrite(const uint8_t * buf, uint16_t len)
+            {
+                FILE * fp = _calibrationPath ? fopen(_calibrationPath, "wb") : NULL;
+                if (fp) {
+                    fwrite(buf, 1, len, fp);
+                    fclose(fp);
+                }
+            }
+
+            // Host cycle counter for profiling: nanoseconds of wall-clock time, unless stopped
+            uint32_t getCycleCount(void)
+            {
+                if (_stoppedCycles) {
+                    return 0;
+                }
+
+                return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now().time_since_epoch()).count();
+            }
+
+            uint32_t getCyclesPerMicrosecond(void)
+            {
+                return 1000;
+            }
+
         private:
 
             // https://www.math24.net/barometric-formula (but in mbar)
@@ -206,15 +743,24 @@ namespace hf {
                 return 1013.25 * exp (-0.00012 * h); 
             }
 
+            float motor(uint8_t index)
+            {
+                return _motors[index] * _motorScales[index];
+            }
+
             float motorsToAngularVelocity(int a, int b, int c, int d)
             {
-                float v = ((_motors[a] + _motors[b]) - (_motors[c] + _motors[d]));
+                float v = ((motor(a) + motor(b)) - (motor(c) + motor(d)));
 
                 return (v<0 ? -1 : +1) * pow(fabs(v), MOTOR_EXPONENT);
             }
 
-           float seconds()
+            double seconds()
             {
+                if (simUsingSimulatedTime()) {
+                    return _simMicros / 1.e6;
+                }
+
                 struct timespec t;
                 cputime(&t);
                 return t.tv_sec + t.tv_nsec/1.e9;
@@ -0,0 +1,476 @@
+/*
+   swarm.hpp: Many simulated vehicles stepped together, one array per state variable
+
+   SimSwarm flies N quadcopters through the same per-cycle sequence as a SimBoard on a simulated clock with a
+   Stabilizer and a MixerQuadX, the way each gyro cycle of the flight loop runs them:
+
+       SimBoard::getGyroRates()          physics step (semi-implicit Euler, one substep)
+       SimBoard::getEulerAngles()        every fifth cycle, as SimBoard reads the true angles
+       Stabilizer::updateEulerAngles()
+       Stabilizer::modifyDemands()       filters off, as they are until Stabilizer::initFilters()
+       MixerQuadX::runArmed()            armed vehicles only
+
+   but with each variable of each vehicle kept in its own array (structure of arrays), so each stage is a loop
+   over vehicles that the compiler can vectorize: eight at a time with AVX2, four with NEON.  The arithmetic is
+   written in the same order as the scalar code, and the few library calls (the motor-response power law and the
+   sines of the attitude angles) are the same ones, in a loop of their own, so a swarm vehicle matches a scalar
+   one bit for bit, as long as the compiler isn't left free to fuse multiplies and adds differently in the two
+   (-ffp-contract=off with GCC on FMA targets).  All vehicles share one clock and one set of gains; stick demands
+   and arming are per vehicle.  Vehicles never interact, so a big swarm splits naturally into one SimSwarm per
+   thread.
+
+   extras/simtest/linux/swarmtest.cpp checks the match and measures throughput.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <datatypes.hpp>
+#include <fixed.hpp>
+#include <gains.hpp>
+#include <mixer.hpp>
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+
+// Vehicles are independent, so no array in a loop over them overlaps another; compilers can't prove it
+#if defined(__clang__)
+#define SWARM_LOOP _Pragma("clang loop vectorize(assume_safety)")
+#elif defined(__GNUC__)
+#define SWARM_LOOP _Pragma("GCC ivdep")
+#else
+#define SWARM_LOOP
+#endif
+
+namespace hf {
+
+    class SimSwarm {
+
+        private:
+
+            // SimBoard's constants
+            const float GRAVITY        = 9.80665;
+            const float THRUST_SCALE   = 5.5;
+            const float NOISE_FLOOR    = 0.2;
+            const float MOTOR_EXPONENT = 3;
+
+            // Stabilizer's constants
+            const float gyroWindupMax  = 16.0f;
+            const float bigYawDemand   = 0.1f;
+            const float bigGyroRate    = M_PI * 40.0f / 180.;
+
+            typedef MixerQuadXTable<> Table;
+
+            uint32_t _count;
+
+            // Shared clock, as in SimBoard
+            uint32_t _simStepMicros;
+            uint64_t _simMicros;
+            double   _secondsPrev;
+            uint64_t _cycle;
+
+            // Shared gains
+            float _levelP;
+            float _gyroCyclicP;
+            float _gyroCyclicI;
+            float _gyroCyclicD;
+            float _gyroYawP;
+            float _gyroYawI;
+
+            // One array per variable, carved from a single allocation
+            std::vector<float>   _memory;
+            std::vector<int32_t> _flags;
+
+            // Physics
+            float * _eulerAngles[3];
+            float * _gyroRates[3];
+            float * _translationRates[3];
+            float * _position[3];
+            float * _motors[4];
+            int32_t * _flying;
+
+            // Stabilizer
+            float * _lastGyro[2];
+            float * _gyroDelta1[2];
+            float * _gyroDelta2[2];
+            float * _errorGyroI[3];
+            float * _PTerm[2];
+            float * _proportionalCyclicDemand;
+
+            // Receiver demands and arming
+            float * _throttle;
+            float * _roll;
+            float * _pitch;
+            float * _yaw;
+            int32_t * _armed;
+
+            // Per-step values handed from one loop to the next
+            float * _thrust;
+            float * _lift;
+            float * _sinTheta;
+            float * _sinPhi;
+
+            static const uint8_t FLOATS = 3+3+3+3+4 + 2+2+2+3+2+1 + 4 + 4;
+
+            // Keeps each array on its own 64-byte boundary
+            static uint32_t stride(uint32_t count)
+            {
+                return (count + 15) & ~15u;
+            }
+
+            float * carve(uint32_t & next)
+            {
+                float * p = &_memory[next];
+                next += stride(_count);
+                return p;
+            }
+
+            // Loops take members into locals, so the compiler needn't reload them after each store to an array
+            void stepPhysics(float deltaSeconds)
+            {
+                const uint32_t n = _count;
+                const float thrustScale = THRUST_SCALE, gravity = GRAVITY, noiseFloor = NOISE_FLOOR;
+
+                float * m0 = _motors[0];
+                float * m1 = _motors[1];
+                float * m2 = _motors[2];
+                float * m3 = _motors[3];
+                float * g0 = _gyroRates[0];
+                float * g1 = _gyroRates[1];
+                float * g2 = _gyroRates[2];
+                float * thrust = _thrust;
+                float * lift = _lift;
+                int32_t * flying = _flying;
+
+                // Differences between motors, thrust, lift, and liftoff
+                SWARM_LOOP
+                for (uint32_t i=0; i<n; ++i) {
+                    g0[i] = (m2[i] + m3[i]) - (m0[i] + m1[i]);
+                    g1[i] = (m1[i] + m3[i]) - (m0[i] + m2[i]);
+                    g2[i] = (m1[i] + m2[i]) - (m0[i] + m3[i]);
+                    thrust[i] = thrustScale * (m0[i] + m1[i] + m2[i] + m3[i]);
+                    lift[i] = thrust[i] - gravity;
+                    flying[i] |= lift[i] > noiseFloor;
+                }
+
+                // Library calls, which don't vectorize
+                float * phi = _eulerAngles[0];
+                float * theta = _eulerAngles[1];
+                float * sinPhi = _sinPhi;
+                float * sinTheta = _sinTheta;
+                for (uint32_t i=0; i<n; ++i) {
+                    g0[i] = motorResponse(g0[i]);
+                    g1[i] = motorResponse(g1[i]);
+                    g2[i] = motorResponse(g2[i]);
+                    if (flying[i]) {
+                        sinTheta[i] = sin(theta[i]);
+                        sinPhi[i] = sin(phi[i]);
+                    }
+                }
+
+                // Integrate
+                float * psi = _eulerAngles[2];
+                float * v0 = _translationRates[0];
+                float * v1 = _translationRates[1];
+                float * v2 = _translationRates[2];
+                float * x0 = _position[0];
+                float * x1 = _position[1];
+                float * x2 = _position[2];
+                SWARM_LOOP
+                for (uint32_t i=0; i<n; ++i) {
+                    int32_t f = flying[i];
+                    v2[i] = f ? v2[i] + lift[i] * deltaSeconds : v2[i];
+                    v0[i] = f ? v0[i] + thrust[i] * deltaSeconds * sinTheta[i] : v0[i];
+                    v1[i] = f ? v1[i] + thrust[i] * deltaSeconds * sinPhi[i] : v1[i];
+                    x0[i] += v0[i] * deltaSeconds;
+                    x1[i] += v1[i] * deltaSeconds;
+                    x2[i] += v2[i] * deltaSeconds;
+                    phi[i]   += g0[i] * deltaSeconds;
+                    theta[i] += -g1[i] * deltaSeconds;
+                    psi[i]   += g2[i] * deltaSeconds;
+                }
+            }
+
+            void updateEulerAngles(void)
+            {
+                const uint32_t n = _count;
+                const float levelP = _levelP;
+
+                float * p = _proportionalCyclicDemand;
+
+                for (uint8_t axis=0; axis<2; ++axis) {
+
+                    float * demand = axis ? _pitch : _roll;
+                    float * angle = _eulerAngles[axis];
+                    float * PTerm = _PTerm[axis];
+
+                    SWARM_LOOP
+                    for (uint32_t i=0; i<n; ++i) {
+                        float P = (demand[i] - angle[i]) * levelP;
+                        PTerm[i] = demand[i] * p[i] + P * (1 - p[i]);
+                    }
+                }
+            }
+
+            // Stabilizer::modifyDemands(), then MixerQuadX::runArmed()
+            void stabilizeAndMix(void)
+            {
+                const uint32_t n = _count;
+                const float cyclicP = _gyroCyclicP, cyclicI = _gyroCyclicI, cyclicD = _gyroCyclicD;
+                const float yawP = _gyroYawP, yawI = _gyroYawI;
+                const float windupMax = gyroWindupMax, bigRate = bigGyroRate, bigYaw = bigYawDemand;
+
+                float * g0 = _gyroRates[0];
+                float * g1 = _gyroRates[1];
+                float * g2 = _gyroRates[2];
+                float * throttle = _throttle;
+                float * rollDemand = _roll;
+                float * pitchDemand = _pitch;
+                float * yawDemand = _yaw;
+                float * p = _proportionalCyclicDemand;
+                float * last0 = _lastGyro[0];
+                float * last1 = _lastGyro[1];
+                float * d10 = _gyroDelta1[0];
+                float * d11 = _gyroDelta1[1];
+                float * d20 = _gyroDelta2[0];
+                float * d21 = _gyroDelta2[1];
+                float * i0 = _errorGyroI[0];
+                float * i1 = _errorGyroI[1];
+                float * i2 = _errorGyroI[2];
+                float * P0 = _PTerm[0];
+                float * P1 = _PTerm[1];
+                float * m0 = _motors[0];
+                float * m1 = _motors[1];
+                float * m2 = _motors[2];
+                float * m3 = _motors[3];
+                int32_t * armed = _armed;
+
+                SWARM_LOOP
+                for (uint32_t i=0; i<n; ++i) {
+
+                    float roll = cyclicPid(cyclicP, cyclicI, cyclicD, windupMax, bigRate,
+                            rollDemand[i], g0[i], p[i], P0[i], i0[i], last0[i], d10[i], d20[i]);
+                    float pitch = cyclicPid(cyclicP, cyclicI, cyclicD, windupMax, bigRate,
+                            pitchDemand[i], g1[i], p[i], P1[i], i1[i], last1[i], d11[i], d21[i]);
+
+                    float ITermGyroYaw = ITermGyro(yawP, yawI, windupMax, bigRate,
+                            yawDemand[i], g2[i], i2[i], numericAbs(yawDemand[i]) > bigYaw);
+                    float yaw = (yawDemand[i] - g2[i] * yawP) + ITermGyroYaw - 0.f;
+                    yaw = constrainAbs(yaw, 0.1f + numericAbs(yaw));
+
+                    float motors[4];
+                    for (uint8_t j=0; j<4; ++j) {
+                        motors[j] = throttle[i] * Table::table[j][0] + roll * Table::table[j][1] +
+                            pitch * Table::table[j][2] + yaw * Table::table[j][3];
+                    }
+
+                    float maxMotor = motors[0];
+                    for (uint8_t j=1; j<4; ++j) {
+                        maxMotor = motors[j] > maxMotor ? motors[j] : maxMotor;
+                    }
+
+                    for (uint8_t j=0; j<4; ++j) {
+                        motors[j] = maxMotor > 1 ? motors[j] - (maxMotor - 1) : motors[j];
+                        motors[j] = constrainMinMax(motors[j], 0, 1);
+                    }
+
+                    int32_t a = armed[i];
+                    m0[i] = a ? motors[0] : m0[i];
+                    m1[i] = a ? motors[1] : m1[i];
+                    m2[i] = a ? motors[2] : m2[i];
+                    m3[i] = a ? motors[3] : m3[i];
+                }
+            }
+
+            static float ITermGyro(float rateP, float rateI, float windupMax, float bigRate,
+                    float rcCommand, float gyro, float & errorGyroI, bool bigDemand)
+            {
+                float error = rcCommand*rateP - gyro;
+
+                errorGyroI = constrainAbs(errorGyroI + error, windupMax);
+
+                errorGyroI = (numericAbs(gyro) > bigRate) || bigDemand ? 0 : errorGyroI;
+
+                return errorGyroI * rateI;
+            }
+
+            static float cyclicPid(float rateP, float rateI, float rateD, float windupMax, float bigRate,
+                    float rcCommand, float gyro, float proportionalCyclicDemand, float PTerm, float & errorGyroI,
+                    float & lastGyro, float & gyroDelta1, float & gyroDelta2)
+            {
+                float ITerm = ITermGyro(rateP, rateI, windupMax, bigRate, rcCommand, gyro, errorGyroI, false);
+                ITerm *= proportionalCyclicDemand;
+
+                float gyroDelta = gyro - lastGyro;
+                lastGyro = gyro;
+                float gyroDeltaSum = gyroDelta1 + gyroDelta2 + gyroDelta;
+                gyroDelta2 = gyroDelta1;
+                gyroDelta1 = gyroDelta;
+                float DTerm = gyroDeltaSum * rateD;
+
+                return (PTerm - gyro * rateP) + ITerm - DTerm;
+            }
+
+            float motorResponse(float v)
+            {
+                return (v<0 ? -1 : +1) * pow(fabs(v), MOTOR_EXPONENT);
+            }
+
+            static float constrainMinMax(float val, float min, float max)
+            {
+                return (val<min) ? min : ((val>max) ? max : val);
+            }
+
+            static float constrainAbs(float val, float max)
+            {
+                return constrainMinMax(val, -max, max);
+            }
+
+        public:
+
+            // As SimBoard(simulatedGyroRate), with the gains of a Stabilizer (see Stabilizer::getGains())
+            SimSwarm(uint32_t count, uint32_t simulatedGyroRate, const gains_t & gains) :
+                _count(count), _memory(FLOATS * stride(count)), _flags(2 * stride(count))
+            {
+                _simStepMicros = 1000000 / simulatedGyroRate;
+
+                setGains(gains);
+
+                uint32_t next = 0;
+                for (uint8_t k=0; k<3; ++k) {
+                    _eulerAngles[k] = carve(next);
+                    _gyroRates[k] = carve(next);
+                    _translationRates[k] = carve(next);
+                    _position[k] = carve(next);
+                    _errorGyroI[k] = carve(next);
+                }
+                for (uint8_t k=0; k<4; ++k) {
+                    _motors[k] = carve(next);
+                }
+                for (uint8_t k=0; k<2; ++k) {
+                    _lastGyro[k] = carve(next);
+                    _gyroDelta1[k] = carve(next);
+                    _gyroDelta2[k] = carve(next);
+                    _PTerm[k] = carve(next);
+                }
+                _proportionalCyclicDemand = carve(next);
+                _throttle = carve(next);
+                _roll = carve(next);
+                _pitch = carve(next);
+                _yaw = carve(next);
+                _thrust = carve(next);
+                _lift = carve(next);
+                _sinTheta = carve(next);
+                _sinPhi = carve(next);
+
+                _flying = &_flags[0];
+                _armed = &_flags[stride(count)];
+
+                init();
+            }
+
+            // The arrays point into the swarm's own memory
+            SimSwarm(const SimSwarm &) = delete;
+            SimSwarm & operator=(const SimSwarm &) = delete;
+
+            // As SimBoard::init() and Stabilizer::init() for every vehicle: at rest, disarmed, sticks centered
+            void init(void)
+            {
+                _simMicros = 0;
+                _secondsPrev = 0;
+                _cycle = 0;
+
+                memset(&_memory[0], 0, _memory.size() * sizeof(float));
+                memset(&_flags[0], 0, _flags.size() * sizeof(int32_t));
+            }
+
+            uint32_t count(void)
+            {
+                return _count;
+            }
+
+            void setGains(const gains_t & gains)
+            {
+                _levelP      = gains.levelP;
+                _gyroCyclicP = gains.gyroCyclicP;
+                _gyroCyclicI = gains.gyroCyclicI;
+                _gyroCyclicD = gains.gyroCyclicD;
+                _gyroYawP    = gains.gyroYawP;
+                _gyroYawI    = gains.gyroYawI;
+            }
+
+            // The receiver's demands for a vehicle, as Stabilizer::updateDemands() takes them
+            void setDemands(uint32_t index, const demands_t & demands)
+            {
+                _throttle[index] = demands.throttle;
+                _roll[index]     = demands.roll;
+                _pitch[index]    = demands.pitch;
+                _yaw[index]      = demands.yaw;
+
+                float r = numericAbs(demands.roll), p = numericAbs(demands.pitch);
+                _proportionalCyclicDemand[index] = (r > p ? r : p) / 0.5f;
+            }
+
+            void setArmed(uint32_t index, bool armed)
+            {
+                _armed[index] = armed;
+            }
+
+            // One gyro cycle for every vehicle
+            void step(void)
+            {
+                _simMicros += _simStepMicros;
+
+                double secondsCurr = _simMicros / 1.e6;
+                float deltaSeconds = secondsCurr - _secondsPrev;
+                _secondsPrev = secondsCurr;
+
+                _cycle++;
+
+                stepPhysics(deltaSeconds);
+
+                if (_cycle % 5 == 0) {
+                    updateEulerAngles();
+                }
+
+                stabilizeAndMix();
+            }
+
+            uint32_t getMicroseconds(void)
+            {
+                return (uint32_t)_simMicros;
+            }
+
+            // As SimBoard::simGetVehicleState()
+            void simGetVehicleState(uint32_t index, float gyroRates[3], float translationRates[3], float position[3],
+                    float eulerAngles[3], float motors[4])
+            {
+                for (uint8_t k=0; k<3; ++k) {
+                    gyroRates[k] = _gyroRates[k][index];
+                    translationRates[k] = _translationRates[k][index];
+                    position[k] = _position[k][index];
+                    eulerAngles[k] = _eulerAngles[k][index];
+                }
+                for (uint8_t k=0; k<4; ++k) {
+                    motors[k] = _motors[k][index];
+                }
+            }
+
+    }; // class SimSwarm
+
+} // namespace hf
@@ -0,0 +1,368 @@
+/*
+   threaded.hpp: Board that runs SimBoard's physics on a thread of its own
+
+   SimBoard advances its physics inside getGyroRates(), so the controller and the vehicle share one thread and
+   one clock, and the controller can never be late.  ThreadedSimBoard instead steps a SimBoard at a fixed rate on
+   a physics thread, paced to the wall clock, the way the airframe goes on whether or not the flight code keeps
+   up.  Hackflight runs on whatever thread (or threads, with Features::DUAL_CORE) calls it, and the two sides
+   meet only in latest-value buffers (sequence locks): the physics thread publishes each sensor sample, and the
+   controller publishes its motor values, each side picking up the other's latest whenever it looks.
+
+   The board keeps statistics on how the controller keeps up: gyro samples it read, samples that were replaced
+   before it got to them (deadline misses), and the age of each sample when read.  It also counts physics steps
+   that started more than a period late, since a host that can't keep the physics on time makes every other
+   number suspect.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <board.hpp>
+#include <seqlock.hpp>
+#include <boards/sim/sim.hpp>
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+namespace hf {
+
+    class ThreadedSimBoard final : public Board {
+
+        public:
+
+            typedef struct {
+
+                // Controller side
+                uint32_t samples;      // gyro samples read
+                uint32_t missed;       // gyro samples replaced before the controller read them
+                uint32_t ageMin;       // microseconds from publishing to reading
+                uint32_t ageMax;
+                uint64_t ageSum;
+
+                // Physics side
+                uint32_t steps;
+                uint32_t lateSteps;    // steps that started more than a period late
+                uint32_t latenessMax;  // microseconds
+
+            } stats_t;
+
+        private:
+
+            // One physics step's sensor readings, each with a count of the samples taken so far, so the
+            // controller can tell new from old and count what it missed
+            typedef struct {
+
+                uint32_t usec;         // when published
+
+                uint32_t gyroCount;
+                uint32_t eulerCount;
+                uint32_t accelCount;
+                uint32_t baroCount;
+                uint32_t sonarCount;
+
+                float    gyroRates[3];
+                float    eulerAngles[3];
+                float    accelGs[3];
+                float    pressure;
+                float    sonarDistance;
+                uint32_t sonarTimestamp;
+
+            } sensors_t;
+
+            typedef struct {
+                float values[4];
+            } motors_t;
+
+            SimBoard _physics;
+
+            uint32_t _periodMicros;
+
+            SeqLock<sensors_t> _sensors;
+            SeqLock<motors_t>  _motors;
+
+            std::thread       _thread;
+            std::atomic<bool> _running;
+
+            std::chrono::steady_clock::time_point _start;
+
+            // Controller side: the counts at the last read of each sensor, and the motor values written
+            uint32_t _gyroCount;
+            uint32_t _eulerCount;
+            uint32_t _accelCount;
+            uint32_t _baroCount;
+            uint32_t _sonarCount;
+            motors_t _motorValues;
+
+            // Each field is written by one side only; read them once stopped
+            stats_t  _stats;
+
+            uint32_t micros(std::chrono::steady_clock::time_point t)
+            {
+                return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(t - _start).count();
+            }
+
+            void runPhysics(void)
+            {
+                sensors_t s;
+                memset(&s, 0, sizeof(s));
+
+                std::chrono::steady_clock::time_point next = _start;
+
+                while (_running.load(std::memory_order_relaxed)) {
+
+                    next += std::chrono::microseconds(_periodMicros);
+                    std::this_thread::sleep_until(next);
+
+                    uint32_t lateness = micros(std::chrono::steady_clock::now()) - micros(next);
+                    if (lateness > _periodMicros) {
+                        _stats.lateSteps++;
+                    }
+                    if (lateness > _stats.latenessMax) {
+                        _stats.latenessMax = lateness;
+                    }
+
+                    // Apply the controller's latest motor values, then step; SimBoard steps in getGyroRates()
+                    motors_t m;
+                    _motors.read(m);
+                    _physics.writeMotors(m.values, 4);
+
+                    if (_physics.getGyroRates(s.gyroRates)) {
+                        s.gyroCount++;
+                    }
+                    if (_physics.getEulerAngles(s.eulerAngles)) {
+                        s.eulerCount++;
+                    }
+                    if (_physics.getAccelerometer(s.accelGs)) {
+                        s.accelCount++;
+                    }
+                    if (_physics.getBarometer(s.pressure)) {
+                        s.baroCount++;
+                    }
+                    if (_physics.getSonarAltitude(s.sonarDistance, s.sonarTimestamp)) {
+                        s.sonarCount++;
+                    }
+
+                    s.usec = micros(std::chrono::steady_clock::now());
+
+                    _sensors.write(s);
+
+                    _stats.steps++;
+                }
+            }
+
+            // Copies out the latest sensors, returning false if count shows nothing new since last
+            bool latest(sensors_t & s, uint32_t sensors_t::*count, uint32_t & last)
+            {
+                _sensors.read(s);
+                if (s.*count == last) {
+                    return false;
+                }
+                last = s.*count;
+                return true;
+            }
+
+        public:
+
+            // The physics runs on a simulated clock advanced by exactly one period per step, and the steps are
+            // paced to the wall clock, so the two agree as long as the host keeps up
+            ThreadedSimBoard(uint32_t physicsHz=1000) : _physics(physicsHz), _periodMicros(1000000 / physicsHz),
+                _running(false) { }
+
+            ~ThreadedSimBoard(void)
+            {
+                simStop();
+            }
+
+            // For setting up sensor models, integrator, blackbox file, etc. before init(); and for reading the
+            // vehicle state after simStop()
+            SimBoard & simPhysics(void)
+            {
+                return _physics;
+            }
+
+            // Stops the physics thread; the statistics and the physics are then safe to read
+            void simStop(void)
+            {
+                if (_running.exchange(false)) {
+                    _thread.join();
+                }
+            }
+
+            void simGetStats(stats_t & stats)
+            {
+                stats = _stats;
+            }
+
+            // methods called by Hackflight -------------------------------------------------
+
+            // Starts the physics thread
+            void init(void)
+            {
+                simStop();
+
+                _physics.init();
+
+                _gyroCount = _eulerCount = _accelCount = _baroCount = _sonarCount = 0;
+                memset(&_motorValues, 0, sizeof(_motorValues));
+                _motors.write(_motorValues);
+
+                memset(&_stats, 0, sizeof(_stats));
+                _stats.ageMin = UINT32_MAX;
+
+                _start = std::chrono::steady_clock::now();
+                _running = true;
+                _thread = std::thread(&ThreadedSimBoard::runPhysics, this);
+            }
+
+            bool getGyroRates(float gyroRates[3])
+            {
+                uint32_t usec;
+                return getGyroSample(gyroRates, usec);
+            }
+
+            // The sample's time is when the physics thread produced it
+            bool getGyroSample(float gyroRates[3], uint32_t & usec)
+            {
+                uint32_t last = _gyroCount;
+
+                sensors_t s;
+                if (!latest(s, &sensors_t::gyroCount, _gyroCount)) {
+                    return false;
+                }
+
+                uint32_t age = getMicroseconds() - s.usec;
+
+                _stats.samples++;
+                _stats.missed += s.gyroCount - last - 1;
+                _stats.ageSum += age;
+                if (age < _stats.ageMin) {
+                    _stats.ageMin = age;
+                }
+                if (age > _stats.ageMax) {
+                    _stats.ageMax = age;
+                }
+
+                memcpy(gyroRates, s.gyroRates, sizeof(s.gyroRates));
+                usec = s.usec;
+
+                return true;
+            }
+
+            bool getEulerAngles(float eulerAngles[3])
+            {
+                sensors_t s;
+                if (!latest(s, &sensors_t::eulerCount, _eulerCount)) {
+                    return false;
+                }
+                memcpy(eulerAngles, s.eulerAngles, sizeof(s.eulerAngles));
+                return true;
+            }
+
+            bool getAccelerometer(float accelGs[3])
+            {
+                sensors_t s;
+                if (!latest(s, &sensors_t::accelCount, _accelCount)) {
+                    return false;
+                }
+                memcpy(accelGs, s.accelGs, sizeof(s.accelGs));
+                return true;
+            }
+
+            bool getBarometer(float & pressure)
+            {
+                sensors_t s;
+                if (!latest(s, &sensors_t::baroCount, _baroCount)) {
+                    return false;
+                }
+                pressure = s.pressure;
+                return true;
+            }
+
+            bool getSonarAltitude(float & distance, uint32_t & timestamp)
+            {
+                sensors_t s;
+                if (!latest(s, &sensors_t::sonarCount, _sonarCount)) {
+                    return false;
+                }
+                distance = s.sonarDistance;
+                timestamp = s.sonarTimestamp;
+                return true;
+            }
+
+            uint32_t getMicroseconds()
+            {
+                return micros(std::chrono::steady_clock::now());
+            }
+
+            void writeMotor(uint8_t index, float value)
+            {
+                _motorValues.values[index] = value;
+                _motors.write(_motorValues);
+            }
+
+            void writeMotors(const float * values, uint8_t count)
+            {
+                memcpy(_motorValues.values, values, (count < 4 ? count : 4)*sizeof(float));
+                _motors.write(_motorValues);
+            }
+
+            // Files only, so these don't touch the physics
+            bool hasBlackbox(void)
+            {
+                return _physics.hasBlackbox();
+            }
+
+            uint16_t blackboxWrite(const uint8_t * buf, uint16_t len)
+            {
+                return _physics.blackboxWrite(buf, len);
+            }
+
+            bool hasDebugLog(void)
+            {
+                return _physics.hasDebugLog();
+            }
+
+            uint16_t debugLogWrite(const uint8_t * buf, uint16_t len)
+            {
+                return _physics.debugLogWrite(buf, len);
+            }
+
+            uint16_t calibrationRead(uint8_t * buf, uint16_t len)
+            {
+                return _physics.calibrationRead(buf, len);
+            }
+
+            void calibrationWrite(const uint8_t * buf, uint16_t len)
+            {
+                _physics.calibrationWrite(buf, len);
+            }
+
+            uint32_t getCycleCount(void)
+            {
+                return _physics.getCycleCount();
+            }
+
+            uint32_t getCyclesPerMicrosecond(void)
+            {
+                return 1000;
+            }
+
+    }; // class ThreadedSimBoard
+
+} // namespace hf
@@ -30,8 +30,15 @@
 #include <windows.h>
 #pragma warning(pop)
 #include <varargs.h>
+#include <string.h>
 
-void hf::Board::outbuf(char * buf)
+// OutputDebugStringA() wants a C string, so the text goes over a chunk at a time
+uint16_t hf::Board::outbufWrite(const uint8_t * buf, uint16_t len)
 {
-    OutputDebugStringA(buf);
+    char text[65];
+    uint16_t n = len < 64 ? len : 64;
+    memcpy(text, buf, n);
+    text[n] = 0;
+    OutputDebugStringA(text);
+    return n;
 }
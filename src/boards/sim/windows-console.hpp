@@ -25,7 +25,7 @@
 #include <stdio.h>
 #include <varargs.h>
 
-void hf::Board::outbuf(char * buf)
+uint16_t hf::Board::outbufWrite(const uint8_t * buf, uint16_t len)
 {
-    printf("%s", buf); 
+    return (uint16_t)fwrite(buf, 1, len, stdout);
 }
@@ -22,15 +22,57 @@
 
 #include "sim.hpp"
 
+#pragma warning(push, 0) 
+#include <windows.h>
+#pragma warning(pop)
+
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
+// Wall-clock time, as Windows's process times only tick with the scheduler; the monotonic clock needs no starting
+// point kept between calls, so boards on different threads share nothing
 void hf::SimBoard::cputime(struct timespec *tv)
 {
-    static time_t startsec;
+    uint64_t nanos = wallclockNanos();
 
-    int retval = timespec_get(tv, TIME_UTC);
+    tv->tv_sec = (time_t)(nanos / 1000000000ull);
+    tv->tv_nsec = (long)(nanos % 1000000000ull);
+}
 
-    if (startsec == 0) {
-        startsec = tv->tv_sec;
+uint64_t hf::SimBoard::wallclockNanos(void)
+{
+    LARGE_INTEGER count, frequency;
+    QueryPerformanceCounter(&count);
+    QueryPerformanceFrequency(&frequency);
+    return (uint64_t)(count.QuadPart / frequency.QuadPart) * 1000000000ull + 
+        (uint64_t)(count.QuadPart % frequency.QuadPart) * 1000000000ull / frequency.QuadPart;
+}
+
+// Waitable timers take a due time relative to now, so the deadline is turned into one on each call.  The
+// high-resolution timer (Windows 10 1803 and later) wakes within a few tens of microseconds; older versions fall back
+// on a standard one, which wakes on the system timer tick.  Each thread gets a timer of its own, so that boards
+// paced on different threads don't wait on one another's due times.
+void hf::SimBoard::sleepUntilNanos(uint64_t deadline)
+{
+    static thread_local HANDLE timer = NULL;
+
+    if (!timer) {
+        timer = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+    }
+    if (!timer) {
+        timer = CreateWaitableTimerW(NULL, TRUE, NULL);
+    }
+
+    uint64_t now = wallclockNanos();
+
+    if (!timer || now >= deadline) {
+        return;
     }
 
-    tv->tv_sec -= startsec;
+    LARGE_INTEGER due;
+    due.QuadPart = -(LONGLONG)((deadline - now) / 100); // negative: relative, in 100 ns units
+    if (SetWaitableTimer(timer, &due, 0, NULL, NULL, FALSE)) {
+        WaitForSingleObject(timer, INFINITE);
+    }
 }
@@ -0,0 +1,133 @@
+/*
+   calibration.hpp : Sensor calibration kept across power cycles
+
+   The altitude estimator learns the ground pressure and the accelerometer's vertical offset while the vehicle
+   sits disarmed.  Saving them lets the next boot start from last time's values instead of from zero, so the
+   altitude estimate is usable almost as soon as the first barometer sample arrives.
+
+   The record is versioned and checksummed, and each value is range-checked when loaded; anything that fails is
+   ignored and calibration starts from scratch as before.  Boards store the bytes wherever they can (EEPROM,
+   flash, a file) through Board::calibrationRead() and Board::calibrationWrite().
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+namespace hf {
+
+    class Calibration {
+
+        public:
+
+            static const uint32_t MAGIC   = 0x4C434648; // 'HFCL'
+            static const uint16_t VERSION = 1;
+
+            // Ground pressure in mbar, or zero if unknown
+            float groundPressure;
+
+            // Vertical specific force at rest in Gs (about one), or zero if unknown
+            float accelZoffset;
+
+        private:
+
+            typedef struct {
+
+                uint32_t magic;
+                uint16_t version;
+                uint16_t size;
+                float    groundPressure;
+                float    accelZoffset;
+                uint16_t checksum;
+                uint16_t pad;
+
+            } record_t;
+
+            // Anything outside these didn't come from a working sensor on Earth
+            static constexpr float PRESSURE_MIN = 300;
+            static constexpr float PRESSURE_MAX = 1100;
+            static constexpr float ACCEL_Z_TOLERANCE = 0.1f;
+
+            // Fletcher-16 over the bytes before the checksum
+            static uint16_t checksum(const uint8_t * buf, uint16_t len)
+            {
+                uint16_t a = 0, b = 0;
+                for (uint16_t k=0; k<len; ++k) {
+                    a = (a + buf[k]) % 255;
+                    b = (b + a) % 255;
+                }
+                return (b << 8) | a;
+            }
+
+        public:
+
+            static const uint16_t SIZE = sizeof(record_t);
+
+            void init(void)
+            {
+                groundPressure = 0;
+                accelZoffset = 0;
+            }
+
+            void encode(uint8_t buf[SIZE]) const
+            {
+                record_t r;
+                memset(&r, 0, sizeof(r));
+                r.magic = MAGIC;
+                r.version = VERSION;
+                r.size = SIZE;
+                r.groundPressure = groundPressure;
+                r.accelZoffset = accelZoffset;
+                r.checksum = checksum((const uint8_t *)&r, offsetof(record_t, checksum));
+                memcpy(buf, &r, SIZE);
+            }
+
+            // Returns false, leaving both values zero, unless buf holds a sound record of this version.  A value
+            // out of range is zeroed on its own, so one bad estimate doesn't cost the other.
+            bool decode(const uint8_t * buf, uint16_t len)
+            {
+                init();
+
+                if (len < SIZE) {
+                    return false;
+                }
+
+                record_t r;
+                memcpy(&r, buf, SIZE);
+
+                if (r.magic != MAGIC || r.version != VERSION || r.size != SIZE ||
+                        r.checksum != checksum(buf, offsetof(record_t, checksum))) {
+                    return false;
+                }
+
+                if (r.groundPressure >= PRESSURE_MIN && r.groundPressure <= PRESSURE_MAX) {
+                    groundPressure = r.groundPressure;
+                }
+
+                if (fabsf(r.accelZoffset - 1) < ACCEL_Z_TOLERANCE) {
+                    accelZoffset = r.accelZoffset;
+                }
+
+                return groundPressure != 0 || accelZoffset != 0;
+            }
+
+    }; // class Calibration
+
+} // namespace hf
@@ -2,8 +2,12 @@
     debug.hpp : Cross-platform serial debugging support for Hackflight
        
     Provides a single method printf() for formatted printing of debug
-    messages.  Your Board implementation should provide and outbuf(char *)
-    method that displays the message in an appropriate way.
+    messages.  Your Board implementation should provide an outbufWrite()
+    method that displays the text in an appropriate way; Board::outbuf()
+    queues it for that (see outbuf.hpp).
+
+    printf() still formats on the spot, so keep it out of the flight
+    loop; DebugLog::log() in debuglog.hpp defers that too.
 
     This file is part of Hackflight.
 
@@ -0,0 +1,344 @@
+/*
+   debuglog.hpp : Deferred debug logging, safe to leave on in flight
+
+   Debug::printf() formats where it is called, which takes long enough to upset the loop timing.
+   DebugLog::log() instead records the format string's address and the raw argument values into a RAM ring, so
+   a call costs a few stores, e.g.
+
+       DebugLog::log("baro %f m, accel %f G, arming %d\n", baroAlt, accelZ, armed);
+
+   A low-priority task drains the ring, when Features::DEBUG_LOG is on.  On a board with somewhere to put a binary
+   stream (see Board::hasDebugLog()) the records go out unformatted, each tagged with an ID for its format string,
+   and extras/debuglog/dldecode.py formats them on the host, finding the strings by scanning the sources for
+   DebugLog::log() calls.  Otherwise the task formats them itself, a few per slot, through Board::outbuf().
+
+   Arguments are integers and floating-point values (at most MAXARGS), each recorded in four bytes: floats as
+   single precision, integers as 32 bits.  Conversions take any flags, width, and precision, but length modifiers
+   are ignored.  Strings (%s) aren't supported, as the pointer could be stale by the time it is formatted.  Log
+   from one thread (or core) only.
+
+   Stream format (little-endian):
+
+       header:  'H' 'F' 'D' 'L' version
+       frames:  'L' id[4] nargs args[4*nargs]   a message: id is the FNV-1a hash of its format string
+                'D' count[4]                    total messages dropped so far, when the ring was full
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "board.hpp"
+#include "ringbuffer.hpp"
+
+namespace hf {
+
+    // A template only so that this header can define its static data without violating the one-definition rule
+    template <typename T=void>
+    class DebugLogT {
+
+        public:
+
+            static const uint8_t VERSION = 1;
+            static const uint8_t MAXARGS = 8;
+
+            // Messages buffered between drains
+            static const uint16_t RING_SIZE = 32;
+
+            // Longest message formatted on the board
+            static const uint8_t TEXT_SIZE = 128;
+
+            // FNV-1a hash of a format string, the message's ID in the binary stream; constexpr, so it can also be
+            // had at compile time
+            static constexpr uint32_t id(const char * fmt, uint32_t hash=2166136261u)
+            {
+                return *fmt ? id(fmt+1, (hash ^ (uint8_t)*fmt) * 16777619u) : hash;
+            }
+
+        private:
+
+            typedef struct {
+
+                const char * fmt;
+                uint8_t      nargs;
+                uint32_t     args[MAXARGS];
+
+            } record_t;
+
+            // Longest binary frame
+            static const uint8_t STAGING_SIZE = 1 + 4 + 1 + 4*MAXARGS;
+
+            static RingBuffer<record_t, RING_SIZE> _ring;
+
+            // Producer side
+            static uint32_t _dropped;
+
+            // Consumer side
+            static uint32_t _droppedReported;
+            static uint8_t  _staging[STAGING_SIZE];
+            static uint8_t  _stagingIndex;
+            static uint8_t  _stagingSize;
+            static bool     _headerSent;
+
+            static uint32_t word(float value)
+            {
+                uint32_t w;
+                memcpy(&w, &value, 4);
+                return w;
+            }
+
+            static uint32_t word(double value)
+            {
+                return word((float)value);
+            }
+
+            template <typename A>
+            static uint32_t word(A value)
+            {
+                return (uint32_t)(int32_t)value;
+            }
+
+            static void pack(uint32_t * args)
+            {
+                (void)args;
+            }
+
+            template <typename A, typename... Rest>
+            static void pack(uint32_t * args, A value, Rest... rest)
+            {
+                *args = word(value);
+                pack(args+1, rest...);
+            }
+
+            static void put32(uint32_t value)
+            {
+                for (uint8_t k=0; k<4; ++k) {
+                    _staging[_stagingSize++] = (uint8_t)(value >> (8*k));
+                }
+            }
+
+            // Formats one conversion, as specified by spec, from a recorded argument
+            static int formatOne(char * out, uint16_t size, char * spec, uint8_t length, uint32_t arg)
+            {
+                char conversion = spec[length-1];
+
+                if (strchr("fFeEgGaA", conversion)) {
+                    float f;
+                    memcpy(&f, &arg, 4);
+                    return snprintf(out, size, spec, (double)f);
+                }
+
+                if (conversion == 'c') {
+                    return snprintf(out, size, spec, (int)arg);
+                }
+
+                if (!strchr("diouxX", conversion)) {
+                    return snprintf(out, size, "?");
+                }
+
+                // Integers go through long, which holds 32 bits on every target
+                spec[length-1] = 'l';
+                spec[length] = conversion;
+                spec[length+1] = 0;
+
+                return (conversion == 'd' || conversion == 'i') ?
+                    snprintf(out, size, spec, (long)(int32_t)arg) :
+                    snprintf(out, size, spec, (unsigned long)arg);
+            }
+
+            static void format(const record_t & r, char * out, uint16_t size)
+            {
+                const char * fmt = r.fmt;
+                uint16_t n = 0;
+                uint8_t k = 0;
+
+                while (*fmt && n < size-1) {
+
+                    if (*fmt != '%') {
+                        out[n++] = *fmt++;
+                        continue;
+                    }
+
+                    if (fmt[1] == '%') {
+                        out[n++] = '%';
+                        fmt += 2;
+                        continue;
+                    }
+
+                    // Copy the conversion up to its type, leaving out any length modifier
+                    char spec[16];
+                    uint8_t length = 0;
+                    spec[length++] = *fmt++;
+                    while (*fmt && strchr("-+ #0123456789.", *fmt) && length < sizeof(spec)-3) {
+                        spec[length++] = *fmt++;
+                    }
+                    while (*fmt && strchr("hlLqjzt", *fmt)) {
+                        fmt++;
+                    }
+                    if (!*fmt) {
+                        break;
+                    }
+                    spec[length++] = *fmt++;
+                    spec[length] = 0;
+
+                    // A conversion without an argument prints nothing
+                    if (k < r.nargs) {
+                        int m = formatOne(&out[n], size-n, spec, length, r.args[k++]);
+                        n += (m < 0) ? 0 : (m < size-n) ? m : size-1-n;
+                    }
+                }
+
+                out[n] = 0;
+            }
+
+            static void flushText(uint8_t maxRecords)
+            {
+                char text[TEXT_SIZE];
+
+                uint32_t dropped = _dropped;
+                if (dropped != _droppedReported) {
+                    snprintf(text, sizeof(text), "(%lu debug messages dropped)\n", (unsigned long)(dropped - _droppedReported));
+                    Board::outbuf(text);
+                    _droppedReported = dropped;
+                }
+
+                // Leave messages in the ring, rather than drop them, while the output queue is backed up
+                record_t r;
+                for (uint8_t k=0; k<maxRecords && OutbufQueue::space() >= TEXT_SIZE && _ring.pop(r); ++k) {
+                    format(r, text, sizeof(text));
+                    Board::outbuf(text);
+                }
+            }
+
+            template <class BoardT>
+            static void flushBinary(BoardT * board, uint8_t maxRecords)
+            {
+                if (!_headerSent) {
+                    const uint8_t header[] = {'H', 'F', 'D', 'L', VERSION};
+                    memcpy(_staging, header, sizeof(header));
+                    _stagingIndex = 0;
+                    _stagingSize = sizeof(header);
+                    _headerSent = true;
+                }
+
+                uint8_t records = 0;
+
+                while (true) {
+
+                    if (_stagingIndex < _stagingSize) {
+                        uint8_t pending = _stagingSize - _stagingIndex;
+                        uint16_t written = board->debugLogWrite(&_staging[_stagingIndex], pending);
+                        _stagingIndex += written;
+                        if (written < pending) {
+                            break;
+                        }
+                    }
+
+                    _stagingIndex = 0;
+                    _stagingSize = 0;
+
+                    uint32_t dropped = _dropped;
+                    if (dropped != _droppedReported) {
+                        _staging[_stagingSize++] = 'D';
+                        put32(dropped);
+                        _droppedReported = dropped;
+                        continue;
+                    }
+
+                    record_t r;
+                    if (records >= maxRecords || !_ring.pop(r)) {
+                        break;
+                    }
+
+                    _staging[_stagingSize++] = 'L';
+                    put32(id(r.fmt));
+                    _staging[_stagingSize++] = r.nargs;
+                    for (uint8_t k=0; k<r.nargs; ++k) {
+                        put32(r.args[k]);
+                    }
+                    records++;
+                }
+            }
+
+        public:
+
+            // Records a message for formatting later; drops it, and counts the drop, if the ring is full
+            template <typename... Args>
+            static void log(const char * fmt, Args... args)
+            {
+                static_assert(sizeof...(Args) <= MAXARGS, "too many arguments for DebugLog::log()");
+
+                record_t r;
+                r.fmt = fmt;
+                r.nargs = sizeof...(Args);
+                pack(r.args, args...);
+
+                if (!_ring.push(r)) {
+                    _dropped++;
+                }
+            }
+
+            // Called from a low-priority slot: sends or formats up to maxRecords messages
+            template <class BoardT>
+            static void flush(BoardT * board, uint8_t maxRecords)
+            {
+                if (board->hasDebugLog()) {
+                    flushBinary(board, maxRecords);
+                }
+                else {
+                    flushText(maxRecords);
+                }
+            }
+
+            static uint32_t droppedCount(void)
+            {
+                return _dropped;
+            }
+
+            // Static RAM taken by the ring and the output staging
+            static uint16_t ramSize(void)
+            {
+                return sizeof(_ring) + sizeof(_dropped) + sizeof(_droppedReported) + sizeof(_staging) +
+                    sizeof(_stagingIndex) + sizeof(_stagingSize) + sizeof(_headerSent);
+            }
+
+    }; // class DebugLogT
+
+    template <typename T> RingBuffer<typename DebugLogT<T>::record_t, DebugLogT<T>::RING_SIZE> DebugLogT<T>::_ring;
+    template <typename T> uint32_t DebugLogT<T>::_dropped;
+    template <typename T> uint32_t DebugLogT<T>::_droppedReported;
+    template <typename T> uint8_t  DebugLogT<T>::_staging[DebugLogT<T>::STAGING_SIZE];
+    template <typename T> uint8_t  DebugLogT<T>::_stagingIndex;
+    template <typename T> uint8_t  DebugLogT<T>::_stagingSize;
+    template <typename T> bool     DebugLogT<T>::_headerSent;
+
+    typedef DebugLogT<> DebugLog;
+
+    // Takes DebugLog's place in the flight loop when Features::DEBUG_LOG is switched off, so its ring is never
+    // instantiated; leave out the DebugLog::log() calls too, as nothing drains them
+    class NoDebugLog {
+
+        public:
+
+            template <class BoardT>
+            static void flush(BoardT * board, uint8_t maxRecords) { (void)board; (void)maxRecords; }
+
+    }; // class NoDebugLog
+
+} // namespace hf
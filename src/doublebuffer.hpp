@@ -0,0 +1,106 @@
+/*
+   doublebuffer.hpp : Single-writer double buffer for handing frames from an interrupt to the main loop
+
+   The writer (e.g. a UART receive interrupt) fills whichever slot doesn't hold the latest frame and then
+   publishes it by bumping a sequence counter: odd while it is filling, even once the frame is complete.  A reader
+   copies the latest complete slot, which the writer doesn't touch until it starts the frame after next, so the
+   copy needs no lock and succeeds first time unless two whole frames land while it is being made.  Unlike
+   SeqLock, a reader interrupted by the writer mid-copy doesn't have to start over.  T should be plain data, since
+   it is copied byte-for-byte.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <atomic>
+
+namespace hf {
+
+    template <typename T>
+    class DoubleBuffer {
+
+        public:
+
+            DoubleBuffer(void) : _seq(0)
+            {
+                memset(_slots, 0, sizeof(_slots));
+            }
+
+            // Copies another buffer, e.g. for a simulation checkpoint; its writer may not run meanwhile
+            DoubleBuffer(const DoubleBuffer & other) : _seq(other._seq.load())
+            {
+                memcpy(_slots, other._slots, sizeof(_slots));
+            }
+
+            // Writer side, e.g. from an interrupt: gives the slot to fill with the next frame, which is published
+            // by the following call to publish()
+            T & begin(void)
+            {
+                uint32_t seq = _seq.load(std::memory_order_relaxed);
+
+                _seq.store(seq + 1, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_release);
+
+                return _slots[((seq >> 1) + 1) & 1];
+            }
+
+            void publish(void)
+            {
+                _seq.store(_seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+            }
+
+            void write(const T & value)
+            {
+                memcpy(&begin(), &value, sizeof(T));
+                publish();
+            }
+
+            // Reader side: copies out the latest complete frame, returning its sequence number (even; zero until
+            // the first publish), so callers can tell whether anything new has come in
+            uint32_t read(T & value) const
+            {
+                while (true) {
+
+                    uint32_t seq = _seq.load(std::memory_order_acquire) & ~1u;
+
+                    memcpy(&value, &_slots[(seq >> 1) & 1], sizeof(T));
+
+                    std::atomic_thread_fence(std::memory_order_acquire);
+
+                    // The writer starts refilling this slot only when it goes to seq + 3
+                    if (_seq.load(std::memory_order_relaxed) - seq < 3) {
+                        return seq;
+                    }
+                }
+            }
+
+            // Sequence number of the latest complete frame
+            uint32_t sequence(void) const
+            {
+                return _seq.load(std::memory_order_acquire) & ~1u;
+            }
+
+        private:
+
+            std::atomic<uint32_t> _seq;
+
+            T _slots[2];
+
+    }; // class DoubleBuffer
+
+} // namespace hf
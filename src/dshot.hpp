@@ -0,0 +1,245 @@
+/*
+   dshot.hpp : DShot digital ESC protocol output stage
+
+   Each motor value becomes a 16-bit frame: an 11-bit throttle (48-2047; 0 stops, 1-47 are commands), a
+   telemetry-request bit, and a 4-bit checksum.  Frames for all motors are expanded into one timer-compare
+   buffer, laid out bit-major so a single DMA burst per bit period updates every channel's compare register;
+   after prepare(), the timer and DMA clock the bits out with no CPU work per bit.  DShotT is sized at compile
+   time for a frame's motors (e.g. DShotT<MixerHexX::MOTORS>), and the buffer is packed for the motors written.
+
+   In bidirectional mode the checksum is inverted, telling the ESC to answer each frame with its eRPM on the
+   same wire; the board's capture code feeds the 21-bit GCR responses to setTelemetry().
+
+   Boards supply the hardware by subclassing and implementing startTransfer(); their writeMotors() then just
+   calls write().  BitBangDShot (boards/real/bitbangdshot.hpp) clocks the buffer out on GPIO pins instead, from
+   the cycle counter, for boards without a timer and DMA set up for it; the SpiImu board uses it.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+namespace hf {
+
+    // What doesn't depend on the number of motors: frame and telemetry coding, and the protocol's constants
+    class DShot {
+
+        public:
+
+            typedef enum {
+                DSHOT150  =  150000,
+                DSHOT300  =  300000,
+                DSHOT600  =  600000,
+                DSHOT1200 = 1200000
+            } speed_t;
+
+            static const uint8_t  FRAME_BITS = 16;
+
+            // Two zero-width periods after each frame hold the line idle between frames
+            static const uint8_t  BUFFER_BITS = FRAME_BITS + 2;
+
+            static const uint16_t THROTTLE_MIN = 48;
+            static const uint16_t THROTTLE_MAX = 2047;
+
+            // Builds a frame from a raw 11-bit value (0 = stop, 1-47 = ESC commands, 48-2047 = throttle)
+            static uint16_t encodeFrame(uint16_t value, bool telemetry, bool bidirectional)
+            {
+                uint16_t packet = (value << 1) | (telemetry ? 1 : 0);
+                uint16_t crc = (packet ^ (packet >> 4) ^ (packet >> 8)) & 0x0F;
+                if (bidirectional) {
+                    crc = ~crc & 0x0F;
+                }
+                return (packet << 4) | crc;
+            }
+
+            // Maps a motor value in [0,1] onto the throttle range; zero stops the motor
+            static uint16_t throttleValue(float value)
+            {
+                if (value <= 0) {
+                    return 0;
+                }
+                if (value >= 1) {
+                    return THROTTLE_MAX;
+                }
+                return THROTTLE_MIN + (uint16_t)(value * (THROTTLE_MAX - THROTTLE_MIN) + 0.5f);
+            }
+
+            // Decodes a bidirectional-DShot eRPM response (21 GCR bits as captured), returning eRPM, 0 for a
+            // stopped motor, or -1 if the frame is corrupt
+            static int32_t decodeTelemetry(uint32_t gcr21)
+            {
+                // Undo the transition encoding, leaving 20 bits of GCR
+                uint32_t gcr = (gcr21 ^ (gcr21 >> 1)) & 0xFFFFF;
+
+                uint16_t value = 0;
+
+                for (int8_t quintet=3; quintet>=0; --quintet) {
+                    int8_t nibble = gcrToNibble((gcr >> (5*quintet)) & 0x1F);
+                    if (nibble < 0) {
+                        return -1;
+                    }
+                    value = (value << 4) | nibble;
+                }
+
+                uint8_t crc = (value ^ (value >> 4) ^ (value >> 8) ^ (value >> 12)) & 0x0F;
+                if (crc != 0x0F) {
+                    return -1;
+                }
+
+                // eeem mmmm mmmm: period in microseconds is mantissa shifted by exponent
+                uint16_t data = value >> 4;
+                if (data == 0x0FFF) {
+                    return 0;
+                }
+                uint32_t periodMicros = (uint32_t)(data & 0x01FF) << (data >> 9);
+
+                return periodMicros ? (int32_t)(60000000UL / periodMicros) : 0;
+            }
+
+        private:
+
+            static int8_t gcrToNibble(uint8_t gcr)
+            {
+                static const int8_t table[32] = {
+                    -1, -1, -1, -1, -1, -1, -1, -1, -1,  9, 10, 11, -1, 13, 14, 15,
+                    -1, -1,  2,  3, -1,  5,  6,  7, -1,  0,  8,  1, -1,  4, 12, -1
+                };
+                return table[gcr];
+            }
+
+    }; // class DShot
+
+    template <uint8_t MOTORS>
+    class DShotT : public DShot {
+
+        static_assert(MOTORS > 0, "DShot needs at least one motor");
+
+        private:
+
+            uint16_t _bit0Ticks;
+            uint16_t _bit1Ticks;
+            uint16_t _periodTicks;
+
+            bool     _bidirectional;
+            bool     _telemetryRequest;
+
+            int32_t  _erpm[MOTORS];
+
+            // Bit-major: _buffer[bit*count + motor] holds the compare value for that motor's bit, for the count
+            // motors last written
+            uint16_t _buffer[BUFFER_BITS * MOTORS];
+
+        protected:
+
+            // Starts the timer DMA burst over words compare values in channel-interleaved order, for count
+            // channels: BUFFER_BITS runs of count values.  Returns false if the previous frame is still going out,
+            // in which case the new one is skipped (the next write brings the ESCs up to date).
+            virtual bool startTransfer(const uint16_t * buffer, uint16_t words, uint8_t count) = 0;
+
+        public:
+
+            // timerHz is the output timer's tick rate; the bit timings follow from it and the DShot speed
+            void init(uint32_t timerHz, speed_t speed, bool bidirectional=false)
+            {
+                _periodTicks = timerHz / speed;
+                _bit1Ticks = (_periodTicks * 3) / 4;   // 75% duty
+                _bit0Ticks = (_periodTicks * 3) / 8;   // 37.5% duty
+
+                _bidirectional = bidirectional;
+                _telemetryRequest = false;
+
+                for (uint8_t i=0; i<MOTORS; ++i) {
+                    _erpm[i] = 0;
+                }
+
+                for (uint16_t k=0; k<BUFFER_BITS*MOTORS; ++k) {
+                    _buffer[k] = 0;
+                }
+            }
+
+            // Timer auto-reload value for one bit period
+            uint16_t periodTicks(void)
+            {
+                return _periodTicks;
+            }
+
+            // Sets the telemetry bit in the next frames, asking ESCs for a telemetry packet on their serial wire
+            void requestTelemetry(bool request)
+            {
+                _telemetryRequest = request;
+            }
+
+            // Encodes raw 11-bit values for the first count motors into the DMA buffer; any past MOTORS are left
+            // alone
+            void prepare(const uint16_t * values, uint8_t count)
+            {
+                count = count < MOTORS ? count : MOTORS;
+
+                for (uint8_t i=0; i<count; ++i) {
+
+                    uint16_t frame = encodeFrame(values[i], _telemetryRequest, _bidirectional);
+
+                    for (uint8_t b=0; b<FRAME_BITS; ++b) {
+                        _buffer[b*count + i] = (frame & (0x8000 >> b)) ? _bit1Ticks : _bit0Ticks;
+                    }
+                }
+
+                for (uint16_t k=FRAME_BITS*count; k<BUFFER_BITS*count; ++k) {
+                    _buffer[k] = 0;
+                }
+            }
+
+            // Sends motor values in [0,1] to the first count ESCs; any past MOTORS are left alone
+            bool write(const float * values, uint8_t count)
+            {
+                count = count < MOTORS ? count : MOTORS;
+
+                uint16_t raw[MOTORS];
+                for (uint8_t i=0; i<count; ++i) {
+                    raw[i] = throttleValue(values[i]);
+                }
+
+                return writeRaw(raw, count);
+            }
+
+            // Sends raw values, e.g. ESC commands such as beeps or spin direction
+            bool writeRaw(const uint16_t * values, uint8_t count)
+            {
+                count = count < MOTORS ? count : MOTORS;
+                prepare(values, count);
+                return startTransfer(_buffer, BUFFER_BITS * count, count);
+            }
+
+            // Called by the board's capture code with each motor's eRPM response
+            void setTelemetry(uint8_t motor, uint32_t gcr21)
+            {
+                int32_t erpm = decodeTelemetry(gcr21);
+                if (erpm >= 0 && motor < MOTORS) {
+                    _erpm[motor] = erpm;
+                }
+            }
+
+            // Latest eRPM from bidirectional telemetry (divide by pole pairs for mechanical RPM); 0 for a motor
+            // past MOTORS
+            int32_t getErpm(uint8_t motor)
+            {
+                return motor < MOTORS ? _erpm[motor] : 0;
+            }
+
+    }; // class DShotT
+
+} // namespace hf
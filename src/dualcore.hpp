@@ -0,0 +1,241 @@
+/*
+   dualcore.hpp : Lock-free link between the control core and the background core
+
+   With Features::DUAL_CORE (see features.hpp), one core runs only the gyro / PID / mixer path, through
+   Hackflight::updateControl(), and owns the motors; the other runs everything else through Hackflight::update():
+   receiver decoding, arming, Euler angles, barometer / accelerometer / sonar fusion, MSP, and the blackbox
+   drain.  Nothing is shared between them except through the single-producer / single-consumer queues here, so
+   neither ever waits for the other, and telemetry can't put jitter into the control loop.
+
+   Each queue has one producer core and one consumer core:
+
+       commands   background -> control   receiver demands, arming state, and the altitude-hold throttle
+       attitudes  background -> control   Euler angles (and quaternion) for the stabilizer's level mode
+       gyro       control -> background   gyro samples for the altitude estimator's IMU
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <string.h>
+
+#include "datatypes.hpp"
+#include "gains.hpp"
+#include "ringbuffer.hpp"
+
+namespace hf {
+
+    // What the control core needs from the background core, sent on every receiver frame and every altitude
+    // update
+    typedef struct {
+
+        demands_t demands;          // as the receiver decoded them
+        uint32_t  frameMicros;      // arrival of the frame, and the measured frame interval, for the RC smoother
+        uint32_t  intervalMicros;
+        float     holdThrottle;     // throttle set by altitude hold, when holding
+        bool      holding;
+        bool      armed;
+        bool      throttleDown;
+        bool      newFrame;         // demands are from a new receiver frame
+
+    } command_t;
+
+    class DualCoreLink {
+
+        private:
+
+            typedef struct {
+                float eulerAngles[3];
+                float quaternion[4];
+            } attitude_t;
+
+            typedef struct {
+                float    gyroRates[3];
+                uint32_t usec;
+            } gyro_sample_t;
+
+            // Enough gyro samples for the background core to fall about 30 msec behind at 1 kHz
+            static const uint16_t COMMAND_QUEUE  = 8;
+            static const uint16_t ATTITUDE_QUEUE = 4;
+            static const uint16_t GYRO_QUEUE     = 32;
+
+            RingBuffer<command_t,     COMMAND_QUEUE>  _commands;
+            RingBuffer<attitude_t,    ATTITUDE_QUEUE> _attitudes;
+            RingBuffer<gyro_sample_t, GYRO_QUEUE>     _gyro;
+
+            // Background side: a command that didn't fit, retried before the next one
+            command_t _pending;
+            bool      _havePending;
+
+            // Background side: gains sequence the altitude estimator last took up
+            uint32_t  _gainsTaken;
+
+            // Control side: the latest command and attitude, and gyro samples the background core wasn't keeping
+            // up with
+            command_t _command;
+            float     _eulerAngles[3];
+            float     _quaternion[4];
+            uint32_t  _gyroDropped;
+
+        public:
+
+            void init(void)
+            {
+                _commands.clear();
+                _attitudes.clear();
+                _gyro.clear();
+                _havePending = false;
+                _gainsTaken = 0;
+                memset(&_command, 0, sizeof(_command));
+                memset(_eulerAngles, 0, sizeof(_eulerAngles));
+                memset(_quaternion, 0, sizeof(_quaternion));
+                _quaternion[0] = 1;
+                _gyroDropped = 0;
+            }
+
+            //------------------------------------- Background core --------------------------------------------------
+
+            // A command that can't be queued yet is merged into the next, so a new frame is never lost
+            void sendCommand(const command_t & command)
+            {
+                bool newFrame = command.newFrame || (_havePending && _pending.newFrame);
+
+                _pending = command;
+                _pending.newFrame = newFrame;
+                _havePending = !_commands.push(_pending);
+            }
+
+            // Call on every background pass
+            void flush(void)
+            {
+                if (_havePending) {
+                    _havePending = !_commands.push(_pending);
+                }
+            }
+
+            // The quaternion goes along when the stabilizer levels from it (Features::QUATERNION)
+            void sendAttitude(const float eulerAngles[3], const float * quaternion=0)
+            {
+                static const float IDENTITY[4] = {1, 0, 0, 0};
+
+                attitude_t a;
+                memcpy(a.eulerAngles, eulerAngles, sizeof(a.eulerAngles));
+                memcpy(a.quaternion, quaternion ? quaternion : IDENTITY, sizeof(a.quaternion));
+
+                // The stabilizer wants the latest; if the control core hasn't taken the others, this one can wait
+                _attitudes.push(a);
+            }
+
+            // The altitude estimator takes up retuned gains here; the control core takes the stabilizer's
+            template <class GainBufferType, class AltitudeType>
+            void takeGains(GainBufferType & gainBuffer, AltitudeType & altitudeEstimator)
+            {
+                gains_t gains;
+                if (gainBuffer.take(gains, _gainsTaken)) {
+                    altitudeEstimator.setGains(gains);
+                }
+            }
+
+            // Hands the queued gyro samples to the altitude estimator, oldest first
+            template <class AltitudeType>
+            void receiveGyro(AltitudeType & altitudeEstimator)
+            {
+                gyro_sample_t s;
+                while (_gyro.pop(s)) {
+                    altitudeEstimator.updateGyro(s.gyroRates, s.usec);
+                }
+            }
+
+            //--------------------------------------- Control core ---------------------------------------------------
+
+            // Takes the next command, oldest first, returning false when there are none
+            bool receiveCommand(void)
+            {
+                return _commands.pop(_command);
+            }
+
+            // The command last received; all zero (disarmed) until the first
+            const command_t & command(void)
+            {
+                return _command;
+            }
+
+            // Takes the latest Euler angles, returning false if none have arrived since the last call
+            bool receiveAttitude(void)
+            {
+                attitude_t a;
+                bool got = false;
+                while (_attitudes.pop(a)) {
+                    got = true;
+                }
+                if (got) {
+                    memcpy(_eulerAngles, a.eulerAngles, sizeof(_eulerAngles));
+                    memcpy(_quaternion, a.quaternion, sizeof(_quaternion));
+                }
+                return got;
+            }
+
+            float * eulerAngles(void)
+            {
+                return _eulerAngles;
+            }
+
+            const float * quaternion(void)
+            {
+                return _quaternion;
+            }
+
+            void sendGyro(const float gyroRates[3], uint32_t usec)
+            {
+                gyro_sample_t s;
+                memcpy(s.gyroRates, gyroRates, sizeof(s.gyroRates));
+                s.usec = usec;
+                if (!_gyro.push(s)) {
+                    _gyroDropped++;
+                }
+            }
+
+            uint32_t gyroDroppedCount(void)
+            {
+                return _gyroDropped;
+            }
+
+    }; // class DualCoreLink
+
+    // Takes DualCoreLink's place when both halves run on one core, through Hackflight::update()
+    class NoDualCoreLink {
+
+        public:
+
+            void init(void) { }
+            void sendCommand(const command_t & command) { (void)command; }
+            void flush(void) { }
+            void sendAttitude(const float eulerAngles[3], const float * quaternion=0) { (void)eulerAngles; (void)quaternion; }
+
+            template <class GainBufferType, class AltitudeType>
+            void takeGains(GainBufferType & gainBuffer, AltitudeType & altitudeEstimator)
+            {
+                (void)gainBuffer; (void)altitudeEstimator;
+            }
+
+            template <class AltitudeType>
+            void receiveGyro(AltitudeType & altitudeEstimator) { (void)altitudeEstimator; }
+
+            uint32_t gyroDroppedCount(void) { return 0; }
+
+    }; // class NoDualCoreLink
+
+} // namespace hf
@@ -0,0 +1,178 @@
+/*
+   envelope.hpp : Per-channel mean, minimum, and maximum of loop-rate signals, for decimated telemetry
+
+   The flight loop adds every gyro sample and every attitude as it comes in; whoever streams the telemetry takes
+   the window at its own, much lower, rate and starts the next one.  A plot of the means with the min/max band
+   around them shows every transient the loop saw, at a fraction of the bytes of sending each sample.  Each
+   consumer (e.g. each MSP port) opens a window of its own, so taking one doesn't cut short another's.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+namespace hf {
+
+    class TelemetryEnvelope {
+
+        public:
+
+            // Gyro roll, pitch, yaw rates, then roll, pitch, yaw angles; the heading is in [0,2*pi], so a window
+            // in which it wraps has a min and max a turn apart
+            enum {
+                GYRO_ROLL,
+                GYRO_PITCH,
+                GYRO_YAW,
+                ANGLE_ROLL,
+                ANGLE_PITCH,
+                ANGLE_YAW,
+                CHANNEL_COUNT
+            };
+
+            // A window nobody takes in this many samples starts over, so the float sums keep their precision and
+            // the first reply after a quiet spell covers recent flight only
+            static const uint16_t MAX_SAMPLES = 4096;
+
+            // Consumers with a window of their own: one per MSP port on a RealBoard.  Every sample goes into
+            // each open window.
+            static const uint8_t MAX_WINDOWS = 4;
+
+            // What open() returns when every window is taken; take() gives it an empty window
+            static const uint8_t NO_WINDOW = 0xFF;
+
+            typedef struct {
+                float    mean;
+                float    min;
+                float    max;
+                uint16_t count;
+            } window_t;
+
+        private:
+
+            typedef struct {
+                float    sum;
+                float    min;
+                float    max;
+                uint16_t count;
+            } channel_t;
+
+            channel_t _channels[MAX_WINDOWS][CHANNEL_COUNT];
+
+            uint8_t _windows;   // opened so far
+
+            void add(uint8_t first, const float values[3])
+            {
+                for (uint8_t j=0; j<_windows; ++j) {
+
+                    for (uint8_t k=0; k<3; ++k) {
+
+                        channel_t & c = _channels[j][first+k];
+                        float value = values[k];
+
+                        if (c.count == 0 || c.count == MAX_SAMPLES) {
+                            c.sum = value;
+                            c.min = value;
+                            c.max = value;
+                            c.count = 1;
+                            continue;
+                        }
+
+                        c.sum += value;
+                        c.min = value < c.min ? value : c.min;
+                        c.max = value > c.max ? value : c.max;
+                        c.count++;
+                    }
+                }
+            }
+
+        public:
+
+            TelemetryEnvelope(void) : _windows(0) { }
+
+            // Starts every open window over; windows stay open
+            void init(void)
+            {
+                for (uint8_t j=0; j<MAX_WINDOWS; ++j) {
+                    for (uint8_t k=0; k<CHANNEL_COUNT; ++k) {
+                        _channels[j][k].count = 0;
+                    }
+                }
+            }
+
+            // Opens a window for one more consumer, for good, starting empty
+            uint8_t open(void)
+            {
+                if (_windows == MAX_WINDOWS) {
+                    return NO_WINDOW;
+                }
+
+                for (uint8_t k=0; k<CHANNEL_COUNT; ++k) {
+                    _channels[_windows][k].count = 0;
+                }
+
+                return _windows++;
+            }
+
+            void updateGyro(const float gyroRates[3])
+            {
+                add(GYRO_ROLL, gyroRates);
+            }
+
+            void updateAttitude(const float eulerAngles[3])
+            {
+                add(ANGLE_ROLL, eulerAngles);
+            }
+
+            // Returns the channel's part of an open window so far, all zero if it had no samples, and starts the
+            // next one
+            window_t take(uint8_t window, uint8_t channel)
+            {
+                window_t w = {0, 0, 0, 0};
+
+                if (window >= _windows) {
+                    return w;
+                }
+
+                channel_t & c = _channels[window][channel];
+
+                w.count = c.count;
+
+                if (c.count) {
+                    w.mean = c.sum / c.count;
+                    w.min  = c.min;
+                    w.max  = c.max;
+                }
+
+                c.count = 0;
+
+                return w;
+            }
+
+    }; // class TelemetryEnvelope
+
+    // Takes TelemetryEnvelope's place when there's no telemetry to decimate for
+    class NoTelemetryEnvelope {
+
+        public:
+
+            void init(void) { }
+            void updateGyro(const float gyroRates[3]) { (void)gyroRates; }
+            void updateAttitude(const float eulerAngles[3]) { (void)eulerAngles; }
+
+    }; // class NoTelemetryEnvelope
+
+} // namespace hf
@@ -0,0 +1,117 @@
+/*
+   fastmath.hpp: Cheap, branch-free approximations of transcendental functions
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cmath>
+
+namespace hf {
+
+    class FastMath {
+
+        public:
+
+            // Computes sine and cosine of x together, in single precision.  The angle is reduced to [-pi/4,+pi/4]
+            // and fed to Taylor polynomials (to x^7 for sine, x^8 for cosine), whose truncation error there is below
+            // 3.2e-7.  Including float rounding, the absolute error is under 1e-6 for |x| <= 100 radians.
+            static void sincos(float x, float & s, float & c)
+            {
+                const float TWO_OVER_PI = 0.636619772f;
+                const float PI_OVER_2_HI = 1.5703125f;            // exactly representable high part of pi/2 ...
+                const float PI_OVER_2_LO = 4.83826794897e-4f;     // ... and the remainder
+
+                // Nearest quadrant
+                float q = x * TWO_OVER_PI;
+                int32_t k = (int32_t)(q + (q >= 0 ? 0.5f : -0.5f));
+
+                // Two-step (Cody-Waite) reduction keeps the remainder accurate
+                float r = (x - k * PI_OVER_2_HI) - k * PI_OVER_2_LO;
+                float r2 = r * r;
+
+                float sr = r * (1 + r2 * (-1/6.f + r2 * (1/120.f + r2 * (-1/5040.f))));
+                float cr = 1 + r2 * (-0.5f + r2 * (1/24.f + r2 * (-1/720.f + r2 * (1/40320.f))));
+
+                // Rotate result by quadrant: odd quadrants swap sine and cosine; signs follow the quadrant
+                bool swap = k & 1;
+                float ss = swap ? cr : sr;
+                float cc = swap ? sr : cr;
+                s = (k & 2) ? -ss : ss;
+                c = ((k+1) & 2) ? -cc : cc;
+            }
+
+            // Four-quadrant arctangent.  The ratio of the smaller to the larger magnitude, in [0,1], goes through
+            // an odd minimax polynomial (to z^11) for atan, which is then reflected into the right octant.  The
+            // absolute error is under 3e-6 radians.  Returns zero for (0,0).
+            static float atan2(float y, float x)
+            {
+                const float PI      = 3.14159265f;
+                const float PI_OVER_2 = 1.57079633f;
+
+                float ax = fabsf(x);
+                float ay = fabsf(y);
+                float big = ax > ay ? ax : ay;
+                float small = ax > ay ? ay : ax;
+
+                float z = big > 0 ? small / big : 0;
+                float z2 = z * z;
+
+                float a = z * (0.99997726f + z2 * (-0.33262347f + z2 * (0.19354346f + z2 * (-0.11643287f +
+                                z2 * (0.05265332f + z2 * (-0.01172120f))))));
+
+                a = ay > ax ? PI_OVER_2 - a : a;
+                a = x < 0 ? PI - a : a;
+                return y < 0 ? -a : a;
+            }
+
+            // Arcsine from atan2 and a square root (a single instruction on an FPU); x is clamped to [-1,+1]
+            static float asin(float x)
+            {
+                x = x > 1 ? 1 : (x < -1 ? -1 : x);
+                return atan2(x, sqrtf(1 - x*x));
+            }
+
+            // Roll, pitch, and yaw from a unit quaternion (w, x, y, z), in the convention of the boards' attitude
+            // sensors: roll = atan2(2(wx + yz), w^2 - x^2 - y^2 + z^2), pitch = asin(2(xz - wy)),
+            // yaw = atan2(2(xy + wz), w^2 + x^2 - y^2 - z^2)
+            static void eulerFromQuaternion(const float q[4], float eulerAngles[3])
+            {
+                float qw = q[0], qx = q[1], qy = q[2], qz = q[3];
+
+                eulerAngles[0] = atan2(2 * (qw * qx + qy * qz), qw * qw - qx * qx - qy * qy + qz * qz);
+                eulerAngles[1] = asin(2 * (qx * qz - qw * qy));
+                eulerAngles[2] = atan2(2 * (qx * qy + qw * qz), qw * qw + qx * qx - qy * qy - qz * qz);
+            }
+
+            // The inverse of eulerFromQuaternion(), for sources that only have Euler angles
+            static void quaternionFromEuler(const float eulerAngles[3], float q[4])
+            {
+                float sr, cr, sp, cp, sy, cy;
+                sincos(eulerAngles[0] / 2, sr, cr);
+                sincos(-eulerAngles[1] / 2, sp, cp); // pitch is the opposite way round from the aerospace convention
+                sincos(eulerAngles[2] / 2, sy, cy);
+
+                q[0] = cr * cp * cy + sr * sp * sy;
+                q[1] = sr * cp * cy - cr * sp * sy;
+                q[2] = cr * sp * cy + sr * cp * sy;
+                q[3] = cr * cp * sy - sr * sp * cy;
+            }
+
+    }; // class FastMath
+
+} // namespace hf
@@ -0,0 +1,96 @@
+/*
+   features.hpp : Compile-time selection of optional subsystems
+
+   HackflightT and RealBoardT take a features class as their last template parameter.  A subsystem that is
+   switched off there is replaced by an empty stand-in (NoAltitudeEstimator, NoBlackbox, etc.), its tasks are never
+   scheduled, and none of its code is instantiated, so it costs no RAM, no flash, and no time in the loop.  Start
+   from AllFeatures or CoreFeatures and hide the flags you want changed, e.g.
+
+       struct MyFeatures : hf::AllFeatures { static const bool ALTITUDE = false; };
+
+       hf::HackflightT<MyBoard, MyReceiver, hf::MixerQuadX, hf::Stabilizer, hf::AltitudeEstimator, MyFeatures> h;
+
+   extras/simtest/linux/footprint.cpp reports what each subsystem costs.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+namespace hf {
+
+    // Picks A when the condition holds, otherwise B (<type_traits> isn't available on every Arduino core)
+    template <bool CONDITION, class A, class B>
+    struct Select {
+        typedef A type;
+    };
+
+    template <class A, class B>
+    struct Select<false, A, B> {
+        typedef B type;
+    };
+
+    // Stands in for a variable of a disabled feature: takes any assignment, always reads as zero
+    template <typename T>
+    struct Nothing {
+        Nothing & operator=(T value) { (void)value; return *this; }
+        operator T() const { return T(0); }
+    };
+
+    struct AllFeatures {
+
+        static const bool ALTITUDE      = true;  // barometer, accelerometer, and sonar tasks; altitude hold
+        static const bool SERIAL        = true;  // MSP over the serial port, including live retuning of gains
+        static const bool HEADLESS      = true;  // stick inputs relative to the heading at arming
+        static const bool BLACKBOX      = true;  // flight recorder, on boards with somewhere to put the log
+        static const bool DYNAMIC_NOTCH = true;  // gyro spectrum tracking for the dynamic notch
+        static const bool RC_SMOOTHING  = true;  // interpolation of receiver demands between frames
+        static const bool DEBUG_LOG     = true;  // draining DebugLog messages (see debuglog.hpp)
+
+        // Not a subsystem but a way of running them: the control loop on one core and the rest on another
+        // (see dualcore.hpp).  Off unless asked for, as in DualCoreFeatures.
+        static const bool DUAL_CORE     = false;
+
+        // Nor is this: level from the board's quaternion (see Board::getQuaternion()) instead of its Euler angles,
+        // which are then needed only for arming, headless mode, and MSP, and come from fast approximations.  Off
+        // unless asked for, as in QuaternionFeatures.
+        static const bool QUATERNION    = false;
+    };
+
+    struct DualCoreFeatures : AllFeatures {
+
+        static const bool DUAL_CORE     = true;
+    };
+
+    struct QuaternionFeatures : AllFeatures {
+
+        static const bool QUATERNION    = true;
+    };
+
+    // Angle stabilization from the receiver, and nothing else
+    struct CoreFeatures {
+
+        static const bool ALTITUDE      = false;
+        static const bool SERIAL        = false;
+        static const bool HEADLESS      = false;
+        static const bool BLACKBOX      = false;
+        static const bool DYNAMIC_NOTCH = false;
+        static const bool RC_SMOOTHING  = false;
+        static const bool DEBUG_LOG     = false;
+        static const bool DUAL_CORE     = false;
+        static const bool QUATERNION    = false;
+    };
+
+} // namespace hf
@@ -23,24 +23,28 @@
 #pragma once
 
 #include <cmath>
+#include <cstring>
 
 #include "debug.hpp"
+#include "fixed.hpp"
 
 namespace hf {
 
-    class Filter {
+    // Templated on the numeric type so the same filters serve the float and fixed-point cores
+    template <typename T>
+    class FilterT {
 
         public:
 
 
-            static float max(float a, float b)
+            static T max(T a, T b)
             {
                 return a > b ? a : b;
             }
 
-            static float deadband(float value, float deadband)
+            static T deadband(T value, T deadband)
             {
-                if (fabs(value) < deadband) {
+                if (numericAbs(value) < deadband) {
                     value = 0;
                 } else if (value > 0) {
                     value -= deadband;
@@ -50,21 +54,147 @@ namespace hf {
                 return value;
             }
 
-            static float complementary(float a, float b, float c)
+            static T complementary(T a, T b, T c)
             {
-                return a * c + b * (1 - c);
+                return a * c + b * (T(1) - c);
             }
 
-            static float constrainMinMax(float val, float min, float max)
+            static T constrainMinMax(T val, T min, T max)
             {
                 return (val<min) ? min : ((val>max) ? max : val);
             }
 
-            static float constrainAbs(float val, float max)
+            static T constrainAbs(T val, T max)
             {
-                return constrainMinMax(val, -max, +max);
+                return constrainMinMax(val, -max, max);
             }
 
-    }; // class Filter
+    }; // class FilterT
+
+    typedef FilterT<float> Filter;
+
+    // Second-order IIR (biquad) filter applied to each of AXES signals, e.g. the three gyro axes.  Coefficients
+    // are computed once in float when configured; apply() then costs five multiply-adds per axis, using the
+    // Direct Form II transposed structure with each axis's two state values stored together.
+    template <typename T, uint8_t AXES=3>
+    class BiquadFilterT {
+
+        private:
+
+            T _b0, _b1, _b2, _a1, _a2;
+
+            T _state[AXES][2];
+
+            bool _enabled;
+
+            // Normalizes by a0 and stores coefficients
+            void setCoefficients(float b0, float b1, float b2, float a0, float a1, float a2)
+            {
+                _b0 = T(b0 / a0);
+                _b1 = T(b1 / a0);
+                _b2 = T(b2 / a0);
+                _a1 = T(a1 / a0);
+                _a2 = T(a2 / a0);
+                _enabled = true;
+                reset();
+            }
+
+        public:
+
+            BiquadFilterT(void)
+            {
+                initPassthrough();
+            }
+
+            void initPassthrough(void)
+            {
+                _b0 = 1;
+                _b1 = _b2 = _a1 = _a2 = 0;
+                _enabled = false;
+                reset();
+            }
+
+            // Butterworth response at the default Q.  A cutoff of zero, or at or above Nyquist, passes through.
+            void initLowpass(float cutoffHz, float sampleHz, float q=0.7071f)
+            {
+                if (cutoffHz <= 0 || cutoffHz >= sampleHz/2) {
+                    initPassthrough();
+                    return;
+                }
+
+                float omega = 2 * M_PI * cutoffHz / sampleHz;
+                float sn = sinf(omega);
+                float cs = cosf(omega);
+                float alpha = sn / (2 * q);
+
+                setCoefficients((1-cs)/2, 1-cs, (1-cs)/2, 1+alpha, -2*cs, 1-alpha);
+            }
+
+            // Rejects a band around centerHz; higher Q gives a narrower notch
+            void initNotch(float centerHz, float sampleHz, float q)
+            {
+                if (centerHz <= 0 || centerHz >= sampleHz/2) {
+                    initPassthrough();
+                    return;
+                }
+
+                float omega = 2 * M_PI * centerHz / sampleHz;
+                float cs = cosf(omega);
+                float alpha = sinf(omega) / (2 * q);
+
+                // Keep the state when retuning, so a moving notch doesn't glitch the signal
+                bool wasEnabled = _enabled;
+                T state[AXES][2];
+                memcpy(state, _state, sizeof(state));
+
+                setCoefficients(1, -2*cs, 1, 1+alpha, -2*cs, 1-alpha);
+
+                if (wasEnabled) {
+                    memcpy(_state, state, sizeof(state));
+                }
+            }
+
+            void reset(void)
+            {
+                for (uint8_t k=0; k<AXES; ++k) {
+                    _state[k][0] = _state[k][1] = 0;
+                }
+            }
+
+            bool enabled(void)
+            {
+                return _enabled;
+            }
+
+            T apply(T x, uint8_t axis)
+            {
+                if (!_enabled) {
+                    return x;
+                }
+
+                T * z = _state[axis];
+
+                T y  = _b0 * x + z[0];
+                z[0] = _b1 * x - _a1 * y + z[1];
+                z[1] = _b2 * x - _a2 * y;
+
+                return y;
+            }
+
+            // Filters all axes in place
+            void apply(T x[AXES])
+            {
+                if (!_enabled) {
+                    return;
+                }
+
+                for (uint8_t k=0; k<AXES; ++k) {
+                    x[k] = apply(x[k], k);
+                }
+            }
+
+    }; // class BiquadFilterT
+
+    typedef BiquadFilterT<float> BiquadFilter;
 
 } // namespace hf
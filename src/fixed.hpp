@@ -0,0 +1,157 @@
+/*
+   fixed.hpp : Saturating fixed-point number type, for boards without a floating-point unit
+
+   Fixed<FRAC> keeps a value in a signed 32-bit integer with FRAC fractional bits; Fixed<16> (Q16.16) covers
+   +/-32768 with a resolution of 1.5e-5.  Results that would overflow clamp to the largest or smallest value
+   instead of wrapping, so a PID term that runs away saturates the way a float one would be constrained.
+
+   Conversion from float is constexpr, so constants fold at compile time; do conversions at the edges
+   (sensor input, motor output) and keep arithmetic in between in fixed point.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+namespace hf {
+
+    template <uint8_t FRAC>
+    class Fixed {
+
+        private:
+
+            static const int32_t RAW_MAX = INT32_MAX;
+            static const int32_t RAW_MIN = -INT32_MAX; // symmetric, so negation can't overflow
+
+            int32_t _raw;
+
+            static constexpr int32_t saturate(int64_t v)
+            {
+                return v > RAW_MAX ? RAW_MAX : v < RAW_MIN ? RAW_MIN : (int32_t)v;
+            }
+
+            static constexpr int32_t fromFloat(float f)
+            {
+                return saturate((int64_t)(f * (float)(1L << FRAC) + (f >= 0 ? 0.5f : -0.5f)));
+            }
+
+            struct raw_tag { };
+
+            constexpr Fixed(int32_t raw, raw_tag) : _raw(raw) { }
+
+        public:
+
+            constexpr Fixed(void) : _raw(0) { }
+
+            constexpr Fixed(float f) : _raw(fromFloat(f)) { }
+
+            constexpr Fixed(double d) : _raw(fromFloat((float)d)) { }
+
+            constexpr Fixed(int i) : _raw(saturate((int64_t)i << FRAC)) { }
+
+            static constexpr Fixed fromRaw(int32_t raw)
+            {
+                return Fixed(raw, raw_tag());
+            }
+
+            constexpr int32_t raw(void) const
+            {
+                return _raw;
+            }
+
+            constexpr float toFloat(void) const
+            {
+                return _raw / (float)(1L << FRAC);
+            }
+
+            explicit constexpr operator float(void) const
+            {
+                return toFloat();
+            }
+
+            // Arithmetic ------------------------------------------------------------------------------------
+
+            constexpr Fixed operator-(void) const
+            {
+                return fromRaw(-_raw);
+            }
+
+            constexpr Fixed operator+(Fixed b) const
+            {
+                return fromRaw(saturate((int64_t)_raw + b._raw));
+            }
+
+            constexpr Fixed operator-(Fixed b) const
+            {
+                return fromRaw(saturate((int64_t)_raw - b._raw));
+            }
+
+            constexpr Fixed operator*(Fixed b) const
+            {
+                return fromRaw(saturate(((int64_t)_raw * b._raw + (1L << (FRAC-1))) >> FRAC));
+            }
+
+            constexpr Fixed operator/(Fixed b) const
+            {
+                return b._raw == 0 ?
+                    fromRaw(_raw >= 0 ? RAW_MAX : RAW_MIN) :
+                    fromRaw(saturate(((int64_t)_raw << FRAC) / b._raw));
+            }
+
+            Fixed & operator+=(Fixed b) { return *this = *this + b; }
+            Fixed & operator-=(Fixed b) { return *this = *this - b; }
+            Fixed & operator*=(Fixed b) { return *this = *this * b; }
+            Fixed & operator/=(Fixed b) { return *this = *this / b; }
+
+            // Comparison ------------------------------------------------------------------------------------
+
+            constexpr bool operator< (Fixed b) const { return _raw <  b._raw; }
+            constexpr bool operator> (Fixed b) const { return _raw >  b._raw; }
+            constexpr bool operator<=(Fixed b) const { return _raw <= b._raw; }
+            constexpr bool operator>=(Fixed b) const { return _raw >= b._raw; }
+            constexpr bool operator==(Fixed b) const { return _raw == b._raw; }
+            constexpr bool operator!=(Fixed b) const { return _raw != b._raw; }
+
+    }; // class Fixed
+
+    typedef Fixed<16> Q16_16;
+
+    // Absolute value for either numeric type used by the templated core
+    inline float numericAbs(float x)
+    {
+        return x < 0 ? -x : x;
+    }
+
+    template <uint8_t FRAC>
+    inline Fixed<FRAC> numericAbs(Fixed<FRAC> x)
+    {
+        return x < Fixed<FRAC>() ? -x : x;
+    }
+
+    // Conversion back to float at the edges (motor output, logging)
+    inline float numericToFloat(float x)
+    {
+        return x;
+    }
+
+    template <uint8_t FRAC>
+    inline float numericToFloat(Fixed<FRAC> x)
+    {
+        return x.toFloat();
+    }
+
+} // namespace hf
@@ -0,0 +1,209 @@
+/*
+   gainprofile.hpp : Where the stabilizer and altitude estimator keep their gains
+
+   By default they keep them in members, set by their constructors and retunable over MSP.  Given a profile
+   instead, a struct whose static constexpr floats are named as in gains_t,
+
+       struct MyGains {
+           static constexpr float levelP = 0.20f, gyroCyclicP = 0.225f, gyroCyclicI = 0.001875f,
+                                  gyroCyclicD = 0.375f, gyroYawP = 1.0625f, gyroYawI = 0.005625f;
+           static constexpr float altP = 15, velP = 15, velI = 15, velD = 1;
+       };
+
+       hf::StabilizerT<float, MyGains> stabilizer;
+       hf::HackflightT<MyBoard, MyReceiver, hf::MixerQuadX, hf::StabilizerT<float, MyGains>,
+                       hf::AltitudeEstimatorT<hf::Barometer, MyGains> > h;
+
+   they multiply by constants: the compiler folds them into the code, turns the altitude hold's scalings into
+   single multiplies, and leaves out any I or D term whose gain is zero.  There is then nothing to retune, so
+   Hackflight builds in no gain buffer and MSP rejects SET_PID_GAINS.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include "gains.hpp"
+#include "fixed.hpp"
+
+namespace hf {
+
+    // Stabilizer gains from a profile, in the stabilizer's numeric type T.  Rates are per axis: roll and pitch
+    // share the cyclic gains, and yaw has no D term.
+    template <typename T, class Profile>
+    class StabilizerGainsT {
+
+        public:
+
+            static const bool TUNABLE = false;
+
+            static constexpr bool HAS_CYCLIC_I = Profile::gyroCyclicI != 0;
+            static constexpr bool HAS_CYCLIC_D = Profile::gyroCyclicD != 0;
+            static constexpr bool HAS_YAW_I    = Profile::gyroYawI != 0;
+
+            T levelP(void) const { return T(Profile::levelP); }
+
+            T rateP(uint8_t axis) const { return axis < 2 ? T(Profile::gyroCyclicP) : T(Profile::gyroYawP); }
+            T rateI(uint8_t axis) const { return axis < 2 ? T(Profile::gyroCyclicI) : T(Profile::gyroYawI); }
+            T rateD(uint8_t axis) const { return axis < 2 ? T(Profile::gyroCyclicD) : T(0.f); }
+
+            void get(gains_t & gains) const
+            {
+                gains.levelP      = Profile::levelP;
+                gains.gyroCyclicP = Profile::gyroCyclicP;
+                gains.gyroCyclicI = Profile::gyroCyclicI;
+                gains.gyroCyclicD = Profile::gyroCyclicD;
+                gains.gyroYawP    = Profile::gyroYawP;
+                gains.gyroYawI    = Profile::gyroYawI;
+            }
+
+            void set(const gains_t & gains) { (void)gains; }
+
+    }; // class StabilizerGainsT
+
+    // Stabilizer gains set at construction and retunable
+    template <typename T>
+    class StabilizerGainsT<T, void> {
+
+        private:
+
+            T _levelP;
+
+            // Roll, pitch, yaw
+            T _rateP[3];
+            T _rateI[3];
+            T _rateD[3];
+
+        public:
+
+            static const bool TUNABLE = true;
+
+            static const bool HAS_CYCLIC_I = true;
+            static const bool HAS_CYCLIC_D = true;
+            static const bool HAS_YAW_I    = true;
+
+            StabilizerGainsT(float levelP, float gyroCyclicP, float gyroCyclicI, float gyroCyclicD, float gyroYawP,
+                    float gyroYawI)
+            {
+                gains_t gains = {levelP, gyroCyclicP, gyroCyclicI, gyroCyclicD, gyroYawP, gyroYawI, 0, 0, 0, 0};
+                set(gains);
+            }
+
+            T levelP(void) const { return _levelP; }
+
+            T rateP(uint8_t axis) const { return _rateP[axis]; }
+            T rateI(uint8_t axis) const { return _rateI[axis]; }
+            T rateD(uint8_t axis) const { return _rateD[axis]; }
+
+            void get(gains_t & gains) const
+            {
+                gains.levelP      = numericToFloat(_levelP);
+                gains.gyroCyclicP = numericToFloat(_rateP[0]);
+                gains.gyroCyclicI = numericToFloat(_rateI[0]);
+                gains.gyroCyclicD = numericToFloat(_rateD[0]);
+                gains.gyroYawP    = numericToFloat(_rateP[2]);
+                gains.gyroYawI    = numericToFloat(_rateI[2]);
+            }
+
+            void set(const gains_t & gains)
+            {
+                _levelP = T(gains.levelP);
+                _rateP[0] = _rateP[1] = T(gains.gyroCyclicP);
+                _rateI[0] = _rateI[1] = T(gains.gyroCyclicI);
+                _rateD[0] = _rateD[1] = T(gains.gyroCyclicD);
+                _rateP[2] = T(gains.gyroYawP);
+                _rateI[2] = T(gains.gyroYawI);
+                _rateD[2] = 0;
+            }
+
+    }; // class StabilizerGainsT<T, void>
+
+    // Altitude-hold gains from a profile
+    template <class Profile>
+    class AltitudeGainsT {
+
+        public:
+
+            static const bool TUNABLE = false;
+
+            float altP(void) const { return Profile::altP; }
+            float velP(void) const { return Profile::velP; }
+            float velI(void) const { return Profile::velI; }
+            float velD(void) const { return Profile::velD; }
+
+            void get(gains_t & gains) const
+            {
+                gains.altP = Profile::altP;
+                gains.velP = Profile::velP;
+                gains.velI = Profile::velI;
+                gains.velD = Profile::velD;
+            }
+
+            void set(const gains_t & gains) { (void)gains; }
+
+    }; // class AltitudeGainsT
+
+    // Altitude-hold gains, retunable, in the whole numbers the hold controller was written for
+    template <>
+    class AltitudeGainsT<void> {
+
+        private:
+
+            uint8_t _altP;
+            uint8_t _velP;
+            uint8_t _velI;
+            uint8_t _velD;
+
+            static uint8_t toGain(float value)
+            {
+                return value <= 0 ? 0 : value >= 255 ? 255 : (uint8_t)(value + 0.5f);
+            }
+
+        public:
+
+            static const bool TUNABLE = true;
+
+            // NB: Try ALT P 50; VEL PID 50;5;30
+            // based on https://github.com/betaflight/betaflight/issues/1003 (Glowhead comment at bottom)
+            AltitudeGainsT(uint8_t altP=15, uint8_t velP=15, uint8_t velI=15, uint8_t velD=1) :
+                _altP(altP), _velP(velP), _velI(velI), _velD(velD) { }
+
+            float altP(void) const { return _altP; }
+            float velP(void) const { return _velP; }
+            float velI(void) const { return _velI; }
+            float velD(void) const { return _velD; }
+
+            void get(gains_t & gains) const
+            {
+                gains.altP = _altP;
+                gains.velP = _velP;
+                gains.velI = _velI;
+                gains.velD = _velD;
+            }
+
+            // Rounded to whole numbers
+            void set(const gains_t & gains)
+            {
+                _altP = toGain(gains.altP);
+                _velP = toGain(gains.velP);
+                _velI = toGain(gains.velI);
+                _velD = toGain(gains.velD);
+            }
+
+    }; // class AltitudeGainsT<void>
+
+} // namespace hf
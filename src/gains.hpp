@@ -0,0 +1,115 @@
+/*
+   gains.hpp : PID gains that can be retuned while running
+
+   New gains arrive over MSP in the serial task and are staged in a sequence lock; the gyro task takes them up at
+   the start of its next cycle, all at once.  So the PIDs never run with half of one set and half of another, and
+   the gyro task only ever pays one load of the sequence number to find out there is nothing new.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "seqlock.hpp"
+
+namespace hf {
+
+    // Stabilizer gains, as passed to its constructor, then altitude-hold gains
+    typedef struct {
+
+        float levelP;
+        float gyroCyclicP;
+        float gyroCyclicI;
+        float gyroCyclicD;
+        float gyroYawP;
+        float gyroYawI;
+
+        float altP;
+        float velP;
+        float velI;
+        float velD;
+
+    } gains_t;
+
+    class GainBuffer {
+
+        private:
+
+            SeqLock<gains_t> _staged;
+
+            // Sequence of the set the gyro task last took up
+            uint32_t _taken;
+
+        public:
+
+            // Starts with the gains the flight code was built with
+            void init(const gains_t & current)
+            {
+                _staged.write(current);
+                _taken = _staged.sequence();
+            }
+
+            // Serial side: hands over a new set for the next gyro cycle
+            void stage(const gains_t & gains)
+            {
+                _staged.write(gains);
+            }
+
+            // Serial side: the latest set, running or about to be
+            void get(gains_t & gains) const
+            {
+                _staged.read(gains);
+            }
+
+            // Gyro side: returns true with the new set if one has been staged since the last call
+            bool take(gains_t & gains)
+            {
+                return take(gains, _taken);
+            }
+
+            // For a second consumer on another core, keeping its own record of the sequence it last took up,
+            // starting from sequence()
+            bool take(gains_t & gains, uint32_t & taken)
+            {
+                if (_staged.sequence() == taken) {
+                    return false;
+                }
+
+                taken = _staged.read(gains);
+
+                return true;
+            }
+
+            uint32_t sequence(void) const
+            {
+                return _staged.sequence();
+            }
+
+    }; // class GainBuffer
+
+    // Takes GainBuffer's place when AllFeatures::SERIAL is switched off, or the gains are fixed at compile time (see
+    // gainprofile.hpp), leaving nothing to retune from
+    class NoGainBuffer {
+
+        public:
+
+            void init(const gains_t & current) { (void)current; }
+            bool take(gains_t & gains) { (void)gains; return false; }
+            bool take(gains_t & gains, uint32_t & taken) { (void)gains; (void)taken; return false; }
+            uint32_t sequence(void) const { return 0; }
+
+    }; // class NoGainBuffer
+
+} // namespace hf
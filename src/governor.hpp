@@ -0,0 +1,140 @@
+/*
+   governor.hpp : Sheds non-critical work, a level at a time, when the loop runs short of idle time
+
+   Fed the profiler's CPU load once per load window, the governor goes up a level whenever a window comes in
+   above SHED_PERCENT, and back down one after RESTORE_WINDOWS windows in a row below RESTORE_PERCENT.  Each
+   level keeps the cuts of the ones below it:
+
+       TELEMETRY   serial comms run at a quarter of their rate, and with them MSP subscriptions
+       BLACKBOX    the flight recorder keeps one PID cycle in four
+       FUSION      barometer and accelerometer (altitude fusion) run at half their rate
+       SPECTRUM    the dynamic notch stops tracking, and holds its last peak
+
+   The gyro, PID, and mixer are never touched, so the control rate holds.  Hackflight applies the levels, once
+   Hackflight::initLoadGovernor() has switched the governor on; the governor only decides them.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+namespace hf {
+
+    class LoadGovernor {
+
+        public:
+
+            enum {
+                LEVEL_NOMINAL,
+                LEVEL_TELEMETRY,
+                LEVEL_BLACKBOX,
+                LEVEL_FUSION,
+                LEVEL_SPECTRUM,
+                LEVEL_COUNT
+            };
+
+            static constexpr float SHED_PERCENT    = 85;
+            static constexpr float RESTORE_PERCENT = 60;
+
+            // Shedding lowers the load, so restoring waits to see the headroom last
+            static const uint8_t RESTORE_WINDOWS = 4;
+
+        private:
+
+            bool     _enabled;
+            uint8_t  _level;
+            uint8_t  _quietWindows;
+            uint32_t _changes;
+
+        public:
+
+            LoadGovernor(void) : _enabled(false), _level(LEVEL_NOMINAL), _quietWindows(0), _changes(0) { }
+
+            void init(void)
+            {
+                _level = LEVEL_NOMINAL;
+                _quietWindows = 0;
+                _changes = 0;
+                _enabled = true;
+            }
+
+            bool enabled(void) const
+            {
+                return _enabled;
+            }
+
+            // Called with the load of each completed window; returns true when the level changed
+            bool update(float loadPercent)
+            {
+                if (loadPercent > SHED_PERCENT) {
+                    _quietWindows = 0;
+                    if (_level < LEVEL_COUNT-1) {
+                        _level++;
+                        _changes++;
+                        return true;
+                    }
+                    return false;
+                }
+
+                if (loadPercent >= RESTORE_PERCENT || _level == LEVEL_NOMINAL) {
+                    _quietWindows = 0;
+                    return false;
+                }
+
+                if (++_quietWindows < RESTORE_WINDOWS) {
+                    return false;
+                }
+
+                _quietWindows = 0;
+                _level--;
+                _changes++;
+                return true;
+            }
+
+            uint8_t level(void) const
+            {
+                return _level;
+            }
+
+            // Whether the work cut at the given level is being shed
+            bool shedding(uint8_t level) const
+            {
+                return _level >= level;
+            }
+
+            // Times the level has gone up or down since init()
+            uint32_t changes(void) const
+            {
+                return _changes;
+            }
+
+    }; // class LoadGovernor
+
+    // Takes LoadGovernor's place when there is nothing optional to shed
+    class NoLoadGovernor {
+
+        public:
+
+            void    init(void) { }
+            bool    enabled(void) const { return false; }
+            bool    update(float loadPercent) { (void)loadPercent; return false; }
+            uint8_t level(void) const { return LoadGovernor::LEVEL_NOMINAL; }
+            bool    shedding(uint8_t level) const { (void)level; return false; }
+
+    }; // class NoLoadGovernor
+
+} // namespace hf
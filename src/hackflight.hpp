@@ -27,138 +27,589 @@
 #include "debug.hpp"
 #include "datatypes.hpp"
 #include "altitude.hpp"
+#include "calibration.hpp"
+#include "profiler.hpp"
+#include "blackbox.hpp"
+#include "scheduler.hpp"
+#include "spectrum.hpp"
+#include "rcsmoother.hpp"
+#include "gains.hpp"
+#include "features.hpp"
+#include "pidchain.hpp"
+#include "dualcore.hpp"
+#include "debuglog.hpp"
+#include "oversampler.hpp"
+#include "envelope.hpp"
+#include "governor.hpp"
+#include "vehiclestate.hpp"
+#include "binaryangle.hpp"
 
 namespace hf {
 
-    class Hackflight {
+    // Instantiating with concrete (final) board and receiver classes, e.g. HackflightT<Ladybug, SBUS_Receiver>,
+    // lets the compiler resolve and inline sensor, receiver, and motor calls instead of dispatching them virtually.
+    // The Hackflight typedef below gives the usual runtime-polymorphic version.  MixerType selects the frame;
+    // MixerType and StabilizerType can also select a fixed-point core, e.g. MixerT<MixerQuadXTable<>, Q16_16>
+    // with StabilizerT<Q16_16>, for boards without an FPU.  AltitudeType selects the altitude estimator's
+    // barometer filter, e.g. AltitudeEstimatorT<BarometerT<PressureDecimator<>>> on boards short of RAM.  Both
+    // StabilizerType and AltitudeType can fix their gains at compile time with a profile (see gainprofile.hpp).
+    // Features leaves out whole subsystems at compile time (see features.hpp), or splits the work across two cores
+    // (see dualcore.hpp); Controllers adds further PID controllers after the altitude estimator's (see
+    // pidchain.hpp).
+    template <class BoardT, class ReceiverT, class MixerType=MixerQuadX, class StabilizerType=Stabilizer,
+              class AltitudeType=AltitudeEstimator, class Features=AllFeatures, class Controllers=PidChain<> >
+    class HackflightT {
+
+        public:
+
+            typedef typename Select<Features::ALTITUDE, AltitudeType, NoAltitudeEstimator>::type AltitudeSelected;
 
         private: 
 
             // Passed to Hackflight::init() for a particular board and receiver
-            Board      * board;
-            Receiver   * receiver;
-            Stabilizer * stabilizer;
-
-            // Altitude-estimation task
-            // NB: Try ALT P 50; VEL PID 50;5;30
-            // based on https://github.com/betaflight/betaflight/issues/1003 (Glowhead comment at bottom)
-            AltitudeEstimator altitudeEstimator = AltitudeEstimator(
-                    15,  // Alt P
-                    15,  // Vel P
-                    15,  // Vel I
-                    1);  // Vel D 
-
-            // Eventually we might want to support mixers for different kinds of configurations (tricopter, etc.)
-            Mixer      mixer;
+            BoardT         * board;
+            ReceiverT      * receiver;
+            StabilizerType * stabilizer;
+
+            // Altitude-estimation task, with its default gains (see AltitudeGainsT) or its profile's
+            AltitudeSelected altitudeEstimator;
+
+            // Further PID controllers, run in order after the altitude estimator's
+            Controllers controllers;
+
+            // Mixer for the frame configuration (quad, hex, octo, etc.)
+            MixerType  mixer;
 
             // Vehicle state
             float eulerAngles[3];
+
+            // Yaw as a fraction of a turn
+            BinaryAngle heading;
             bool armed;
 
+            // Attitude and sticks as of the end of the last control cycle, for MSP to reply from
+            typename Select<Features::SERIAL, VehicleState, NoVehicleState>::type vehicleState;
+
             // Auxiliary switch state for change detection
             uint8_t auxState;
 
             // Safety
             bool failsafe;
 
+            // Set once everything the vehicle needs to arm is up (see checkBoot())
+            bool booted;
+
             // Support for headless mode
-            float yawInitial;
+            typename Select<Features::HEADLESS, BinaryAngle, Nothing<BinaryAngle> >::type yawInitial;
+
+            uint32_t gcount, acount, qcount, bcount, rcount, scount;
+
+            // Sources with fresh data on this pass, from Board::pollEvents()
+            uint8_t events;
+
+            // When the last loop pass ended, in board cycles, for the CPU load
+            uint32_t passEndCycles;
+
+            // Loop timing, reported over MSP
+            Profiler profiler;
+
+            // Flight recorder, used when the board has somewhere to put the log
+            typename Select<Features::BLACKBOX, Blackbox, NoBlackbox>::type blackbox;
+            bool blackboxEnabled;
+
+            // Most records encoded and written per flush, keeping it out of the way of the gyro loop
+            static const uint8_t BLACKBOX_FLUSH_RECORDS = 4;
+
+            // Deferred debug messages, drained when enabled
+            typedef typename Select<Features::DEBUG_LOG, DebugLog, NoDebugLog>::type DebugLogSelected;
+
+            // Most debug messages sent or formatted per drain
+            static const uint8_t DEBUG_LOG_FLUSH_RECORDS = 2;
+
+            // Time allowed for one pass through update(), in microseconds; lower-priority tasks that don't fit wait
+            static const uint32_t PASS_BUDGET_MICROS = 1000;
+
+            // Tracks the gyro noise peak for the dynamic notch, when enabled
+            typename Select<Features::DYNAMIC_NOTCH, GyroSpectrum, NoGyroSpectrum>::type spectrum;
+
+            // Interpolates receiver demands between frames, when enabled
+            typename Select<Features::RC_SMOOTHING, RcSmoother, NoRcSmoother>::type rcSmoother;
+
+            // Averages gyro samples down to the PID rate; passes every sample through unless set up
+            GyroOversampler oversampler;
+
+            // Gains staged over MSP for the gyro task to take up, unless fixed at compile time
+            typename Select<Features::SERIAL && StabilizerType::TUNABLE && AltitudeSelected::TUNABLE,
+                     GainBuffer, NoGainBuffer>::type gainBuffer;
+
+            // Mean, min, and max of every gyro sample and attitude between serial replies, for decimated telemetry.
+            // Kept only with MSP, and only on one core, as it is both fed and taken from the loop.
+            typename Select<Features::SERIAL && !Features::DUAL_CORE, TelemetryEnvelope, NoTelemetryEnvelope>::type envelope;
+
+            // Sheds telemetry, blackbox detail, altitude fusion, and notch tracking under load, once switched on by
+            // initLoadGovernor(), when there are any of them to shed
+            typename Select<Features::SERIAL || Features::BLACKBOX || Features::ALTITUDE || Features::DYNAMIC_NOTCH,
+                     LoadGovernor, NoLoadGovernor>::type governor;
+
+            // What the governor's levels cut rates to: serial comms to a quarter, blackbox records to one PID
+            // cycle in four, barometer and accelerometer to half
+            static const uint8_t TELEMETRY_SHED_FACTOR = 4;
+            static const uint8_t BLACKBOX_SHED_CYCLES  = 4;
+            static const uint8_t FUSION_SHED_FACTOR    = 2;
+
+            // Load windows the governor has been given, and PID cycles since the last blackbox record kept while it
+            // sheds blackbox detail
+            uint32_t governedWindows;
+            uint8_t  blackboxCycle;
+
+            // What MSP works on, when there is MSP; see fillMSPContext()
+            typename Select<Features::SERIAL, MSPContext, NoMSPContext>::type mspContext;
 
-            uint32_t gcount, acount, qcount, bcount, rcount;
+            // Runs the check*() tasks below by priority, period, and budget
+            Scheduler<HackflightT, 9> scheduler;
+
+            // Queues between the control core and the background core, in dual-core mode
+            typename Select<Features::DUAL_CORE, DualCoreLink, NoDualCoreLink>::type link;
 
             bool safeAngle(uint8_t axis)
             {
                 return fabs(eulerAngles[axis]) < stabilizer->maxArmingAngle;
             }
 
+            // Reads the attitude as a quaternion or as Euler angles, per Features::QUATERNION
+            bool getAttitude(float quaternion[4])
+            {
+                if (!Features::QUATERNION) {
+                    return board->getEulerAngles(eulerAngles);
+                }
+
+                if (!board->getQuaternion(quaternion)) {
+                    return false;
+                }
+                FastMath::eulerFromQuaternion(quaternion, eulerAngles);
+                return true;
+            }
+
             void checkEulerAngles(void)
             {
-                if (board->getEulerAngles(eulerAngles)) {
+                float quaternion[4];
+
+                if ((events & Board::EVENT_ATTITUDE) && getAttitude(quaternion)) {
 
                     qcount++;
 
-                    // Convert heading from [-pi,+pi] to [0,2*pi]
-                    if (eulerAngles[AXIS_YAW] < 0) {
-                        eulerAngles[AXIS_YAW] += 2*M_PI;
+                    profiler.markBoot(Profiler::BOOT_ATTITUDE, board->getMicroseconds());
+
+                    // Convert heading from [-pi,+pi] to [0,2*pi], by way of a binary angle
+                    heading = BinaryAngle::fromRadians(eulerAngles[AXIS_YAW]);
+                    eulerAngles[AXIS_YAW] = heading.radians();
+
+                    envelope.updateAttitude(eulerAngles);
+
+                    // Update stabilizer with new Euler angles, on whichever core runs it
+                    if (Features::DUAL_CORE) {
+                        link.sendAttitude(eulerAngles, Features::QUATERNION ? quaternion : 0);
                     }
+                    else if (Features::QUATERNION) {
+                        stabilizer->updateQuaternion(quaternion);
+                    }
+                    else {
+                        stabilizer->updateEulerAngles(eulerAngles);
+                    }
+                }
+            }
+
+            // What MSP is given of optional subsystems: nothing, for those switched off
+            static GyroSpectrum * pointer(GyroSpectrum & s) { return &s; }
+            static GyroSpectrum * pointer(NoGyroSpectrum & s) { (void)s; return 0; }
+            static GainBuffer * pointer(GainBuffer & g) { return &g; }
+            static GainBuffer * pointer(NoGainBuffer & g) { (void)g; return 0; }
+            static TelemetryEnvelope * pointer(TelemetryEnvelope & e) { return &e; }
+            static TelemetryEnvelope * pointer(NoTelemetryEnvelope & e) { (void)e; return 0; }
+            static LoadGovernor * pointer(LoadGovernor & g) { return g.enabled() ? &g : 0; }
+            static LoadGovernor * pointer(NoLoadGovernor & g) { (void)g; return 0; }
+            static const VehicleState * pointer(VehicleState & s) { return &s; }
+            static const VehicleState * pointer(NoVehicleState & s) { (void)s; return 0; }
+
+            static const MSPContext * pointer(MSPContext & c) { return &c; }
+            static const MSPContext * pointer(NoMSPContext & c) { (void)c; return 0; }
+
+            // In dual-core mode only the control core drives the motors, so MSP gets no mixer for motor testing
+            void fillMSPContext(MSPContext & c)
+            {
+                c.state    = pointer(vehicleState);
+                c.mixer    = Features::DUAL_CORE ? 0 : &mixer;
+                c.profiler = &profiler;
+                c.spectrum = pointer(spectrum);
+                c.gains    = pointer(gainBuffer);
+                c.envelope = pointer(envelope);
+                c.governor = pointer(governor);
+            }
+
+            void fillMSPContext(NoMSPContext & c) { (void)c; }
+
+            void checkSerialComms(void)
+            {
+                board->doSerialComms(pointer(mspContext), armed);
+            }
+
+            // Once per load window, lets the governor move a level, and sets the task rates for the new one.  The
+            // gyro task applies the blackbox and notch levels itself, on one core only.
+            void checkLoad(void)
+            {
+                uint32_t windows = profiler.getLoadWindows();
+
+                if (!governor.enabled() || windows == governedWindows) {
+                    return;
+                }
+
+                governedWindows = windows;
 
-                    // Update stabilizer with new Euler angles
-                    stabilizer->updateEulerAngles(eulerAngles);
+                if (!governor.update(profiler.getCpuLoad())) {
+                    return;
+                }
+
+                uint8_t telemetry = governor.shedding(LoadGovernor::LEVEL_TELEMETRY) ? TELEMETRY_SHED_FACTOR : 1;
+                uint8_t fusion    = governor.shedding(LoadGovernor::LEVEL_FUSION)    ? FUSION_SHED_FACTOR : 1;
+
+                scheduler.stretch(&HackflightT::checkSerialComms,   telemetry);
+                scheduler.stretch(&HackflightT::checkBarometer,     fusion);
+                scheduler.stretch(&HackflightT::checkAccelerometer, fusion);
+            }
 
-                    // Do serial comms
-                    board->doSerialComms(eulerAngles, armed, receiver, &mixer);
+            // Every PID cycle's record, or one in BLACKBOX_SHED_CYCLES while the governor sheds blackbox detail
+            bool keepBlackboxRecord(void)
+            {
+                if (!governor.shedding(LoadGovernor::LEVEL_BLACKBOX)) {
+                    return true;
                 }
+
+                blackboxCycle = (blackboxCycle + 1) % BLACKBOX_SHED_CYCLES;
+
+                return blackboxCycle == 0;
+            }
+
+            void flushBlackbox(void)
+            {
+                blackbox.flush(board, BLACKBOX_FLUSH_RECORDS);
+            }
+
+            void flushDebugOutput(void)
+            {
+                DebugLogSelected::flush(board, DEBUG_LOG_FLUSH_RECORDS);
+                board->drainOutbuf();
             }
 
             void checkGyroRates(void)
             {
+                // Failsafe goes by the clock, on every pass, so it trips on time even if the gyro or receiver stalls
+                checkFailsafe(board->getMicroseconds());
+
                 float gyroRates[3];
 
-                if (board->getGyroRates(gyroRates)) {
+                // Everything downstream uses the time the sample was acquired
+                uint32_t usec = 0;
+
+                if ((events & Board::EVENT_GYRO) && board->getGyroSample(gyroRates, usec)) {
 
                     gcount++;
 
+                    // Every sample, so telemetry sees the transients the oversampler averages away
+                    envelope.updateGyro(gyroRates);
+
+                    // Pre-integrate rotation for the altitude estimator's IMU, which runs on accel samples, from
+                    // every sample
+                    altitudeEstimator.updateGyro(gyroRates, usec);
+
+                    // The rest runs at the PID rate, on the average of the samples since its last cycle
+                    if (!oversampler.update(gyroRates)) {
+                        return;
+                    }
+
+                    // Take up any gains staged over MSP, all together, before this cycle uses them
+                    gains_t gains;
+                    if (gainBuffer.take(gains)) {
+                        stabilizer->setGains(gains);
+                        altitudeEstimator.setGains(gains);
+                    }
+
+                    // Follow the noise peak with the gyro notch, unless the governor has the notch hold its peak
+                    if (spectrum.enabled() && !governor.shedding(LoadGovernor::LEVEL_SPECTRUM)) {
+                        spectrum.update(gyroRates);
+                        if (spectrum.peakUpdated()) {
+                            stabilizer->setGyroNotch(spectrum.getPeakHz());
+                        }
+                    }
+
                     // Start with demands from receiver
                     demands_t demands;
                     memcpy(&demands, &receiver->demands, sizeof(demands_t));
 
+                    // Smooth out the steps between receiver frames
+                    if (rcSmoother.enabled()) {
+                        rcSmoother.apply(demands, usec);
+                    }
+
+                    // Keep a copy for the blackbox
+                    demands_t demandsIn = demands;
+
                     // Run stabilization to get updated demands
                     stabilizer->modifyDemands(gyroRates, demands);
 
-                    // Run altitude estimator PIDs
+                    // Run altitude estimator PIDs, then any others
                     altitudeEstimator.modifyDemands(demands);
-
-                    // Sync failsafe to gyro loop
-                    checkFailsafe();
+                    controllers.modifyDemands(demands, eulerAngles, armed, usec);
 
                     // Use updated demands to run motors
                     if (armed && !failsafe && !receiver->throttleIsDown()) {
-                        mixer.runArmed(demands);
+                        mixer.runArmed(demands, board);
+                        profiler.updateLatency(board->getMicroseconds() - usec);
                     }
+
+                    // Record flights only
+                    if (blackboxEnabled && armed && keepBlackboxRecord()) {
+                        blackbox.record(usec, gyroRates, demandsIn, demands, mixer.motorValues);
+                    }
+
+                    // The cycle is done: everything MSP reports until the next one comes from here
+                    vehicleState.publish(eulerAngles, receiver);
                 }
             }
 
             void checkBarometer(void)
             {
                 float pressure;
-                if (board->getBarometer(pressure)) {
+                if ((events & Board::EVENT_BARO) && board->getBarometer(pressure)) {
                     bcount++;
                     altitudeEstimator.updateBaro(armed, pressure, board->getMicroseconds());
+                    if (!armed) {
+                        altitudeEstimator.saveCalibration(board);
+                    }
+                    // Hand the control core the new altitude-hold throttle
+                    if (Features::DUAL_CORE) {
+                        sendCommand(false);
+                    }
+                }
+            }
+
+            void checkSonar(void)
+            {
+                float distance;
+                uint32_t timestamp;
+                if (board->getSonarAltitude(distance, timestamp)) {
+                    scount++;
+                    // Straight down from slant range
+                    distance *= cos(eulerAngles[AXIS_ROLL]) * cos(eulerAngles[AXIS_PITCH]);
+                    altitudeEstimator.updateSonar(armed, distance, timestamp);
                 }
             }
 
             void checkAccelerometer(void)
             {
+                // Pre-integrate rotation from the control core's gyro samples first
+                link.receiveGyro(altitudeEstimator);
+
                 float accelGs[3];
-                if (board->getAccelerometer(accelGs)) {
+                if ((events & Board::EVENT_ACCEL) && board->getAccelerometer(accelGs)) {
                     acount++;
                     altitudeEstimator.updateAccel(accelGs, board->getMicroseconds());
                     //Debug::printf("%+3.3f    %+3.3f    %+3.3f\n", accelGs[0], accelGs[1], accelGs[2]);
                 }
             }
 
-            void checkFailsafe(void)
+            void checkFailsafe(uint32_t usec)
             {
-                if (armed && receiver->lostSignal()) {
-                    mixer.cutMotors();
+                if (armed && receiver->inFailsafe(usec)) {
                     armed = false;
                     failsafe = true;
                     board->showArmedStatus(false);
+                    // The control core cuts the motors on being told it is disarmed
+                    if (Features::DUAL_CORE) {
+                        sendCommand(false);
+                    }
+                    else {
+                        mixer.cutMotors(board);
+                    }
                 }
             } 
 
+            // Dual-core mode, background core: tells the control core the receiver demands, arming state, and
+            // altitude-hold throttle
+            void sendCommand(bool newFrame)
+            {
+                command_t command;
+                command.demands = receiver->demands;
+                command.frameMicros = receiver->getFrameTimestampMicros();
+                command.intervalMicros = receiver->getFrameIntervalMicros();
+                demands_t held = receiver->demands;
+                altitudeEstimator.modifyDemands(held);
+                command.holdThrottle = held.throttle;
+                command.holding = altitudeEstimator.isHolding();
+                command.armed = armed;
+                command.throttleDown = receiver->throttleIsDown();
+                command.newFrame = newFrame;
+                link.sendCommand(command);
+            }
+
+            // Dual-core mode, control core: does what the receiver task does on one core for the stabilizer, the
+            // smoother, and the motors
+            void receiveCommands(void)
+            {
+                while (true) {
+
+                    bool wasArmed = link.command().armed;
+
+                    if (!link.receiveCommand()) {
+                        break;
+                    }
+
+                    const command_t & command = link.command();
+
+                    if (command.newFrame) {
+                        demands_t demands = command.demands;
+                        stabilizer->updateDemands(demands);
+                        if (command.throttleDown) {
+                            stabilizer->resetIntegral();
+                        }
+                        if (command.armed && command.throttleDown) {
+                            mixer.cutMotors(board);
+                        }
+                        if (rcSmoother.enabled()) {
+                            rcSmoother.update(command.demands, command.frameMicros, command.intervalMicros,
+                                    !command.armed || command.throttleDown);
+                        }
+                    }
+
+                    // Disarmed by the sticks or by failsafe
+                    if (wasArmed && !command.armed) {
+                        mixer.cutMotors(board);
+                    }
+                }
+            }
+
+            // Dual-core mode, control core: the gyro task, working from what the background core has sent
+            void checkGyroRatesDualCore(void)
+            {
+                float gyroRates[3];
+                uint32_t usec = 0;
+
+                if (!board->getGyroSample(gyroRates, usec)) {
+                    return;
+                }
+
+                gcount++;
+
+                // Everything here, including the samples sent on for the altitude estimator, runs at the PID rate
+                if (!oversampler.update(gyroRates)) {
+                    return;
+                }
+
+                receiveCommands();
+
+                if (link.receiveAttitude()) {
+                    if (Features::QUATERNION) {
+                        stabilizer->updateQuaternion(link.quaternion());
+                    }
+                    else {
+                        stabilizer->updateEulerAngles(link.eulerAngles());
+                    }
+                }
+
+                // The background core takes up the altitude-hold gains itself
+                gains_t gains;
+                if (gainBuffer.take(gains)) {
+                    stabilizer->setGains(gains);
+                }
+
+                link.sendGyro(gyroRates, usec);
+
+                if (spectrum.enabled()) {
+                    spectrum.update(gyroRates);
+                    if (spectrum.peakUpdated()) {
+                        stabilizer->setGyroNotch(spectrum.getPeakHz());
+                    }
+                }
+
+                const command_t & command = link.command();
+
+                demands_t demands = command.demands;
+
+                if (rcSmoother.enabled()) {
+                    rcSmoother.apply(demands, usec);
+                }
+
+                demands_t demandsIn = demands;
+
+                stabilizer->modifyDemands(gyroRates, demands);
+
+                if (command.holding) {
+                    demands.throttle = command.holdThrottle;
+                }
+
+                controllers.modifyDemands(demands, link.eulerAngles(), command.armed, usec);
+
+                if (command.armed && !command.throttleDown) {
+                    mixer.runArmed(demands, board);
+                    profiler.updateLatency(board->getMicroseconds() - usec);
+                }
+
+                if (blackboxEnabled && command.armed) {
+                    blackbox.record(usec, gyroRates, demandsIn, demands, mixer.motorValues);
+                }
+            }
+
+            // Until the vehicle can arm, flashes the LED, and stamps the board's sensors coming up and the vehicle
+            // being ready; the attitude and receiver stamp their own first arrivals
+            void checkBoot(void)
+            {
+                if (booted) {
+                    return;
+                }
+
+                uint32_t usec = board->getMicroseconds();
+
+                if (board->ready()) {
+                    profiler.markBoot(Profiler::BOOT_SENSORS, usec);
+                }
+
+                booted = profiler.bootReached(Profiler::BOOT_SENSORS) &&
+                    profiler.bootReached(Profiler::BOOT_ATTITUDE) &&
+                    profiler.bootReached(Profiler::BOOT_RECEIVER);
+
+                if (booted) {
+                    profiler.markBoot(Profiler::BOOT_READY, usec);
+                }
+
+                board->showBootStatus(!booted);
+            }
+
             void checkReceiver(void)
             {
+                // On its own core, this is the top task: keep the control core up to date, and check failsafe
+                // here instead of in the gyro loop
+                if (Features::DUAL_CORE) {
+                    link.flush();
+                    link.takeGains(gainBuffer, altitudeEstimator);
+                    checkFailsafe(board->getMicroseconds());
+                }
+
+                checkBoot();
+
                 // Acquire receiver demands, passing yaw angle for headless mode
-                if (!receiver->getDemands(eulerAngles[AXIS_YAW] - yawInitial)) return;
+                BinaryAngle yawAngle = Features::HEADLESS ? heading - yawInitial : BinaryAngle();
+                if (!receiver->getDemands(yawAngle, board->getMicroseconds())) return;
 
                 rcount++;
 
+                profiler.markBoot(Profiler::BOOT_RECEIVER, board->getMicroseconds());
+
                 // Update stabilizer with cyclic demands
-                stabilizer->updateDemands(receiver->demands);
+                if (!Features::DUAL_CORE) {
+                    stabilizer->updateDemands(receiver->demands);
+                }
 
                 // When landed, reset integral component of PID
-                if (receiver->throttleIsDown()) {
+                if (!Features::DUAL_CORE && receiver->throttleIsDown()) {
                     stabilizer->resetIntegral();
                 }
 
@@ -168,30 +619,44 @@ namespace hf {
                 } 
 
                 // Arm (after lots of safety checks!)
-                if (!armed && receiver->arming() && !auxState && !failsafe && safeAngle(AXIS_ROLL) && safeAngle(AXIS_PITCH)) {
+                if (!armed && booted && receiver->arming() && !auxState && !failsafe && safeAngle(AXIS_ROLL) && safeAngle(AXIS_PITCH)) {
                     armed = true;
-                    yawInitial = eulerAngles[AXIS_YAW]; // grab yaw for headless mode
+                    yawInitial = heading; // grab yaw for headless mode
                 }
 
                 // Detect aux switch changes for altitude-hold, loiter, etc.
                 if (receiver->demands.aux != auxState) {
                     auxState = receiver->demands.aux;
                     altitudeEstimator.handleAuxSwitch(receiver->demands);
+                    controllers.handleAuxSwitch(receiver->demands);
                 }
 
                 // Cut motors on throttle-down
-                if (armed && receiver->throttleIsDown()) {
-                    mixer.cutMotors();
+                if (!Features::DUAL_CORE && armed && receiver->throttleIsDown()) {
+                    mixer.cutMotors(board);
                 }
 
-                // Set LED based on arming status
-                board->showArmedStatus(armed);
+                // Set LED based on arming status, once it is done showing the boot
+                if (booted) {
+                    board->showArmedStatus(armed);
+                }
+
+                // Hand the new frame to the smoother, once arming state is settled
+                if (!Features::DUAL_CORE && rcSmoother.enabled()) {
+                    rcSmoother.update(receiver->demands, receiver->getFrameTimestampMicros(), receiver->getFrameIntervalMicros(),
+                            !armed || receiver->throttleIsDown());
+                }
+
+                // The control core does all of the above that touches the stabilizer, smoother, and motors
+                if (Features::DUAL_CORE) {
+                    sendCommand(true);
+                }
 
             } // checkReceiver
 
         public:
 
-            void init(Board * _board, Receiver * _receiver, Stabilizer * _stabilizer)
+            void init(BoardT * _board, ReceiverT * _receiver, StabilizerType * _stabilizer)
             {  
                 // Store the essentials
                 board = _board;
@@ -208,26 +673,182 @@ namespace hf {
                 stabilizer->init();
                 mixer.init(board); 
 
-                // Initialize the atitude estimator
+                // Initialize the atitude estimator, starting from the last calibration saved
                 altitudeEstimator.init();
+                altitudeEstimator.loadCalibration(board);
+
+                // Initialize any further PID controllers
+                controllers.init();
 
-                // Start unarmed
+                // Start the retuning buffer from the gains we were built with
+                if (Features::SERIAL) {
+                    gains_t gains;
+                    stabilizer->getGains(gains);
+                    altitudeEstimator.getGains(gains);
+                    gainBuffer.init(gains);
+                }
+
+                // Initialize loop timing
+                profiler.init();
+
+                // Start the first telemetry window
+                envelope.init();
+
+                // Show MSP what it may work on
+                fillMSPContext(mspContext);
+
+                // Nothing shed till the governor is switched on
+                governedWindows = 0;
+                blackboxCycle = 0;
+
+                // Start the queues between the cores
+                link.init();
+
+                // Initialize the flight recorder
+                blackboxEnabled = Features::BLACKBOX && board->hasBlackbox();
+                blackbox.init(mixer.motorCount());
+
+                // Gyro/PID is the top rate group, polled on every pass.  Tasks with period zero poll a cheap
+                // data-ready check; the others run no faster than their data can arrive.
+                //                                                       stage                    prio  period  budget
+                scheduler.init(PASS_BUDGET_MICROS);
+                if (!Features::DUAL_CORE) { // otherwise run by updateControl()
+                    scheduler.addTask(&HackflightT::checkGyroRates, Profiler::STAGE_GYRO,     0,     0,  500);
+                }
+                scheduler.addTask(&HackflightT::checkReceiver,      Profiler::STAGE_RECEIVER, 1,  5000,      200);
+                scheduler.addTask(&HackflightT::checkEulerAngles,   Profiler::STAGE_EULER,    2,     0,      100);
+                if (Features::ALTITUDE) {
+                    scheduler.addTask(&HackflightT::checkBarometer,     Profiler::STAGE_BARO,     3, 10000,  100);
+                    scheduler.addTask(&HackflightT::checkAccelerometer, Profiler::STAGE_ACCEL,    4,  2000,  100);
+                    scheduler.addTask(&HackflightT::checkSonar,         Profiler::STAGE_SONAR,    5,  1000,   50);
+                }
+                if (Features::SERIAL) {
+                    scheduler.addTask(&HackflightT::checkSerialComms,   Profiler::STAGE_SERIAL,   6,  5000,  300);
+                }
+                if (blackboxEnabled) {
+                    scheduler.addTask(&HackflightT::flushBlackbox,  Profiler::STAGE_BLACKBOX, 7,     0,      200);
+                }
+
+                // Debug output is timed on its own, so that it doesn't show up as serial comms
+                scheduler.addTask(&HackflightT::flushDebugOutput,   Profiler::STAGE_DEBUG,    8,  5000,      100);
+
+                // Start unarmed, and level until the first attitude arrives, which can come after the first receiver
+                // frame
                 armed = false;
                 failsafe = false;
+                booted = false;
+                memset(eulerAngles, 0, sizeof(eulerAngles));
+                heading = BinaryAngle();
+
+                // Read every source until the first poll
+                events = Board::EVENT_ALL;
+
+                passEndCycles = board->getCycleCount();
+
+                profiler.markBoot(Profiler::BOOT_INIT, board->getMicroseconds());
 
             } // init
 
+            // Call after init() to have the gyro notch track noise between minHz and maxHz.  The stabilizer's
+            // filters must have been set up with initFilters() for the same gyro sample rate.
+            void initDynamicNotch(float gyroSampleHz, float minHz, float maxHz)
+            {
+                spectrum.init(gyroSampleHz, minHz, maxHz);
+            }
+
+            // Call after init() to have the loop shed non-critical work when the CPU load runs high (see
+            // governor.hpp), instead of slowing everything down together
+            void initLoadGovernor(void)
+            {
+                governor.init();
+                fillMSPContext(mspContext);
+            }
+
+            // Call after init() to interpolate receiver demands between frames
+            void initRcSmoothing(RcSmoother::mode_t mode)
+            {
+                rcSmoother.init(mode);
+            }
+
+            // Call after init() to run the PIDs and mixer on every pidDivider'th gyro sample, on the average of
+            // the samples since the last; the stabilizer's filters and the dynamic notch then see samples at the
+            // gyro rate divided by pidDivider, so set them up for that rate
+            void initGyroOversampling(uint8_t pidDivider)
+            {
+                oversampler.init(pidDivider);
+            }
+
+            // Loop-timing statistics, in board cycles, for benchmarks and diagnostics
+            Profiler & getProfiler(void)
+            {
+                return profiler;
+            }
+
+            // Points a copy of a running Hackflight (e.g. a fork of a simulation checkpoint) at its own copies of the
+            // board, receiver, and stabilizer, so that it carries on from where the original was
+            void rebind(BoardT * _board, ReceiverT * _receiver, StabilizerType * _stabilizer)
+            {
+                board = _board;
+                receiver = _receiver;
+                stabilizer = _stabilizer;
+                mixer.rebind(board);
+            }
+
+            // For choosing the altitude fusion (e.g. useKalmanFilter()) before flight
+            AltitudeSelected & getAltitudeEstimator(void)
+            {
+                return altitudeEstimator;
+            }
+
+            // For configuring the further PID controllers, e.g. getControllers().head
+            Controllers & getControllers(void)
+            {
+                return controllers;
+            }
+
+            // In dual-core mode, runs everything but the gyro task, on the background core
             void update(void)
             {
                 //Debug::printf("G: %d    A: %d    Q: %d    B: %d    R: %d\n", gcount, acount, qcount, bcount, rcount);
 
-                checkGyroRates();
-                checkEulerAngles();
-                checkReceiver();
-                checkAccelerometer();
-                checkBarometer();
+                // One check of what has come in, instead of a call into every source that usually has nothing
+                events = board->pollEvents();
+
+                uint32_t busyCycles = scheduler.run(this, board, &profiler);
+
+                // The control cycles run on the other core, which doesn't get the attitude or sticks, so MSP's
+                // snapshot is of this core's pass instead
+                if (Features::DUAL_CORE) {
+                    vehicleState.publish(eulerAngles, receiver);
+                }
+
+                // Then rest until new data or the next task with a period is due.  Whatever the pass didn't spend
+                // in tasks (polling, and the rest) counts as spare, as boards that can't sleep poll in its place.
+                board->idle(scheduler.microsUntilDue(board->getMicroseconds()));
+                uint32_t cycles = board->getCycleCount();
+                uint32_t passCycles = cycles - passEndCycles;
+                busyCycles = busyCycles < passCycles ? busyCycles : passCycles;
+                profiler.updateLoad(busyCycles, passCycles - busyCycles, board->getCyclesPerMicrosecond());
+                passEndCycles = cycles;
+
+                checkLoad();
             } 
 
-    }; // class Hackflight
+            // Dual-core mode: call as often as possible on the core that owns the motors, after init() and while
+            // the other core calls update().  The board's gyro and motor routines are called from this core only, its
+            // clock and cycle counter from both, and the rest from the other core.  The gyro stage's statistics are
+            // written here and read over MSP there, so one report can catch them mid-update.
+            void updateControl(void)
+            {
+                static_assert(Features::DUAL_CORE, "updateControl() needs Features::DUAL_CORE");
+
+                uint32_t startCycles = board->getCycleCount();
+                checkGyroRatesDualCore();
+                profiler.update(Profiler::STAGE_GYRO, board->getCycleCount() - startCycles);
+            }
+
+    }; // class HackflightT
+
+    typedef HackflightT<Board, Receiver> Hackflight;
 
 } // namespace
@@ -0,0 +1,429 @@
+/*
+   hil.hpp : Framing for hardware-in-the-loop runs, between a board's sensors and flight code on a host
+
+   The board (see boards/real/hilbridge.hpp) streams its sensor samples to the host and takes motor values back;
+   the host (see boards/hil/hilboard.hpp) runs the flight code against them.  Both directions use one packet
+   format, sized to fit a USB full-speed bulk packet, so that a packet goes out as one USB transfer:
+
+       sync (0xA5), body size, sequence number, base time (uint32 microseconds), records..., CRC8-DVB-S2
+
+   The CRC covers everything after the sync byte.  Each record is a type byte and a uint16 offset in
+   microseconds from the base time, followed by its values, little-endian:
+
+       GYRO        int16 x 3, rad/s in units of 2^-10 (to about 1830 deg/s)
+       ACCEL       int16 x 3, g in units of 2^-11 (to 16 g)
+       QUATERNION  int16 x 4 (w, x, y, z) in units of 2^-14
+       BARO        float, millibars
+       MOTORS      uint8 count, then uint16 x count, [0,1] in units of 1/65535
+
+   Many samples share one base time, so a gyro sample takes nine bytes and six go in a packet.  Motor packets
+   carry the time of the latest gyro sample the host had used as their base time, so the board can tell how
+   long the round trip took.  A gap in the sequence numbers shows a packet was lost.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+namespace hf {
+
+    class HIL {
+
+        public:
+
+            static const uint8_t SYNC = 0xA5;
+
+            // One USB full-speed bulk packet
+            static const uint8_t PACKET_SIZE = 64;
+
+            // Sync, size, sequence, and base time ahead of the records
+            static const uint8_t HEADER_SIZE = 7;
+
+            static const uint8_t MAX_MOTORS = 8;
+
+            enum {
+                GYRO = 1,
+                ACCEL,
+                QUATERNION,
+                BARO,
+                MOTORS
+            };
+
+            // A decoded record
+            typedef struct {
+                uint8_t  type;
+                uint32_t usec;
+                uint8_t  count;               // values used
+                float    values[MAX_MOTORS];
+            } record_t;
+
+            static constexpr float GYRO_UNITS       = 1024;   // per rad/s
+            static constexpr float ACCEL_UNITS      = 2048;   // per g
+            static constexpr float QUATERNION_UNITS = 16384;
+            static constexpr float MOTOR_UNITS      = 65535;
+
+            static uint8_t crc8(uint8_t crc, uint8_t a)
+            {
+                crc ^= a;
+                for (uint8_t k=0; k<8; ++k) {
+                    crc = (crc & 0x80) ? (crc << 1) ^ 0xD5 : crc << 1;
+                }
+                return crc;
+            }
+
+            // Bytes a record takes, type and offset included; zero for a type we don't know
+            static uint8_t recordSize(uint8_t type, uint8_t count=0)
+            {
+                switch (type) {
+                    case GYRO:       return 3 + 6;
+                    case ACCEL:      return 3 + 6;
+                    case QUATERNION: return 3 + 8;
+                    case BARO:       return 3 + 4;
+                    case MOTORS:     return 3 + 1 + 2*count;
+                }
+                return 0;
+            }
+
+    }; // class HIL
+
+    // Builds one packet at a time.  Records are added until the next won't fit; finish() then closes the packet,
+    // and the next record starts another.
+    class HILWriter {
+
+        private:
+
+            uint8_t  _buf[HIL::PACKET_SIZE];
+            uint8_t  _size;
+            uint8_t  _sequence;
+            uint32_t _base;
+
+            void put8(uint8_t a)
+            {
+                _buf[_size++] = a;
+            }
+
+            void put16(uint16_t a)
+            {
+                put8(a & 0xFF);
+                put8(a >> 8);
+            }
+
+            void putScaled(float value, float units)
+            {
+                float scaled = value * units;
+                scaled = scaled < -32767 ? -32767 : (scaled > 32767 ? 32767 : scaled);
+                put16((uint16_t)(int16_t)(scaled + (scaled < 0 ? -.5f : +.5f)));
+            }
+
+            // Starts a record, and the packet if this is its first
+            void begin(uint8_t type, uint32_t usec)
+            {
+                if (empty()) {
+                    _base = usec;
+                    _size = HIL::HEADER_SIZE;
+                }
+                put8(type);
+                put16((uint16_t)(usec - _base));
+            }
+
+        public:
+
+            HILWriter(void) : _size(0), _sequence(0), _base(0) { }
+
+            bool empty(void) const
+            {
+                return _size == 0;
+            }
+
+            // Time of the packet's first record
+            uint32_t base(void) const
+            {
+                return _base;
+            }
+
+            // Whether a record of the given type (and motor count) fits in the packet as it stands; one whose
+            // offset from the base time wouldn't fit in sixteen bits doesn't
+            bool fits(uint8_t type, uint32_t usec, uint8_t count=0) const
+            {
+                return empty() || (_size + HIL::recordSize(type, count) + 1 <= HIL::PACKET_SIZE &&
+                        usec - _base <= UINT16_MAX);
+            }
+
+            void gyro(uint32_t usec, const float gyroRates[3])
+            {
+                begin(HIL::GYRO, usec);
+                for (uint8_t k=0; k<3; ++k) {
+                    putScaled(gyroRates[k], HIL::GYRO_UNITS);
+                }
+            }
+
+            void accel(uint32_t usec, const float accelGs[3])
+            {
+                begin(HIL::ACCEL, usec);
+                for (uint8_t k=0; k<3; ++k) {
+                    putScaled(accelGs[k], HIL::ACCEL_UNITS);
+                }
+            }
+
+            void quaternion(uint32_t usec, const float q[4])
+            {
+                begin(HIL::QUATERNION, usec);
+                for (uint8_t k=0; k<4; ++k) {
+                    putScaled(q[k], HIL::QUATERNION_UNITS);
+                }
+            }
+
+            void baro(uint32_t usec, float pressure)
+            {
+                begin(HIL::BARO, usec);
+                uint32_t bits;
+                memcpy(&bits, &pressure, 4);
+                put16(bits & 0xFFFF);
+                put16(bits >> 16);
+            }
+
+            void motors(uint32_t usec, const float * values, uint8_t count)
+            {
+                count = count < HIL::MAX_MOTORS ? count : HIL::MAX_MOTORS;
+                begin(HIL::MOTORS, usec);
+                put8(count);
+                for (uint8_t k=0; k<count; ++k) {
+                    float value = values[k] < 0 ? 0 : (values[k] > 1 ? 1 : values[k]);
+                    put16((uint16_t)(value * HIL::MOTOR_UNITS + .5f));
+                }
+            }
+
+            // Fills in the header and CRC, returning the packet and its size; the writer then starts afresh
+            const uint8_t * finish(uint8_t & size)
+            {
+                _buf[0] = HIL::SYNC;
+                _buf[1] = _size - 2;     // sequence, base time, and records
+                _buf[2] = _sequence++;
+                for (uint8_t k=0; k<4; ++k) {
+                    _buf[3+k] = (_base >> (8*k)) & 0xFF;
+                }
+
+                uint8_t crc = 0;
+                for (uint8_t k=1; k<_size; ++k) {
+                    crc = HIL::crc8(crc, _buf[k]);
+                }
+                _buf[_size] = crc;
+
+                size = _size + 1;
+                _size = 0;
+                return _buf;
+            }
+
+    }; // class HILWriter
+
+    // Finds packets in a byte stream, however it is split up, and hands out their records.  A packet whose CRC
+    // fails is dropped, and the search for the next sync byte starts again just after the bad one's.
+    class HILReader {
+
+        private:
+
+            uint8_t  _buf[HIL::PACKET_SIZE];
+            uint8_t  _size;       // bytes of the current packet so far
+            uint8_t  _read;       // offset of the next record to hand out, once a packet is in
+            uint8_t  _length;     // size of the packet that is in
+            uint32_t _base;
+
+            bool     _synced;
+            uint8_t  _sequence;   // expected next
+
+            uint32_t _packets;
+            uint32_t _lost;
+            uint32_t _bad;
+
+            uint16_t get16(uint8_t offset) const
+            {
+                return _buf[offset] | (uint16_t)_buf[offset+1] << 8;
+            }
+
+            float getScaled(uint8_t offset, float units) const
+            {
+                return (int16_t)get16(offset) / units;
+            }
+
+            // Checks the packet just completed, returning true if it is good
+            bool check(void)
+            {
+                uint8_t crc = 0;
+                for (uint8_t k=1; k<_size-1; ++k) {
+                    crc = HIL::crc8(crc, _buf[k]);
+                }
+
+                if (crc != _buf[_size-1]) {
+                    _bad++;
+                    return false;
+                }
+
+                if (_synced) {
+                    _lost += (uint8_t)(_buf[2] - _sequence);
+                }
+                _synced = true;
+                _sequence = _buf[2] + 1;
+
+                _packets++;
+
+                _base = _buf[3] | (uint32_t)_buf[4] << 8 | (uint32_t)_buf[5] << 16 | (uint32_t)_buf[6] << 24;
+                _length = _size - 1;
+                _read = HIL::HEADER_SIZE;
+
+                return true;
+            }
+
+            // After a bad packet, starts looking again from the byte after its sync byte
+            void resync(void)
+            {
+                uint8_t k = 1;
+                while (k < _size && _buf[k] != HIL::SYNC) {
+                    k++;
+                }
+                memmove(_buf, &_buf[k], _size - k);
+                _size -= k;
+            }
+
+        public:
+
+            HILReader(void) { init(); }
+
+            void init(void)
+            {
+                _size = 0;
+                _read = 0;
+                _length = 0;
+                _base = 0;
+                _synced = false;
+                _sequence = 0;
+                _packets = 0;
+                _lost = 0;
+                _bad = 0;
+            }
+
+            // Takes one byte, returning true when it completes a good packet, whose records next() then hands
+            // out.  The records of one packet must be taken before the next byte goes in.
+            bool parse(uint8_t c)
+            {
+                _length = 0;
+
+                if (_size == 0 && c != HIL::SYNC) {
+                    return false;
+                }
+
+                _buf[_size++] = c;
+
+                while (_size >= 2) {
+
+                    // Header (sync, size), body, CRC
+                    uint8_t total = 2 + _buf[1] + 1;
+
+                    if (_buf[1] < 5 || total > HIL::PACKET_SIZE) {
+                        _bad++;
+                        resync();
+                        continue;
+                    }
+
+                    if (_size < total) {
+                        return false;
+                    }
+
+                    if (check()) {
+                        _size = 0;
+                        return true;
+                    }
+
+                    resync();
+                }
+
+                return false;
+            }
+
+            // The next record of the packet parse() just completed; false when there are no more
+            bool next(HIL::record_t & record)
+            {
+                if (_read + 3 > _length) {
+                    return false;
+                }
+
+                uint8_t type = _buf[_read];
+                uint8_t count = type == HIL::MOTORS && _read + 3 < _length ? _buf[_read+3] : 0;
+                uint8_t size = HIL::recordSize(type, count);
+
+                // An unknown or cut-off record ends the packet
+                if (!size || count > HIL::MAX_MOTORS || _read + size > _length) {
+                    _read = _length;
+                    return false;
+                }
+
+                uint8_t at = _read + 3;
+
+                record.type = type;
+                record.usec = _base + get16(_read+1);
+
+                switch (type) {
+
+                    case HIL::GYRO:
+                    case HIL::ACCEL:
+                        record.count = 3;
+                        for (uint8_t k=0; k<3; ++k) {
+                            record.values[k] = getScaled(at+2*k, type == HIL::GYRO ? HIL::GYRO_UNITS : HIL::ACCEL_UNITS);
+                        }
+                        break;
+
+                    case HIL::QUATERNION:
+                        record.count = 4;
+                        for (uint8_t k=0; k<4; ++k) {
+                            record.values[k] = getScaled(at+2*k, HIL::QUATERNION_UNITS);
+                        }
+                        break;
+
+                    case HIL::BARO:
+                        {
+                            uint32_t bits = get16(at) | (uint32_t)get16(at+2) << 16;
+                            record.count = 1;
+                            memcpy(&record.values[0], &bits, 4);
+                        }
+                        break;
+
+                    case HIL::MOTORS:
+                        record.count = count;
+                        for (uint8_t k=0; k<count; ++k) {
+                            record.values[k] = get16(at+1+2*k) / HIL::MOTOR_UNITS;
+                        }
+                        break;
+                }
+
+                _read += size;
+
+                return true;
+            }
+
+            // Base time of the packet parse() just completed
+            uint32_t base(void) const
+            {
+                return _base;
+            }
+
+            uint32_t packets(void) const { return _packets; }
+            uint32_t lost(void) const    { return _lost; }
+            uint32_t bad(void) const     { return _bad; }
+
+    }; // class HILReader
+
+} // namespace hf
@@ -0,0 +1,130 @@
+/*
+   i2cqueue.hpp : Queue of register reads for a non-blocking I^2C transport
+
+   A board submits reads (device address, first register, buffer, count), each with a flag that is set once its
+   buffer holds the result, and calls service() on every pass.  The transport moves each read's bytes in the
+   background, by interrupt or DMA, so the loop goes on computing with the previous sample while the next is in
+   flight; service() only notices that a read is done and starts the next.  A transport that can only block
+   works too: each read then finishes inside service().
+
+   The transport needs two methods, both called from the main loop only:
+
+       bool start(uint8_t address, uint8_t reg, uint8_t * buf, uint8_t count)   // false if it couldn't start
+       bool done(void)                                                           // the read started last is over
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+namespace hf {
+
+    template <class Transport, uint8_t SIZE=4>
+    class I2CQueue {
+
+        public:
+
+            typedef struct {
+                uint8_t   address;
+                uint8_t   reg;
+                uint8_t * buf;
+                uint8_t   count;
+                bool    * done;    // set when buf holds the result
+            } read_t;
+
+        private:
+
+            Transport * _transport;
+
+            read_t  _reads[SIZE];
+            uint8_t _first;        // the read in flight, when busy, or the next to start
+            uint8_t _count;
+            bool    _busy;
+
+        public:
+
+            I2CQueue(void) : _transport(0), _first(0), _count(0), _busy(false) { }
+
+            void init(Transport * transport)
+            {
+                _transport = transport;
+                _first = 0;
+                _count = 0;
+                _busy = false;
+            }
+
+            // Queues a read, clearing its flag; returns false if the queue is full
+            bool submit(uint8_t address, uint8_t reg, uint8_t * buf, uint8_t count, bool * done)
+            {
+                if (_count == SIZE) {
+                    return false;
+                }
+
+                read_t & r = _reads[(_first + _count) % SIZE];
+                r.address = address;
+                r.reg = reg;
+                r.buf = buf;
+                r.count = count;
+                r.done = done;
+                *done = false;
+                _count++;
+
+                return true;
+            }
+
+            // Finishes the read in flight if the transport is done with it, and starts queued ones until one is left
+            // in flight or none are queued
+            void service(void)
+            {
+                while (true) {
+
+                    if (_busy) {
+                        if (!_transport->done()) {
+                            return;
+                        }
+                        *_reads[_first].done = true;
+                        _first = (_first + 1) % SIZE;
+                        _count--;
+                        _busy = false;
+                    }
+
+                    if (_count == 0) {
+                        return;
+                    }
+
+                    const read_t & r = _reads[_first];
+                    if (!_transport->start(r.address, r.reg, r.buf, r.count)) {
+                        return; // bus still busy with something else; try again on the next pass
+                    }
+                    _busy = true;
+                }
+            }
+
+            // True when service() has a finished read to hand over, so a board sleeping in idle() can wake for it
+            bool finished(void)
+            {
+                return _busy && _transport->done();
+            }
+
+            bool empty(void)
+            {
+                return _count == 0;
+            }
+
+    }; // class I2CQueue
+
+} // namespace hf
@@ -20,14 +20,26 @@
    along with EM7180.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#pragma once
+
 #include <math.h>
+#include <string.h>
 
 #include "filter.hpp"
+#include "binaryangle.hpp"
 
 namespace hf {
 
     class IMU {
 
+        public:
+
+            // How gyro rates are propagated into the attitude used for Earth-frame acceleration
+            typedef enum {
+                PROPAGATE_MATRIX,     // rebuild a full rotation matrix from Euler deltas (six trig calls) per update
+                PROPAGATE_QUATERNION  // first-order quaternion integration; no trig calls
+            } propagation_t;
+
         private:
 
             const float ACCEL_LPF_CUTOFF  = 5.0f;
@@ -35,10 +47,15 @@ namespace hf {
             const float ACCEL_Z_DEADBAND  = 0.02f;
 
             float   accel[3];
-            float   gyro[3];
+
+            // Gyro pre-integration: rotation (radians) since the last accel sample, and the latest gyro sample
+            float    deltaAngle[3];
+            float    gyro[3];
+            uint32_t gyroTime;
+            bool     haveGyro;
 
             float anglerad[2] = { 0.0f, 0.0f };    // absolute angle inclination in radians
-            int16_t heading;
+            BinaryAngle heading;
             float EstG[3];
             uint32_t previousTime;
             float fc_accel;
@@ -54,6 +71,64 @@ namespace hf {
             float accelZoffset;
             float accelSmooth[3];
 
+            // Vertical acceleration less one G, integrated over time (G-usec), with no offset removal or deadband
+            float accelIncrementZ;
+
+            propagation_t propagation;
+
+            // Body-to-Earth attitude quaternion for PROPAGATE_QUATERNION
+            float q[4];
+
+            // Gain (1/sec) pulling the quaternion's gravity direction toward the accelerometer's, so that it can
+            // serve as the attitude estimate of a board with a raw IMU; zero leaves the gyro integration alone
+            float accelCorrection;
+
+            // Longest interval to apply the correction over, so the first sample can't swing the estimate
+            const float ACCEL_CORRECTION_MAX_DT = 0.1f;
+
+            // Adds to a delta angle the rotation that turns the estimated gravity direction toward the measured one:
+            // their cross product, as in a Mahony filter's proportional term
+            void correctFromAccel(float delta[3], float dT)
+            {
+                float norm = sqrtf(accel[0]*accel[0] + accel[1]*accel[1] + accel[2]*accel[2]);
+
+                if (norm == 0 || dT > ACCEL_CORRECTION_MAX_DT) {
+                    return;
+                }
+
+                float ax = accel[0] / norm, ay = accel[1] / norm, az = accel[2] / norm;
+                float gain = accelCorrection * dT;
+
+                delta[0] += gain * (ay*EstG[2] - az*EstG[1]);
+                delta[1] += gain * (az*EstG[0] - ax*EstG[2]);
+                delta[2] += gain * (ax*EstG[1] - ay*EstG[0]);
+            }
+
+            // Rotates by a body-frame delta angle: q += 0.5 * q (x) (0, delta), then renormalizes
+            void propagateQuaternion(const float delta[3])
+            {
+                float hx = 0.5f * delta[0];
+                float hy = 0.5f * delta[1];
+                float hz = 0.5f * delta[2];
+
+                float qw = q[0], qx = q[1], qy = q[2], qz = q[3];
+
+                q[0] = qw - qx*hx - qy*hy - qz*hz;
+                q[1] = qx + qw*hx + qy*hz - qz*hy;
+                q[2] = qy + qw*hy - qx*hz + qz*hx;
+                q[3] = qz + qw*hz + qx*hy - qy*hx;
+
+                float norm = 1 / sqrtf(q[0]*q[0] + q[1]*q[1] + q[2]*q[2] + q[3]*q[3]);
+                for (uint8_t k=0; k<4; ++k) {
+                    q[k] *= norm;
+                }
+
+                // Earth Z axis seen in the body frame is the third row of the rotation matrix
+                EstG[0] = 2 * (q[1]*q[3] - q[0]*q[2]);
+                EstG[1] = 2 * (q[2]*q[3] + q[0]*q[1]);
+                EstG[2] = q[0]*q[0] - q[1]*q[1] - q[2]*q[2] + q[3]*q[3];
+            }
+
              // Rotate Estimated vector(s) with small angle approximation, according to the gyro data
             static void rotateV(float *vout, float *delta)
             {
@@ -92,41 +167,82 @@ namespace hf {
                 vout[2] = v_tmp[0] * mat[0][2] + v_tmp[1] * mat[1][2] + v_tmp[2] * mat[2][2];
             }
 
+            // Trapezoidal integration of the gyro from the previous sample time to currentTime; past the latest
+            // sample, the latest rate is held
+            void integrateGyro(uint32_t currentTime, const float * newGyro=NULL)
+            {
+                if (!haveGyro) {
+                    return;
+                }
+
+                float dt = (int32_t)(currentTime - gyroTime) * 1.e-6f;
+
+                if (dt <= 0) {
+                    return;
+                }
+
+                for (uint8_t axis=0; axis<3; ++axis) {
+                    float rate = newGyro ? (gyro[axis] + newGyro[axis]) / 2 : gyro[axis];
+                    deltaAngle[axis] += rate * dt;
+                }
+
+                gyroTime = currentTime;
+            }
+
             void update(uint32_t currentTime)
             {
                 uint32_t deltaTime = currentTime - previousTime;
-                float scale = deltaTime * 1.e-6;
                 previousTime = currentTime;
 
-                // Initialize
+                // Rotation since the previous accel sample, carried forward at the latest rate to this one
+                integrateGyro(currentTime);
                 float deltaGyroAngle[3];
                 for (uint8_t axis = 0; axis < 3; axis++) {
-                    deltaGyroAngle[axis] = gyro[axis] * scale;
+                    deltaGyroAngle[axis] = deltaAngle[axis];
+                    deltaAngle[axis] = 0;
                     accelSmooth[axis] = Filter::complementary(accel[axis], accelSmooth[axis], ACCEL_LPF_FACTOR);
                 }
 
-                // Rotate into Earth frame
-                rotateV(EstG, deltaGyroAngle);
-
-                // Attitude of the estimated vector
-                anglerad[0] = atan2f(EstG[1], EstG[2]);
-                anglerad[1] = atan2f(-EstG[0], sqrtf(EstG[1] * EstG[1] + EstG[2] * EstG[2]));
-
                 // deltaTime is measured in us ticks
                 float dT = (float)deltaTime * 1e-6f;
 
-                // the accel values have to be rotated into the earth frame
-                float rpy[3];
-                rpy[0] = -(float)anglerad[0];
-                rpy[1] = -(float)anglerad[1];
-                rpy[2] = -(float)heading * M_PI / 180.0f;;
-
                 float accel_ned[3];
-                accel_ned[0] = accelSmooth[0];
-                accel_ned[1] = accelSmooth[1];
-                accel_ned[2] = accelSmooth[2];
 
-                IMU::rotateV(accel_ned, rpy);
+                if (propagation == PROPAGATE_QUATERNION) {
+
+                    if (accelCorrection > 0) {
+                        correctFromAccel(deltaGyroAngle, dT);
+                    }
+
+                    propagateQuaternion(deltaGyroAngle);
+
+                    // Only the vertical component is used below, and it is the projection onto Earth Z
+                    accel_ned[2] = EstG[0]*accelSmooth[0] + EstG[1]*accelSmooth[1] + EstG[2]*accelSmooth[2];
+                }
+
+                else {
+
+                    // Rotate into Earth frame
+                    rotateV(EstG, deltaGyroAngle);
+
+                    // Attitude of the estimated vector
+                    anglerad[0] = atan2f(EstG[1], EstG[2]);
+                    anglerad[1] = atan2f(-EstG[0], sqrtf(EstG[1] * EstG[1] + EstG[2] * EstG[2]));
+
+                    // the accel values have to be rotated into the earth frame
+                    float rpy[3];
+                    rpy[0] = -(float)anglerad[0];
+                    rpy[1] = -(float)anglerad[1];
+                    rpy[2] = -heading.signedRadians();
+
+                    accel_ned[0] = accelSmooth[0];
+                    accel_ned[1] = accelSmooth[1];
+                    accel_ned[2] = accelSmooth[2];
+
+                    IMU::rotateV(accel_ned, rpy);
+                }
+
+                accelIncrementZ += (accel_ned[2] - 1) * deltaTime;
 
                 accelZoffset -= accelZoffset / 64;
                 accelZoffset += accel_ned[2];
@@ -151,9 +267,33 @@ namespace hf {
 
         public:
 
-            void init(void)
+            void init(propagation_t _propagation=PROPAGATE_MATRIX)
             {
+                propagation = _propagation;
+
+                // Start level, facing north
+                q[0] = 1;
+                q[1] = 0;
+                q[2] = 0;
+                q[3] = 0;
+                EstG[0] = 0;
+                EstG[1] = 0;
+                EstG[2] = 1;
+                heading = BinaryAngle();
+                accelCorrection = 0;
+
+                memset(accel, 0, 3*sizeof(float));
+                memset(gyro, 0, 3*sizeof(float));
+                memset(deltaAngle, 0, 3*sizeof(float));
+                gyroTime = 0;
+                haveGyro = false;
+                memset(accelSmooth, 0, 3*sizeof(float));
+                previousTime = 0;
+                accelZsmooth = 0;
+                accelZ_tmp = 0;
+
                 accelZoffset = 0;
+                accelIncrementZ = 0;
 
                 fc_accel = 0.5f / (M_PI * ACCEL_LPF_CUTOFF); // calculate RC time constant used in the accelZ lpf
 
@@ -177,21 +317,60 @@ namespace hf {
                 return vel_acc;
             }
 
+            // Change in vertical velocity (cm/sec) since the last call, for estimators that track accelerometer
+            // bias themselves
+            float getVerticalVelocityIncrement(void)
+            {
+                float dv = accelIncrementZ * 9.80665e-4f;
+                accelIncrementZ = 0;
+                return dv;
+            }
+
+            // Vertical specific force at rest (Gs), as learned so far or seeded from an earlier boot
+            float getAccelZoffset(void)
+            {
+                return accelZoffset / 64;
+            }
+
+            // Call after init()
+            void seedAccelZoffset(float offset)
+            {
+                accelZoffset = 64 * offset;
+            }
+
+            // With PROPAGATE_QUATERNION, corrects the attitude toward the accelerometer's gravity direction at this
+            // rate (1/sec; e.g. 1-2), so that getQuaternion() gives a drift-free roll and pitch.  Call after init().
+            void setAccelCorrection(float gain)
+            {
+                accelCorrection = gain;
+            }
+
+            // Body-to-Earth attitude (w, x, y, z), as of the latest accel sample, with PROPAGATE_QUATERNION
+            void getQuaternion(float quaternion[4])
+            {
+                memcpy(quaternion, q, 4*sizeof(float));
+            }
+
             float getVerticalAcceleration(void)
             {
                 return accelZ_tmp;
             }
 
+            // Runs the attitude and vertical-acceleration update, over the interval since the previous accel sample
             void updateAccel(float _accel[3], uint32_t currentTime)
             {
                 memcpy(accel, _accel, 3*sizeof(float));
                 update(currentTime);
             }
 
+            // Only accumulates rotation, so gyro samples can come at the full loop rate; the rest of the work waits
+            // for the next accel sample.  The time is when the sample was acquired.
             void updateGyro(float _gyro[3], uint32_t currentTime)
             {
+                integrateGyro(currentTime, _gyro);
                 memcpy(gyro, _gyro, 3*sizeof(float));
-                update(currentTime);
+                gyroTime = currentTime;
+                haveGyro = true;
             }
 
     }; // class IMU
@@ -1,120 +1,247 @@
-/*
-   mixer.hpp : Mixer class header
-
-   This file is part of Hackflight.
-
-   Hackflight is free software: you can redistribute it and/or modify
-   it under the terms of the GNU General Public License as published by
-   the Free Software Foundation, either version 3 of the License, or
-   (at your option) any later version.
-
-   Hackflight is distributed in the hope that it will be useful,
-   but WITHOUT ANY WARRANTY; without even the implied warranty of
-   MEReceiverHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
-   GNU General Public License for more details.
-   You should have received a copy of the GNU General Public License
-   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
- */
-
-#pragma once
-
-#include "board.hpp"
-#include "filter.hpp"
-#include "debug.hpp"
-#include "datatypes.hpp"
-
-#include <cstring>
-
-namespace hf {
-
-    class Mixer {
-
-        public:
-
-            // This is set by MSP
-            float  motorsDisarmed[4];
-
-            void init(Board * _board)
-            {
-                //  T   A    E   R
-                mixerQuadX[0] = { +1, -1,  +1, +1 };    // right rear
-                mixerQuadX[1] = { +1, -1,  -1, -1 };    // right front
-                mixerQuadX[2] = { +1, +1,  +1, -1 };    // left rear
-                mixerQuadX[3] = { +1, +1,  -1, +1 };    // left front
-
-                board = _board;
-
-                // set disarmed motor values
-                for (uint8_t i = 0; i < 4; i++)
-                    motorsDisarmed[i] = 0;
-            }
-
-            void runArmed(demands_t demands)
-            {
-                float motors[4];
-
-                for (uint8_t i = 0; i < 4; i++) {
-
-                    motors[i] = 
-                        (demands.throttle * mixerQuadX[i].throttle + 
-                         demands.roll     * mixerQuadX[i].roll +     
-                         demands.pitch    * mixerQuadX[i].pitch +   
-                         demands.yaw      * mixerQuadX[i].yaw);      
-                }
-
-                float maxMotor = motors[0];
-
-                for (uint8_t i = 1; i < 4; i++)
-                    if (motors[i] > maxMotor)
-                        maxMotor = motors[i];
-
-                for (uint8_t i = 0; i < 4; i++) {
-
-                    // This is a way to still have good gyro corrections if at least one motor reaches its max
-                    if (maxMotor > 1) {
-                        motors[i] -= maxMotor - 1;
-                    }
-
-                    // Keep motor values in interval [0,1]
-                    motors[i] = Filter::constrainMinMax(motors[i], 0, 1);
-                }
-
-                for (uint8_t i = 0; i < 4; i++) {
-                    board->writeMotor(i, motors[i]);
-                }
-            }
-
-            // This is how we can spin the motors from the GCS
-            void runDisarmed(void)
-            {
-                for (uint8_t i = 0; i < 4; i++) {
-                    board->writeMotor(i, motorsDisarmed[i]);
-                }
-            }
-
-            void cutMotors(void)
-            {
-                for (uint8_t i = 0; i < 4; i++) {
-                    board->writeMotor(i, 0);
-                }
-            }
-
-
-        private:
-
-            Receiver * rc;
-
-            Board * board;
-
-            // Custom mixer data per motor
-            typedef struct motorMixer_t {
-                int8_t throttle; // T
-                int8_t roll; 	 // A
-                int8_t pitch;	 // E
-                int8_t yaw;	     // R
-            } motorMixer_t;
-
-            motorMixer_t mixerQuadX[4];
-    };
-
-} // namespace
+/*
+   mixer.hpp : Mixer class header
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MEReceiverHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "board.hpp"
+#include "filter.hpp"
+#include "debug.hpp"
+#include "datatypes.hpp"
+
+#include <cstring>
+
+namespace hf {
+
+    // Mixing tables give one {throttle, roll, pitch, yaw} row per motor.  Roll is positive for motors on the left,
+    // pitch positive for motors at the rear.  The tables are templates only so that this header can define their
+    // static data without violating the one-definition rule.
+
+    template <typename T=void>
+    struct MixerQuadXTable {
+        static constexpr uint8_t MOTORS = 4;
+        static constexpr float table[MOTORS][4] = {
+            //  T   A    E   R
+            { +1, -1,  +1, +1 },    // right rear
+            { +1, -1,  -1, -1 },    // right front
+            { +1, +1,  +1, -1 },    // left rear
+            { +1, +1,  -1, +1 },    // left front
+        };
+    };
+    template <typename T> constexpr float MixerQuadXTable<T>::table[MixerQuadXTable<T>::MOTORS][4];
+
+    // Motors clockwise from front right
+    template <typename T=void>
+    struct MixerHexXTable {
+        static constexpr uint8_t MOTORS = 6;
+        static constexpr float table[MOTORS][4] = {
+            //  T     A          E       R
+            { +1, -0.500000f, -0.866025f, -1 },    // front right
+            { +1, -1.000000f,  0.000000f, +1 },    // right
+            { +1, -0.500000f, +0.866025f, -1 },    // rear right
+            { +1, +0.500000f, +0.866025f, +1 },    // rear left
+            { +1, +1.000000f,  0.000000f, -1 },    // left
+            { +1, +0.500000f, -0.866025f, +1 },    // front left
+        };
+    };
+    template <typename T> constexpr float MixerHexXTable<T>::table[MixerHexXTable<T>::MOTORS][4];
+
+    // Motors clockwise from front right
+    template <typename T=void>
+    struct MixerOctoXTable {
+        static constexpr uint8_t MOTORS = 8;
+        static constexpr float table[MOTORS][4] = {
+            //  T     A          E       R
+            { +1, -0.414214f, -1.000000f, -1 },    // front right
+            { +1, -1.000000f, -0.414214f, +1 },    // mid-front right
+            { +1, -1.000000f, +0.414214f, -1 },    // mid-rear right
+            { +1, -0.414214f, +1.000000f, +1 },    // rear right
+            { +1, +0.414214f, +1.000000f, -1 },    // rear left
+            { +1, +1.000000f, +0.414214f, +1 },    // mid-rear left
+            { +1, +1.000000f, -0.414214f, -1 },    // mid-front left
+            { +1, +0.414214f, -1.000000f, +1 },    // front left
+        };
+    };
+    template <typename T> constexpr float MixerOctoXTable<T>::table[MixerOctoXTable<T>::MOTORS][4];
+
+    // Coaxial tricopter: upper motors first, then the lower ones, which spin the other way
+    template <typename T=void>
+    struct MixerY6Table {
+        static constexpr uint8_t MOTORS = 6;
+        static constexpr float table[MOTORS][4] = {
+            //  T   A     E          R
+            { +1,  0, +1.333333f, -1 },    // rear
+            { +1, -1, -0.666667f, +1 },    // right
+            { +1, +1, -0.666667f, +1 },    // left
+            { +1,  0, +1.333333f, +1 },    // under rear
+            { +1, -1, -0.666667f, -1 },    // under right
+            { +1, +1, -0.666667f, -1 },    // under left
+        };
+    };
+    template <typename T> constexpr float MixerY6Table<T>::table[MixerY6Table<T>::MOTORS][4];
+
+    // Tricopter motors only: yaw comes from tilting the rear motor, which needs a board-specific servo output
+    template <typename T=void>
+    struct MixerTriTable {
+        static constexpr uint8_t MOTORS = 3;
+        static constexpr float table[MOTORS][4] = {
+            //  T   A     E        R
+            { +1,  0, +1.333333f, 0 },    // rear
+            { +1, -1, -0.666667f, 0 },    // right front
+            { +1, +1, -0.666667f, 0 },    // left front
+        };
+    };
+    template <typename T> constexpr float MixerTriTable<T>::table[MixerTriTable<T>::MOTORS][4];
+
+    // Frame-independent part of the mixer, used by MSP and boards for motor testing
+    class Mixer {
+
+        public:
+
+            static const uint8_t MAXMOTORS = 8;
+
+            // This is set by MSP
+            float  motorsDisarmed[MAXMOTORS];
+
+            // Most recent values sent to the motors, for logging
+            float  motorValues[MAXMOTORS];
+
+            uint8_t motorCount(void)
+            {
+                return _nmotors;
+            }
+
+            void init(Board * _board)
+            {
+                board = _board;
+
+                // set disarmed motor values
+                for (uint8_t i = 0; i < MAXMOTORS; i++)
+                    motorsDisarmed[i] = motorValues[i] = 0;
+            }
+
+            // Points a copied mixer at its own board, keeping the motor values
+            void rebind(Board * _board)
+            {
+                board = _board;
+            }
+
+            // This is how we can spin the motors from the GCS
+            void runDisarmed(void)
+            {
+                for (uint8_t i = 0; i < _nmotors; i++) {
+                    motorValues[i] = motorsDisarmed[i];
+                }
+
+                board->writeMotors(motorValues, _nmotors);
+            }
+
+        protected:
+
+            Mixer(uint8_t nmotors) : _nmotors(nmotors) { }
+
+            Board * board;
+
+            uint8_t _nmotors;
+
+    }; // class Mixer
+
+    // Mixer for a particular frame, whose table is fixed at compile time so the per-motor mixing can be constant-folded
+    // T is the numeric type used for mixing: float, or a Fixed type such as Q16_16 for boards without an FPU
+    template <class Table, typename T=float>
+    class MixerT : public Mixer {
+
+        public:
+
+            static const uint8_t MOTORS = Table::MOTORS;
+
+            MixerT(void) : Mixer(MOTORS) { }
+
+            void runArmed(demands_t demands)
+            {
+                runArmed(demands, board);
+            }
+
+            // Writing through the concrete board type lets the compiler inline writeMotor()
+            template <class BoardT>
+            void runArmed(demands_t demands, BoardT * _board)
+            {
+                T motors[MOTORS];
+
+                T throttle = T(demands.throttle);
+                T roll     = T(demands.roll);
+                T pitch    = T(demands.pitch);
+                T yaw      = T(demands.yaw);
+
+                // Table entries are constexpr, so converting them to T folds at compile time
+                for (uint8_t i = 0; i < MOTORS; i++) {
+
+                    motors[i] = 
+                        (throttle * T(Table::table[i][0]) + 
+                         roll     * T(Table::table[i][1]) +     
+                         pitch    * T(Table::table[i][2]) +   
+                         yaw      * T(Table::table[i][3]));      
+                }
+
+                T maxMotor = motors[0];
+
+                for (uint8_t i = 1; i < MOTORS; i++)
+                    if (motors[i] > maxMotor)
+                        maxMotor = motors[i];
+
+                for (uint8_t i = 0; i < MOTORS; i++) {
+
+                    // This is a way to still have good gyro corrections if at least one motor reaches its max
+                    if (maxMotor > T(1)) {
+                        motors[i] -= maxMotor - T(1);
+                    }
+
+                    // Keep motor values in interval [0,1]
+                    motors[i] = FilterT<T>::constrainMinMax(motors[i], T(0), T(1));
+                }
+
+                for (uint8_t i = 0; i < MOTORS; i++) {
+                    motorValues[i] = numericToFloat(motors[i]);
+                }
+
+                _board->writeMotors(motorValues, MOTORS);
+            }
+
+            void cutMotors(void)
+            {
+                cutMotors(board);
+            }
+
+            template <class BoardT>
+            void cutMotors(BoardT * _board)
+            {
+                for (uint8_t i = 0; i < MOTORS; i++) {
+                    motorValues[i] = 0;
+                }
+
+                _board->writeMotors(motorValues, MOTORS);
+            }
+
+    }; // class MixerT
+
+    typedef MixerT< MixerQuadXTable<> > MixerQuadX;
+    typedef MixerT< MixerHexXTable<> >  MixerHexX;
+    typedef MixerT< MixerOctoXTable<> > MixerOctoX;
+    typedef MixerT< MixerY6Table<> >    MixerY6;
+    typedef MixerT< MixerTriTable<> >   MixerTri;
+
+} // namespace
@@ -0,0 +1,126 @@
+/*
+   outbuf.hpp : Transmit queue behind Board::outbuf()
+
+   Board::outbuf() copies its text here and returns, so printing from the flight loop never waits on a serial
+   port.  A low-priority task hands the queued bytes to the board's port as fast as the port takes them (see
+   Board::drainOutbuf()).  A message that doesn't fit is dropped whole and counted, and the count is printed
+   ahead of the next message that does fit.
+
+   Queue from one thread (or core) only; the drain may run on another.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "ringbuffer.hpp"
+
+namespace hf {
+
+    // A template only so that this header can define its static data without violating the one-definition rule
+    template <typename T=void>
+    class OutbufQueueT {
+
+        public:
+
+            // Bytes of text buffered between drains
+            static const uint16_t SIZE = 1024;
+
+        private:
+
+            static RingBuffer<uint8_t, SIZE> _ring;
+
+            // Producer side
+            static uint32_t _dropped;
+            static uint32_t _droppedReported;
+
+        public:
+
+            // Queues all of text, or none of it
+            static void write(const char * text)
+            {
+                uint16_t len = (uint16_t)strlen(text);
+
+                if (_dropped != _droppedReported) {
+                    char note[40];
+                    uint16_t noteLen = (uint16_t)snprintf(note, sizeof(note), "(%lu messages dropped)\n",
+                            (unsigned long)(_dropped - _droppedReported));
+                    if (noteLen + len > _ring.space()) {
+                        _dropped++;
+                        return;
+                    }
+                    _ring.write((const uint8_t *)note, noteLen);
+                    _droppedReported = _dropped;
+                }
+
+                if (len > _ring.space()) {
+                    _dropped++;
+                    return;
+                }
+
+                _ring.write((const uint8_t *)text, len);
+            }
+
+            // Hands the queue to sink in contiguous chunks, stopping when sink takes less than it was offered
+            static void drain(uint16_t (*sink)(const uint8_t * buf, uint16_t len))
+            {
+                for (uint8_t pass=0; pass<2; ++pass) { // at most two chunks when the text wraps
+                    const uint8_t * ptr;
+                    uint16_t count = _ring.peekContiguous(&ptr);
+                    if (count == 0) {
+                        break;
+                    }
+                    uint16_t sent = sink(ptr, count);
+                    _ring.consume(sent);
+                    if (sent < count) {
+                        break;
+                    }
+                }
+            }
+
+            static uint16_t space(void)
+            {
+                return _ring.space();
+            }
+
+            static uint16_t available(void)
+            {
+                return _ring.available();
+            }
+
+            static uint32_t droppedCount(void)
+            {
+                return _dropped;
+            }
+
+            // Static RAM taken by the queue
+            static uint16_t ramSize(void)
+            {
+                return sizeof(_ring) + sizeof(_dropped) + sizeof(_droppedReported);
+            }
+
+    }; // class OutbufQueueT
+
+    template <typename T> RingBuffer<uint8_t, OutbufQueueT<T>::SIZE> OutbufQueueT<T>::_ring;
+    template <typename T> uint32_t OutbufQueueT<T>::_dropped;
+    template <typename T> uint32_t OutbufQueueT<T>::_droppedReported;
+
+    typedef OutbufQueueT<> OutbufQueue;
+
+} // namespace hf
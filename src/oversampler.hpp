@@ -0,0 +1,85 @@
+/*
+   oversampler.hpp : Averages gyro samples down to the PID rate
+
+   A fast IMU can deliver gyro samples (e.g. at 8 kHz) faster than a slow MCU can run the PIDs and mixer on each
+   one.  Rather than throw the extra samples away, the oversampler averages each run of DIVIDER of them into one,
+   which knocks down noise above the PID rate before it can alias, and hands that on to the filters and PIDs at
+   the sample rate divided by DIVIDER.  A divider of one passes every sample straight through.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+namespace hf {
+
+    class GyroOversampler {
+
+        private:
+
+            uint8_t _divider;
+            uint8_t _count;
+            float   _sum[3];
+            float   _scale;
+
+        public:
+
+            GyroOversampler(void)
+            {
+                init(1);
+            }
+
+            void init(uint8_t divider)
+            {
+                _divider = divider ? divider : 1;
+                _scale = 1.f / _divider;
+                _count = 0;
+                _sum[0] = _sum[1] = _sum[2] = 0;
+            }
+
+            uint8_t divider(void)
+            {
+                return _divider;
+            }
+
+            // Takes a new sample; returns true, with gyroRates replaced by the average, on every DIVIDER'th
+            bool update(float gyroRates[3])
+            {
+                if (_divider == 1) {
+                    return true;
+                }
+
+                for (uint8_t k=0; k<3; ++k) {
+                    _sum[k] += gyroRates[k];
+                }
+
+                if (++_count < _divider) {
+                    return false;
+                }
+
+                for (uint8_t k=0; k<3; ++k) {
+                    gyroRates[k] = _sum[k] * _scale;
+                    _sum[k] = 0;
+                }
+                _count = 0;
+
+                return true;
+            }
+
+    }; // class GyroOversampler
+
+} // namespace hf
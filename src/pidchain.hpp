@@ -0,0 +1,127 @@
+/*
+   pidchain.hpp : Statically composed chain of demand-modifying PID controllers
+
+   After the stabilizer and the altitude estimator have had their say, each gyro cycle hands the demands down
+   a PidChain of further controllers (position hold, terrain following, ...), in the order they are listed:
+
+       hf::HackflightT<MyBoard, MyReceiver, hf::MixerQuadX, hf::Stabilizer, hf::AltitudeEstimator, hf::AllFeatures,
+           hf::PidChain<PositionHold, TerrainFollow> > h;
+
+   The chain is unrolled at compile time, so each controller costs one inlinable call and no virtual dispatch,
+   and a controller that isn't listed costs nothing.  A controller derives from PidController and hides what it
+   needs of:
+
+       PERIOD_MICROS                         how often update() is due; zero for every gyro cycle
+       init()                                called from Hackflight::init()
+       update(eulerAngles, armed, usec)      computes a new correction when due
+       modifyDemands(demands)                applies the latest correction, every gyro cycle
+       handleAuxSwitch(demands)              called when the auxiliary switch changes
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "datatypes.hpp"
+
+namespace hf {
+
+    // Defaults for everything a controller in a PidChain may leave out
+    class PidController {
+
+        public:
+
+            static const uint32_t PERIOD_MICROS = 0;
+
+            void init(void) { }
+
+            void update(const float eulerAngles[3], bool armed, uint32_t usec)
+            {
+                (void)eulerAngles; (void)armed; (void)usec;
+            }
+
+            void modifyDemands(demands_t & demands) { (void)demands; }
+
+            void handleAuxSwitch(demands_t & demands) { (void)demands; }
+
+    }; // class PidController
+
+    template <class... Controllers>
+    class PidChain;
+
+    // End of the chain
+    template <>
+    class PidChain<> {
+
+        public:
+
+            static const uint8_t COUNT = 0;
+
+            void init(void) { }
+
+            void modifyDemands(demands_t & demands, const float eulerAngles[3], bool armed, uint32_t usec)
+            {
+                (void)demands; (void)eulerAngles; (void)armed; (void)usec;
+            }
+
+            void handleAuxSwitch(demands_t & demands) { (void)demands; }
+
+    }; // class PidChain<>
+
+    template <class Head, class... Tail>
+    class PidChain<Head, Tail...> {
+
+        private:
+
+            // When head.update() is next due
+            uint32_t _due;
+
+        public:
+
+            static const uint8_t COUNT = 1 + PidChain<Tail...>::COUNT;
+
+            // This link's controller, then the rest of the chain, e.g. getControllers().tail.head for the second
+            Head               head;
+            PidChain<Tail...>  tail;
+
+            void init(void)
+            {
+                _due = 0;
+                head.init();
+                tail.init();
+            }
+
+            // Called from the gyro loop with the time of the sample
+            void modifyDemands(demands_t & demands, const float eulerAngles[3], bool armed, uint32_t usec)
+            {
+                if (Head::PERIOD_MICROS == 0 || (int32_t)(usec - _due) >= 0) {
+                    head.update(eulerAngles, armed, usec);
+                    _due = usec + Head::PERIOD_MICROS;
+                }
+
+                head.modifyDemands(demands);
+
+                tail.modifyDemands(demands, eulerAngles, armed, usec);
+            }
+
+            void handleAuxSwitch(demands_t & demands)
+            {
+                head.handleAuxSwitch(demands);
+                tail.handleAuxSwitch(demands);
+            }
+
+    }; // class PidChain
+
+} // namespace hf
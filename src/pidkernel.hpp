@@ -0,0 +1,148 @@
+/*
+   pidkernel.hpp : Rate PIDs for roll, pitch, and yaw computed together
+
+   PidKernelT keeps the rate-PID state of all three axes in aligned four-lane arrays (roll, pitch, yaw, and a pad
+   lane, so that one vector load covers an array) and steps the three axes in one loop with no branch on the data:
+   the windup clamp is a min and a max, and the integral reset a multiply by zero or one.  The loop unrolls, and the
+   tests of which axis it is on (yaw has no D term, and only roll and pitch scale I by the cyclic demand) are
+   settled at compile time, so a PID step takes the same time whatever the input.  The gains come in with each step,
+   so gains fixed at compile time (see gainprofile.hpp) fold into the loop too.  The arithmetic runs in the same
+   order as the per-axis code it replaced, so the outputs are unchanged bit for bit.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include "fixed.hpp"
+
+namespace hf {
+
+    template <typename T>
+    class PidKernelT {
+
+        public:
+
+            // Roll, pitch, yaw, and a pad lane
+            static const uint8_t LANES = 4;
+
+        private:
+
+            static const uint8_t AXES = 3;
+
+            // Integral limits
+            T _windupMax;
+            T _bigGyroRate;
+            T _bigYawDemand;
+
+            // State, per lane
+            alignas(16) T _errorI[LANES];
+            alignas(16) T _lastGyro[LANES];
+            alignas(16) T _gyroDelta1[LANES];
+            alignas(16) T _gyroDelta2[LANES];
+
+            // Written so that compilers emit min and max instructions rather than branches
+            static T minimum(T a, T b)
+            {
+                return b < a ? b : a;
+            }
+
+            static T maximum(T a, T b)
+            {
+                return a < b ? b : a;
+            }
+
+        public:
+
+            PidKernelT(void)
+            {
+                setLimits(0, 0, 0);
+                init();
+            }
+
+            // Clears the D-term history and the integral
+            void init(void)
+            {
+                for (uint8_t k=0; k<LANES; ++k) {
+                    _lastGyro[k] = _gyroDelta1[k] = _gyroDelta2[k] = 0;
+                }
+                resetIntegral();
+            }
+
+            void resetIntegral(void)
+            {
+                for (uint8_t k=0; k<LANES; ++k) {
+                    _errorI[k] = 0;
+                }
+            }
+
+            // The integral is clamped to windupMax, and reset on a gyro rate above bigGyroRate or, for yaw, a
+            // demand above bigYawDemand
+            void setLimits(T windupMax, T bigGyroRate, T bigYawDemand)
+            {
+                _windupMax = windupMax;
+                _bigGyroRate = bigGyroRate;
+                _bigYawDemand = bigYawDemand;
+            }
+
+            // One PID step for all three axes, with gains from a StabilizerGainsT (see gainprofile.hpp).  demand
+            // is the stick demand, and PTerm the roll and pitch leveling P terms and the yaw demand; ITermScale
+            // scales the roll and pitch I terms, and dtermLowpass filters their D terms.  Terms whose gains are
+            // known at compile time to be zero aren't computed.
+            template <class Gains, class Lowpass>
+            void update(const Gains & gains, const T gyro[3], const T demand[3], const T PTerm[3], T ITermScale,
+                    Lowpass & dtermLowpass, T output[3])
+            {
+                for (uint8_t k=0; k<AXES; ++k) {
+
+                    T g = gyro[k];
+                    T d = demand[k];
+                    T rateP = gains.rateP(k);
+
+                    T ITerm = 0;
+
+                    // I, clamped against windup and reset on a quick gyro change or a large yaw demand
+                    if ((k < AXES-1 && Gains::HAS_CYCLIC_I) || (k == AXES-1 && Gains::HAS_YAW_I)) {
+                        T errorI = minimum(maximum(_errorI[k] + (d * rateP - g), -_windupMax), _windupMax);
+                        bool reset = (numericAbs(g) > _bigGyroRate) | ((k == AXES-1) & (numericAbs(d) > _bigYawDemand));
+                        _errorI[k] = errorI * T(float(!reset));
+                        ITerm = _errorI[k] * gains.rateI(k);
+                        if (k < AXES-1) {
+                            ITerm *= ITermScale;
+                        }
+                    }
+
+                    T DTerm = 0;
+
+                    if (k < AXES-1 && Gains::HAS_CYCLIC_D) {
+
+                        // D, from the sum of the last three gyro deltas
+                        T delta = g - _lastGyro[k];
+                        _lastGyro[k] = g;
+                        T deltaSum = _gyroDelta1[k] + _gyroDelta2[k] + delta;
+                        _gyroDelta2[k] = _gyroDelta1[k];
+                        _gyroDelta1[k] = delta;
+                        DTerm = dtermLowpass.apply(deltaSum, k) * gains.rateD(k);
+                    }
+
+                    output[k] = (PTerm[k] - g * rateP) + ITerm - DTerm;
+                }
+            }
+
+    }; // class PidKernelT
+
+} // namespace hf
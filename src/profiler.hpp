@@ -0,0 +1,292 @@
+/*
+   profiler.hpp : Per-stage timing statistics for the Hackflight main loop
+
+   Times are measured in board-specific cycle-counter ticks (see Board::getCycleCount()).
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+namespace hf {
+
+    class Profiler {
+
+        public:
+
+            // Stages (scheduler tasks) timed in Hackflight::update()
+            enum {
+                STAGE_GYRO,
+                STAGE_EULER,
+                STAGE_RECEIVER,
+                STAGE_ACCEL,
+                STAGE_BARO,
+                STAGE_SERIAL,
+                STAGE_BLACKBOX,
+                STAGE_SONAR,
+                STAGE_DEBUG,
+                STAGE_COUNT
+            };
+
+            // Bin k counts times in [2^k, 2^(k+1)); the last bin also holds anything longer
+            static const uint8_t HISTOGRAM_BINS = 16;
+
+            // Latency bin k counts latencies in [k, k+1) bin widths; the last bin also holds anything longer
+            static const uint8_t  LATENCY_BINS = 64;
+            static const uint16_t LATENCY_BIN_MICROS = 10;
+
+            // CPU load is reported over windows of this length
+            static const uint32_t LOAD_WINDOW_MICROS = 500000;
+
+            // Boot phases, each stamped with the board clock when it is first reached (see Hackflight::checkBoot())
+            enum {
+                BOOT_INIT,      // Hackflight::init() is done
+                BOOT_SENSORS,   // the board's sensors are up (Board::ready())
+                BOOT_ATTITUDE,  // first attitude
+                BOOT_RECEIVER,  // first receiver frame
+                BOOT_READY,     // all of the above, so the vehicle can arm
+                BOOT_COUNT
+            };
+
+            void init(void)
+            {
+                _bootReached = 0;
+                for (uint8_t k=0; k<BOOT_COUNT; ++k) {
+                    _boot[k] = 0;
+                }
+
+                for (uint8_t k=0; k<STAGE_COUNT; ++k) {
+                    reset(k);
+                }
+                resetLatency();
+                resetLoad();
+            }
+
+            void reset(uint8_t stage)
+            {
+                stats_t & s = _stats[stage];
+                s.min = UINT32_MAX;
+                s.max = 0;
+                s.sum = 0;
+                s.count = 0;
+                for (uint8_t k=0; k<HISTOGRAM_BINS; ++k) {
+                    s.histogram[k] = 0;
+                }
+            }
+
+            void update(uint8_t stage, uint32_t ticks)
+            {
+                stats_t & s = _stats[stage];
+
+                if (ticks < s.min) s.min = ticks;
+                if (ticks > s.max) s.max = ticks;
+                s.sum += ticks;
+                s.count++;
+
+                s.histogram[log2bin(ticks)]++;
+            }
+
+            uint32_t getMin(uint8_t stage)
+            {
+                return _stats[stage].count ? _stats[stage].min : 0;
+            }
+
+            uint32_t getMax(uint8_t stage)
+            {
+                return _stats[stage].max;
+            }
+
+            uint32_t getMean(uint8_t stage)
+            {
+                return _stats[stage].count ? (uint32_t)(_stats[stage].sum / _stats[stage].count) : 0;
+            }
+
+            uint32_t getCount(uint8_t stage)
+            {
+                return _stats[stage].count;
+            }
+
+            uint32_t getHistogramBin(uint8_t stage, uint8_t bin)
+            {
+                return _stats[stage].histogram[bin];
+            }
+
+            // Gyro-to-motor latency: microseconds from a gyro sample's acquisition to the motor writes it led to
+
+            void resetLatency(void)
+            {
+                _latency.max = 0;
+                _latency.sum = 0;
+                _latency.count = 0;
+                for (uint8_t k=0; k<LATENCY_BINS; ++k) {
+                    _latency.histogram[k] = 0;
+                }
+            }
+
+            void updateLatency(uint32_t usec)
+            {
+                if (usec > _latency.max) _latency.max = usec;
+                _latency.sum += usec;
+                _latency.count++;
+
+                uint32_t bin = usec / LATENCY_BIN_MICROS;
+                _latency.histogram[bin < LATENCY_BINS ? bin : LATENCY_BINS-1]++;
+            }
+
+            uint32_t getLatencyCount(void)
+            {
+                return _latency.count;
+            }
+
+            uint32_t getLatencyMean(void)
+            {
+                return _latency.count ? (uint32_t)(_latency.sum / _latency.count) : 0;
+            }
+
+            uint32_t getLatencyMax(void)
+            {
+                return _latency.max;
+            }
+
+            // Latency that the given fraction of samples came in under, rounded up to a bin edge (or the maximum,
+            // from the last bin)
+            uint32_t getLatencyPercentile(float fraction)
+            {
+                uint32_t target = (uint32_t)(fraction * _latency.count);
+                uint32_t count = 0;
+
+                for (uint8_t k=0; k<LATENCY_BINS-1; ++k) {
+                    count += _latency.histogram[k];
+                    if (count > target) {
+                        uint32_t edge = (k + 1) * LATENCY_BIN_MICROS;
+                        return edge < _latency.max ? edge : _latency.max;
+                    }
+                }
+
+                return _latency.max;
+            }
+
+            // Keeps only the first time a phase is reached
+            void markBoot(uint8_t phase, uint32_t usec)
+            {
+                if (!bootReached(phase)) {
+                    _boot[phase] = usec;
+                    _bootReached |= 1 << phase;
+                }
+            }
+
+            bool bootReached(uint8_t phase)
+            {
+                return _bootReached & (1 << phase);
+            }
+
+            // Board-clock microseconds (from power-on, on real boards) at which a phase was reached; zero until it is
+            uint32_t getBootMicros(uint8_t phase)
+            {
+                return _boot[phase];
+            }
+
+            // CPU load: how much of the main loop's time went to running its tasks, rather than to polling for data
+            // or idling (see Board::idle()).  Busy time is measured around the tasks themselves, so a board whose
+            // idle() returns at once still shows its headroom.
+
+            void resetLoad(void)
+            {
+                _load.active = 0;
+                _load.idle = 0;
+                _load.percent = 0;
+                _load.windows = 0;
+            }
+
+            void updateLoad(uint32_t activeTicks, uint32_t idleTicks, uint32_t ticksPerMicro)
+            {
+                _load.active += activeTicks;
+                _load.idle += idleTicks;
+
+                uint64_t total = _load.active + _load.idle;
+
+                if (total >= (uint64_t)LOAD_WINDOW_MICROS * ticksPerMicro) {
+                    _load.percent = 100.f * _load.active / total;
+                    _load.windows++;
+                    _load.active = 0;
+                    _load.idle = 0;
+                }
+            }
+
+            // Percent over the last complete window; zero until there is one
+            float getCpuLoad(void)
+            {
+                return _load.percent;
+            }
+
+            // Windows completed so far, so callers can tell when getCpuLoad() has a new one
+            uint32_t getLoadWindows(void)
+            {
+                return _load.windows;
+            }
+
+        private:
+
+            typedef struct {
+
+                uint32_t min;
+                uint32_t max;
+                uint64_t sum;
+                uint32_t count;
+                uint32_t histogram[HISTOGRAM_BINS];
+
+            } stats_t;
+
+            stats_t _stats[STAGE_COUNT];
+
+            typedef struct {
+
+                uint32_t max;
+                uint64_t sum;
+                uint32_t count;
+                uint32_t histogram[LATENCY_BINS];
+
+            } latency_t;
+
+            latency_t _latency;
+
+            typedef struct {
+
+                uint64_t active;
+                uint64_t idle;
+                float    percent;
+                uint32_t windows;
+
+            } load_t;
+
+            load_t _load;
+
+            uint32_t _boot[BOOT_COUNT];
+            uint8_t  _bootReached;
+
+            static uint8_t log2bin(uint32_t ticks)
+            {
+                uint8_t bin = 0;
+                while ((ticks >>= 1) && bin < HISTOGRAM_BINS-1) {
+                    bin++;
+                }
+                return bin;
+            }
+
+    }; // class Profiler
+
+} // namespace hf
@@ -0,0 +1,153 @@
+/*
+   rcsmoother.hpp : Interpolates receiver demands at the gyro rate between RC frames
+
+   RC frames arrive every 9-22 msec depending on the protocol, while the PID loop runs many times per frame.
+   Feeding it the latest frame as-is moves the setpoint in steps, which shows up as stair-steps in the motors.
+   The smoother times the frames and, on each gyro cycle, either ramps from the last output to the newest frame
+   over one frame interval (RAMP), or carries the newest frame forward along the slope from the one before it
+   (EXTRAPOLATE), for at most one interval.  Ramping is smooth but adds up to one frame of delay; extrapolating
+   adds none but overshoots a little when the sticks stop.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include "datatypes.hpp"
+
+namespace hf {
+
+    class RcSmoother {
+
+        public:
+
+            typedef enum {
+                OFF,
+                RAMP,
+                EXTRAPOLATE
+            } mode_t;
+
+        private:
+
+            static const uint8_t AXES = 4; // throttle, roll, pitch, yaw
+
+            mode_t   _mode;
+
+            float    _start[AXES];   // where the ramp starts (RAMP) or the previous frame (EXTRAPOLATE)
+            float    _target[AXES];  // newest frame
+            float    _output[AXES];  // last value handed out
+
+            uint32_t _frameMicros;
+            float    _invInterval;   // 1 / frame interval in usec; zero until the interval is known
+
+            bool     _idle;          // previous frame was taken while the motors were idle
+
+            static void load(const demands_t & demands, float v[AXES])
+            {
+                v[0] = demands.throttle;
+                v[1] = demands.roll;
+                v[2] = demands.pitch;
+                v[3] = demands.yaw;
+            }
+
+        public:
+
+            RcSmoother(void) : _mode(OFF), _invInterval(0) { }
+
+            void init(mode_t mode)
+            {
+                _mode = mode;
+                _invInterval = 0;
+                _frameMicros = 0;
+                _idle = true;
+                for (uint8_t k=0; k<AXES; ++k) {
+                    _start[k] = _target[k] = _output[k] = 0;
+                }
+            }
+
+            bool enabled(void)
+            {
+                return _mode != OFF;
+            }
+
+            // Called on each new frame with its demands, arrival time, and the measured frame interval.  While the
+            // motors are idle (disarmed or throttle down) the output jumps straight to each frame, and so does the
+            // first frame after, so stick positions used for arming aren't carried into flight.
+            void update(const demands_t & demands, uint32_t frameMicros, uint32_t intervalMicros, bool idle)
+            {
+                float v[AXES];
+                load(demands, v);
+
+                bool jump = idle || _idle;
+                _idle = idle;
+
+                for (uint8_t k=0; k<AXES; ++k) {
+                    _start[k] = jump ? v[k] : (_mode == RAMP) ? _output[k] : _target[k];
+                    _target[k] = v[k];
+                    if (jump) {
+                        _output[k] = v[k];
+                    }
+                }
+
+                _frameMicros = frameMicros;
+                _invInterval = intervalMicros ? 1.f / intervalMicros : 0;
+            }
+
+            // Called every gyro cycle; replaces throttle, roll, pitch, and yaw with their interpolated values
+            void apply(demands_t & demands, uint32_t nowMicros)
+            {
+                // Until the interval is known, pass the frame through
+                if (_invInterval == 0) {
+                    load(demands, _output);
+                    return;
+                }
+
+                // A gyro sample taken just before the frame came in is at the frame's start, not far past its end
+                float s = (int32_t)(nowMicros - _frameMicros) * _invInterval;
+                s = s < 0 ? 0 : (s > 1 ? 1 : s);
+
+                for (uint8_t k=0; k<AXES; ++k) {
+                    float slope = _target[k] - _start[k];
+                    _output[k] = (_mode == RAMP) ? _start[k] + s * slope : _target[k] + s * slope;
+                }
+
+                demands.throttle = _output[0];
+                demands.roll     = _output[1];
+                demands.pitch    = _output[2];
+                demands.yaw      = _output[3];
+            }
+
+    }; // class RcSmoother
+
+    // Takes RcSmoother's place when AllFeatures::RC_SMOOTHING is switched off
+    class NoRcSmoother {
+
+        public:
+
+            void init(RcSmoother::mode_t mode) { (void)mode; }
+            bool enabled(void) { return false; }
+
+            void update(const demands_t & demands, uint32_t frameMicros, uint32_t intervalMicros, bool idle)
+            {
+                (void)demands; (void)frameMicros; (void)intervalMicros; (void)idle;
+            }
+
+            void apply(demands_t & demands, uint32_t nowMicros) { (void)demands; (void)nowMicros; }
+
+    }; // class NoRcSmoother
+
+} // namespace hf
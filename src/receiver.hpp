@@ -25,6 +25,7 @@
 #include <cmath>
 
 #include "filter.hpp"
+#include "binaryangle.hpp"
 #include "debug.hpp"
 #include "datatypes.hpp"
 
@@ -51,30 +52,71 @@ namespace hf {
                 return command;
             }
 
+            // Expo/rate curve coefficients, precomputed in constructor
+            float _cyclicLinear;
+            float _cyclicCubic;
+            float _throttleLinear;
+            float _throttleCubicLow;
+            float _throttleCubicHigh;
+
+            // (1 + e*(x^2 - 1)) * x * r  =  x * (r*(1-e) + r*e*x^2)
             float applyCyclicFunction(float command)
             {
-                return rcFun(command, cyclicExpo, cyclicRate);
+                return command * (_cyclicLinear + _cyclicCubic * command * command);
             }
 
-            float makePositiveCommand(uint8_t channel)
+            // mid + t*(1-e + e*t^2/y^2), with t = x-mid and y = 1-mid above the midpoint, mid below it;
+            // the ternary selects a precomputed coefficient rather than branching
+            float applyThrottleFunction(float x)
             {
-                return fabs(rawvals[channel]);
+                float tmp = x - throttleMid;
+                float k = tmp > 0 ? _throttleCubicHigh : _throttleCubicLow;
+                return throttleMid + tmp * (_throttleLinear + k * tmp * tmp);
             }
 
-            static float rcFun(float x, float e, float r)
+            float makePositiveCommand(uint8_t channel)
             {
-                return (1 + e*(x*x - 1)) * x * r;
+                return fabs(rawvals[channel]);
             }
 
-            static float throttleFun(float x, float e, float mid)
+            // Frame timing, in microseconds
+            uint32_t _latestFrameMicros;
+            uint32_t _frameIntervalMicros;  // smoothed
+            uint32_t _frameJitterMicros;    // smoothed absolute deviation of interval from its mean
+            uint32_t _frameCount;
+            bool     _gotFrame;
+
+            // Failsafe timing, in microseconds
+            uint32_t _latestValidFrameMicros;
+            uint32_t _failsafeTimeoutMicros;
+
+            void updateFrameTiming(uint32_t frameMicros)
             {
-                float tmp   = x - mid;
-                float y = tmp>0 ? 1-mid : (tmp<0 ? mid : 1);
-                return mid + tmp*(1-e + e * (tmp*tmp) / (y*y));
+                if (_gotFrame) {
+
+                    uint32_t interval = frameMicros - _latestFrameMicros;
+
+                    // Seed with the first interval, then smooth by 1/8
+                    if (_frameIntervalMicros == 0) {
+                        _frameIntervalMicros = interval;
+                    }
+                    else {
+                        int32_t deviation = (int32_t)(interval - _frameIntervalMicros);
+                        _frameIntervalMicros += deviation / 8;
+                        uint32_t absdev = deviation < 0 ? -deviation : deviation;
+                        _frameJitterMicros += ((int32_t)absdev - (int32_t)_frameJitterMicros) / 8;
+                    }
+                }
+
+                _latestFrameMicros = frameMicros;
+                _frameCount++;
+                _gotFrame = true;
             }
 
         protected: 
 
+            // Channels the flight code reads (throttle, roll, pitch, yaw, aux), and the count for receivers that
+            // don't set their own
             static const uint8_t CHANNELS = 5;
 
             // channel indices
@@ -94,6 +136,14 @@ namespace hf {
             virtual bool  gotNewFrame(void) = 0;
             virtual void  readRawvals(void) = 0;
 
+            // Receivers that timestamp frames in hardware (e.g., by input capture) override this to report when
+            // the latest frame actually arrived; otherwise the time it was picked up is used
+            virtual bool  getFrameMicros(uint32_t & usec) { (void)usec; return false; }
+
+            // Receivers whose frames carry a failsafe flag (e.g., SBUS) override this to report a frame that holds
+            // the receiver's own failsafe values rather than the transmitter's, so it doesn't hold off failsafe
+            virtual bool  frameIsValid(void) { return true; }
+
             // For logical combinations of stick positions (low, center, high)
             static const uint8_t ROL_LO = (1 << (2 * CHANNEL_ROLL));
             static const uint8_t ROL_CE = (3 << (2 * CHANNEL_ROLL));
@@ -111,6 +161,9 @@ namespace hf {
             // Stick positions for command combos
             uint8_t sticks;                    
 
+            // Channels this receiver's protocol carries, set by receivers with more than CHANNELS
+            uint8_t _channelCount;
+
             // Software trim
             float _trimRoll;
             float _trimPitch;
@@ -121,17 +174,40 @@ namespace hf {
             // Default to non-headless mode
             float headless = false;
 
-            float rawvals[CHANNELS];  // raw [-1,+1] from receiver, for MSP
+            // Most channels any protocol carries (SBUS has sixteen)
+            static const uint8_t MAXCHANNELS = 16;
+
+            float rawvals[MAXCHANNELS];  // raw [-1,+1] from receiver, for MSP; zero past channelCount()
 
             demands_t demands;
 
             // These can be overridden to support various styles of arming (sticks, switches, etc.)
 
+            // Time without a valid frame after which the signal counts as lost
+            static const uint32_t FAILSAFE_TIMEOUT_MICROS = 200000;
+
             // Override this if your receiver provides RSSI or other weak-signal detection
             virtual bool lostSignal(void) { return false; }
 
             Receiver(float trimRoll=0, float trimPitch=0, float trimYaw=0) : 
-                _trimRoll(trimRoll), _trimPitch(trimPitch), _trimYaw(trimYaw) { }
+                _channelCount(CHANNELS), _trimRoll(trimRoll), _trimPitch(trimPitch), _trimYaw(trimYaw) 
+            { 
+                memset(rawvals, 0, sizeof(rawvals));
+
+                _latestFrameMicros = 0;
+                _frameIntervalMicros = 0;
+                _frameJitterMicros = 0;
+                _frameCount = 0;
+                _gotFrame = false;
+                _latestValidFrameMicros = 0;
+                _failsafeTimeoutMicros = FAILSAFE_TIMEOUT_MICROS;
+
+                _cyclicLinear      = cyclicRate * (1 - cyclicExpo);
+                _cyclicCubic       = cyclicRate * cyclicExpo;
+                _throttleLinear    = 1 - throttleExpo;
+                _throttleCubicLow  = throttleExpo / (throttleMid * throttleMid);
+                _throttleCubicHigh = throttleExpo / ((1 - throttleMid) * (1 - throttleMid));
+            }
 
             virtual bool arming(void)
             {
@@ -151,7 +227,9 @@ namespace hf {
                 sticks = 0;
             }
 
-            bool getDemands(float yawAngle)
+            // yawAngle is the heading relative to that at arming, for headless mode; nowMicros is the board time, used
+            // to time frames for receivers without their own timestamps
+            bool getDemands(BinaryAngle yawAngle, uint32_t nowMicros=0)
             {
                 // Wait till there's a new frame
                 if (!gotNewFrame()) return false;
@@ -159,6 +237,14 @@ namespace hf {
                 // Read raw channel values
                 readRawvals();
 
+                // Track frame timing
+                uint32_t frameMicros = nowMicros;
+                getFrameMicros(frameMicros);
+                if (frameIsValid() || !_gotFrame) { // the first frame of any kind starts the failsafe clock
+                    _latestValidFrameMicros = frameMicros;
+                }
+                updateFrameTiming(frameMicros);
+
                 // Check stick positions, updating command delay
                 uint8_t stTmp = 0;
                 for (uint8_t i = 0; i < 4; i++) {
@@ -192,8 +278,8 @@ namespace hf {
 
                 // Support headless mode
                 if (headless) {
-                    float c = cos(yawAngle);
-                    float s = sin(yawAngle);
+                    float s, c;
+                    yawAngle.sincos(s, c);
                     float p = demands.pitch;
                     float r = demands.roll;
                     demands.pitch = c*p + s*r;
@@ -205,7 +291,7 @@ namespace hf {
 
                 // Special handling for throttle
                 float tmp = (rawvals[CHANNEL_THROTTLE] + 1) / 2; // [-1,+1] -> [0,1]
-                demands.throttle = throttleFun(tmp, throttleExpo, throttleMid);
+                demands.throttle = applyThrottleFunction(tmp);
 
                 // Store auxiliary switch value
                 float aux = rawvals[4];
@@ -217,11 +303,60 @@ namespace hf {
             }  // getDemands
 
 
+            uint8_t channelCount(void)
+            {
+                return _channelCount;
+            }
+
             bool throttleIsDown(void)
             {
                 return rawvals[CHANNEL_THROTTLE] < -1 + margin;
             }
 
+            // Sets the time without a valid frame after which inFailsafe() reports the signal lost, so failsafe trips
+            // a fixed time after the signal goes, however fast the protocol sends frames
+            void setFailsafeTimeout(uint32_t usec)
+            {
+                _failsafeTimeoutMicros = usec;
+            }
+
+            // True once the receiver reports the signal lost, or no valid frame has arrived within the failsafe
+            // timeout; nowMicros is on the same clock as getDemands()'s.  Cheap enough to call on every gyro cycle.
+            bool inFailsafe(uint32_t nowMicros)
+            {
+                return lostSignal() || (_gotFrame && nowMicros - _latestValidFrameMicros > _failsafeTimeoutMicros);
+            }
+
+            // Time since the latest frame arrived
+            uint32_t getFrameAgeMicros(uint32_t nowMicros)
+            {
+                return _gotFrame ? nowMicros - _latestFrameMicros : 0;
+            }
+
+            // Time the latest frame arrived, on the same clock as getDemands()'s nowMicros
+            uint32_t getFrameTimestampMicros(void)
+            {
+                return _latestFrameMicros;
+            }
+
+            // Smoothed time between frames; zero until two frames have arrived
+            uint32_t getFrameIntervalMicros(void)
+            {
+                return _frameIntervalMicros;
+            }
+
+            // Smoothed deviation of the frame interval from its mean
+            uint32_t getFrameJitterMicros(void)
+            {
+                return _frameJitterMicros;
+            }
+
+            // Frames received so far
+            uint32_t getFrameCount(void)
+            {
+                return _frameCount;
+            }
+
     }; // class Receiver
 
 
@@ -26,11 +26,11 @@ static BreezyCPPM rx(0, 5);
 
 namespace hf {
 
-    class Arduino_CPPM_Receiver : public CPPM_Receiver {
+    class Arduino_CPPM_Receiver final : public CPPM_Receiver {
 
         public:
 
-            Arduino_CPPM_Receiver(float trimRoll=0, float trimPitch=0, float trimYaw=0) : CPPM_Receiver(trimRoll, trimPitch, trimYaw) { }
+            Arduino_CPPM_Receiver(float trimRoll=0, float trimPitch=0, float trimYaw=0) : CPPM_Receiver(5, trimRoll, trimPitch, trimYaw) { }
 
         protected:
 
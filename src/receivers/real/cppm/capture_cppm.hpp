@@ -0,0 +1,88 @@
+/*
+   capture_cppm.hpp : CPPM receiver that timestamps frames on capture
+
+   Decodes the CPPM stream with CPPM_Decoder from an edge interrupt on the given pin, so each frame carries the
+   time it arrived and the frame timing reported by Receiver reflects the transmitter rather than the main loop.
+   Boards with a timer input-capture channel on the CPPM pin can instead call edge() from their capture interrupt
+   with the latched capture time converted to microseconds.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+
+#include "cppm.hpp"
+#include "cppm_decoder.hpp"
+
+namespace hf {
+
+    class Capture_CPPM_Receiver final : public CPPM_Receiver {
+
+        private:
+
+            static CPPM_Decoder _decoder;
+
+            uint8_t  _pin;
+            uint32_t _frameMicros;
+
+            static void edgeHandler(void)
+            {
+                _decoder.handleEdge(micros());
+            }
+
+        public:
+
+            // nchannels must match the transmitter's frame, as a frame is complete after that many pulses
+            Capture_CPPM_Receiver(uint8_t pin, float trimRoll=0, float trimPitch=0, float trimYaw=0, uint8_t nchannels=CHANNELS) 
+                : CPPM_Receiver(nchannels, trimRoll, trimPitch, trimYaw), _pin(pin), _frameMicros(0) { }
+
+            // For boards feeding hardware capture times directly
+            static void edge(uint32_t usec)
+            {
+                _decoder.handleEdge(usec);
+            }
+
+        protected:
+
+            void begin(void)
+            {
+                _decoder.init(_channelCount);
+                pinMode(_pin, INPUT);
+                attachInterrupt(digitalPinToInterrupt(_pin), edgeHandler, RISING);
+            }
+
+            bool gotNewFrame(void)
+            {
+                return _decoder.gotNewFrame();
+            }
+
+            void readPulseVals(uint16_t pulsevals[8])
+            {
+                _decoder.readFrame(pulsevals, _frameMicros);
+            }
+
+            bool getFrameMicros(uint32_t & usec)
+            {
+                usec = _frameMicros;
+                return true;
+            }
+
+    }; // class Capture_CPPM_Receiver
+
+    CPPM_Decoder Capture_CPPM_Receiver::_decoder;
+
+} // namespace hf
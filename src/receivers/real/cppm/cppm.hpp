@@ -1,7 +1,7 @@
 /*
    cppm.hpp : Receiver subclass for CPPM receivers like FrSky MicroRX
 
-   Uses moving average of channel values to remove noise
+   Uses a running-sum moving average of channel values to remove noise
 
    Adapted from https://github.com/multiwii/baseflight/blob/master/src/mw.h
 
@@ -22,6 +22,8 @@
 
 #pragma once
 
+#include <cstring>
+
 #include "receiver.hpp"
 
 namespace hf {
@@ -30,36 +32,44 @@ namespace hf {
 
         protected:
 
-            CPPM_Receiver(float trimRoll=0, float trimPitch=0, float trimYaw=0) : Receiver(trimRoll, trimPitch, trimYaw) { }
+            // nchannels is the number of channels in the transmitter's frame, at most MAXCHANS
+            CPPM_Receiver(uint8_t nchannels, float trimRoll=0, float trimPitch=0, float trimYaw=0) 
+                : Receiver(trimRoll, trimPitch, trimYaw) 
+            { 
+                _channelCount = nchannels < MAXCHANS ? nchannels : MAXCHANS;
+                ppmAverageIndex = 0;
+                memset(averageRaw, 0, sizeof(averageRaw));
+                memset(averageSum, 0, sizeof(averageSum));
+            }
 
             virtual void readPulseVals(uint16_t chanvals[8]) = 0;
 
+            static const uint8_t MAXCHANS = 8;
+
         private: 
 
-            int32_t ppmAverageIndex;  
+            // Moving average over the last few frames, kept as a running sum so each frame costs one add and
+            // one subtract per channel
+            static const uint8_t AVERAGE_FRAMES = 4;
 
-            void init(void)
-            {
-                Receiver::init();
+            uint8_t ppmAverageIndex;  
 
-                ppmAverageIndex = 0;
-            }
+            float averageRaw[MAXCHANS][AVERAGE_FRAMES];
+            float averageSum[MAXCHANS];
 
             void readRawvals(void)
             {
-                uint16_t pulsevals[8];
+                uint16_t pulsevals[MAXCHANS];
                 readPulseVals(pulsevals);
 
-                float averageRaw[5][4];
-
-                for (uint8_t chan = 0; chan < 5; chan++) {
-                    averageRaw[chan][ppmAverageIndex % 4] = (pulsevals[chan] - 1000) / 500.f - 1;
-                    rawvals[chan] = 0;
-                    for (uint8_t i = 0; i < 4; i++)
-                        rawvals[chan] += averageRaw[chan][i];
-                    rawvals[chan] /= 4;
+                for (uint8_t chan = 0; chan < _channelCount; chan++) {
+                    float value = (pulsevals[chan] - 1000) / 500.f - 1;
+                    averageSum[chan] += value - averageRaw[chan][ppmAverageIndex];
+                    averageRaw[chan][ppmAverageIndex] = value;
+                    rawvals[chan] = averageSum[chan] / AVERAGE_FRAMES;
                 }
-                ppmAverageIndex++;
+
+                ppmAverageIndex = (ppmAverageIndex + 1) % AVERAGE_FRAMES;
             }
     };
 }
@@ -0,0 +1,130 @@
+/*
+   cppm_decoder.hpp : CPPM frame decoder driven by timestamped input-capture edges
+
+   The board's capture interrupt calls handleEdge() with the time of each rising edge, ideally latched by a
+   timer input-capture channel so the timestamp doesn't depend on interrupt latency.  The gap between edges is a
+   channel pulse; a gap longer than SYNC_MIN_USEC marks the start of a frame.  A complete frame is copied, along
+   with the capture time of the edge that ended it, into a buffer the main loop reads with readFrame().
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+namespace hf {
+
+    class CPPM_Decoder {
+
+        public:
+
+            static const uint8_t  MAXCHANS = 8;
+
+            static const uint16_t PULSE_MIN_USEC = 750;
+            static const uint16_t PULSE_MAX_USEC = 2250;
+            static const uint16_t SYNC_MIN_USEC  = 2700;
+
+        private:
+
+            uint8_t  _nchans;
+
+            // Written only by the capture interrupt
+            uint32_t _lastEdge;
+            uint16_t _pulses[MAXCHANS];
+            int8_t   _chan;    // -1 until the first sync gap
+
+            // Completed frame, handed to the main loop
+            volatile uint16_t _frame[MAXCHANS];
+            volatile uint32_t _frameMicros;
+            volatile uint8_t  _sequence;  // odd while the interrupt is writing the frame
+            uint8_t           _sequenceRead;
+
+        public:
+
+            void init(uint8_t nchans)
+            {
+                _nchans = nchans < MAXCHANS ? nchans : MAXCHANS;
+                _lastEdge = 0;
+                _chan = -1;
+                _frameMicros = 0;
+                _sequence = 0;
+                _sequenceRead = 0;
+                for (uint8_t k=0; k<MAXCHANS; ++k) {
+                    _pulses[k] = 0;
+                    _frame[k] = 1500;
+                }
+            }
+
+            // Called from the capture interrupt with the time of each rising edge
+            void handleEdge(uint32_t usec)
+            {
+                uint32_t width = usec - _lastEdge;
+                _lastEdge = usec;
+
+                if (width >= SYNC_MIN_USEC) {
+                    _chan = 0;
+                    return;
+                }
+
+                if (_chan < 0) {
+                    return;
+                }
+
+                // A pulse out of range spoils the frame; wait for the next sync
+                if (width < PULSE_MIN_USEC || width > PULSE_MAX_USEC) {
+                    _chan = -1;
+                    return;
+                }
+
+                _pulses[_chan++] = (uint16_t)width;
+
+                if (_chan == _nchans) {
+                    _sequence++;
+                    for (uint8_t k=0; k<_nchans; ++k) {
+                        _frame[k] = _pulses[k];
+                    }
+                    _frameMicros = usec;
+                    _sequence++;
+                    _chan = -1;
+                }
+            }
+
+            // True once per completed frame
+            bool gotNewFrame(void)
+            {
+                return _sequence != _sequenceRead;
+            }
+
+            // Copies out the latest frame and its capture time.  Retries if a new frame landed mid-copy, which can
+            // only happen if the main loop was held off for a whole frame.
+            void readFrame(uint16_t pulses[MAXCHANS], uint32_t & frameMicros)
+            {
+                uint8_t seq;
+
+                do {
+                    seq = _sequence;
+                    for (uint8_t k=0; k<_nchans; ++k) {
+                        pulses[k] = _frame[k];
+                    }
+                    frameMicros = _frameMicros;
+                } while ((seq & 1) || seq != _sequence);
+
+                _sequenceRead = seq;
+            }
+
+    }; // class CPPM_Decoder
+
+} // namespace hf
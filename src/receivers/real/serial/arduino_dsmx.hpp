@@ -26,11 +26,15 @@ static SpektrumDSM2048 rx;
 
 namespace hf {
 
-    class DSMX_Receiver : public Receiver {
+    class DSMX_Receiver final : public Receiver {
 
         public:
 
-            DSMX_Receiver(float trimRoll=0, float trimPitch=0, float trimYaw=0) : Receiver(trimRoll, trimPitch, trimYaw) { }
+            // DSMX frames carry up to twelve channels; the library decodes the first eight
+            DSMX_Receiver(float trimRoll=0, float trimPitch=0, float trimYaw=0) : Receiver(trimRoll, trimPitch, trimYaw)
+            {
+                _channelCount = 8;
+            }
 
          protected:
 
@@ -46,9 +50,11 @@ namespace hf {
 
             void readRawvals(void)
             {
-                rx.getChannelValuesNormalized(rawvals, CHANNELS);
+                rx.getChannelValuesNormalized(rawvals, _channelCount);
             }
 
+        public:
+
             bool lostSignal(void)
             {
                 return rx.timedOut();
@@ -25,22 +25,21 @@ static SBUS rx(Serial1);
 
 namespace hf {
 
-    class SBUS_Receiver : public Receiver {
+    class SBUS_Receiver final : public Receiver {
 
         private:
 
             // These values must persist between calls to readRawvals()
-            float channels[16];
+            float channels[MAXCHANNELS];
 
-            const uint16_t MAX_FAILSAFE = 10;
-
-            uint16_t failsafeCount;
+            // Whether the latest frame had the failsafe flag set
+            bool failsafeFrame;
 
         protected:
 
             void begin(void)
             {
-                failsafeCount = 0;
+                failsafeFrame = false;
                 rx.begin();
             }
 
@@ -50,15 +49,7 @@ namespace hf {
                 uint16_t lostFrames = 0;
 
                 if (rx.readCal(channels, &failsafe, &lostFrames)) {
-
-                    // accumulate consecutive failsafe hits
-                    if (failsafe) {
-                        failsafeCount++;
-                    }
-                    else { // reset count
-                        failsafeCount = 0;
-                    }
-
+                    failsafeFrame = failsafe;
                     return true;
                 }
 
@@ -67,18 +58,21 @@ namespace hf {
 
             void readRawvals(void)
             {
-                memset(rawvals, 0, CHANNELS*sizeof(float));
-                memcpy(rawvals, channels, CHANNELS*sizeof(float));
+                memcpy(rawvals, channels, sizeof(channels));
             }
 
-            bool lostSignal(void)
+            // Failsafe frames don't hold off the receiver's failsafe timeout
+            bool frameIsValid(void)
             {
-                return failsafeCount > MAX_FAILSAFE;
+                return !failsafeFrame;
             }
 
         public:
 
-            SBUS_Receiver(float trimRoll=0, float trimPitch=0, float trimYaw=0) : Receiver(trimRoll, trimPitch, trimYaw) { }
+            SBUS_Receiver(float trimRoll=0, float trimPitch=0, float trimYaw=0) : Receiver(trimRoll, trimPitch, trimYaw)
+            {
+                _channelCount = MAXCHANNELS;
+            }
 
     }; // class SBUS_Receiver
 
@@ -0,0 +1,151 @@
+/*
+   dsmx_decoder.hpp : Spektrum DSM2 / DSMX frame decoder driven byte by byte from the UART receive interrupt
+
+   A frame is 16 bytes at 115200 baud, 8N1: a fade count, a system byte, and seven big-endian servo words, each a
+   channel number and position (4 + 11 bits, or 4 + 10 bits for the 1024-step DSM2 system).  Frames carry no
+   header, so a gap longer than FRAME_GAP_USEC is what starts one.  The 11 msec systems split the channels across
+   two alternating frames; every frame updates the channels it carries, and the interrupt hands all of them, in
+   [-1,+1], to the main loop through a DoubleBuffer, along with the time the frame's last byte came in.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include "doublebuffer.hpp"
+
+namespace hf {
+
+    class DSMX_Decoder {
+
+        public:
+
+            static const uint8_t CHANNELS = 12;
+
+            // A frame takes 1.4 msec and frames come at least 11 msec apart
+            static const uint32_t FRAME_GAP_USEC = 5000;
+
+            typedef struct {
+                float    channels[CHANNELS];
+                uint32_t usec;
+            } frame_t;
+
+        private:
+
+            static const uint8_t FRAME_SIZE = 16;
+            static const uint8_t SERVOS     = 7;
+
+            // System byte of the 22 msec DSM2 system, whose positions have ten bits
+            static const uint8_t SYSTEM_DSM2_1024 = 0x01;
+
+            // Eleven-bit positions of full stick travel either side of center
+            static constexpr float CENTER = 1024;
+            static constexpr float TRAVEL = 682;
+
+            // Written only by the interrupt
+            uint8_t  _bytes[FRAME_SIZE];
+            uint8_t  _count;
+            uint32_t _lastByteUsec;
+            float    _channels[CHANNELS];
+
+            DoubleBuffer<frame_t> _frames;
+
+            uint32_t _sequenceRead;
+
+            void decode(uint32_t usec)
+            {
+                bool tenBits = _bytes[1] == SYSTEM_DSM2_1024;
+
+                for (uint8_t k=0; k<SERVOS; ++k) {
+
+                    uint16_t word = (uint16_t)(_bytes[2+2*k] << 8) | _bytes[3+2*k];
+
+                    // Unused slot
+                    if (word == 0xFFFF) {
+                        continue;
+                    }
+
+                    uint8_t  channel  = tenBits ? (word >> 10) & 0x0F : (word >> 11) & 0x0F;
+                    uint16_t position = tenBits ? (word & 0x03FF) << 1 : word & 0x07FF;
+
+                    if (channel < CHANNELS) {
+                        _channels[channel] = (position - CENTER) / TRAVEL;
+                    }
+                }
+
+                frame_t & frame = _frames.begin();
+                memcpy(frame.channels, _channels, sizeof(_channels));
+                frame.usec = usec;
+                _frames.publish();
+            }
+
+        public:
+
+            void init(void)
+            {
+                _count = 0;
+                _lastByteUsec = 0;
+                _sequenceRead = 0;
+                for (uint8_t k=0; k<CHANNELS; ++k) {
+                    _channels[k] = 0;
+                }
+            }
+
+            // Called from the UART receive interrupt with each byte and the time it came in
+            void handleByte(uint8_t c, uint32_t usec)
+            {
+                if (usec - _lastByteUsec > FRAME_GAP_USEC) {
+                    _count = 0;
+                }
+                _lastByteUsec = usec;
+
+                // Bytes past the end of a frame wait for the next gap
+                if (_count == FRAME_SIZE) {
+                    return;
+                }
+
+                _bytes[_count++] = c;
+
+                if (_count == FRAME_SIZE) {
+                    decode(usec);
+                }
+            }
+
+            // For boards whose DMA idle-line interrupt delivers a frame at a time
+            void handleBytes(const uint8_t * buf, uint16_t len, uint32_t usec)
+            {
+                for (uint16_t k=0; k<len; ++k) {
+                    handleByte(buf[k], usec);
+                }
+            }
+
+            // True once per completed frame
+            bool gotNewFrame(void) const
+            {
+                return _frames.sequence() != _sequenceRead;
+            }
+
+            // Copies out the latest frame
+            void readFrame(frame_t & frame)
+            {
+                _sequenceRead = _frames.read(frame);
+            }
+
+    }; // class DSMX_Decoder
+
+} // namespace hf
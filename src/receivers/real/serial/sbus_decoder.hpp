@@ -0,0 +1,151 @@
+/*
+   sbus_decoder.hpp : SBUS frame decoder driven byte by byte from the UART receive interrupt
+
+   An SBUS frame is 25 bytes at 100000 baud, 8E2: a 0x0F header, sixteen 11-bit channels packed LSB first into
+   22 bytes, a flags byte (bit 3 set in a failsafe frame), and a footer (0x00, or 0x04 / 0x14 / 0x24 / 0x34 from
+   SBUS2 receivers).  The interrupt hands each byte to handleByte() as it arrives; a gap longer than FRAME_GAP_USEC
+   starts a new frame, so a lost byte spoils only the frame it was in.  Each complete frame is decoded to [-1,+1]
+   in the interrupt and handed to the main loop through a DoubleBuffer, along with the time its last byte came in.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include "doublebuffer.hpp"
+
+namespace hf {
+
+    class SBUS_Decoder {
+
+        public:
+
+            static const uint8_t CHANNELS = 16;
+
+            // Bytes take 120 usec each and frames come at least 4 msec apart
+            static const uint32_t FRAME_GAP_USEC = 2000;
+
+            typedef struct {
+                float    channels[CHANNELS];
+                bool     failsafe;
+                uint32_t usec;
+            } frame_t;
+
+        private:
+
+            static const uint8_t FRAME_SIZE  = 25;
+            static const uint8_t HEADER      = 0x0F;
+            static const uint8_t FLAGS       = 23;
+            static const uint8_t FAILSAFE    = 0x08;
+
+            // Channel values at full stick travel, as in the Bolder Flight SBUS library's readCal()
+            static constexpr float RAW_MIN = 172;
+            static constexpr float RAW_MAX = 1811;
+
+            // Written only by the interrupt
+            uint8_t  _bytes[FRAME_SIZE];
+            uint8_t  _count;
+            uint32_t _lastByteUsec;
+
+            DoubleBuffer<frame_t> _frames;
+
+            uint32_t _sequenceRead;
+
+            static bool isFooter(uint8_t c)
+            {
+                return c == 0x00 || (c & 0x0F) == 0x04;
+            }
+
+            void decode(uint32_t usec)
+            {
+                frame_t & frame = _frames.begin();
+
+                // Sixteen 11-bit values, LSB first, starting at the byte after the header
+                uint32_t bits = 0;
+                uint8_t  nbits = 0;
+                uint8_t  index = 1;
+                for (uint8_t k=0; k<CHANNELS; ++k) {
+                    while (nbits < 11) {
+                        bits |= (uint32_t)_bytes[index++] << nbits;
+                        nbits += 8;
+                    }
+                    frame.channels[k] = ((bits & 0x07FF) - RAW_MIN) * (2 / (RAW_MAX - RAW_MIN)) - 1;
+                    bits >>= 11;
+                    nbits -= 11;
+                }
+
+                frame.failsafe = _bytes[FLAGS] & FAILSAFE;
+                frame.usec = usec;
+
+                _frames.publish();
+            }
+
+        public:
+
+            void init(void)
+            {
+                _count = 0;
+                _lastByteUsec = 0;
+                _sequenceRead = 0;
+            }
+
+            // Called from the UART receive interrupt with each byte and the time it came in
+            void handleByte(uint8_t c, uint32_t usec)
+            {
+                if (usec - _lastByteUsec > FRAME_GAP_USEC) {
+                    _count = 0;
+                }
+                _lastByteUsec = usec;
+
+                // Skip to the next header
+                if (_count == 0 && c != HEADER) {
+                    return;
+                }
+
+                _bytes[_count++] = c;
+
+                if (_count == FRAME_SIZE) {
+                    if (isFooter(c)) {
+                        decode(usec);
+                    }
+                    _count = 0;
+                }
+            }
+
+            // For boards whose DMA idle-line interrupt delivers bytes a burst at a time
+            void handleBytes(const uint8_t * buf, uint16_t len, uint32_t usec)
+            {
+                for (uint16_t k=0; k<len; ++k) {
+                    handleByte(buf[k], usec);
+                }
+            }
+
+            // True once per completed frame
+            bool gotNewFrame(void) const
+            {
+                return _frames.sequence() != _sequenceRead;
+            }
+
+            // Copies out the latest frame
+            void readFrame(frame_t & frame)
+            {
+                _sequenceRead = _frames.read(frame);
+            }
+
+    }; // class SBUS_Decoder
+
+} // namespace hf
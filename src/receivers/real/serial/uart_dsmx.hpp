@@ -0,0 +1,101 @@
+/*
+   uart_dsmx.hpp : Spektrum DSMX receiver decoding frames in the UART receive interrupt
+
+   Unlike DSMX_Receiver, which polls the SpektrumDSM library from the main loop, this one assembles each frame as
+   its bytes arrive, with DSMX_Decoder, so a frame is ready (and timestamped) as soon as its last byte is in, and
+   reading it from the loop is just a copy.  On the STM32L4 core the decoder runs from Serial1's receive
+   callback.  Boards whose UART interrupt or DMA idle-line callback is their own can feed it bytes() instead; on
+   other cores, without either, gotNewFrame() drains Serial1 itself.  A satellite that stops sending trips the
+   receiver's failsafe timeout.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+
+#include "receiver.hpp"
+#include "dsmx_decoder.hpp"
+
+namespace hf {
+
+    class UART_DSMX_Receiver final : public Receiver {
+
+        private:
+
+            static DSMX_Decoder _decoder;
+
+            uint32_t _frameMicros;
+
+            static void drain(void)
+            {
+                while (Serial1.available()) {
+                    _decoder.handleByte(Serial1.read(), micros());
+                }
+            }
+
+        public:
+
+            UART_DSMX_Receiver(float trimRoll=0, float trimPitch=0, float trimYaw=0) 
+                : Receiver(trimRoll, trimPitch, trimYaw), _frameMicros(0)
+            {
+                _channelCount = DSMX_Decoder::CHANNELS;
+            }
+
+            // For boards feeding bytes from their own UART interrupt or DMA idle-line callback
+            static void bytes(const uint8_t * buf, uint16_t len, uint32_t usec)
+            {
+                _decoder.handleBytes(buf, len, usec);
+            }
+
+        protected:
+
+            void begin(void)
+            {
+                _decoder.init();
+                Serial1.begin(115200);
+#if defined(ARDUINO_ARCH_STM32L4)
+                Serial1.onReceive(drain);
+#endif
+            }
+
+            bool gotNewFrame(void)
+            {
+#if !defined(ARDUINO_ARCH_STM32L4)
+                drain();
+#endif
+                return _decoder.gotNewFrame();
+            }
+
+            void readRawvals(void)
+            {
+                DSMX_Decoder::frame_t frame;
+                _decoder.readFrame(frame);
+                memcpy(rawvals, frame.channels, sizeof(frame.channels));
+                _frameMicros = frame.usec;
+            }
+
+            bool getFrameMicros(uint32_t & usec)
+            {
+                usec = _frameMicros;
+                return true;
+            }
+
+    }; // class UART_DSMX_Receiver
+
+    DSMX_Decoder UART_DSMX_Receiver::_decoder;
+
+} // namespace hf
@@ -0,0 +1,110 @@
+/*
+   uart_sbus.hpp : Futaba SBUS receiver decoding frames in the UART receive interrupt
+
+   Unlike SBUS_Receiver, which has the SBUS library pull and parse bytes from the main loop, this one assembles
+   each frame as its bytes arrive, with SBUS_Decoder, so a frame is ready (and timestamped) as soon as its last
+   byte is in, and reading it from the loop is just a copy.  On the STM32L4 core the decoder runs from Serial1's
+   receive callback.  Boards whose UART interrupt or DMA idle-line callback is their own can feed it bytes()
+   instead; on other cores, without either, gotNewFrame() drains Serial1 itself.  SBUS is an inverted signal:
+   the STM32L4 core inverts Serial1's RX pin itself (SERIAL_SBUS, as the SBUS library asks for there), but other
+   cores take plain 8E2 and need an external inverter on the pin.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+
+#include "receiver.hpp"
+#include "sbus_decoder.hpp"
+
+namespace hf {
+
+    class UART_SBUS_Receiver final : public Receiver {
+
+        private:
+
+            static SBUS_Decoder _decoder;
+
+            SBUS_Decoder::frame_t _frame;
+
+            static void drain(void)
+            {
+                while (Serial1.available()) {
+                    _decoder.handleByte(Serial1.read(), micros());
+                }
+            }
+
+        public:
+
+            UART_SBUS_Receiver(float trimRoll=0, float trimPitch=0, float trimYaw=0) 
+                : Receiver(trimRoll, trimPitch, trimYaw)
+            {
+                _channelCount = SBUS_Decoder::CHANNELS;
+                _frame.failsafe = false;
+                _frame.usec = 0;
+            }
+
+            // For boards feeding bytes from their own UART interrupt or DMA idle-line callback
+            static void bytes(const uint8_t * buf, uint16_t len, uint32_t usec)
+            {
+                _decoder.handleBytes(buf, len, usec);
+            }
+
+        protected:
+
+            void begin(void)
+            {
+                _decoder.init();
+#if defined(ARDUINO_ARCH_STM32L4)
+                Serial1.begin(100000, SERIAL_SBUS);
+                Serial1.onReceive(drain);
+#else
+                Serial1.begin(100000, SERIAL_8E2);
+#endif
+            }
+
+            bool gotNewFrame(void)
+            {
+#if !defined(ARDUINO_ARCH_STM32L4)
+                drain();
+#endif
+                return _decoder.gotNewFrame();
+            }
+
+            void readRawvals(void)
+            {
+                _decoder.readFrame(_frame);
+                memcpy(rawvals, _frame.channels, sizeof(_frame.channels));
+            }
+
+            bool getFrameMicros(uint32_t & usec)
+            {
+                usec = _frame.usec;
+                return true;
+            }
+
+            // Failsafe frames don't hold off the receiver's failsafe timeout
+            bool frameIsValid(void)
+            {
+                return !_frame.failsafe;
+            }
+
+    }; // class UART_SBUS_Receiver
+
+    SBUS_Decoder UART_SBUS_Receiver::_decoder;
+
+} // namespace hf
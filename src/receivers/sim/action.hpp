@@ -0,0 +1,102 @@
+/*
+   action.hpp : Simulated receiver whose channels are set by the program flying the simulation
+
+   For agents and optimizers stepping the simulator themselves: the caller hands over the raw channel values
+   with setRawvals() whenever it likes, and they go out in the next frame, at the receiver's usual frame rate on
+   the board clock.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <string.h>
+
+#include "receiver.hpp"
+#include "board.hpp"
+
+namespace hf {
+
+    class ActionReceiver final : public Receiver {
+
+        public:
+
+            ActionReceiver(Board * board, uint32_t framePeriodMicros=10000) :
+                _board(board), _framePeriodMicros(framePeriodMicros)
+            {
+                reset();
+            }
+
+            // Raw channel values in [-1,+1]: throttle, roll, pitch, yaw, aux
+            void setRawvals(const float vals[CHANNELS])
+            {
+                memcpy(_pending, vals, sizeof(_pending));
+            }
+
+        protected:
+
+            void begin(void)
+            {
+                _nextFrameMicros = 0;
+                reset();
+            }
+
+            bool gotNewFrame(void)
+            {
+                uint32_t usec = _board->getMicroseconds();
+
+                if ((int32_t)(usec - _nextFrameMicros) < 0) {
+                    return false;
+                }
+
+                _nextFrameMicros = usec + _framePeriodMicros;
+                _frameMicros = usec;
+
+                return true;
+            }
+
+            void readRawvals(void)
+            {
+                memcpy(rawvals, _pending, sizeof(_pending));
+            }
+
+            bool getFrameMicros(uint32_t & usec)
+            {
+                usec = _frameMicros;
+                return true;
+            }
+
+        private:
+
+            Board *  _board;
+            uint32_t _framePeriodMicros;
+            uint32_t _nextFrameMicros;
+            uint32_t _frameMicros;
+
+            float    _pending[CHANNELS];
+
+            // Throttle down and aux off until told otherwise
+            void reset(void)
+            {
+                memset(_pending, 0, sizeof(_pending));
+                _pending[0] = -1;
+                _pending[4] = -1;
+                _nextFrameMicros = 0;
+                _frameMicros = 0;
+            }
+
+    }; // class ActionReceiver
+
+} // namespace hf
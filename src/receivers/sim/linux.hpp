@@ -22,6 +22,7 @@
 
 #include <unistd.h>
 #include <sys/time.h>
+#include <sys/epoll.h>
 #include <linux/joystick.h>
 
 static const char * DEVNAME = "/dev/input/js0";
@@ -32,6 +33,13 @@ void hf::Controller::productInit(void)
 
         fcntl(_joyid, F_SETFL, O_NONBLOCK);
 
+        // The input thread sleeps on this until the joystick has events
+        _epollfd = epoll_create1(0);
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.fd = _joyid;
+        epoll_ctl(_epollfd, EPOLL_CTL_ADD, _joyid, &ev);
+
         char prodname[128];
 
         if (ioctl(_joyid, JSIOCGNAME(sizeof(prodname)), prodname) < 0) {
@@ -90,23 +98,46 @@ void hf::Controller::productInit(void)
     }
 }
 
-void hf::Controller::productPoll(int32_t axes[6], uint8_t & buttons)
+bool hf::Controller::productWait(int32_t axes[6], uint8_t & buttons)
 {
-    if (_joyid <= 0) return;
-
-    struct js_event js;
-
-    read(_joyid, &js, sizeof(struct js_event));
+    // No joystick: idle, so halt() can still stop the thread
+    if (_joyid <= 0 || _epollfd < 0) {
+        usleep(10000);
+        return false;
+    }
 
-    if (js.type & JS_EVENT_INIT) return;
+    struct epoll_event ev;
+    if (epoll_wait(_epollfd, &ev, 1, 10) <= 0) {
+        return false;
+    }
 
-    switch (js.type) {
-        case JS_EVENT_AXIS:
-            axes[js.number] = js.value;
-            break;
-        case JS_EVENT_BUTTON:
-            buttons = js.number + 1; // avoid zero
+    bool got = false;
+
+    // Drain everything queued, so the snapshot is never behind the stick
+    struct js_event js[32];
+    ssize_t n;
+    while ((n = read(_joyid, js, sizeof(js))) > 0) {
+
+        for (ssize_t k=0; k<n/(ssize_t)sizeof(struct js_event); ++k) {
+
+            // Initial-state events report where the axes and buttons start
+            switch (js[k].type & ~JS_EVENT_INIT) {
+                case JS_EVENT_AXIS:
+                    if (js[k].number < 6) {
+                        axes[js[k].number] = js[k].value;
+                    }
+                    break;
+                case JS_EVENT_BUTTON:
+                    if (!(js[k].type & JS_EVENT_INIT)) {
+                        buttons = js[k].number + 1; // avoid zero
+                    }
+            }
+
+            got = true;
+        }
     }
+
+    return got;
 }
 
 int32_t hf::Controller::productGetBaseline(void)
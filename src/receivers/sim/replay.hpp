@@ -0,0 +1,62 @@
+/*
+   replay.hpp : Receiver subclass that plays back the channels recorded in a ReplayBoard log
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "receiver.hpp"
+#include "boards/sim/replay.hpp"
+
+namespace hf {
+
+    class ReplayReceiver final : public Receiver {
+
+        public:
+
+            ReplayReceiver(ReplayBoard * board) : _board(board) { }
+
+        protected:
+
+            void begin(void)
+            {
+                _frameMicros = 0;
+            }
+
+            // Frames arrive on the gyro samples they were recorded with
+            bool gotNewFrame(void)
+            {
+                return _board->getReceiverFrame(rawvals, MAXCHANNELS, _frameMicros);
+            }
+
+            void readRawvals(void)
+            {
+            }
+
+            bool getFrameMicros(uint32_t & usec)
+            {
+                usec = _frameMicros;
+                return true;
+            }
+
+        private:
+
+            ReplayBoard * _board;
+            uint32_t      _frameMicros;
+
+    }; // class ReplayReceiver
+
+} // namespace hf
@@ -0,0 +1,122 @@
+/*
+   scenarios.hpp : Standard stick-input scenarios, for unattended and comparable simulation runs
+
+   Each scenario arms (throttle down, yaw right for a second), takes off on a one-second throttle ramp to hover,
+   and then puts the vehicle through one thing, on the same schedule every run.  settleStart is when the last
+   stick disturbance is over; altitudeHold says the scenario flies on the altitude-hold switch, and so wants a
+   barometer.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <string.h>
+
+#include "stickscript.hpp"
+
+namespace hf {
+
+    typedef struct {
+
+        const char * name;
+        StickScript  script;
+        float        duration;    // seconds
+        float        settleStart; // seconds
+        bool         altitudeHold;
+
+    } scenario_t;
+
+    class Scenarios {
+
+        public:
+
+            enum {
+                TAKEOFF_HOVER,
+                ROLL_DOUBLETS,
+                PITCH_DOUBLETS,
+                ROLL_CHIRP,
+                THROTTLE_PUNCH,
+                ALTITUDE_STEP,
+                COUNT
+            };
+
+            static const scenario_t & get(uint8_t index)
+            {
+                typedef StickScript S;
+
+                static const S::segment_t takeoffHover[] = {
+                    S::pulse(0, S::YAW, +1, 1), S::ramp(1, S::THROTTLE, 0, 1)
+                };
+
+                // Two roll doublets, two seconds apart
+                static const S::segment_t rollDoublets[] = {
+                    S::pulse(0, S::YAW, +1, 1), S::ramp(1, S::THROTTLE, 0, 1),
+                    S::pulse(3.0, S::ROLL, +0.3f, 0.5), S::pulse(3.5, S::ROLL, -0.3f, 0.5),
+                    S::pulse(5.0, S::ROLL, +0.3f, 0.5), S::pulse(5.5, S::ROLL, -0.3f, 0.5)
+                };
+
+                static const S::segment_t pitchDoublets[] = {
+                    S::pulse(0, S::YAW, +1, 1), S::ramp(1, S::THROTTLE, 0, 1),
+                    S::pulse(3.0, S::PITCH, +0.3f, 0.5), S::pulse(3.5, S::PITCH, -0.3f, 0.5),
+                    S::pulse(5.0, S::PITCH, +0.3f, 0.5), S::pulse(5.5, S::PITCH, -0.3f, 0.5)
+                };
+
+                // A roll input the size of the doublets', swept from half a hertz to eight over five seconds
+                static const S::segment_t rollChirp[] = {
+                    S::pulse(0, S::YAW, +1, 1), S::ramp(1, S::THROTTLE, 0, 1),
+                    S::chirp(3, S::ROLL, 0.3f, 5, 0.5, 8)
+                };
+
+                // Full throttle for a second, then back to hover
+                static const S::segment_t throttlePunch[] = {
+                    S::pulse(0, S::YAW, +1, 1), S::ramp(1, S::THROTTLE, 0, 1),
+                    S::pulse(3, S::THROTTLE, +1, 1)
+                };
+
+                // Hold, then climb off the switch for a second and hold again higher up
+                static const S::segment_t altitudeStep[] = {
+                    S::pulse(0, S::YAW, +1, 1), S::ramp(1, S::THROTTLE, 0, 1),
+                    S::step(2.5, S::AUX1, +1),
+                    S::step(5, S::AUX1, -1), S::pulse(5, S::THROTTLE, +0.4f, 1),
+                    S::step(6.5, S::AUX1, +1)
+                };
+
+                static const scenario_t scenarios[COUNT] = {
+                    {"takeoffHover",  takeoffHover,  6,  2,   false},
+                    {"rollDoublets",  rollDoublets,  9,  6,   false},
+                    {"pitchDoublets", pitchDoublets, 9,  6,   false},
+                    {"rollChirp",     rollChirp,     10, 8,   false},
+                    {"throttlePunch", throttlePunch, 7,  4,   false},
+                    {"altitudeStep",  altitudeStep,  10, 6.5, true}
+                };
+
+                return scenarios[index];
+            }
+
+            // The scenario of the given name, or null
+            static const scenario_t * find(const char * name)
+            {
+                for (uint8_t k=0; k<COUNT; ++k) {
+                    if (!strcmp(get(k).name, name)) {
+                        return &get(k);
+                    }
+                }
+                return 0;
+            }
+
+    }; // class Scenarios
+
+} // namespace hf
@@ -0,0 +1,100 @@
+/*
+   scripted.hpp : Receiver subclass that plays back scripted stick inputs, for unattended simulation
+
+   The script is either a function of time, or a StickScript table (see scenarios.hpp for the standard ones).
+   Either way it is played against the board's clock, so a run on a simulated clock is the same every time.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "receiver.hpp"
+#include "board.hpp"
+#include "stickscript.hpp"
+
+namespace hf {
+
+    class ScriptedReceiver final : public Receiver {
+
+        public:
+
+            // A script fills raw channel values in [-1,+1] for a given time in seconds
+            typedef void (*script_t)(float seconds, float rawvals[]);
+
+            ScriptedReceiver(Board * board, script_t script, uint32_t framePeriodMicros=10000) :
+                _board(board), _script(script), _table(0), _framePeriodMicros(framePeriodMicros) { }
+
+            // The table must outlive the receiver
+            ScriptedReceiver(Board * board, const StickScript & table, uint32_t framePeriodMicros=10000) :
+                _board(board), _script(0), _table(&table), _framePeriodMicros(framePeriodMicros) { }
+
+            // Points a copy of a running receiver (e.g. a fork of a simulation checkpoint) at its own board
+            void rebind(Board * board)
+            {
+                _board = board;
+            }
+
+        protected:
+
+            void begin(void)
+            {
+                _nextFrameMicros = 0;
+            }
+
+            bool gotNewFrame(void)
+            {
+                uint32_t usec = _board->getMicroseconds();
+
+                if ((int32_t)(usec - _nextFrameMicros) < 0) {
+                    return false;
+                }
+
+                _nextFrameMicros = usec + _framePeriodMicros;
+                _frameMicros = usec;
+
+                return true;
+            }
+
+            void readRawvals(void)
+            {
+                float t = _frameMicros / 1.e6f;
+
+                if (_table) {
+                    _table->fill(t, rawvals);
+                }
+                else {
+                    _script(t, rawvals);
+                }
+            }
+
+            bool getFrameMicros(uint32_t & usec)
+            {
+                usec = _frameMicros;
+                return true;
+            }
+
+        private:
+
+            Board *             _board;
+            script_t            _script;
+            const StickScript * _table;
+            uint32_t            _framePeriodMicros;
+            uint32_t            _nextFrameMicros;
+            uint32_t            _frameMicros;
+
+    }; // class ScriptedReceiver
+
+} // namespace hf
@@ -0,0 +1,73 @@
+/*
+   shared.hpp : Receiver subclass that takes stick inputs from a simulator's shared-memory channel
+
+   An external program (visualizer, game engine, test script) injects channels by writing the
+   SimStateChannel command block; see boards/sim/sharedstate.hpp for the layout.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "receiver.hpp"
+#include "boards/sim/sharedstate.hpp"
+
+namespace hf {
+
+    class SharedMemoryReceiver final : public Receiver {
+
+        public:
+
+            SharedMemoryReceiver(SimStateChannel * channel) : _channel(channel)
+            {
+                _channelCount = SimStateChannel::CHANNELS;
+            }
+
+        protected:
+
+            void begin(void)
+            {
+                _lastSeq = 0;
+            }
+
+            // A frame is new whenever the writer has published another command
+            bool gotNewFrame(void)
+            {
+                uint32_t seq = _channel->commandSequence();
+
+                if (seq == _lastSeq) {
+                    return false;
+                }
+
+                _lastSeq = seq;
+
+                return true;
+            }
+
+            void readRawvals(void)
+            {
+                SimStateChannel::command_t command;
+                _lastSeq = _channel->readCommand(command);
+                memcpy(rawvals, command.rawvals, sizeof(command.rawvals));
+            }
+
+        private:
+
+            SimStateChannel * _channel;
+            uint32_t          _lastSeq;
+
+    }; // class SharedMemoryReceiver
+
+} // namespace hf
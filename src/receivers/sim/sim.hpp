@@ -1,7 +1,9 @@
 /*
    sim.hpp : Support USB controller for flight simulators
 
-   Controller subclasses Receiver
+   Controller subclasses Receiver.  A background thread waits on the controller, drains every pending event, and
+   publishes the latest axes and buttons through a seqlock, so reading them in the flight loop never waits and
+   never falls behind the input.
 
    This file is part of Hackflight.
 
@@ -26,12 +28,16 @@
 #include <math.h>
 #include <fcntl.h>
 
+#include <atomic>
+#include <thread>
+
 #include "receiver.hpp"
+#include "seqlock.hpp"
 #include "debug.hpp"
 
 namespace hf {
 
-    class Controller : public Receiver {
+    class Controller final : public Receiver {
 
         public:
 
@@ -59,11 +65,19 @@ namespace hf {
                 _springyThrottle = false;
                 _useButtonForAux = false;
                 _joyid = 0;
+                _epollfd = -1;
                 _cycle = 0;
+                _lastSeq = 0;
+                _running = false;
 
                 _buttonState = 0;
             }
 
+            ~Controller(void)
+            {
+                halt();
+            }
+
             void begin(void)
             {
                 // Set up axes based on OS and controller
@@ -71,24 +85,29 @@ namespace hf {
 
                 // Useful for springy-throttle controllers (XBox, PS3)
                 _throttleDemand = -1.f;
+
+                // Start reading the controller in the background
+                if (!_running) {
+                    _running = true;
+                    _thread = std::thread(&Controller::run, this);
+                }
             }
 
+            // New input makes a new frame at once; otherwise frames repeat every third check
             bool gotNewFrame(void)
             {
-                return (++_cycle % 3) ? false : true;
+                return _input.sequence() != _lastSeq || (++_cycle % 3) == 0;
             }
 
             void readRawvals(void)
             {
-                static int32_t axes[6];
-                static uint8_t buttons;
-
-                // Grab the axis values in an OS-specific way
-                productPoll(axes, buttons);
+                // Latest snapshot from the input thread
+                input_t input;
+                _lastSeq = _input.read(input);
 
                 // Normalize the axes to demands in [-1,+1]
                 for (uint8_t k=0; k<5; ++k) {
-                    rawvals[k] = (axes[_axismap[k]] - productGetBaseline()) / 32767.f;
+                    rawvals[k] = (input.axes[_axismap[k]] - productGetBaseline()) / 32767.f;
                 }
 
                 // Invert throttle, pitch if indicated
@@ -100,7 +119,7 @@ namespace hf {
                 // For game controllers, use buttons to fake up values in a three-position aux switch
                 if (_useButtonForAux) {
                     for (uint8_t k=0; k<3; ++k) {
-                        if (buttons == _buttonmap[k]) {
+                        if (input.buttons == _buttonmap[k]) {
                             _buttonState = k;
                         }
                     }
@@ -121,20 +140,51 @@ namespace hf {
                 rawvals[0] = _throttleDemand;
             }
 
+            // Stops the input thread
             void halt(void)
             {
+                if (_running) {
+                    _running = false;
+                    _thread.join();
+                }
             }
 
         private:
 
+            typedef struct {
+
+                int32_t axes[6];
+                uint8_t buttons;
+
+            } input_t;
+
             // A hack to skip noisy throttle on startup
             bool     _ready;
 
-            // Implemented differently for each OS
+            // Implemented differently for each OS.  productWait() waits a few milliseconds at most for input,
+            // applies everything pending to axes and buttons, and returns true if any arrived.
             void     productInit(void);
-            void     productPoll(int32_t axes[6], uint8_t & buttons);
+            bool     productWait(int32_t axes[6], uint8_t & buttons);
             int32_t  productGetBaseline(void);
 
+            // Input thread, and the snapshot it publishes
+            std::thread       _thread;
+            std::atomic<bool> _running;
+            SeqLock<input_t>  _input;
+            uint32_t          _lastSeq;
+
+            void run(void)
+            {
+                input_t input;
+                memset(&input, 0, sizeof(input));
+
+                while (_running) {
+                    if (productWait(input.axes, input.buttons)) {
+                        _input.write(input);
+                    }
+                }
+            }
+
             // Determined dynamically based on controller
             bool     _reversedVerticals;
             bool     _springyThrottle;
@@ -143,6 +193,7 @@ namespace hf {
             uint8_t  _axismap[5];   // Thr, Ael, Ele, Rud, Aux
             uint8_t  _buttonmap[3]; // Aux=0, Aux=1, Aux=2
             int      _joyid;        // Linux file descriptor or Windows joystick ID
+            int      _epollfd;      // Linux only
 
             // Simulate auxiliary switch via pushbuttons
             uint8_t _buttonState;
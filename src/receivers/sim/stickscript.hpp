@@ -0,0 +1,153 @@
+/*
+   stickscript.hpp : Stick inputs as a table of timed segments, for ScriptedReceiver
+
+   A script is an array of segments, each driving one channel from its start time: a step or a pulse to a value, a
+   ramp to a value (a run of ramps is a set of linearly interpolated keyframes), or a chirp about the channel's
+   value with its frequency swept from f0 to f1.  A channel holds its initial value until its first segment, and
+   each segment starts from wherever the one before it on that channel had got to, cutting it off.  Aux switch
+   flips are steps on an aux channel.  Segments must be listed in order of start time.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <math.h>
+#include <cstdint>
+
+namespace hf {
+
+    class StickScript {
+
+        public:
+
+            // Channels a script can drive: throttle, roll, pitch, yaw, and two aux switches
+            enum {
+                THROTTLE,
+                ROLL,
+                PITCH,
+                YAW,
+                AUX1,
+                AUX2,
+                CHANNELS
+            };
+
+            enum {
+                STEP,   // to value, held
+                PULSE,  // to value for duration, then back
+                RAMP,   // to value, linearly over duration, then held
+                CHIRP   // value is the amplitude, swept from f0 to f1 Hz over duration, then back
+            };
+
+            typedef struct {
+                float   start;     // seconds
+                uint8_t channel;
+                uint8_t shape;
+                float   value;
+                float   duration;  // seconds
+                float   f0;
+                float   f1;
+            } segment_t;
+
+            // Shorthands for script tables
+            static constexpr segment_t step(float start, uint8_t channel, float value)
+            {
+                return {start, channel, STEP, value, 0, 0, 0};
+            }
+
+            static constexpr segment_t pulse(float start, uint8_t channel, float value, float duration)
+            {
+                return {start, channel, PULSE, value, duration, 0, 0};
+            }
+
+            static constexpr segment_t ramp(float start, uint8_t channel, float value, float duration)
+            {
+                return {start, channel, RAMP, value, duration, 0, 0};
+            }
+
+            static constexpr segment_t chirp(float start, uint8_t channel, float amplitude, float duration, float f0,
+                    float f1)
+            {
+                return {start, channel, CHIRP, amplitude, duration, f0, f1};
+            }
+
+            // Channels start at throttle down, sticks centered, switches off
+            StickScript(const segment_t * segments, uint16_t count) : _segments(segments), _count(count) { }
+
+            template <uint16_t N>
+            StickScript(const segment_t (&segments)[N]) : _segments(segments), _count(N) { }
+
+            // Fills raw channel values in [-1,+1] for time t in seconds
+            void fill(float t, float rawvals[]) const
+            {
+                for (uint8_t c=0; c<CHANNELS; ++c) {
+                    rawvals[c] = value(c, t);
+                }
+            }
+
+            float value(uint8_t channel, float t) const
+            {
+                float from = (channel == THROTTLE || channel >= AUX1) ? -1 : 0;
+
+                const segment_t * active = 0;
+
+                for (uint16_t k=0; k<_count && _segments[k].start <= t; ++k) {
+                    const segment_t & s = _segments[k];
+                    if (s.channel != channel) {
+                        continue;
+                    }
+                    if (active) {
+                        from = at(*active, s.start - active->start, from);
+                    }
+                    active = &s;
+                }
+
+                return active ? at(*active, t - active->start, from) : from;
+            }
+
+        private:
+
+            const segment_t * _segments;
+            uint16_t          _count;
+
+            // Value of segment s, tau seconds after its start, coming from value from
+            static float at(const segment_t & s, float tau, float from)
+            {
+                switch (s.shape) {
+
+                    case STEP:
+                        return s.value;
+
+                    case PULSE:
+                        return tau < s.duration ? s.value : from;
+
+                    case RAMP:
+                        return tau < s.duration ? from + (s.value - from) * tau / s.duration : s.value;
+
+                    case CHIRP:
+                        if (tau < s.duration) {
+                            // Phase is the integral of a linear frequency sweep
+                            float cycles = s.f0 * tau + (s.f1 - s.f0) * tau * tau / (2 * s.duration);
+                            return from + s.value * sinf(2 * (float)M_PI * cycles);
+                        }
+                        return from;
+                }
+
+                return from;
+            }
+
+    }; // class StickScript
+
+} // namespace hf
@@ -113,21 +113,28 @@ void hf::Controller::productInit(void)
     }
 }
 
-void hf::Controller::productPoll(int32_t axes[6], uint8_t & buttons)
+bool hf::Controller::productWait(int32_t axes[6], uint8_t & buttons)
 {
+    // The joystick API has no events to wait on, so poll it at 1 kHz
+    Sleep(1);
+
     JOYINFOEX joyState;
     joyState.dwSize=sizeof(joyState);
     joyState.dwFlags=JOY_RETURNALL | JOY_RETURNPOVCTS | JOY_RETURNCENTERED | JOY_USEDEADZONE;
-    joyGetPosEx(_joyid, &joyState);
+    if (joyGetPosEx(_joyid, &joyState) != JOYERR_NOERROR) {
+        return false;
+    }
+
+    int32_t latest[6] = {(int32_t)joyState.dwXpos, (int32_t)joyState.dwYpos, (int32_t)joyState.dwZpos,
+                         (int32_t)joyState.dwRpos, (int32_t)joyState.dwUpos, (int32_t)joyState.dwVpos};
+
+    // Publish only changes
+    bool changed = buttons != (uint8_t)joyState.dwButtons || memcmp(axes, latest, sizeof(latest)) != 0;
 
-    axes[0] = joyState.dwXpos;
-    axes[1] = joyState.dwYpos;
-    axes[2] = joyState.dwZpos;
-    axes[3] = joyState.dwRpos;
-    axes[4] = joyState.dwUpos;
-    axes[5] = joyState.dwVpos;
+    memcpy(axes, latest, sizeof(latest));
+    buttons = (uint8_t)joyState.dwButtons;
 
-    buttons = joyState.dwButtons;
+    return changed;
 }
 
 int32_t hf::Controller::productGetBaseline(void)
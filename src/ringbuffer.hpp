@@ -0,0 +1,145 @@
+/*
+   ringbuffer.hpp : Lock-free single-producer / single-consumer ring buffer
+
+   One side (e.g. an interrupt handler, DMA callback, or thread) may push while the other pops, without locks.
+   SIZE must be a power of two; one slot is kept empty to tell full from empty.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <atomic>
+
+namespace hf {
+
+    template <typename T, uint16_t SIZE>
+    class RingBuffer {
+
+        static_assert(SIZE && !(SIZE & (SIZE-1)), "RingBuffer size must be a power of two");
+
+        private:
+
+            static const uint16_t MASK = SIZE - 1;
+
+            T _buf[SIZE];
+
+            std::atomic<uint16_t> _head; // next slot to write; owned by producer
+            std::atomic<uint16_t> _tail; // next slot to read; owned by consumer
+
+        public:
+
+            RingBuffer(void) : _head(0), _tail(0) { }
+
+            // Copies another ring and what it holds, e.g. for a simulation checkpoint; neither of its sides may run
+            // meanwhile
+            RingBuffer(const RingBuffer & other) : _head(other._head.load()), _tail(other._tail.load())
+            {
+                for (uint16_t k=0; k<SIZE; ++k) {
+                    _buf[k] = other._buf[k];
+                }
+            }
+
+            void clear(void)
+            {
+                _tail.store(_head.load());
+            }
+
+            uint16_t available(void) const
+            {
+                return (_head.load(std::memory_order_acquire) - _tail.load(std::memory_order_relaxed)) & MASK;
+            }
+
+            uint16_t space(void) const
+            {
+                return SIZE - 1 - ((_head.load(std::memory_order_relaxed) - _tail.load(std::memory_order_acquire)) & MASK);
+            }
+
+            // Producer side ----------------------------------------------------------------------------------
+
+            bool push(const T & value)
+            {
+                uint16_t head = _head.load(std::memory_order_relaxed);
+                uint16_t next = (head + 1) & MASK;
+
+                if (next == _tail.load(std::memory_order_acquire)) {
+                    return false; // full
+                }
+
+                _buf[head] = value;
+                _head.store(next, std::memory_order_release);
+                return true;
+            }
+
+            // Pushes as many of count values as fit, returning the number written
+            uint16_t write(const T * values, uint16_t count)
+            {
+                uint16_t n = 0;
+                while (n < count && push(values[n])) {
+                    n++;
+                }
+                return n;
+            }
+
+            // Gives the largest contiguous free region, so a DMA transfer or bulk read can fill it directly;
+            // follow with commit() of the number of values actually written
+            uint16_t reserveContiguous(T ** ptr)
+            {
+                uint16_t head = _head.load(std::memory_order_relaxed);
+                uint16_t tail = _tail.load(std::memory_order_acquire);
+                uint16_t free = (tail > head) ? (tail - head - 1) : (SIZE - head - (tail == 0 ? 1 : 0));
+                *ptr = &_buf[head];
+                return free;
+            }
+
+            void commit(uint16_t count)
+            {
+                _head.store((_head.load(std::memory_order_relaxed) + count) & MASK, std::memory_order_release);
+            }
+
+            // Consumer side ----------------------------------------------------------------------------------
+
+            bool pop(T & value)
+            {
+                uint16_t tail = _tail.load(std::memory_order_relaxed);
+
+                if (tail == _head.load(std::memory_order_acquire)) {
+                    return false; // empty
+                }
+
+                value = _buf[tail];
+                _tail.store((tail + 1) & MASK, std::memory_order_release);
+                return true;
+            }
+
+            // Gives the largest contiguous readable region, so a DMA transfer or bulk write can drain it directly;
+            // follow with consume() of the number of values actually used
+            uint16_t peekContiguous(const T ** ptr) const
+            {
+                uint16_t head = _head.load(std::memory_order_acquire);
+                uint16_t tail = _tail.load(std::memory_order_relaxed);
+                *ptr = &_buf[tail];
+                return (head >= tail) ? (head - tail) : (SIZE - tail);
+            }
+
+            void consume(uint16_t count)
+            {
+                _tail.store((_tail.load(std::memory_order_relaxed) + count) & MASK, std::memory_order_release);
+            }
+
+    }; // class RingBuffer
+
+} // namespace hf
@@ -0,0 +1,244 @@
+/*
+   scheduler.hpp : Rate-group scheduler for the main loop
+
+   Each task has a priority, a period, and a time budget.  On every pass the highest-priority task (the gyro/PID
+   rate group) runs first.  Lower-priority tasks that are due then run in priority order, as long as their last
+   measured duration still fits in the pass budget.  If the top task overran its budget, or there is no slack
+   left, the remaining due tasks are deferred to the next pass; a task that was deferred is allowed to run on the
+   following pass regardless of slack (one such catch-up per pass), so nothing starves.
+
+   Periods are measured on the board's clock (which may be simulated); durations and budgets are CPU time,
+   measured with the board's cycle counter.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include "timedtask.hpp"
+#include "profiler.hpp"
+
+namespace hf {
+
+    template <class Owner, uint8_t MAXTASKS=8>
+    class Scheduler {
+
+        public:
+
+            typedef void (Owner::*task_t)(void);
+
+            void init(uint32_t passBudgetMicros)
+            {
+                _passBudget = passBudgetMicros;
+                _ntasks = 0;
+            }
+
+            // Lower priority number runs first.  A period of zero means the task is due on every pass; such tasks
+            // normally poll a sensor's data-ready status.  The stage index ties the task to its Profiler statistics.
+            void addTask(task_t fn, uint8_t stage, uint8_t priority, uint32_t periodMicros, uint32_t budgetMicros)
+            {
+                if (_ntasks == MAXTASKS) {
+                    return;
+                }
+
+                // Insert in priority order
+                uint8_t k = _ntasks++;
+                while (k > 0 && _tasks[k-1].priority > priority) {
+                    _tasks[k] = _tasks[k-1];
+                    k--;
+                }
+
+                task_info_t & t = _tasks[k];
+                t.fn = fn;
+                t.stage = stage;
+                t.priority = priority;
+                t.period = periodMicros;
+                t.basePeriod = periodMicros;
+                t.timer.init(periodMicros);
+                t.budget = budgetMicros;
+                t.lastDuration = 0;
+                t.overruns = 0;
+                t.deferrals = 0;
+                t.deferred = false;
+            }
+
+            // Returns the cycles spent running tasks, for the CPU load
+            template <class BoardT>
+            uint32_t run(Owner * owner, BoardT * board, Profiler * profiler)
+            {
+                if (_ntasks == 0) {
+                    return 0;
+                }
+
+                uint32_t cyclesPerMicro = board->getCyclesPerMicrosecond();
+
+                uint32_t passStart = board->getCycleCount();
+
+                uint32_t busy = 0;
+
+                // The top rate group always runs
+                bool topLong = runTask(_tasks[0], owner, board, profiler, cyclesPerMicro, busy);
+
+                bool caughtUp = false;
+
+                for (uint8_t k=1; k<_ntasks; ++k) {
+
+                    task_info_t & t = _tasks[k];
+
+                    if (!t.timer.check(board->getMicroseconds())) {
+                        continue;
+                    }
+
+                    uint32_t elapsed = (board->getCycleCount() - passStart) / cyclesPerMicro;
+
+                    bool fits = !topLong && elapsed + t.lastDuration <= _passBudget;
+
+                    if (!fits) {
+
+                        // Let one previously deferred task catch up per pass
+                        if (t.deferred && !caughtUp) {
+                            caughtUp = true;
+                        }
+                        else {
+                            if (!t.deferred) {
+                                t.deferrals++;
+                            }
+                            t.deferred = true;
+                            continue;
+                        }
+                    }
+
+                    t.deferred = false;
+                    runTask(t, owner, board, profiler, cyclesPerMicro, busy);
+                }
+
+                return busy;
+            }
+
+            // Runs a task at factor times the period it was added with, e.g. to shed load; factor 1 restores it.
+            // The change takes effect from the task's next run.
+            void stretch(task_t fn, uint8_t factor)
+            {
+                for (uint8_t k=0; k<_ntasks; ++k) {
+                    task_info_t & t = _tasks[k];
+                    if (t.fn == fn) {
+                        t.period = t.basePeriod * factor;
+                        t.timer.setPeriod(t.period);
+                    }
+                }
+            }
+
+            // How long the loop can idle before a task with a period is due, or a deferred one wants to catch up.
+            // Tasks with period zero are left out: they wait on data, whose arrival is what ends the idling.
+            uint32_t microsUntilDue(uint32_t currentTime)
+            {
+                uint32_t wait = UINT32_MAX;
+
+                for (uint8_t k=0; k<_ntasks; ++k) {
+                    task_info_t & t = _tasks[k];
+                    if (t.deferred) {
+                        return 0;
+                    }
+                    if (t.period > 0) {
+                        uint32_t remaining = t.timer.remaining(currentTime);
+                        if (remaining < wait) {
+                            wait = remaining;
+                        }
+                    }
+                }
+
+                return wait;
+            }
+
+            uint8_t taskCount(void)
+            {
+                return _ntasks;
+            }
+
+            // Task statistics, indexed by profiler stage
+            uint32_t getOverruns(uint8_t stage)
+            {
+                task_info_t * t = find(stage);
+                return t ? t->overruns : 0;
+            }
+
+            uint32_t getDeferrals(uint8_t stage)
+            {
+                task_info_t * t = find(stage);
+                return t ? t->deferrals : 0;
+            }
+
+        private:
+
+            typedef struct {
+
+                task_t    fn;
+                uint8_t   stage;
+                uint8_t   priority;
+                uint32_t  period;
+                uint32_t  basePeriod;
+                TimedTask timer;
+                uint32_t  budget;
+                uint32_t  lastDuration;
+                uint32_t  overruns;   // times the task ran longer than its budget
+                uint32_t  deferrals;  // times the task was due but postponed for lack of slack
+                bool      deferred;
+
+            } task_info_t;
+
+            task_info_t _tasks[MAXTASKS];
+            uint8_t     _ntasks;
+            uint32_t    _passBudget;
+
+            // Runs a task, adding its cycles to busy; returns true if it overran its budget
+            template <class BoardT>
+            static bool runTask(task_info_t & t, Owner * owner, BoardT * board, Profiler * profiler, uint32_t cyclesPerMicro,
+                                uint32_t & busy)
+            {
+                t.timer.update(board->getMicroseconds());
+
+                uint32_t startCycles = board->getCycleCount();
+                (owner->*t.fn)();
+                uint32_t cycles = board->getCycleCount() - startCycles;
+
+                profiler->update(t.stage, cycles);
+                busy += cycles;
+
+                t.lastDuration = cycles / cyclesPerMicro;
+
+                bool overran = t.lastDuration > t.budget;
+
+                if (overran) {
+                    t.overruns++;
+                }
+
+                return overran;
+            }
+
+            task_info_t * find(uint8_t stage)
+            {
+                for (uint8_t k=0; k<_ntasks; ++k) {
+                    if (_tasks[k].stage == stage) {
+                        return &_tasks[k];
+                    }
+                }
+                return 0;
+            }
+
+    }; // class Scheduler
+
+} // namespace hf
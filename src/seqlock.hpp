@@ -0,0 +1,97 @@
+/*
+   seqlock.hpp : Single-writer sequence lock for publishing a snapshot to readers that must never wait on it
+
+   The writer bumps the sequence to odd, copies the value in, and bumps it back to even; it never blocks.  A reader
+   copies the value out between two reads of the sequence and retries if the writer was in the middle of an update
+   (odd sequence, or the sequence changed).  Readers never block the writer and never see a torn value.  T should
+   be plain data, since it is copied byte-for-byte.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <atomic>
+
+namespace hf {
+
+    template <typename T>
+    class SeqLock {
+
+        public:
+
+            SeqLock(void) : _seq(0)
+            {
+                memset(&_value, 0, sizeof(T));
+            }
+
+            // Copies another lock's value, e.g. for a simulation checkpoint; its writer may not run meanwhile
+            SeqLock(const SeqLock & other) : _seq(other._seq.load())
+            {
+                memcpy(&_value, &other._value, sizeof(T));
+            }
+
+            // Writer side: only one thread may write
+            void write(const T & value)
+            {
+                uint32_t seq = _seq.load(std::memory_order_relaxed);
+
+                _seq.store(seq + 1, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_release);
+
+                memcpy(&_value, &value, sizeof(T));
+
+                _seq.store(seq + 2, std::memory_order_release);
+            }
+
+            // Reader side: copies out a consistent snapshot, returning its sequence number (even; zero until the
+            // first write), so callers can tell whether anything new has been published
+            uint32_t read(T & value) const
+            {
+                while (true) {
+
+                    uint32_t before = _seq.load(std::memory_order_acquire);
+
+                    if (before & 1) {
+                        continue;
+                    }
+
+                    memcpy(&value, &_value, sizeof(T));
+
+                    std::atomic_thread_fence(std::memory_order_acquire);
+
+                    if (_seq.load(std::memory_order_relaxed) == before) {
+                        return before;
+                    }
+                }
+            }
+
+            // Sequence number of the latest complete write
+            uint32_t sequence(void) const
+            {
+                return _seq.load(std::memory_order_acquire) & ~1u;
+            }
+
+        private:
+
+            std::atomic<uint32_t> _seq;
+
+            T _value;
+
+    }; // class SeqLock
+
+} // namespace hf
@@ -0,0 +1,214 @@
+/*
+   sonars.hpp : Non-blocking round-robin ultrasonic rangefinders
+
+   For HC-SR04-style sensors: a short pulse on the trigger pin starts a ping, and the echo pin then stays high
+   for the round-trip time of the sound.  Reading one the usual way (pulseIn()) busy-waits for the echo, up to
+   25 msec at 4 m, which would stall the gyro loop.  Here the board captures the echo edges in a pin-change or
+   input-capture interrupt and hands them to echoEdge(), and the loop only polls.
+
+   Sensors are pinged one at a time, round robin, and the next ping waits until the last one's echo is in (or
+   has timed out) plus a guard time for stray reflections to die away, so no sensor can hear another's ping.
+   Edges from any sensor but the one pinging are ignored.  The altitude (bottom) sensor can be given every other
+   slot, so altitude hold gets a reading at least twice per round.
+
+   A board with sonars holds a SonarArray, calls echoEdge() from its interrupt handler, and implements
+   Board::getSonarAltitude() by calling update(), firing the trigger pin it asks for, and passing on the
+   altitude sensor's readings.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+namespace hf {
+
+    template <uint8_t COUNT=5>
+    class SonarArray {
+
+        public:
+
+            static const uint8_t NONE = 0xFF;
+
+            // Half the speed of sound at 20C, in cm per usec of echo
+            static constexpr float CM_PER_MICROSECOND = 0.01715f;
+
+        private:
+
+            typedef enum {
+                IDLE,        // between pings, waiting out the guard time
+                AWAIT_RISE,  // pinged, echo not yet started
+                AWAIT_FALL,  // echo started
+                DONE         // echo finished, not yet read by the loop
+            } state_t;
+
+            // Written by echoEdge() in interrupt context; the loop only changes them while no echo is expected
+            volatile uint8_t  _state;
+            volatile uint32_t _riseMicros;
+            volatile uint32_t _fallMicros;
+
+            uint8_t  _active;
+            uint8_t  _altitudeIndex;
+            bool     _altitudeSlot;
+            uint8_t  _next;
+            uint32_t _pingMicros;
+            uint32_t _idleMicros;
+
+            uint16_t _minRange;
+            uint16_t _maxRange;
+            uint32_t _timeoutMicros;
+            uint32_t _guardMicros;
+
+            float    _distances[COUNT];
+            uint32_t _timestamps[COUNT];
+            bool     _fresh[COUNT];
+
+            uint8_t nextSensor(void)
+            {
+                // The altitude sensor takes every other slot when asked for; the rest take turns in between
+                if (_altitudeIndex != NONE && COUNT > 1) {
+                    _altitudeSlot = !_altitudeSlot;
+                    if (_altitudeSlot) {
+                        return _altitudeIndex;
+                    }
+                    _next = (_next + 1) % COUNT;
+                    if (_next == _altitudeIndex) {
+                        _next = (_next + 1) % COUNT;
+                    }
+                    return _next;
+                }
+
+                _next = (_next + 1) % COUNT;
+                return _next;
+            }
+
+        public:
+
+            // Ranges are in cm and bound the readings accepted; an echo longer than the maximum range's round trip
+            // is abandoned.  altitudeIndex, if given, is pinged on every other slot.
+            void init(uint8_t altitudeIndex=NONE, uint16_t minRange=2, uint16_t maxRange=400, uint32_t guardMicros=5000)
+            {
+                _altitudeIndex = altitudeIndex < COUNT ? altitudeIndex : NONE;
+                _minRange = minRange;
+                _maxRange = maxRange;
+                _guardMicros = guardMicros;
+
+                // Sensors typically wait half a msec after the trigger before the echo pin goes high
+                _timeoutMicros = 500 + (uint32_t)(maxRange / CM_PER_MICROSECOND);
+
+                for (uint8_t k=0; k<COUNT; ++k) {
+                    _distances[k] = 0;
+                    _timestamps[k] = 0;
+                    _fresh[k] = false;
+                }
+
+                _active = NONE;
+                _next = COUNT - 1;
+                _altitudeSlot = false;
+                _state = IDLE;
+                _pingMicros = 0;
+                _idleMicros = 0;
+                _riseMicros = 0;
+                _fallMicros = 0;
+            }
+
+            // Call from the echo pin's pin-change or input-capture interrupt, with the edge's time
+            void echoEdge(uint8_t index, bool high, uint32_t usec)
+            {
+                if (index != _active) {
+                    return;
+                }
+
+                if (high && _state == AWAIT_RISE) {
+                    _riseMicros = usec;
+                    _state = AWAIT_FALL;
+                }
+
+                else if (!high && _state == AWAIT_FALL) {
+                    _fallMicros = usec;
+                    _state = DONE;
+                }
+            }
+
+            // Call from the loop.  Collects a finished echo and, once the guard time is up, returns the sensor
+            // whose trigger pin the caller should pulse now; otherwise returns NONE.
+            uint8_t update(uint32_t usec)
+            {
+                uint8_t state = _state;
+
+                if (state == DONE) {
+
+                    uint32_t echo = _fallMicros - _riseMicros;
+                    float distance = echo * CM_PER_MICROSECOND;
+
+                    if (distance >= _minRange && distance <= _maxRange) {
+                        _distances[_active] = distance;
+                        // The sound turned around halfway through the echo
+                        _timestamps[_active] = _riseMicros + echo / 2;
+                        _fresh[_active] = true;
+                    }
+
+                    _state = IDLE;
+                    _idleMicros = usec;
+                }
+
+                // A lost echo (nothing in range, or a missed edge) gives up the slot.  If the echo ends just as we
+                // give up, the reading is dropped, which is harmless.
+                else if (state != IDLE && usec - _pingMicros > _timeoutMicros) {
+                    _state = IDLE;
+                    _idleMicros = usec;
+                }
+
+                if (_state != IDLE || usec - _idleMicros < _guardMicros) {
+                    return NONE;
+                }
+
+                // Set the sensor before arming the state, so the interrupt never pairs a state with the wrong sensor
+                _active = nextSensor();
+                _pingMicros = usec;
+                _state = AWAIT_RISE;
+
+                return _active;
+            }
+
+            // Returns true once for each new reading from the sensor, giving its distance in cm and the time the
+            // sound reached the target
+            bool getDistance(uint8_t index, float & distance, uint32_t & timestamp)
+            {
+                if (index >= COUNT || !_fresh[index]) {
+                    return false;
+                }
+
+                _fresh[index] = false;
+                distance = _distances[index];
+                timestamp = _timestamps[index];
+
+                return true;
+            }
+
+            // Latest in-range distance from the sensor, fresh or not
+            float getLatestDistance(uint8_t index)
+            {
+                return index < COUNT ? _distances[index] : 0;
+            }
+
+            uint8_t getAltitudeIndex(void)
+            {
+                return _altitudeIndex;
+            }
+
+    }; // class SonarArray
+
+} // namespace hf
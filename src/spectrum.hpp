@@ -0,0 +1,263 @@
+/*
+   spectrum.hpp : Gyro spectrum analyzer for tracking propeller noise with a dynamic notch
+
+   Roll and pitch gyro rates are decimated by averaging, then fed to a sliding DFT, which updates every bin
+   in constant time per new sample.  The bin updates for one decimated sample are spread across the gyro cycles
+   until the next one arrives, so no single cycle carries the whole transform.  Every so often the strongest
+   bin in the search band gives the noise peak, refined by parabolic interpolation and smoothed.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cmath>
+
+namespace hf {
+
+    class GyroSpectrum {
+
+        public:
+
+            // Window length of the DFT, and number of bins from DC to Nyquist
+            static const uint8_t SIZE = 32;
+            static const uint8_t BINS = SIZE/2 + 1;
+
+            // Gyro samples averaged into each analyzed sample
+            static const uint8_t DECIMATION = 2;
+
+            // Analyzed samples between peak searches
+            static const uint8_t PEAK_INTERVAL = 8;
+
+        private:
+
+            static const uint8_t AXES = 2; // roll, pitch
+
+            // Bins updated per gyro cycle, so all are done before the next decimated sample
+            static const uint8_t BINS_PER_CYCLE = (BINS + DECIMATION - 1) / DECIMATION;
+
+            // Slight damping keeps rounding error from accumulating in the recursion
+            const float DAMPING = 0.999f;
+
+            // Peak frequency smoothing (fraction of the new estimate taken each search)
+            const float PEAK_LPF = 0.3f;
+
+            bool    _enabled;
+            float   _binHz;
+            uint8_t _minBin;
+            uint8_t _maxBin;
+            float   _dampingN;
+
+            float   _twiddleCos[BINS];
+            float   _twiddleSin[BINS];
+
+            float   _re[AXES][BINS];
+            float   _im[AXES][BINS];
+
+            float   _history[AXES][SIZE];
+            uint8_t _historyIndex;
+
+            float   _accum[AXES];
+            uint8_t _accumCount;
+
+            float   _delta[AXES];  // new sample minus the (damped) one leaving the window
+            uint8_t _binCursor;    // next bin to update for the current sample; BINS when done
+
+            uint8_t _sinceSearch;
+            float   _peakHz;
+            bool    _peakUpdated;
+
+            void updateBins(uint8_t count)
+            {
+                for (; count && _binCursor < BINS; --count, ++_binCursor) {
+
+                    uint8_t k = _binCursor;
+                    float c = _twiddleCos[k], s = _twiddleSin[k];
+
+                    for (uint8_t a=0; a<AXES; ++a) {
+                        float re = DAMPING * _re[a][k] + _delta[a];
+                        float im = DAMPING * _im[a][k];
+                        _re[a][k] = re*c - im*s;
+                        _im[a][k] = re*s + im*c;
+                    }
+                }
+
+                if (_binCursor == BINS && ++_sinceSearch >= PEAK_INTERVAL) {
+                    _sinceSearch = 0;
+                    searchPeak();
+                }
+            }
+
+            void searchPeak(void)
+            {
+                uint8_t best = _minBin;
+                float bestPower = power(best);
+
+                for (uint8_t k=_minBin+1; k<=_maxBin; ++k) {
+                    float p = power(k);
+                    if (p > bestPower) {
+                        best = k;
+                        bestPower = p;
+                    }
+                }
+
+                if (bestPower <= 0) {
+                    return;
+                }
+
+                // Parabolic interpolation between neighboring bins
+                float offset = 0;
+                if (best > 0 && best < BINS-1) {
+                    float l = sqrtf(power(best-1)), m = sqrtf(bestPower), r = sqrtf(power(best+1));
+                    float denom = l - 2*m + r;
+                    if (denom < 0) {
+                        offset = 0.5f * (l - r) / denom;
+                    }
+                }
+
+                float hz = (best + offset) * _binHz;
+
+                _peakHz = (_peakHz > 0) ? _peakHz + PEAK_LPF * (hz - _peakHz) : hz;
+                _peakUpdated = true;
+            }
+
+            // Power summed over axes
+            float power(uint8_t k)
+            {
+                float p = 0;
+                for (uint8_t a=0; a<AXES; ++a) {
+                    p += _re[a][k]*_re[a][k] + _im[a][k]*_im[a][k];
+                }
+                return p;
+            }
+
+        public:
+
+            GyroSpectrum(void) : _enabled(false) { }
+
+            // Looks for the peak between minHz and maxHz, in gyro data arriving at gyroSampleHz
+            void init(float gyroSampleHz, float minHz, float maxHz)
+            {
+                float sampleHz = gyroSampleHz / DECIMATION;
+
+                _binHz = sampleHz / SIZE;
+
+                _minBin = (uint8_t)(minHz / _binHz);
+                _maxBin = (uint8_t)(maxHz / _binHz);
+                if (_minBin < 1) _minBin = 1;
+                if (_maxBin > BINS-1) _maxBin = BINS-1;
+                if (_minBin > _maxBin) _minBin = _maxBin;
+
+                _dampingN = powf(DAMPING, SIZE);
+
+                for (uint8_t k=0; k<BINS; ++k) {
+                    float w = 2 * M_PI * k / SIZE;
+                    _twiddleCos[k] = cosf(w);
+                    _twiddleSin[k] = sinf(w);
+                }
+
+                for (uint8_t a=0; a<AXES; ++a) {
+                    for (uint8_t k=0; k<BINS; ++k) {
+                        _re[a][k] = _im[a][k] = 0;
+                    }
+                    for (uint8_t k=0; k<SIZE; ++k) {
+                        _history[a][k] = 0;
+                    }
+                    _accum[a] = 0;
+                    _delta[a] = 0;
+                }
+
+                _historyIndex = 0;
+                _accumCount = 0;
+                _binCursor = BINS;
+                _sinceSearch = 0;
+                _peakHz = 0;
+                _peakUpdated = false;
+                _enabled = true;
+            }
+
+            bool enabled(void)
+            {
+                return _enabled;
+            }
+
+            // Called with every gyro sample
+            void update(const float gyroRates[3])
+            {
+                for (uint8_t a=0; a<AXES; ++a) {
+                    _accum[a] += gyroRates[a];
+                }
+
+                if (++_accumCount == DECIMATION) {
+
+                    // Finish any bins still owed the previous sample before starting on this one
+                    updateBins(BINS);
+
+                    for (uint8_t a=0; a<AXES; ++a) {
+                        float x = _accum[a] / DECIMATION;
+                        _delta[a] = x - _dampingN * _history[a][_historyIndex];
+                        _history[a][_historyIndex] = x;
+                        _accum[a] = 0;
+                    }
+
+                    _historyIndex = (_historyIndex + 1) % SIZE;
+                    _accumCount = 0;
+                    _binCursor = 0;
+                }
+
+                updateBins(BINS_PER_CYCLE);
+            }
+
+            // True once per new peak estimate
+            bool peakUpdated(void)
+            {
+                bool updated = _peakUpdated;
+                _peakUpdated = false;
+                return updated;
+            }
+
+            float getPeakHz(void)
+            {
+                return _peakHz;
+            }
+
+            float getBinHz(void)
+            {
+                return _binHz;
+            }
+
+            // Amplitude of bin k in rad/sec, averaged over roll and pitch
+            float getMagnitude(uint8_t k)
+            {
+                return 2 * sqrtf(power(k) / AXES) / SIZE;
+            }
+
+    }; // class GyroSpectrum
+
+    // Takes GyroSpectrum's place when AllFeatures::DYNAMIC_NOTCH is switched off
+    class NoGyroSpectrum {
+
+        public:
+
+            void  init(float gyroSampleHz, float minHz, float maxHz) { (void)gyroSampleHz; (void)minHz; (void)maxHz; }
+            bool  enabled(void) { return false; }
+            void  update(const float gyroRates[3]) { (void)gyroRates; }
+            bool  peakUpdated(void) { return false; }
+            float getPeakHz(void) { return 0; }
+
+    }; // class NoGyroSpectrum
+
+} // namespace hf
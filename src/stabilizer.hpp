@@ -28,6 +28,10 @@
 #include "filter.hpp"
 #include "debug.hpp"
 #include "datatypes.hpp"
+#include "gains.hpp"
+#include "gainprofile.hpp"
+#include "fastmath.hpp"
+#include "pidkernel.hpp"
 
 namespace hf {
 
@@ -38,161 +42,223 @@ namespace hf {
         AXIS_YAW
     };
 
-    class Stabilizer {
+    // Templated on the numeric type (float, or a Fixed type such as Q16_16 for boards without an FPU).  Inputs and
+    // outputs stay in float; they are converted once on the way in and out, and everything in between runs in T.
+    // With a gain profile (see gainprofile.hpp) the gains are compile-time constants, and the stabilizer is
+    // constructed with no arguments.
+    template <typename T, class Profile=void>
+    class StabilizerT {
 
         private: 
 
+            typedef FilterT<T> F;
+
             // Resetting thresholds for PID Integral term
-            const float gyroWindupMax           = 16.0f;
+            const T     gyroWindupMax           = T(16.0f);
             const float bigGyroDegreesPerSecond = 40.0f; 
-            const float bigYawDemand            = 0.1f;
+            const T     bigYawDemand            = T(0.1f);
             const float maxArmingAngleDegrees   = 25.0f;         
 
-            // PID constants set in constructor
-            float _levelP;
-            float _gyroCyclicP;
-            float _gyroCyclicI;
-            float _gyroCyclicD; 
-            float _gyroYawP; 
-            float _gyroYawI;
+            // PID constants, set in constructor or fixed by the profile
+            StabilizerGainsT<T, Profile> _gains;
 
-            float lastGyro[2];
-            float gyroDelta1[2]; 
-            float gyroDelta2[2];
-            float errorGyroI[3];
+            // Rate PIDs for all three axes at once
+            PidKernelT<T> _pids;
 
             // For PTerm computation
-            float PTerm[2]; // roll, pitch
-            float demandRoll;
-            float demandPitch;
+            T PTerm[2]; // roll, pitch
+            T demandRoll;
+            T demandPitch;
 
             // proportion of cyclic demand compared to its maximum
-            float proportionalCyclicDemand;
-
-            float bigGyroRate;
-
-            float degreesToRadians(float deg)
-            {
-                return M_PI * deg / 180.;
-            }
+            T proportionalCyclicDemand;
 
-            float computeITermGyro(float rateP, float rateI, float rcCommand, float gyro[3], uint8_t axis)
-            {
-                float error = rcCommand*rateP - gyro[axis];
+            // Gravity's direction in the body frame at the demanded roll and pitch, for leveling from quaternions
+            float _levelTarget[3];
 
-                // Avoid integral windup
-                errorGyroI[axis] = Filter::constrainAbs(errorGyroI[axis] + error, gyroWindupMax);
+            T bigGyroRate;
 
-                // Reset integral on quick gyro change or large gyroYaw command
-                if ((fabs(gyro[axis]) > bigGyroRate) || ((axis == AXIS_YAW) && (fabs(rcCommand) > bigYawDemand)))
-                    errorGyroI[axis] = 0;
+            // Optional filtering, off (passing signals through) until initFilters() is called
+            BiquadFilterT<T,3> _gyroNotch;
+            BiquadFilterT<T,3> _gyroLowpass;
+            BiquadFilterT<T,2> _dtermLowpass;  // roll, pitch
 
-                return (errorGyroI[axis] * rateI);
-            }
+            float _gyroSampleHz;
+            float _gyroNotchQ;
 
-            float computePid( float rateP, float PTerm, float ITerm, float DTerm, float gyro[3], uint8_t axis)
+            float degreesToRadians(float deg)
             {
-                PTerm -= gyro[axis] * rateP; 
-
-                return PTerm + ITerm - DTerm;
+                return M_PI * deg / 180.;
             }
 
             // Computes leveling PID for pitch or roll
-            void computeCyclicPTerm(float demand, float eulerAngles[3], uint8_t imuAxis)
+            void computeCyclicPTerm(T demand, T eulerAngles[3], uint8_t imuAxis)
             {
-                PTerm[imuAxis] = (demand - eulerAngles[imuAxis]) * _levelP;  
-                PTerm[imuAxis] = Filter::complementary(demand, PTerm[imuAxis], proportionalCyclicDemand); 
+                computeCyclicPTermFromError(demand, demand - eulerAngles[imuAxis], imuAxis);
             }
 
-            // Computes leveling PID for pitch or roll
-            float computeCyclicPid(float rcCommand, float gyro[3], uint8_t imuAxis)
+            void computeCyclicPTermFromError(T demand, T error, uint8_t imuAxis)
             {
-                // I
-                float ITerm = computeITermGyro(_gyroCyclicP, _gyroCyclicI, rcCommand, gyro, imuAxis);
-                ITerm *= proportionalCyclicDemand;
-
-                // D
-                float gyroDelta = gyro[imuAxis] - lastGyro[imuAxis];
-                lastGyro[imuAxis] = gyro[imuAxis];
-                float gyroDeltaSum = gyroDelta1[imuAxis] + gyroDelta2[imuAxis] + gyroDelta;
-                gyroDelta2[imuAxis] = gyroDelta1[imuAxis];
-                gyroDelta1[imuAxis] = gyroDelta;
-                float DTerm = gyroDeltaSum * _gyroCyclicD; 
-
-                return computePid(_gyroCyclicP, PTerm[imuAxis], ITerm, DTerm, gyro, imuAxis);
+                PTerm[imuAxis] = error * _gains.levelP();  
+                PTerm[imuAxis] = F::complementary(demand, PTerm[imuAxis], proportionalCyclicDemand); 
             }
 
-            float constrainCyclicDemand(float eulerAngle, float demand)
+            T constrainCyclicDemand(T eulerAngle, T demand)
             {
-                return demand * (1 - fabs(eulerAngle)/maxArmingAngle);
+                return demand * (T(1) - numericAbs(eulerAngle)/T(maxArmingAngle));
             }
 
         public:
 
             float maxArmingAngle;
 
-            Stabilizer(float levelP, float gyroCyclicP, float gyroCyclicI, float gyroCyclicD, float gyroYawP, float gyroYawI) :
-                _levelP(levelP), 
-                _gyroCyclicP(gyroCyclicP), 
-                _gyroCyclicI(gyroCyclicI), 
-                _gyroCyclicD(gyroCyclicD), 
-                _gyroYawP(gyroYawP), 
-                _gyroYawI(gyroYawI) { }
+            // Whether setGains() takes effect
+            static const bool TUNABLE = StabilizerGainsT<T, Profile>::TUNABLE;
+
+            StabilizerT(float levelP, float gyroCyclicP, float gyroCyclicI, float gyroCyclicD, float gyroYawP, float gyroYawI) :
+                _gains(levelP, gyroCyclicP, gyroCyclicI, gyroCyclicD, gyroYawP, gyroYawI),
+                _gyroSampleHz(0),
+                _gyroNotchQ(3) { }
+
+            // With a profile
+            StabilizerT(void) :
+                _gyroSampleHz(0),
+                _gyroNotchQ(3) { }
 
 
             void init(void)
             {
-                // Zero-out previous values for D term
-                for (uint8_t axis=0; axis<2; ++axis) {
-                    lastGyro[axis] = 0;
-                    gyroDelta1[axis] = 0;
-                    gyroDelta2[axis] = 0;
-                }
+                // Zero-out previous values for D term, and the gyro error integral
+                _pids.init();
+
+                // Nothing to level until the first demands and Euler angles arrive
+                PTerm[0] = PTerm[1] = 0;
+                demandRoll = demandPitch = 0;
+                proportionalCyclicDemand = 0;
+                _levelTarget[0] = _levelTarget[1] = 0;
+                _levelTarget[2] = 1;
 
                 // Convert degree parameters to radians for use later
-                bigGyroRate = degreesToRadians(bigGyroDegreesPerSecond);
+                bigGyroRate = T(degreesToRadians(bigGyroDegreesPerSecond));
                 maxArmingAngle = degreesToRadians(maxArmingAngleDegrees);
+                _pids.setLimits(gyroWindupMax, bigGyroRate, bigYawDemand);
+
+                // Clear filter history
+                _gyroNotch.reset();
+                _gyroLowpass.reset();
+                _dtermLowpass.reset();
+            }
+
+            // Sets up low-pass filters on the gyro rates and the roll/pitch D term, and optionally a notch on the
+            // gyro rates, for gyro samples arriving at gyroSampleHz.  A frequency of zero leaves that filter off.
+            void initFilters(float gyroSampleHz, float gyroLowpassHz, float dtermLowpassHz, 
+                             float gyroNotchHz=0, float gyroNotchQ=3)
+            {
+                _gyroSampleHz = gyroSampleHz;
+                _gyroNotchQ = gyroNotchQ;
 
-                // Initialize gyro error integral
-                resetIntegral();
+                _gyroLowpass.initLowpass(gyroLowpassHz, gyroSampleHz);
+                _dtermLowpass.initLowpass(dtermLowpassHz, gyroSampleHz);
+                _gyroNotch.initNotch(gyroNotchHz, gyroSampleHz, gyroNotchQ);
+            }
+
+            // Fills in the stabilizer's part of gains
+            void getGains(gains_t & gains)
+            {
+                _gains.get(gains);
+            }
+
+            // Takes the stabilizer's part of gains, keeping the PID state; ignored with a profile
+            void setGains(const gains_t & gains)
+            {
+                _gains.set(gains);
+            }
+
+            // Moves the gyro notch (zero turns it off), keeping its filter state; requires initFilters() first
+            void setGyroNotch(float centerHz)
+            {
+                _gyroNotch.initNotch(centerHz, _gyroSampleHz, _gyroNotchQ);
             }
 
             void updateEulerAngles(float eulerAngles[3])
             {
-                computeCyclicPTerm(demandRoll,  eulerAngles, 0);
-                computeCyclicPTerm(demandPitch, eulerAngles, 1);
+                T angles[3] = {T(eulerAngles[0]), T(eulerAngles[1]), T(eulerAngles[2])};
+
+                computeCyclicPTerm(demandRoll,  angles, 0);
+                computeCyclicPTerm(demandPitch, angles, 1);
+            }
+
+            // Levels from a unit quaternion (w, x, y, z) instead of Euler angles, with no trigonometry: the roll and
+            // pitch errors are the body-frame components of the rotation taking gravity's measured direction to
+            // its demanded one.  For a single axis that is sin(demand - angle), so it matches updateEulerAngles()
+            // for small errors, and it has no singularity at any attitude.
+            void updateQuaternion(const float q[4])
+            {
+                float qw = q[0], qx = q[1], qy = q[2], qz = q[3];
+
+                // Gravity in the body frame; roll = atan2(gy, gz) and pitch = asin(gx) in the sensors' convention
+                float gx = 2 * (qx * qz - qw * qy);
+                float gy = 2 * (qw * qx + qy * qz);
+                float gz = qw * qw - qx * qx - qy * qy + qz * qz;
+
+                const float * t = _levelTarget;
+
+                computeCyclicPTermFromError(demandRoll,  T(gz * t[1] - gy * t[2]), 0);
+                computeCyclicPTermFromError(demandPitch, T(gz * t[0] - gx * t[2]), 1);
             }
 
             void updateDemands(demands_t & demands)
             {
-                demandRoll  = demands.roll;
-                demandPitch = demands.pitch;
+                demandRoll  = T(demands.roll);
+                demandPitch = T(demands.pitch);
 
                 // Compute proportion of cyclic demand compared to its maximum
-                proportionalCyclicDemand = Filter::max(fabs(demandRoll), fabs(demandPitch)) / 0.5f;
+                proportionalCyclicDemand = F::max(numericAbs(demandRoll), numericAbs(demandPitch)) / T(0.5f);
+
+                // Where gravity should point for updateQuaternion(); once a frame, so the trigonometry stays off
+                // the attitude path
+                float sr, cr, sp, cp;
+                FastMath::sincos(demands.roll, sr, cr);
+                FastMath::sincos(demands.pitch, sp, cp);
+                _levelTarget[0] = sp;
+                _levelTarget[1] = sr * cp;
+                _levelTarget[2] = cr * cp;
             }
 
             void modifyDemands(float gyroRates[3], demands_t & demands)
             {
-                // Pitch, roll use leveling based on Euler angles
-                demands.roll = computeCyclicPid(demands.roll,   gyroRates, AXIS_ROLL);
-                demands.pitch = computeCyclicPid(demands.pitch, gyroRates, AXIS_PITCH);
+                T gyro[3] = {T(gyroRates[0]), T(gyroRates[1]), T(gyroRates[2])};
+
+                // Knock down motor noise before it reaches the PIDs
+                _gyroNotch.apply(gyro);
+                _gyroLowpass.apply(gyro);
+
+                // Pitch, roll use leveling based on Euler angles; for gyroYaw, P term comes directly from RC command,
+                // and D term is zero
+                T demand[3] = {T(demands.roll), T(demands.pitch), T(demands.yaw)};
+                T PTerms[3] = {PTerm[0], PTerm[1], demand[2]};
+                T output[3];
+                _pids.update(_gains, gyro, demand, PTerms, proportionalCyclicDemand, _dtermLowpass, output);
 
-                // For gyroYaw, P term comes directly from RC command, and D term is zero
-                float ITermGyroYaw = computeITermGyro(_gyroYawP, _gyroYawI, demands.yaw, gyroRates, AXIS_YAW);
-                demands.yaw = computePid(_gyroYawP, demands.yaw, ITermGyroYaw, 0, gyroRates, AXIS_YAW);
+                T roll  = output[0];
+                T pitch = output[1];
+                T yaw   = output[2];
 
                 // Prevent "gyroYaw jump" during gyroYaw correction
-                demands.yaw = Filter::constrainAbs(demands.yaw, 0.1 + fabs(demands.yaw));
+                yaw = F::constrainAbs(yaw, T(0.1f) + numericAbs(yaw));
+
+                demands.roll  = numericToFloat(roll);
+                demands.pitch = numericToFloat(pitch);
+                demands.yaw   = numericToFloat(yaw);
             }
 
             void resetIntegral(void)
             {
-                errorGyroI[AXIS_ROLL] = 0;
-                errorGyroI[AXIS_PITCH] = 0;
-                errorGyroI[AXIS_YAW] = 0;
+                _pids.resetIntegral();
             }
 
-    };  // class Stabilize
+    };  // class StabilizerT
+
+    typedef StabilizerT<float> Stabilizer;
 
 } // namespace
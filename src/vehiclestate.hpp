@@ -0,0 +1,82 @@
+/*
+   vehiclestate.hpp : The vehicle's attitude and stick inputs as of the end of the last control cycle
+
+   The loop publishes a snapshot once per control cycle, into whichever of two slots doesn't hold the latest one,
+   and then swaps the slots by bumping a sequence number (see doublebuffer.hpp).  Readers such as MSP copy out the
+   latest snapshot, so everything they report comes from the same cycle, however far the loop has got by the time
+   they run, and the sequence number tells them whether anything has changed since their last look.
+
+   This file is part of Hackflight.
+
+   Hackflight is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Hackflight is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with Hackflight.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include "receiver.hpp"
+#include "doublebuffer.hpp"
+
+namespace hf {
+
+    typedef struct {
+
+        float   eulerAngles[3];
+        float   rawvals[Receiver::MAXCHANNELS];  // zero past channelCount
+        uint8_t channelCount;
+
+    } vehicle_state_t;
+
+    class VehicleState {
+
+        private:
+
+            DoubleBuffer<vehicle_state_t> _buffer;
+
+        public:
+
+            // Called once at the end of each control cycle
+            void publish(const float eulerAngles[3], Receiver * receiver)
+            {
+                vehicle_state_t & state = _buffer.begin();
+                memcpy(state.eulerAngles, eulerAngles, sizeof(state.eulerAngles));
+                memcpy(state.rawvals, receiver->rawvals, sizeof(state.rawvals));
+                state.channelCount = receiver->channelCount();
+                _buffer.publish();
+            }
+
+            // Copies out the latest snapshot, all zero until the first publish(), returning its sequence number
+            uint32_t read(vehicle_state_t & state) const
+            {
+                return _buffer.read(state);
+            }
+
+            uint32_t sequence(void) const
+            {
+                return _buffer.sequence();
+            }
+
+    }; // class VehicleState
+
+    // Takes VehicleState's place when nothing reads the snapshots
+    class NoVehicleState {
+
+        public:
+
+            void publish(const float eulerAngles[3], Receiver * receiver) { (void)eulerAngles; (void)receiver; }
+
+    }; // class NoVehicleState
+
+} // namespace hf